@@ -0,0 +1,380 @@
+/* aio.c - Asynchronous I/O through submission and completion rings
+ * vim:ts=4 noexpandtab
+ */
+
+#include "aio.h"
+#include "file.h"
+#include "frame.h"
+#include "kmalloc.h"
+#include "paging.h"
+#include "process.h"
+#include "scheduler.h"
+#include "signal.h"
+#include "lib.h"
+
+/* NOTES: aio_setup maps one page holding both rings into the process. The program fills in
+          requests at sq_tail and calls aio_enter, which hands them to a worker task and can
+          wait for completions. The worker is a kernel-only task with its own PID and kernel
+          stack that runs on the owner's page table, so it calls the same drivers read and
+          write do and can sleep in them (a disk read, an empty pipe) while the owner keeps
+          computing. It runs requests one at a time in order, and only takes one when there's
+          a completion slot free for it. Completion slots the program frees by moving cq_head
+          are noticed on the next aio_enter.
+          The worker borrows each request's open file under an fd of its own, so the owner
+          closing the fd meanwhile doesn't pull the file out from under the driver. The
+          request's buffer is faulted in before the driver runs, a buffer that can't be (a
+          read into a read-only mapping, out of memory) fails the request with -1. Should the
+          worker still take a fault nothing resolves (the owner unmapped the buffer while the
+          driver slept), that request fails and the worker ends instead of being halted like
+          a process, the next aio_enter with work starts a new one. When the
+          owner exits or execs while the worker is busy, the worker keeps the old address
+          space until its current request is done and then frees it and itself, the requests
+          left in the ring are dropped. */
+
+static void aio_worker(void);
+static void aio_worker_exit(aio_ctx_t * ctx);
+static void aio_complete(aio_ctx_t * ctx, uint32_t user_data, int32_t res);
+static pcb_t * aio_start_worker(aio_ctx_t * ctx);
+static int32_t aio_ready(aio_ctx_t * ctx);
+static int32_t aio_do(aio_ctx_t * ctx, aio_sqe_t * sqe);
+
+/*
+ * aio_attach
+ *    DESCRIPTION: Sets up a process's rings
+ *    INPUTS: pcb -- the process, its page table must be the mapped one
+ *            addr -- page-aligned user address to map the rings at
+ *    OUTPUTS: none
+ *    RETURN VALUE: 0 on success, -1 if the process already has rings, addr is bad or we're out of memory
+ *    SIDE EFFECTS: Whatever was mapped at addr before is freed. The page stays shared with a
+ *                  forked child, which doesn't get rings of its own
+ */
+int32_t aio_attach(pcb_t * pcb, uint32_t addr) {
+    aio_ctx_t * ctx;
+    uint32_t frame;
+
+    if(pcb->aio != NULL || (addr & (FOUR_KB - 1)) || addr < ONE_TWO_EIGHT_MB || addr > ONE_THREE_TWO_MB - FOUR_KB)
+        return -1;
+
+    ctx = kmalloc(sizeof(aio_ctx_t));
+    if(ctx == NULL)
+        return -1;
+    frame = frame_alloc(1, 1);
+    if(frame == 0) {
+        kfree(ctx);
+        return -1;
+    }
+    memset((void *)frame, 0, FOUR_KB);
+
+    // One reference for the page table, one for us (the worker may outlive the mapping)
+    frame_get(frame);
+    if(user_page_share(addr, frame) == -1) {
+        frame_free(frame, 1);
+        frame_free(frame, 1);
+        kfree(ctx);
+        return -1;
+    }
+
+    ctx->ring = (aio_ring_t *)frame;
+    ctx->owner = pcb;
+    ctx->worker = NULL;
+    ctx->sq_head = 0;
+    ctx->cq_tail = 0;
+    ctx->running = 0;
+    ctx->work_wait.head = NULL;
+    ctx->done_wait.head = NULL;
+    pcb->aio = ctx;
+    return 0;
+}
+
+/*
+ * aio_wait
+ *    DESCRIPTION: Lets the worker see newly submitted requests and waits for completions
+ *    INPUTS: pcb -- the calling process
+ *            min_complete -- completions to wait for (counting ones not yet read), 0 to not wait
+ *    OUTPUTS: none
+ *    RETURN VALUE: Completions ready to read, -1 if the process has no rings, min_complete is
+ *                  more than AIO_ENTRIES, the worker can't be started or cq_head is garbage
+ *    SIDE EFFECTS: Starts the worker the first time there's something to run. Sleeps until
+ *                  enough completions are posted, a signal cuts the wait short
+ */
+int32_t aio_wait(pcb_t * pcb, int32_t min_complete) {
+    aio_ctx_t * ctx = pcb->aio;
+    aio_ring_t * ring;
+    uint32_t ready, flags;
+
+    if(ctx == NULL || min_complete < 0 || min_complete > AIO_ENTRIES)
+        return -1;
+    ring = ctx->ring;
+
+    cli_and_save(flags);
+    if(ctx->worker == NULL && ring->sq_tail != ctx->sq_head) {
+        ctx->worker = aio_start_worker(ctx);
+        if(ctx->worker == NULL) {
+            restore_flags(flags);
+            return -1;
+        }
+    }
+    wake_up(&ctx->work_wait);
+
+    while((ready = ctx->cq_tail - ring->cq_head) < (uint32_t)min_complete && !signal_pending(pcb))
+        sleep_on(&ctx->done_wait);
+    restore_flags(flags);
+
+    return (ready > AIO_ENTRIES) ? -1 : (int32_t)ready;
+}
+
+/*
+ * aio_run_next
+ *    DESCRIPTION: Takes the next request off the submission ring, runs it and posts its completion
+ *    INPUTS: ctx -- the rings
+ *    OUTPUTS: none
+ *    RETURN VALUE: 1 if a request ran, 0 if there's none, the completion ring is full or the
+ *                  owner is gone
+ *    SIDE EFFECTS: Can sleep in the driver, wakes the owner if it's waiting for completions
+ */
+int32_t aio_run_next(aio_ctx_t * ctx) {
+    aio_ring_t * ring = ctx->ring;
+    aio_sqe_t sqe;
+    uint32_t flags;
+
+    // Copy the request out, the program can scribble over its slot once sq_head moves past it
+    cli_and_save(flags);
+    if(!aio_ready(ctx)) {
+        restore_flags(flags);
+        return 0;
+    }
+    sqe = ring->sq[ctx->sq_head & AIO_MASK];
+    ring->sq_head = ++ctx->sq_head;
+    ctx->running = sqe.user_data;
+    restore_flags(flags);
+
+    aio_complete(ctx, sqe.user_data, aio_do(ctx, &sqe));
+    return 1;
+}
+
+/*
+ * aio_release
+ *    DESCRIPTION: Drops a process's rings when it exits or execs
+ *    INPUTS: pcb -- the process
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: If the worker is running, it's told to stop and pcb->page_table is handed to
+ *                  it (set to 0 here), the worker frees it once it's off the user pages.
+ *                  The ring page mapping goes away with the address space
+ */
+void aio_release(pcb_t * pcb) {
+    aio_ctx_t * ctx = pcb->aio;
+    uint32_t flags;
+
+    if(ctx == NULL)
+        return;
+
+    cli_and_save(flags);
+    pcb->aio = NULL;
+    if(ctx->worker == NULL) {
+        frame_free((uint32_t)ctx->ring, 1);
+        kfree(ctx);
+        restore_flags(flags);
+        return;
+    }
+
+    ctx->owner = NULL;
+    pcb->page_table = 0;
+    ctx->worker->pending_signals |= (1 << INTERRUPT);      // Gets it out of a terminal read
+    wake_up(&ctx->work_wait);
+    restore_flags(flags);
+}
+
+/*
+ * aio_worker_fault
+ *    DESCRIPTION: Fails the request a worker was running when it took a page fault nothing resolves
+ *    INPUTS: none (the faulting task is current_task)
+ *    OUTPUTS: none
+ *    RETURN VALUE: none, doesn't return if current_task is a worker
+ *    SIDE EFFECTS: The request completes with -1 and the worker ends (see aio_worker_exit),
+ *                  its borrowed fd is closed with its PCB. Anything else the driver held at
+ *                  the time stays held
+ */
+void aio_worker_fault(void) {
+    pcb_t * self = current_task;
+    aio_ctx_t * ctx = self->aio;
+
+    if(ctx == NULL || ctx->worker != self)
+        return;
+    cli();
+    if(ctx->owner != NULL)
+        aio_complete(ctx, ctx->running, -1);
+    aio_worker_exit(ctx);
+}
+
+/*
+ * aio_worker
+ *    DESCRIPTION: Body of a worker task, runs requests until its owner goes away
+ *    INPUTS: none (the rings are current_task->aio)
+ *    OUTPUTS: none
+ *    RETURN VALUE: none, never returns
+ *    SIDE EFFECTS: Sleeps while there's nothing it can run
+ */
+static void aio_worker(void) {
+    aio_ctx_t * ctx = current_task->aio;
+
+    sti();      // The first context_switch to us came from the scheduler with interrupts off
+    while(1) {
+        if(aio_run_next(ctx))
+            continue;
+
+        cli();
+        if(ctx->owner == NULL)
+            aio_worker_exit(ctx);
+        if(!aio_ready(ctx))
+            sleep_on(&ctx->work_wait);
+        sti();
+    }
+}
+
+/*
+ * aio_worker_exit
+ *    DESCRIPTION: Ends the worker task, call on the worker with interrupts off
+ *    INPUTS: ctx -- the rings
+ *    OUTPUTS: none
+ *    RETURN VALUE: none, never returns
+ *    SIDE EFFECTS: If the owner is gone, frees the rings and the address space aio_release
+ *                  handed us. Otherwise the owner keeps both and its next aio_enter with work
+ *                  starts a new worker. The PCB is freed once the scheduler is off our stack
+ */
+static void aio_worker_exit(aio_ctx_t * ctx) {
+    pcb_t * self = current_task;
+
+    self->aio = NULL;
+    runqueue_remove(self);
+    if(ctx->owner == NULL) {
+        frame_free((uint32_t)ctx->ring, 1);
+        kfree(ctx);
+        user_space_destroy(self->page_table);
+    } else {
+        ctx->worker = NULL;
+    }
+    self->page_table = 0;
+    pcb_free_deferred(self);
+    scheduler();
+}
+
+/*
+ * aio_complete
+ *    DESCRIPTION: Posts a completion and wakes the owner if it's waiting for one
+ *    INPUTS: ctx -- the rings, with a completion slot free
+ *            user_data -- the request's user_data
+ *            res -- its result
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ */
+static void aio_complete(aio_ctx_t * ctx, uint32_t user_data, int32_t res) {
+    aio_ring_t * ring = ctx->ring;
+    aio_cqe_t * cqe;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    cqe = &ring->cq[ctx->cq_tail & AIO_MASK];
+    cqe->user_data = user_data;
+    cqe->res = res;
+    ring->cq_tail = ++ctx->cq_tail;
+    wake_up(&ctx->done_wait);
+    restore_flags(flags);
+}
+
+/*
+ * aio_start_worker
+ *    DESCRIPTION: Makes the worker task of a process's rings, call with interrupts off
+ *    INPUTS: ctx -- the rings, ctx->owner is the running process
+ *    OUTPUTS: none
+ *    RETURN VALUE: The worker, on the runqueue, NULL if out of PIDs or memory
+ *    SIDE EFFECTS: The worker shares the owner's page table and terminal
+ */
+static pcb_t * aio_start_worker(aio_ctx_t * ctx) {
+    pcb_t * owner = ctx->owner;
+    pcb_t * worker = pcb_alloc();
+    uint32_t * esp;
+
+    if(worker == NULL)
+        return NULL;
+
+    worker->page_table = owner->page_table;
+    worker->terminal_id = owner->terminal_id;
+    worker->parent_process_id = owner->process_id;
+    worker->called_vidmap = 0;
+    worker->arg[0] = '\0';
+    worker->exit_status = 0;
+    worker->executed = 0;
+    worker->aio = ctx;
+
+    // The first context_switch to it pops the callee-saved registers and "returns" into aio_worker
+    esp = (uint32_t *)PCB_KERNEL_STACK(worker);
+    *(--esp) = 0;                       // aio_worker never returns
+    *(--esp) = (uint32_t)aio_worker;
+    *(--esp) = 0;     // ebp
+    *(--esp) = 0;     // ebx
+    *(--esp) = 0;     // esi
+    *(--esp) = 0;     // edi
+    worker->curr_esp = (uint32_t)esp;
+
+    runqueue_add(worker);
+    return worker;
+}
+
+/*
+ * aio_ready
+ *    DESCRIPTION: Checks whether the worker can take a request, call with interrupts off
+ *    INPUTS: ctx -- the rings
+ *    OUTPUTS: none
+ *    RETURN VALUE: 1 if the owner is still there, a request is waiting and its completion will fit
+ */
+static int32_t aio_ready(aio_ctx_t * ctx) {
+    return ctx->owner != NULL && ctx->ring->sq_tail != ctx->sq_head
+            && ctx->cq_tail - ctx->ring->cq_head < AIO_ENTRIES;
+}
+
+/*
+ * aio_do
+ *    DESCRIPTION: Runs one request in the calling task
+ *    INPUTS: ctx -- the rings
+ *            sqe -- a copy of the request
+ *    OUTPUTS: reads into the request's buffer
+ *    RETURN VALUE: The driver's result, -1 for a bad operation or fd, or a buffer that can't be
+ *                  faulted in (writable, for a read)
+ *    SIDE EFFECTS: The file gets an fd in the calling task for as long as the driver runs
+ */
+static int32_t aio_do(aio_ctx_t * ctx, aio_sqe_t * sqe) {
+    pcb_t * self = current_task;
+    file_t * file = NULL;
+    int32_t fd = -1, ret;
+    uint32_t flags;
+
+    if(sqe->op == AIO_NOP)
+        return 0;
+    if((sqe->op != AIO_READ && sqe->op != AIO_WRITE) || sqe->len < 0
+            || sqe->buf < ONE_TWO_EIGHT_MB || (uint32_t)sqe->len > ONE_THREE_TWO_MB - sqe->buf)
+        return -1;
+
+    // Borrow the owner's open file, the driver looks it up by fd in whoever is running
+    cli_and_save(flags);
+    if(ctx->owner != NULL)
+        file = fd_get(ctx->owner, sqe->fd);
+    if(file != NULL && (fd = fd_install(self, file)) != -1)
+        file->refcount++;
+    restore_flags(flags);
+    if(fd == -1)
+        return -1;
+
+    // Rather than take a fault that would end the worker (a read into a read-only page)
+    if(user_range_prepare(sqe->buf, sqe->len, sqe->op == AIO_READ) == -1) {
+        fd_close(self, fd);
+        return -1;
+    }
+
+    if(sqe->op == AIO_READ)
+        ret = file->ops->read(fd, (void *)sqe->buf, sqe->len);
+    else
+        ret = file->ops->write(fd, (const void *)sqe->buf, sqe->len);
+    fd_close(self, fd);
+    return ret;
+}
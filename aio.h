@@ -0,0 +1,71 @@
+/* aio.h - Asynchronous I/O through submission and completion rings
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _AIO_H
+#define _AIO_H
+
+#include "types.h"
+#include "system_calls.h"
+
+#define AIO_ENTRIES         128         // Slots in each ring (power of 2)
+#define AIO_MASK            (AIO_ENTRIES - 1)
+
+// Request operations
+#define AIO_NOP             0           // Completes with 0 without doing anything
+#define AIO_READ            1           // read(fd, buf, len)
+#define AIO_WRITE           2           // write(fd, buf, len)
+
+// One request, filled in by the program
+typedef struct aio_sqe {
+    int32_t op;                         // AIO_* operation
+    int32_t fd;                         // File descriptor of the submitting process
+    uint32_t buf;                       // User buffer
+    int32_t len;                        // Bytes to read or write
+    uint32_t user_data;                 // Copied to the completion as is
+} aio_sqe_t;
+
+// One finished request, filled in by the kernel
+typedef struct aio_cqe {
+    uint32_t user_data;                 // The request's user_data
+    int32_t res;                        // What read or write returned, -1 for a bad request
+} aio_cqe_t;
+
+// The page shared with the program. Indices only ever count up, slot i is i & AIO_MASK
+typedef struct aio_ring {
+    volatile uint32_t sq_head;          // Next request the kernel takes (kernel writes)
+    volatile uint32_t sq_tail;          // One past the last request submitted (program writes)
+    volatile uint32_t cq_head;          // Next completion the program reads (program writes)
+    volatile uint32_t cq_tail;          // One past the last completion posted (kernel writes)
+    aio_sqe_t sq[AIO_ENTRIES];
+    aio_cqe_t cq[AIO_ENTRIES];
+} aio_ring_t;
+
+// A process's rings and the kernel task that runs its requests
+typedef struct aio_ctx {
+    aio_ring_t * ring;                  // Kernel address of the ring page
+    pcb_t * owner;                      // Submitting process, NULL once it has exited or exec'd
+    pcb_t * worker;                     // Runs the requests, started by the first aio_wait with work
+    uint32_t sq_head;                   // The kernel's own copies of the indices it writes
+    uint32_t cq_tail;
+    uint32_t running;                   // user_data of the request the worker is running
+    wait_queue_t work_wait;             // Worker waiting for requests or completion slots
+    wait_queue_t done_wait;             // Owner waiting for completions
+} aio_ctx_t;
+
+// Maps a zeroed ring page at addr in pcb's (currently mapped) address space, returns 0 or -1
+int32_t aio_attach(pcb_t * pcb, uint32_t addr);
+
+// Starts pcb's submitted requests and waits for min_complete completions, returns how many are ready or -1
+int32_t aio_wait(pcb_t * pcb, int32_t min_complete);
+
+// Runs the next submitted request in the calling task, returns 1 if one ran, 0 if none could
+int32_t aio_run_next(aio_ctx_t * ctx);
+
+// Called on a page fault nothing resolves, ends the running task if it's a worker (failing its request)
+void aio_worker_fault(void);
+
+// Drops a process's rings when it exits or execs, the worker may take over its address space
+void aio_release(pcb_t * pcb);
+
+#endif /* _AIO_H */
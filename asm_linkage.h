@@ -1,6 +1,9 @@
 #ifndef _ASM_LINKAGE_H
 #define _ASM_LINKAGE_H
 
+// Highest system call number in systems_jump_table
+#define SYSCALL_MAX 34
+
 #ifndef ASM
 
 #include "idt.h"
@@ -34,7 +37,22 @@ extern void simd_floating_point();  //exception 19
 extern void keyboard_processor();   //process keyboard interrupt
 extern void RTC_processor();        //process RTC interrupt
 extern void PIT_processor();
+extern void ATA_processor();        //process disk interrupt (IRQ14)
 extern void systems_handler();      //process systems call arg
 
+// System call functions indexed by number (0 and out of range numbers are invalid), see batch
+extern int32_t (*systems_jump_table[])(uint32_t arg1, uint32_t arg2, uint32_t arg3);
+extern void syscall_exit();         //tail of systems_handler that restores a hw_context_t and irets
+extern void ret_from_intr();        //delivers pending signals when going back to user mode, then popal and iret
+
+extern void sysenter_entry();       //SYSENTER target, builds a hw_context_t like systems_handler
+
+// vDSO system call stubs (copied into the vDSO page, see vdso.c)
+extern uint8_t vdso_sysenter_start[], vdso_sysenter_return[], vdso_sysenter_end[];
+extern uint8_t vdso_int80_start[], vdso_int80_end[];
+
+// Saves the running kernel thread's esp into *save_esp and resumes the thread at next_esp
+extern void context_switch(uint32_t * save_esp, uint32_t next_esp);
+
 #endif /* ASM */
 #endif /* _ASM_LINKAGE_H */
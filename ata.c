@@ -0,0 +1,373 @@
+/* ata.c - IDE/ATA disk driver (PIO and bus-master DMA) for the primary channel
+ * vim:ts=4 noexpandtab
+ */
+
+#include "ata.h"
+#include "asm_linkage.h"
+#include "x86_desc.h"
+#include "i8259.h"
+#include "scheduler.h"
+#include "signal.h"
+#include "lib.h"
+
+/* NOTES: The disk is the slave on the primary channel, QEMU's -hdb (the boot image is the
+          master). kernel.c mounts the file system image on it at /disk, make one with
+          "tools/mkfs <dir> disk.img" and add "-hdb disk.img" to QEMU's command line.
+          It's addressed with LBA28 and read a whole 4KB block (8 sectors) per command.
+          If the PCI IDE controller can bus master, blocks are read with DMA straight into the
+          cache's buffer, otherwise with PIO through the data port. One command runs at a time,
+          other readers sleep until the channel is free.
+          A DMA read by a task with interrupts on sleeps until IRQ14 says it's done, so other
+          tasks run while the disk works. With interrupts off (boot, or a caller holding cli) the
+          drive's interrupt is masked with nIEN and the bus master's status is polled instead.
+          PIO always polls. Buffers are handed to the bus master by their kernel address, which
+          is the physical one for everything below 128MB (frames and the kernel image). */
+
+#define ATA_TIMEOUT     1000000         // Status polls before giving up on the drive
+
+static int32_t ata_read(block_dev_t * dev, uint32_t block, uint8_t * buf);
+static int32_t ata_read_pio(uint32_t lba, uint8_t * buf);
+static int32_t ata_read_dma(uint32_t lba, uint8_t * buf, int32_t can_sleep);
+static int32_t ata_select(uint32_t lba, uint32_t count);
+static int32_t ata_wait_ready(void);
+static int32_t ata_wait_drq(void);
+static void ata_delay(void);
+static uint32_t ata_find_bus_master(void);
+static uint32_t pci_read(uint32_t bus, uint32_t dev, uint32_t func, uint32_t reg);
+static void pci_write(uint32_t bus, uint32_t dev, uint32_t func, uint32_t reg, uint32_t val);
+
+static block_dev_t ata_disk = {"ata0", 0, ata_read, NULL};
+static uint32_t ata_found;              // 1 if init_ata found the disk
+static uint32_t bm_base;                // Bus master I/O ports, 0 to read with PIO
+
+// At most two entries, a block can cross one 64KB boundary
+static ata_prd_t prdt[2] __attribute__((aligned (16)));
+
+static wait_queue_t ata_wait;           // The DMA reader waiting for IRQ14
+static wait_queue_t ata_free;           // Readers waiting for the channel
+static volatile uint32_t ata_busy;      // A command owns the channel
+static volatile uint32_t ata_done;      // IRQ14 came for the running DMA
+static volatile uint32_t ata_irq_bm;    // Bus master status IRQ14 saw
+
+/*
+ * init_ata
+ *    DESCRIPTION: Looks for a disk on the primary channel's slave and sets up IRQ14
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUE: 0 if there's a disk, -1 if not (or it's not ATA)
+ *    SIDE EFFECTS: Turns on bus mastering on the IDE controller if it has it
+ */
+int32_t init_ata(void) {
+    uint16_t identify[ATA_SECTOR_SIZE / 2];
+    uint32_t sectors;
+    int32_t i;
+
+    if(inb(ATA_COMMAND) == 0xFF)        // Floating bus, no drives at all
+        return -1;
+
+    outb(ATA_CTRL_NIEN, ATA_CONTROL);
+    outb(ATA_DRIVE_LBA | ATA_SLAVE, ATA_DRIVE);
+    ata_delay();
+    outb(0, ATA_SECTOR_COUNT);
+    outb(0, ATA_LBA_LOW);
+    outb(0, ATA_LBA_MID);
+    outb(0, ATA_LBA_HIGH);
+    outb(ATA_CMD_IDENTIFY, ATA_COMMAND);
+    if(inb(ATA_COMMAND) == 0)           // No slave
+        return -1;
+    if(ata_wait_ready() == -1 || inb(ATA_LBA_MID) != 0 || inb(ATA_LBA_HIGH) != 0)
+        return -1;                      // Hung, or ATAPI/SATA
+    if(ata_wait_drq() == -1)
+        return -1;
+    for(i = 0; i < ATA_SECTOR_SIZE / 2; i++)
+        identify[i] = inw(ATA_DATA);
+
+    // Words 60-61 are the number of LBA28 sectors
+    sectors = identify[60] | ((uint32_t)identify[61] << 16);
+    if(sectors > ATA_MAX_SECTORS)
+        sectors = ATA_MAX_SECTORS;
+    ata_disk.num_blocks = sectors / ATA_SECTORS_PER_BLOCK;
+    if(ata_disk.num_blocks == 0)
+        return -1;
+
+    bm_base = ata_find_bus_master();
+    SET_IDT_ENTRY(idt[0x2E], &ATA_processor);       //index 2E of IDT is IRQ14
+    enable_irq(ATA_IRQ);
+    ata_found = 1;
+    return 0;
+}
+
+/*
+ * ata_device
+ *    DESCRIPTION: Gives the disk as a block device
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUE: The disk, NULL if init_ata didn't find one
+ */
+block_dev_t * ata_device(void) {
+    return ata_found ? &ata_disk : NULL;
+}
+
+/*
+ * ata_interrupt
+ *    DESCRIPTION: IRQ14 handler, finishes a DMA read
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Reading the status register lets the drive drop the interrupt, wakes the reader
+ */
+void ata_interrupt(void) {
+    if(bm_base != 0)
+        ata_irq_bm = inb(bm_base + BM_STATUS);
+    inb(ATA_COMMAND);
+    ata_done = 1;
+    wake_up(&ata_wait);
+    send_eoi(ATA_IRQ);
+}
+
+/*
+ * ata_read
+ *    DESCRIPTION: block_dev_t read, reads one 4KB block of the disk
+ *    INPUTS: dev -- the disk, block -- block number
+ *    OUTPUTS: buf -- BCACHE_BLOCK_SIZE bytes of the block
+ *    RETURN VALUE: 0 on success, -1 if the block is past the end or the drive reports an error
+ *    SIDE EFFECTS: Sleeps while the channel is busy and, for DMA with interrupts on, until IRQ14
+ */
+static int32_t ata_read(block_dev_t * dev, uint32_t block, uint8_t * buf) {
+    int32_t can_sleep, ret;
+    uint32_t flags;
+
+    if(block >= dev->num_blocks)
+        return -1;
+
+    cli_and_save(flags);
+    can_sleep = (flags & EFLAGS_IF) && current_task != NULL;
+    while(ata_busy)
+        sleep_on(&ata_free);
+    ata_busy = 1;
+
+    if(bm_base != 0)
+        ret = ata_read_dma(block * ATA_SECTORS_PER_BLOCK, buf, can_sleep);
+    else
+        ret = ata_read_pio(block * ATA_SECTORS_PER_BLOCK, buf);
+
+    ata_busy = 0;
+    wake_up(&ata_free);
+    restore_flags(flags);
+    return ret;
+}
+
+/*
+ * ata_read_pio
+ *    DESCRIPTION: Reads a block a sector at a time through the data port, call with interrupts off
+ *    INPUTS: lba -- first sector
+ *    OUTPUTS: buf -- the block
+ *    RETURN VALUE: 0 on success, -1 on a drive error or timeout
+ */
+static int32_t ata_read_pio(uint32_t lba, uint8_t * buf) {
+    uint16_t * words = (uint16_t *)buf;
+    int32_t sector, i;
+
+    outb(ATA_CTRL_NIEN, ATA_CONTROL);
+    if(ata_select(lba, ATA_SECTORS_PER_BLOCK) == -1)
+        return -1;
+    outb(ATA_CMD_READ_PIO, ATA_COMMAND);
+
+    for(sector = 0; sector < ATA_SECTORS_PER_BLOCK; sector++) {
+        ata_delay();
+        if(ata_wait_drq() == -1)
+            return -1;
+        for(i = 0; i < ATA_SECTOR_SIZE / 2; i++)
+            *words++ = inw(ATA_DATA);
+    }
+    return 0;
+}
+
+/*
+ * ata_read_dma
+ *    DESCRIPTION: Reads a block with the bus master, call with interrupts off
+ *    INPUTS: lba -- first sector
+ *            can_sleep -- 1 to sleep until IRQ14, 0 to poll
+ *    OUTPUTS: buf -- the block
+ *    RETURN VALUE: 0 on success, -1 on a drive or bus master error or timeout
+ */
+static int32_t ata_read_dma(uint32_t lba, uint8_t * buf, int32_t can_sleep) {
+    uint32_t addr = (uint32_t)buf;
+    uint32_t first = 0x10000 - (addr & 0xFFFF);     // Bytes before the next 64KB boundary
+    uint32_t bm_status = 0, status;
+    int32_t i;
+
+    prdt[0].addr = addr;
+    if(first >= BCACHE_BLOCK_SIZE) {
+        prdt[0].bytes = BCACHE_BLOCK_SIZE;
+        prdt[0].flags = PRD_EOT;
+    } else {
+        prdt[0].bytes = first;
+        prdt[0].flags = 0;
+        prdt[1].addr = addr + first;
+        prdt[1].bytes = BCACHE_BLOCK_SIZE - first;
+        prdt[1].flags = PRD_EOT;
+    }
+
+    outl((uint32_t)prdt, bm_base + BM_PRDT);
+    outb(BM_CMD_READ, bm_base + BM_COMMAND);
+    outb(BM_SR_ERR | BM_SR_IRQ, bm_base + BM_STATUS);
+    outb(can_sleep ? 0 : ATA_CTRL_NIEN, ATA_CONTROL);
+    if(ata_select(lba, ATA_SECTORS_PER_BLOCK) == -1)
+        return -1;
+
+    ata_done = 0;
+    outb(ATA_CMD_READ_DMA, ATA_COMMAND);
+    outb(BM_CMD_READ | BM_CMD_START, bm_base + BM_COMMAND);
+
+    if(can_sleep) {
+        while(!ata_done)
+            sleep_on(&ata_wait);
+        bm_status = ata_irq_bm;
+    } else {
+        for(i = 0; i < ATA_TIMEOUT; i++) {
+            bm_status = inb(bm_base + BM_STATUS);
+            if((bm_status & (BM_SR_IRQ | BM_SR_ERR)) || !(bm_status & BM_SR_ACTIVE))
+                break;
+        }
+        if(i == ATA_TIMEOUT)
+            bm_status |= BM_SR_ERR;
+    }
+
+    // Stop the bus master, acknowledge the drive and clear the bus master's status
+    outb(BM_CMD_READ, bm_base + BM_COMMAND);
+    if(ata_wait_ready() == -1)
+        return -1;
+    status = inb(ATA_COMMAND);
+    outb(BM_SR_ERR | BM_SR_IRQ, bm_base + BM_STATUS);
+    if((bm_status & BM_SR_ERR) || (status & (ATA_SR_ERR | ATA_SR_DF)))
+        return -1;
+    return 0;
+}
+
+/*
+ * ata_select
+ *    DESCRIPTION: Selects the disk and loads the sector registers for a read
+ *    INPUTS: lba -- first sector, count -- sectors (1 to 255)
+ *    OUTPUTS: none
+ *    RETURN VALUE: 0 on success, -1 if the drive stays busy
+ */
+static int32_t ata_select(uint32_t lba, uint32_t count) {
+    if(ata_wait_ready() == -1)
+        return -1;
+    outb(ATA_DRIVE_LBA | ATA_SLAVE | ((lba >> 24) & 0x0F), ATA_DRIVE);
+    ata_delay();
+    outb(count, ATA_SECTOR_COUNT);
+    outb(lba & 0xFF, ATA_LBA_LOW);
+    outb((lba >> 8) & 0xFF, ATA_LBA_MID);
+    outb((lba >> 16) & 0xFF, ATA_LBA_HIGH);
+    return 0;
+}
+
+/*
+ * ata_wait_ready
+ *    DESCRIPTION: Polls until the drive isn't busy
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUE: 0 on success, -1 on timeout
+ */
+static int32_t ata_wait_ready(void) {
+    int32_t i;
+
+    for(i = 0; i < ATA_TIMEOUT; i++) {
+        if(!(inb(ATA_COMMAND) & ATA_SR_BSY))
+            return 0;
+    }
+    return -1;
+}
+
+/*
+ * ata_wait_drq
+ *    DESCRIPTION: Polls until the drive has a sector of data ready
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUE: 0 on success, -1 on a drive error or timeout
+ */
+static int32_t ata_wait_drq(void) {
+    uint32_t status;
+    int32_t i;
+
+    for(i = 0; i < ATA_TIMEOUT; i++) {
+        status = inb(ATA_COMMAND);
+        if(status & ATA_SR_BSY)
+            continue;
+        if(status & (ATA_SR_ERR | ATA_SR_DF))
+            return -1;
+        if(status & ATA_SR_DRQ)
+            return 0;
+    }
+    return -1;
+}
+
+/*
+ * ata_delay
+ *    DESCRIPTION: Waits the 400ns a drive needs before its status is valid
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    NOTES: Each alternate status read takes about 100ns
+ */
+static void ata_delay(void) {
+    int32_t i;
+
+    for(i = 0; i < 4; i++)
+        inb(ATA_CONTROL);
+}
+
+/*
+ * ata_find_bus_master
+ *    DESCRIPTION: Looks for a bus mastering IDE controller on PCI bus 0
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUE: Its bus master I/O base (BAR4), 0 if there's none
+ *    SIDE EFFECTS: Enables I/O decoding and bus mastering on the controller
+ */
+static uint32_t ata_find_bus_master(void) {
+    uint32_t dev, func, class, bar, cmd;
+
+    for(dev = 0; dev < 32; dev++) {
+        for(func = 0; func < 8; func++) {
+            if((pci_read(0, dev, func, 0) & 0xFFFF) == 0xFFFF)
+                continue;
+            class = pci_read(0, dev, func, PCI_CLASS_REG);
+            if((class >> 16) != PCI_CLASS_IDE || !(class & 0x8000))    // prog-if bit 7: bus master
+                continue;
+            bar = pci_read(0, dev, func, PCI_BAR4_REG);
+            if(!(bar & 1))              // Not an I/O port BAR
+                continue;
+            cmd = pci_read(0, dev, func, PCI_COMMAND_REG);
+            pci_write(0, dev, func, PCI_COMMAND_REG, cmd | PCI_CMD_IO | PCI_CMD_BUS_MASTER);
+            return bar & ~0x3;
+        }
+    }
+    return 0;
+}
+
+/*
+ * pci_read
+ *    DESCRIPTION: Reads a dword of a PCI function's configuration space
+ *    INPUTS: bus, dev, func -- the function, reg -- register offset
+ *    OUTPUTS: none
+ *    RETURN VALUE: The dword, all ones if there's no such function
+ */
+static uint32_t pci_read(uint32_t bus, uint32_t dev, uint32_t func, uint32_t reg) {
+    outl(PCI_ENABLE | (bus << 16) | (dev << 11) | (func << 8) | (reg & 0xFC), PCI_CONFIG_ADDRESS);
+    return inl(PCI_CONFIG_DATA);
+}
+
+/*
+ * pci_write
+ *    DESCRIPTION: Writes a dword of a PCI function's configuration space
+ *    INPUTS: bus, dev, func -- the function, reg -- register offset, val -- what to write
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ */
+static void pci_write(uint32_t bus, uint32_t dev, uint32_t func, uint32_t reg, uint32_t val) {
+    outl(PCI_ENABLE | (bus << 16) | (dev << 11) | (func << 8) | (reg & 0xFC), PCI_CONFIG_ADDRESS);
+    outl(val, PCI_CONFIG_DATA);
+}
@@ -0,0 +1,85 @@
+/* ata.h - IDE/ATA disk driver (PIO and bus-master DMA) for the primary channel
+ * vim:ts=4 noexpandtab
+ */
+
+// Helpful ATA links:
+// https://wiki.osdev.org/ATA_PIO_Mode
+// https://wiki.osdev.org/ATA/ATAPI_using_DMA
+// https://wiki.osdev.org/PCI#Configuration_Space_Access_Mechanism_.231
+
+#ifndef _ATA_H
+#define _ATA_H
+
+#include "types.h"
+#include "bcache.h"
+
+// Primary channel registers
+#define ATA_DATA                0x1F0
+#define ATA_ERROR               0x1F1
+#define ATA_SECTOR_COUNT        0x1F2
+#define ATA_LBA_LOW             0x1F3
+#define ATA_LBA_MID             0x1F4
+#define ATA_LBA_HIGH            0x1F5
+#define ATA_DRIVE               0x1F6       // Drive select and LBA bits 24-27
+#define ATA_COMMAND             0x1F7       // Status when read
+#define ATA_CONTROL             0x3F6       // Alternate status when read
+#define ATA_IRQ                 14
+
+// Status bits
+#define ATA_SR_BSY              0x80
+#define ATA_SR_DRQ              0x08
+#define ATA_SR_DF               0x20
+#define ATA_SR_ERR              0x01
+
+// Commands
+#define ATA_CMD_READ_PIO        0x20
+#define ATA_CMD_READ_DMA        0xC8
+#define ATA_CMD_IDENTIFY        0xEC
+
+#define ATA_CTRL_NIEN           0x02        // Control register: the drive doesn't raise IRQ14
+#define ATA_DRIVE_LBA           0xE0        // Drive register: LBA addressing, OR in 0x10 for the slave
+#define ATA_SLAVE               0x10
+
+#define ATA_SECTOR_SIZE         512
+#define ATA_SECTORS_PER_BLOCK   (BCACHE_BLOCK_SIZE / ATA_SECTOR_SIZE)
+#define ATA_MAX_SECTORS         0x0FFFFFFF  // LBA28
+
+// Bus master IDE registers, offsets from BAR4 of the IDE controller (primary channel)
+#define BM_COMMAND              0x0         // Bit 0 starts, bit 3 set means device to memory
+#define BM_STATUS               0x2         // Bit 2 interrupt, bit 1 error (write 1 to clear)
+#define BM_PRDT                 0x4         // Physical address of the PRD table
+#define BM_CMD_START            0x01
+#define BM_CMD_READ             0x08
+#define BM_SR_ACTIVE            0x01
+#define BM_SR_ERR               0x02
+#define BM_SR_IRQ               0x04
+#define PRD_EOT                 0x8000      // Last entry of the PRD table
+
+// PCI configuration space access
+#define PCI_CONFIG_ADDRESS      0xCF8
+#define PCI_CONFIG_DATA         0xCFC
+#define PCI_ENABLE              0x80000000
+#define PCI_CLASS_REG           0x08        // Class, subclass, prog-if, revision
+#define PCI_COMMAND_REG         0x04
+#define PCI_BAR4_REG            0x20
+#define PCI_CLASS_IDE           0x0101      // Mass storage, IDE
+#define PCI_CMD_IO              0x01
+#define PCI_CMD_BUS_MASTER      0x04
+
+// One physical region descriptor, the PRD table is a list of them
+typedef struct ata_prd {
+    uint32_t addr;                          // Physical address of the buffer
+    uint16_t bytes;                         // Its length (0 means 64KB), can't cross a 64KB boundary
+    uint16_t flags;                         // PRD_EOT on the last entry
+} ata_prd_t;
+
+// Finds the disk (QEMU's -hdb, the primary slave) and the bus master, returns 0 or -1 if there's no disk
+int32_t init_ata(void);
+
+// Returns the disk as a block device, NULL if init_ata found none
+block_dev_t * ata_device(void);
+
+// IRQ14 handler, called from ATA_processor
+void ata_interrupt(void);
+
+#endif /* _ATA_H */
@@ -0,0 +1,324 @@
+/* bcache.c - Block cache shared by every block device
+ * vim:ts=4 noexpandtab
+ */
+
+#include "bcache.h"
+#include "frame.h"
+#include "scheduler.h"
+#include "lib.h"
+
+/* NOTES: File systems on a block device never read it directly, they ask for (device, block)
+          here and get a pinned buffer holding the block. Buffers are found through a hash of
+          the key and kept on an LRU ring like the dentry cache's, a miss reuses the least
+          recently used buffer nobody has pinned. Each buffer gets its own frame the first time
+          it's used and keeps it, so the cache holds at most BCACHE_BUFFERS blocks (1MB).
+          A miss pins the buffer as BUF_READING before calling the driver with interrupts on, so
+          a driver can sleep until its interrupt and anyone else asking for the block sleeps on
+          the buffer until the read is done. bcache_readahead reads a block without pinning it
+          and marks it, a later bcache_get of it counts as a readahead hit. The device's read is
+          still synchronous today, which is fine for the boot module (a memcpy).
+          A file system can lend a buffer's frame out with frame_get (mmap does, see bootfs_map).
+          The cache never writes to a frame someone else holds: a buffer reused while its frame
+          is lent out gets a new frame instead. */
+
+static buffer_t buffers[BCACHE_BUFFERS];
+static buffer_t * bcache_hash[BCACHE_BUCKETS];
+static buffer_t * bcache_lru;           // Most recently used, lru_prev of it is the least recent
+static bcache_stats_t bcache_stats;
+
+static buffer_t * bcache_find(block_dev_t * dev, uint32_t block);
+static buffer_t * bcache_start(block_dev_t * dev, uint32_t block);
+static int32_t bcache_finish(buffer_t * buf);
+static uint32_t bcache_hash_of(block_dev_t * dev, uint32_t block);
+static void bcache_unhash(buffer_t * buf);
+static void bcache_touch(buffer_t * buf);
+
+/*
+ * init_bcache
+ *    DESCRIPTION: Sets up the block cache
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Every buffer starts empty on the LRU ring, frames are allocated as they're used
+ */
+void init_bcache(void) {
+    int32_t i;
+
+    for(i = 0; i < BCACHE_BUFFERS; i++) {
+        buffers[i].dev = NULL;
+        buffers[i].state = BUF_EMPTY;
+        buffers[i].lru_next = &buffers[(i + 1) % BCACHE_BUFFERS];
+        buffers[i].lru_prev = &buffers[(i + BCACHE_BUFFERS - 1) % BCACHE_BUFFERS];
+    }
+    bcache_lru = &buffers[0];
+}
+
+/*
+ * bcache_get
+ *    DESCRIPTION: Gives a block of a device, reading it if it isn't cached
+ *    INPUTS: dev -- the device
+ *            block -- block number
+ *    OUTPUTS: none
+ *    RETURN VALUE: The buffer, pinned until bcache_put, NULL if block is past the end of dev, the
+ *                  read failed, every buffer is pinned or we're out of memory
+ *    SIDE EFFECTS: Can sleep while the device reads, counts a hit or miss
+ */
+buffer_t * bcache_get(block_dev_t * dev, uint32_t block) {
+    buffer_t * buf;
+    uint32_t flags;
+
+    if(dev == NULL || block >= dev->num_blocks)
+        return NULL;
+
+    cli_and_save(flags);
+    buf = bcache_find(dev, block);
+    if(buf != NULL) {
+        bcache_stats.hits++;
+        if(buf->readahead) {
+            bcache_stats.readahead_hits++;
+            buf->readahead = 0;
+        }
+        buf->refs++;
+        bcache_touch(buf);
+
+        // Someone else is reading it
+        while(buf->state == BUF_READING)
+            sleep_on(&buf->wait);
+        if(buf->state != BUF_VALID) {
+            buf->refs--;
+            buf = NULL;
+        }
+        restore_flags(flags);
+        return buf;
+    }
+
+    bcache_stats.misses++;
+    buf = bcache_start(dev, block);
+    restore_flags(flags);
+    if(buf == NULL || bcache_finish(buf) == -1)
+        return NULL;
+    return buf;
+}
+
+/*
+ * bcache_put
+ *    DESCRIPTION: Unpins a buffer
+ *    INPUTS: buf -- a buffer from bcache_get
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: The block stays cached until the buffer is reused
+ */
+void bcache_put(buffer_t * buf) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    buf->refs--;
+    restore_flags(flags);
+}
+
+/*
+ * bcache_readahead
+ *    DESCRIPTION: Reads a block into the cache ahead of being asked for it
+ *    INPUTS: dev -- the device
+ *            block -- block number
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Does nothing if the block is cached, past the end or no buffer is free,
+ *                  otherwise evicts like a miss (without counting one)
+ */
+void bcache_readahead(block_dev_t * dev, uint32_t block) {
+    buffer_t * buf;
+    uint32_t flags;
+
+    if(dev == NULL || block >= dev->num_blocks)
+        return;
+
+    cli_and_save(flags);
+    buf = bcache_find(dev, block);
+    if(buf == NULL) {
+        buf = bcache_start(dev, block);
+        if(buf != NULL) {
+            bcache_stats.readaheads++;
+            buf->readahead = 1;
+        }
+    } else {
+        buf = NULL;
+    }
+    restore_flags(flags);
+
+    if(buf != NULL && bcache_finish(buf) == 0)
+        bcache_put(buf);
+}
+
+/*
+ * bcache_invalidate
+ *    DESCRIPTION: Forgets every cached block of a device
+ *    INPUTS: dev -- the device
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Pinned buffers keep their data for their holders but are never found again
+ */
+void bcache_invalidate(block_dev_t * dev) {
+    int32_t i;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    for(i = 0; i < BCACHE_BUFFERS; i++) {
+        if(buffers[i].dev == dev) {
+            bcache_unhash(&buffers[i]);
+            buffers[i].dev = NULL;
+            buffers[i].readahead = 0;
+        }
+    }
+    restore_flags(flags);
+}
+
+/*
+ * bcache_get_stats
+ *    DESCRIPTION: Returns the block cache counters
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUE: Hits, misses, readaheads and evictions since boot
+ */
+bcache_stats_t bcache_get_stats(void) {
+    return bcache_stats;
+}
+
+/*
+ * bcache_find
+ *    DESCRIPTION: Looks a block up, call with interrupts off
+ *    INPUTS: dev, block -- the key
+ *    OUTPUTS: none
+ *    RETURN VALUE: Its buffer, NULL if it isn't cached
+ */
+static buffer_t * bcache_find(block_dev_t * dev, uint32_t block) {
+    buffer_t * buf;
+
+    for(buf = bcache_hash[bcache_hash_of(dev, block)]; buf != NULL; buf = buf->hash_next) {
+        if(buf->dev == dev && buf->block == block)
+            return buf;
+    }
+    return NULL;
+}
+
+/*
+ * bcache_start
+ *    DESCRIPTION: Takes the least recently used unpinned buffer for a block that missed, call with
+ *                 interrupts off and then bcache_finish with them on
+ *    INPUTS: dev, block -- the block
+ *    OUTPUTS: none
+ *    RETURN VALUE: The buffer, pinned and BUF_READING, NULL if every buffer is pinned
+ *    SIDE EFFECTS: Drops whatever block the buffer held
+ */
+static buffer_t * bcache_start(block_dev_t * dev, uint32_t block) {
+    buffer_t * buf;
+    int32_t i;
+
+    if(bcache_lru == NULL)              // init_bcache hasn't run
+        return NULL;
+    buf = bcache_lru->lru_prev;
+    for(i = 0; i < BCACHE_BUFFERS && buf->refs != 0; i++)
+        buf = buf->lru_prev;
+    if(buf->refs != 0)
+        return NULL;
+
+    if(buf->dev != NULL) {
+        bcache_unhash(buf);
+        bcache_stats.evictions++;
+    }
+    buf->dev = dev;
+    buf->block = block;
+    buf->refs = 1;
+    buf->state = BUF_READING;
+    buf->readahead = 0;
+    buf->hash_next = bcache_hash[bcache_hash_of(dev, block)];
+    bcache_hash[bcache_hash_of(dev, block)] = buf;
+    bcache_touch(buf);
+    return buf;
+}
+
+/*
+ * bcache_finish
+ *    DESCRIPTION: Reads the block bcache_start picked a buffer for
+ *    INPUTS: buf -- the buffer
+ *    OUTPUTS: none
+ *    RETURN VALUE: 0 if buf now holds the block, -1 if the read failed (buf is unpinned then)
+ *    SIDE EFFECTS: Wakes anyone waiting for the block, a failed block isn't cached. Gives the
+ *                  buffer a new frame if its old one is lent out
+ */
+static int32_t bcache_finish(buffer_t * buf) {
+    int32_t ret = -1;
+    uint32_t flags;
+
+    // A frame mmap still has mapped keeps the old block for it, the buffer moves to a new one
+    if(buf->data != NULL && frame_refcount((uint32_t)buf->data) > 1) {
+        frame_free((uint32_t)buf->data, 1);
+        buf->data = NULL;
+    }
+    if(buf->data == NULL)
+        buf->data = (uint8_t *)frame_alloc(1, 1);
+    if(buf->data != NULL)
+        ret = buf->dev->read(buf->dev, buf->block, buf->data);
+
+    cli_and_save(flags);
+    if(ret == 0) {
+        buf->state = BUF_VALID;
+    } else {
+        buf->state = BUF_EMPTY;
+        if(buf->dev != NULL)
+            bcache_unhash(buf);
+        buf->dev = NULL;
+        buf->refs--;
+    }
+    wake_up(&buf->wait);
+    restore_flags(flags);
+    return ret == 0 ? 0 : -1;
+}
+
+/*
+ * bcache_hash_of
+ *    DESCRIPTION: Picks the hash bucket of a (device, block) key
+ *    INPUTS: dev, block -- the key
+ *    OUTPUTS: none
+ *    RETURN VALUE: Bucket index, consecutive blocks go in consecutive buckets
+ */
+static uint32_t bcache_hash_of(block_dev_t * dev, uint32_t block) {
+    return (((uint32_t)dev >> 4) + block) & (BCACHE_BUCKETS - 1);
+}
+
+/*
+ * bcache_unhash
+ *    DESCRIPTION: Takes a buffer out of its hash chain
+ *    INPUTS: buf -- a buffer holding a block
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ */
+static void bcache_unhash(buffer_t * buf) {
+    buffer_t ** link = &bcache_hash[bcache_hash_of(buf->dev, buf->block)];
+
+    for(; *link != NULL; link = &(*link)->hash_next) {
+        if(*link == buf) {
+            *link = buf->hash_next;
+            return;
+        }
+    }
+}
+
+/*
+ * bcache_touch
+ *    DESCRIPTION: Makes a buffer the most recently used
+ *    INPUTS: buf -- the buffer
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ */
+static void bcache_touch(buffer_t * buf) {
+    if(buf == bcache_lru)
+        return;
+    buf->lru_prev->lru_next = buf->lru_next;
+    buf->lru_next->lru_prev = buf->lru_prev;
+    buf->lru_next = bcache_lru;
+    buf->lru_prev = bcache_lru->lru_prev;
+    bcache_lru->lru_prev->lru_next = buf;
+    bcache_lru->lru_prev = buf;
+    bcache_lru = buf;
+}
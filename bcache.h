@@ -0,0 +1,71 @@
+/* bcache.h - Block devices and the block cache file systems read them through
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _BCACHE_H
+#define _BCACHE_H
+
+#include "types.h"
+#include "system_calls.h"
+#include "x86_desc.h"
+
+#define BCACHE_BLOCK_SIZE   FOUR_KB     // Block size of every device, one frame per cached block
+#define BCACHE_BUFFERS      256         // Blocks cached at once (1MB)
+#define BCACHE_BUCKETS      128         // Hash buckets (power of 2)
+
+// Buffer states
+#define BUF_EMPTY           0           // No data (unused, or the read failed)
+#define BUF_READING         1           // The device is filling it, getters sleep on wait
+#define BUF_VALID           2
+
+// Something that stores BCACHE_BLOCK_SIZE blocks (the boot module, a disk)
+typedef struct block_dev {
+    const int8_t * name;
+    uint32_t num_blocks;
+    // Reads one block into buf, returns 0 or -1, can sleep
+    int32_t (*read)(struct block_dev * dev, uint32_t block, uint8_t * buf);
+    void * priv;                        // Driver's own data
+} block_dev_t;
+
+// A cached block
+typedef struct buffer {
+    block_dev_t * dev;                  // NULL if the buffer holds nothing
+    uint32_t block;
+    uint8_t * data;                     // BCACHE_BLOCK_SIZE bytes (a frame), NULL until first used
+    uint32_t refs;                      // bcache_get holders, a pinned buffer is never reused
+    uint8_t state;                      // BUF_*
+    uint8_t readahead;                  // 1 if read ahead and nobody has asked for it yet
+    wait_queue_t wait;                  // Getters waiting for a read in progress
+    struct buffer * hash_next;
+    struct buffer * lru_prev;           // Most recently used first
+    struct buffer * lru_next;
+} buffer_t;
+
+// Block cache counters
+typedef struct bcache_stats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t readaheads;                // Blocks read ahead
+    uint32_t readahead_hits;            // Blocks read ahead that were used later
+    uint32_t evictions;                 // Cached blocks dropped to make room
+} bcache_stats_t;
+
+// Sets up the buffer list, call after init_frames
+void init_bcache(void);
+
+// Returns block of dev pinned and filled in (reading it if needed), NULL on a read error or bad block
+buffer_t * bcache_get(block_dev_t * dev, uint32_t block);
+
+// Unpins a buffer from bcache_get
+void bcache_put(buffer_t * buf);
+
+// Starts reading a block into the cache if it isn't there, without pinning it
+void bcache_readahead(block_dev_t * dev, uint32_t block);
+
+// Forgets every cached block of dev, call before its contents change under the cache
+void bcache_invalidate(block_dev_t * dev);
+
+// Returns the cache counters
+bcache_stats_t bcache_get_stats(void);
+
+#endif /* _BCACHE_H */
@@ -0,0 +1,129 @@
+/* devfs.c - File system of device nodes, mounted at /dev
+ * vim:ts=4 noexpandtab
+ */
+
+#include "devfs.h"
+#include "lib.h"
+
+/* NOTES: devfs is one flat directory with an entry per driver in the devices table. Looking a
+          name up gives a VFS_TYPE_DEV node carrying the driver's fops, which vfs_open uses
+          directly. Device nodes in other file systems (the boot image's "rtc") find their
+          driver here through devfs_find. */
+
+#define DEVFS_ROOT      0               // Inode number of the directory, devices are 1 and up
+
+typedef struct device {
+    const int8_t * name;
+    const fops_jump_table_t * fops;
+} device_t;
+
+static const device_t devices[] = {
+    {"rtc", &rtc_table},
+    {"stdin", &stdin_table},
+    {"stdout", &stdout_table},
+};
+
+#define NUM_DEVICES     (sizeof(devices) / sizeof(devices[0]))
+
+static int32_t devfs_lookup(super_block_t * sb, uint32_t dir, const uint8_t * name, vfs_node_t * node);
+static int32_t devfs_read(super_block_t * sb, uint32_t ino, uint32_t offset, uint8_t * buf, uint32_t len);
+static int32_t devfs_readdir(super_block_t * sb, uint32_t dir, uint32_t index, uint8_t * name, vfs_node_t * node);
+static int32_t devfs_size(super_block_t * sb, uint32_t ino);
+
+static const super_ops_t devfs_ops = {devfs_lookup, devfs_read, NULL, devfs_readdir, devfs_size, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
+static super_block_t devfs_sb = {&devfs_ops, DEVFS_ROOT, NULL};
+
+/*
+ * devfs_super
+ *    DESCRIPTION: Gives devfs's super block
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUE: The super block, to mount
+ */
+super_block_t * devfs_super(void) {
+    return &devfs_sb;
+}
+
+/*
+ * devfs_find
+ *    DESCRIPTION: Finds a device's driver
+ *    INPUTS: name -- device name
+ *    OUTPUTS: none
+ *    RETURN VALUE: Its fops, NULL if there's no such device
+ */
+const fops_jump_table_t * devfs_find(const uint8_t * name) {
+    uint32_t i;
+
+    for(i = 0; i < NUM_DEVICES; i++) {
+        if(!strncmp(devices[i].name, (const int8_t *)name, VFS_NAME_LEN))
+            return devices[i].fops;
+    }
+    return NULL;
+}
+
+/*
+ * devfs_lookup
+ *    DESCRIPTION: super_ops_t lookup, finds a device in the root directory
+ *    INPUTS: sb -- devfs, dir -- must be the root, name -- device name
+ *    OUTPUTS: node -- the device
+ *    RETURN VALUE: 0 on success, -1 if there's no such device
+ */
+static int32_t devfs_lookup(super_block_t * sb, uint32_t dir, const uint8_t * name, vfs_node_t * node) {
+    uint32_t i;
+
+    if(dir != DEVFS_ROOT)
+        return -1;
+    if(!strncmp((const int8_t *)name, ".", VFS_NAME_LEN)) {
+        node->ino = DEVFS_ROOT;
+        node->type = VFS_TYPE_DIR;
+        return 0;
+    }
+    for(i = 0; i < NUM_DEVICES; i++) {
+        if(!strncmp(devices[i].name, (const int8_t *)name, VFS_NAME_LEN)) {
+            node->ino = i + 1;
+            node->type = VFS_TYPE_DEV;
+            node->fops = devices[i].fops;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+ * devfs_read
+ *    DESCRIPTION: super_ops_t read, devfs has no regular files
+ *    INPUTS: ignored
+ *    OUTPUTS: none
+ *    RETURN VALUE: -1
+ */
+static int32_t devfs_read(super_block_t * sb, uint32_t ino, uint32_t offset, uint8_t * buf, uint32_t len) {
+    return -1;
+}
+
+/*
+ * devfs_readdir
+ *    DESCRIPTION: super_ops_t readdir, lists the devices
+ *    INPUTS: sb -- devfs, dir -- must be the root, index -- position, the device number
+ *    OUTPUTS: name -- the device's name, node -- the device
+ *    RETURN VALUE: Position of the next device, -1 past the last device
+ */
+static int32_t devfs_readdir(super_block_t * sb, uint32_t dir, uint32_t index, uint8_t * name, vfs_node_t * node) {
+    if(dir != DEVFS_ROOT || index >= NUM_DEVICES)
+        return -1;
+    strncpy((int8_t *)name, devices[index].name, VFS_NAME_LEN);
+    node->ino = index + 1;
+    node->type = VFS_TYPE_DEV;
+    node->fops = devices[index].fops;
+    return index + 1;
+}
+
+/*
+ * devfs_size
+ *    DESCRIPTION: super_ops_t size, devices have no length
+ *    INPUTS: ignored
+ *    OUTPUTS: none
+ *    RETURN VALUE: -1
+ */
+static int32_t devfs_size(super_block_t * sb, uint32_t ino) {
+    return -1;
+}
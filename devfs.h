@@ -0,0 +1,17 @@
+/* devfs.h - File system of device nodes, mounted at /dev
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _DEVFS_H
+#define _DEVFS_H
+
+#include "types.h"
+#include "vfs.h"
+
+// Returns devfs's super block for vfs_mount
+super_block_t * devfs_super(void);
+
+// Finds a device's driver by name, returns NULL if there is no such device
+const fops_jump_table_t * devfs_find(const uint8_t * name);
+
+#endif /* _DEVFS_H */
@@ -0,0 +1,238 @@
+/* file.c - Open file objects and per-process fd tables
+ * vim:ts=4 noexpandtab
+ */
+
+#include "file.h"
+#include "kmalloc.h"
+#include "lib.h"
+
+/* NOTES: An fd is an index into the process's fd table, which holds pointers to open files. An
+          open file (file_t) has the driver's ops, its data and the file position, and is shared
+          by every fd that points at it: fork and dup add references instead of copying, so the
+          position moves for all of them. The driver's close only runs when the last reference
+          goes away, while that fd is still installed, since drivers look their file up by fd.
+          Tables start in the PCB (fd_inline) and move to a kmalloc'd array twice the size when
+          they run out, up to FD_MAX. */
+
+static kmem_cache_t * file_cache;
+
+static int32_t fd_grow(pcb_t * pcb, uint32_t count);
+
+/*
+ * init_files
+ *    DESCRIPTION: Makes the cache open files are allocated from
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Call after init_kmalloc
+ */
+void init_files(void) {
+    file_cache = kmem_cache_create("file", sizeof(file_t));
+}
+
+/*
+ * file_alloc
+ *    DESCRIPTION: Makes an open file
+ *    INPUTS: ops -- the driver's functions
+ *            inode -- driver data
+ *    OUTPUTS: none
+ *    RETURN VALUE: The file at position 0, default mode and one reference, NULL if out of memory
+ */
+file_t * file_alloc(const fops_jump_table_t * ops, uint32_t inode) {
+    file_t * file = kmem_cache_alloc(file_cache);
+
+    if(file == NULL)
+        return NULL;
+    file->ops = ops;
+    file->inode = inode;
+    file->file_pos = 0;
+    file->mode = 0;
+    file->refcount = 1;
+    return file;
+}
+
+/*
+ * fd_table_init
+ *    DESCRIPTION: Gives a new PCB an empty fd table
+ *    INPUTS: pcb -- the PCB
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ */
+void fd_table_init(pcb_t * pcb) {
+    memset(pcb->fd_inline, 0, sizeof(pcb->fd_inline));
+    pcb->fds = pcb->fd_inline;
+    pcb->fd_count = FD_INLINE;
+}
+
+/*
+ * fd_table_free
+ *    DESCRIPTION: Frees a grown fd table
+ *    INPUTS: pcb -- PCB being freed, all its fds closed
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ */
+void fd_table_free(pcb_t * pcb) {
+    if(pcb->fds != pcb->fd_inline)
+        kfree(pcb->fds);
+    pcb->fds = pcb->fd_inline;
+    pcb->fd_count = FD_INLINE;
+}
+
+/*
+ * fd_get
+ *    DESCRIPTION: Looks up an fd
+ *    INPUTS: pcb -- the process
+ *            fd -- the fd
+ *    OUTPUTS: none
+ *    RETURN VALUE: Its open file, NULL if fd is out of range or not open
+ */
+file_t * fd_get(pcb_t * pcb, int32_t fd) {
+    if(fd < 0 || (uint32_t)fd >= pcb->fd_count)
+        return NULL;
+    return pcb->fds[fd];
+}
+
+/*
+ * fd_install
+ *    DESCRIPTION: Gives an open file an fd
+ *    INPUTS: pcb -- the process
+ *            file -- the file, the fd takes over the caller's reference
+ *    OUTPUTS: none
+ *    RETURN VALUE: The lowest free fd, -1 if all FD_MAX are taken or the table can't grow
+ */
+int32_t fd_install(pcb_t * pcb, file_t * file) {
+    uint32_t fd;
+
+    for(fd = 0; fd < pcb->fd_count && pcb->fds[fd] != NULL; fd++);
+    if(fd == pcb->fd_count && fd_grow(pcb, fd + 1) == -1)
+        return -1;
+    pcb->fds[fd] = file;
+    return fd;
+}
+
+/*
+ * fd_close
+ *    DESCRIPTION: Drops an fd
+ *    INPUTS: pcb -- the running process
+ *            fd -- an open fd
+ *    OUTPUTS: none
+ *    RETURN VALUE: The driver's close result if this was the file's last reference, 0 otherwise,
+ *                  -1 if fd isn't open
+ */
+int32_t fd_close(pcb_t * pcb, int32_t fd) {
+    file_t * file = fd_get(pcb, fd);
+    int32_t ret = 0;
+
+    if(file == NULL)
+        return -1;
+    if(--file->refcount == 0) {
+        ret = file->ops->close(fd);
+        kfree(file);
+    }
+    pcb->fds[fd] = NULL;
+    return ret;
+}
+
+/*
+ * fd_close_all
+ *    DESCRIPTION: Closes every fd of an exiting process
+ *    INPUTS: pcb -- the running process
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ */
+void fd_close_all(pcb_t * pcb) {
+    uint32_t fd;
+
+    for(fd = 0; fd < pcb->fd_count; fd++) {
+        if(pcb->fds[fd] != NULL)
+            fd_close(pcb, fd);
+    }
+}
+
+/*
+ * fd_dup
+ *    DESCRIPTION: Makes another fd for an open file
+ *    INPUTS: pcb -- the running process
+ *            fd -- an open fd
+ *            newfd -- fd to use (closed first if it's open), -1 for the lowest free one
+ *    OUTPUTS: none
+ *    RETURN VALUE: The new fd, -1 if fd isn't open, newfd is out of range or no fd is free
+ *    SIDE EFFECTS: Both fds share the file position and mode
+ */
+int32_t fd_dup(pcb_t * pcb, int32_t fd, int32_t newfd) {
+    file_t * file = fd_get(pcb, fd);
+
+    if(file == NULL || newfd < -1 || newfd >= FD_MAX)
+        return -1;
+    if(newfd == fd)
+        return newfd;
+
+    if(newfd == -1) {
+        newfd = fd_install(pcb, file);
+        if(newfd == -1)
+            return -1;
+    } else {
+        if((uint32_t)newfd >= pcb->fd_count && fd_grow(pcb, newfd + 1) == -1)
+            return -1;
+        if(pcb->fds[newfd] != NULL)
+            fd_close(pcb, newfd);
+        pcb->fds[newfd] = file;
+    }
+    file->refcount++;
+    return newfd;
+}
+
+/*
+ * fd_fork
+ *    DESCRIPTION: Copies a parent's fd table to its forked child
+ *    INPUTS: parent -- the forking process
+ *            child -- its child, with an empty table
+ *    OUTPUTS: none
+ *    RETURN VALUE: 0, -1 if the child's table can't grow to the parent's size
+ *    SIDE EFFECTS: Every open file gains a reference
+ */
+int32_t fd_fork(pcb_t * parent, pcb_t * child) {
+    uint32_t fd;
+
+    if(parent->fd_count > child->fd_count && fd_grow(child, parent->fd_count) == -1)
+        return -1;
+    for(fd = 0; fd < parent->fd_count; fd++) {
+        child->fds[fd] = parent->fds[fd];
+        if(child->fds[fd] != NULL)
+            child->fds[fd]->refcount++;
+    }
+    return 0;
+}
+
+/*
+ * fd_grow
+ *    DESCRIPTION: Makes an fd table bigger
+ *    INPUTS: pcb -- the process
+ *            count -- entries needed
+ *    OUTPUTS: none
+ *    RETURN VALUE: 0, -1 if count is over FD_MAX or out of memory
+ *    SIDE EFFECTS: Doubles the table until it's big enough, new entries are empty
+ */
+static int32_t fd_grow(pcb_t * pcb, uint32_t count) {
+    uint32_t new_count = pcb->fd_count;
+    file_t ** fds;
+
+    if(count > FD_MAX)
+        return -1;
+    while(new_count < count)
+        new_count *= 2;
+    if(new_count > FD_MAX)
+        new_count = FD_MAX;
+
+    fds = kmalloc(new_count * sizeof(file_t *));
+    if(fds == NULL)
+        return -1;
+    memcpy(fds, pcb->fds, pcb->fd_count * sizeof(file_t *));
+    memset(fds + pcb->fd_count, 0, (new_count - pcb->fd_count) * sizeof(file_t *));
+
+    if(pcb->fds != pcb->fd_inline)
+        kfree(pcb->fds);
+    pcb->fds = fds;
+    pcb->fd_count = new_count;
+    return 0;
+}
@@ -0,0 +1,43 @@
+/* file.h - Open file objects and per-process fd tables
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _FILE_H
+#define _FILE_H
+
+#include "types.h"
+#include "system_calls.h"
+
+#define FD_MAX              64          // Most fds a process can have, the table grows up to this
+
+// Makes the cache open files are allocated from
+void init_files(void);
+
+// Makes an open file with one reference, returns NULL if out of memory
+file_t * file_alloc(const fops_jump_table_t * ops, uint32_t inode);
+
+// Gives a new PCB an empty table of FD_INLINE fds
+void fd_table_init(pcb_t * pcb);
+
+// Frees a grown fd table, every fd must be closed already
+void fd_table_free(pcb_t * pcb);
+
+// Looks up an fd, returns NULL if it's out of range or not open
+file_t * fd_get(pcb_t * pcb, int32_t fd);
+
+// Puts a file in the lowest free fd (growing the table if needed), returns the fd or -1
+int32_t fd_install(pcb_t * pcb, file_t * file);
+
+// Drops an fd of the running process, returns the driver's close result or 0
+int32_t fd_close(pcb_t * pcb, int32_t fd);
+
+// Closes every fd of the running process
+void fd_close_all(pcb_t * pcb);
+
+// Makes newfd (or the lowest free fd if newfd is -1) point at fd's file, returns it or -1
+int32_t fd_dup(pcb_t * pcb, int32_t fd, int32_t newfd);
+
+// Gives a forked child the parent's fds, sharing the open files, returns 0 or -1
+int32_t fd_fork(pcb_t * parent, pcb_t * child);
+
+#endif /* _FILE_H */
@@ -2,48 +2,218 @@
 #include "lib.h"
 #include "system_calls.h"
 #include "x86_desc.h"
+#include "devfs.h"
+#include "frame.h"
+#include "kmalloc.h"
+#include "bcache.h"
+#include "ramdisk.h"
+
+/* NOTES: Images come in two formats. The Appendix A format has one directory, the dentries in
+          the boot block. The extended format (boot->magic is FS_EXT_MAGIC) stores every
+          directory, the root included, as an inode whose data blocks hold an array of dentry_t.
+          The array is an open-addressed hash table: its length is a power of 2, a name goes in
+          the first free slot at or after fs_name_hash(name), and slots with an empty name are
+          free. tools/mkfs.c builds it at most half full, so a lookup checks a slot or two no
+          matter how many files a directory has. A directory is capped like any file at
+          MAX_FILE_BLOCKS blocks (65472 slots), so its table is at most 32768 slots and it
+          holds up to 16382 names besides "." and "..".
+          Every directory also has "." and ".." entries. Directories are named by inode number,
+          with BOOTFS_ROOT standing for the root in both formats.
+
+          The image sits on a block device (the boot module through a ramdisk, see
+          mount_filesystem) and only the boot block is kept in memory. Inode n is block 1 + n and
+          data block i is block 1 + num_inodes + i, both are read through the block cache, so
+          nothing here depends on the image being in memory. bootfs_readahead lets the VFS read
+          the next blocks of a file being read sequentially into the cache early, and bootfs_map
+          lets mmap map a cached block's frame straight into a process.
+
+          Besides the root image, bootfs_mount gives a read-only super block for an image on
+          any other block device (a disk), each mounted image is a bootfs_t.
+
+          The boot image is read-only, but bootfs_enable_overlay makes it writable without copying
+          anything up front. The first write to a file gives its inode a shadow_inode_t holding
+          the file's size and one slot per data block. A slot stays 0 while the block still reads
+          from the image, the first write to a block copies it into a frame of its own and later
+          reads and writes use that frame. Editing a big file only costs the blocks it touches
+          (plus the shadow's 4KB), files nobody writes to cost nothing. Bytes past a shadow's size
+          are never read, so a block that is wholly past the end starts out uninitialized and
+          growing a file zero-fills the gap. Nothing is written back to the image. */
+
+/*one mounted image*/
+typedef struct{
+    block_dev_t* dev;           //device the image is read from
+    boot_block_t boot;          //its boot block
+    shadow_inode_t** shadows;   //shadow of each inode, NULL until overlay mode writes to it
+    super_block_t sb;           //priv points back here
+}bootfs_t;
+
+static int32_t bootfs_lookup(super_block_t* sb, uint32_t dir, const uint8_t* name, vfs_node_t* node);
+static int32_t bootfs_read(super_block_t* sb, uint32_t ino, uint32_t offset, uint8_t* buf, uint32_t len);
+static int32_t bootfs_readdir(super_block_t* sb, uint32_t dir, uint32_t index, uint8_t* name, vfs_node_t* node);
+static int32_t bootfs_size(super_block_t* sb, uint32_t ino);
+static int32_t bootfs_write(super_block_t* sb, uint32_t ino, uint32_t offset, const uint8_t* buf, uint32_t len);
+static int32_t bootfs_truncate(super_block_t* sb, uint32_t ino, uint32_t size);
+static shadow_inode_t* shadow_get(bootfs_t* fs, uint32_t ino);
+static int32_t dir_find(bootfs_t* fs, uint32_t dir, const uint8_t* name, uint32_t len, dentry_t* dentry);
+static int32_t dir_entry(bootfs_t* fs, uint32_t dir, uint32_t pos, dentry_t* dentry);
+static uint32_t dir_slots(bootfs_t* fs, uint32_t dir, uint32_t* ino);
+static int32_t dir_read_slot(bootfs_t* fs, uint32_t ino, uint32_t slot, dentry_t* dentry);
+static uint32_t dir_of(bootfs_t* fs, const dentry_t* dentry);
+static uint32_t name_hash(const uint8_t* name, uint32_t len);
+static int32_t shadow_copy(bootfs_t* fs, shadow_inode_t* shadow, uint32_t ino, uint32_t offset, uint8_t* buf, uint32_t len, int32_t write);
+static void shadows_drop(bootfs_t* fs, uint32_t num_inodes);
+static void bootfs_readahead(super_block_t* sb, uint32_t ino, uint32_t offset, uint32_t len);
+static uint32_t bootfs_map(super_block_t* sb, uint32_t ino, uint32_t page);
+static inode_t* inode_get(bootfs_t* fs, uint32_t ino, buffer_t** buf);
+static int32_t inode_size(bootfs_t* fs, uint32_t ino);
+static int32_t image_read(bootfs_t* fs, uint32_t ino, uint32_t offset, uint8_t* buf, uint32_t length);
+static int32_t image_load(bootfs_t* fs, block_dev_t* dev);
+
+#define DATA_BLOCK(fs,i) (1+fs->boot.num_inodes+(i))  //device block of data block i
+
+/*the boot image is read-only, so it has no write until overlay mode is on*/
+static const super_ops_t bootfs_ops = {bootfs_lookup, bootfs_read, NULL, bootfs_readdir, bootfs_size, NULL, NULL, NULL, NULL, NULL, bootfs_readahead, bootfs_map};
+/*overlay mode can change files but not the directory*/
+static const super_ops_t bootfs_overlay_ops = {bootfs_lookup, bootfs_read, bootfs_write, bootfs_readdir, bootfs_size, NULL, NULL, bootfs_truncate, NULL, NULL, bootfs_readahead, bootfs_map};
+
+static bootfs_t root_fs = {NULL, {0}, NULL, {&bootfs_ops, BOOTFS_ROOT, &root_fs}};     //mounted at /, read_data and friends use it
+static block_dev_t module_disk;     //the boot module as a block device
 
 /*  
  * init_filesystem
  *    DESCRIPTION: Initializes the file system structure based off the given start pointer
  *    INPUTS: pointer to the start of the file system
  *    OUTPUTS: NONE
- *    SIDE EFFECTS: Boot, inode, dentry, and data block global variables are initialized
- *    NOTES: See Appendix A
+ *    SIDE EFFECTS: The boot module becomes a ramdisk and the file system is mounted from it
+ *    NOTES: See Appendix A, runs before paging and the frame allocator are up
  */ 
 void init_filesystem(uint32_t start){
-    boot=(boot_block_t*)start;      //points to starting memory block of file system 
-    fs_inode=(inode_t*)(start+BLOCK_SIZE);   //inodes start one block (4KB) after start/boot
-    fs_dentry=(dentry_t*)(start+64);   //dir entries start 64B after start/boot 
-    fs_data_block=(data_block_t*)(start+BLOCK_SIZE*(boot->num_inodes+1)); //data block starts a block after inode
+    boot_block_t* image=(boot_block_t*)start;
+
+    ramdisk_init(&module_disk, "module", start, 1+image->num_inodes+image->num_data_blocks);
+    mount_filesystem(&module_disk);
+}
+
+/*  
+ * mount_filesystem
+ *    DESCRIPTION: Switches the file system to the image on a block device
+ *    INPUTS: dev -- the device, block 0 is the boot block
+ *    OUTPUTS: 0 on success, -1 if the boot block can't be read or says the image is bigger than dev
+ *    SIDE EFFECTS: Boot and dentry globals point at the new boot block, nothing of the old device
+ *                  stays cached, not even lookups in the dentry cache. Switching devices drops
+ *                  overlay mode's changes (overlay mode stays on)
+ *    NOTES: Reads the boot block straight from the device, the rest goes through the block cache
+ */
+int32_t mount_filesystem(block_dev_t* dev){
+    bootfs_t* fs=&root_fs;
+    uint32_t old_inodes=fs->boot.num_inodes;
+    int32_t overlay=(fs->shadows!=NULL);
+
+    if(image_load(fs, dev)==-1){
+        if(fs->dev!=NULL)    //keep the old image
+            fs->dev->read(fs->dev, 0, (uint8_t*)&fs->boot);
+        return -1;
+    }
+
+    if(dev!=fs->dev && fs->dev!=NULL){
+        bcache_invalidate(fs->dev);
+        shadows_drop(fs, old_inodes);
+        if(overlay)
+            bootfs_enable_overlay();
+    }
+    bcache_invalidate(dev);
+    dcache_invalidate_sb(&fs->sb);
+    fs->dev=dev;
+    boot=&fs->boot;
+    fs_dentry=fs->boot.dentries;
+    return 0;
+}
+
+/*  
+ * bootfs_mount
+ *    DESCRIPTION: Makes a read-only file system of the image on a block device
+ *    INPUTS: dev -- the device, block 0 is the boot block
+ *    OUTPUTS: Its super block, to vfs_mount, NULL if the boot block can't be read or says the
+ *             image is bigger than dev, or if out of memory
+ *    SIDE EFFECTS: Reads the boot block straight from the device, the rest goes through the block cache
+ *    NOTES: Call after init_kmalloc, the image can be in either format
+ */
+struct super_block* bootfs_mount(struct block_dev* dev){
+    bootfs_t* fs=kmalloc(sizeof(bootfs_t));
+
+    if(fs==NULL)
+        return NULL;
+    if(image_load(fs, dev)==-1){
+        kfree(fs);
+        return NULL;
+    }
+    fs->dev=dev;
+    fs->shadows=NULL;
+    fs->sb.ops=&bootfs_ops;
+    fs->sb.root=BOOTFS_ROOT;
+    fs->sb.priv=fs;
+    return &fs->sb;
+}
+
+/*  
+ * image_load
+ *    DESCRIPTION: Reads an image's boot block and checks it fits its device
+ *    INPUTS: fs -- where to keep the boot block, dev -- the device
+ *    OUTPUTS: 0 on success, -1 if the read fails or the image is bigger than dev
+ *    SIDE EFFECTS: fs->boot is overwritten either way
+ */
+static int32_t image_load(bootfs_t* fs, block_dev_t* dev){
+    if(dev==NULL || dev->num_blocks==0)
+        return -1;
+    if(dev->read(dev, 0, (uint8_t*)&fs->boot)!=0)
+        return -1;
+    if(fs->boot.num_inodes>=dev->num_blocks || fs->boot.num_data_blocks>dev->num_blocks-1-fs->boot.num_inodes)
+        return -1;
+    return 0;
+}
+
+/*  
+ * fs_device
+ *    DESCRIPTION: Gives the device the file system is read from
+ *    INPUTS: none
+ *    OUTPUTS: The device, to mount again later
+ *    SIDE EFFECTS: none
+ */
+struct block_dev* fs_device(void){
+    return root_fs.dev;
 }
 
 /*  
  * read_dentry_by_name
  *    DESCRIPTION: Finds and copies over dentry info into a dentry block based on file name 
- *    INPUTS: file name (to find), dentry (to copy over to)
+ *    INPUTS: file name or '/'-separated path from the root (to find), dentry (to copy over to)
  *    OUTPUTS: 0 for success, -1 for fail
  *    SIDE EFFECTS: Dentry block is initialized with info upon success
- *    NOTES: See Appendix A
+ *    NOTES: See Appendix A, paths only go below the root in the extended format
  */ 
 int32_t read_dentry_by_name(const uint8_t* fname, dentry_t* dentry){
-    if(fname==NULL||dentry==NULL||strlen((int8_t*)fname) > 32)   //check for invalid pointers
-        return -1;
-
-    int i;
-    for(i=0;i<boot->num_dentries;i++){      //loop through all dentries
-        /*if names match, copy over dentry file name, type, and index node into dentry block*/
-        if(!strncmp((int8_t*)&(boot->dentries[i]),(int8_t*)fname,FNAME_LENGTH)){   
-            // if(strlen((int8_t*)fname) <= 32){
-                strncpy((int8_t*)dentry->fname, (int8_t*)boot->dentries[i].fname,FNAME_LENGTH);
-                dentry->ftype=boot->dentries[i].ftype;
-                dentry->inode=boot->dentries[i].inode;
-                return 0;   //successfully copied over, return 0
-            // }  
-            
-        }
+    bootfs_t* fs=&root_fs;
+    uint32_t dir=BOOTFS_ROOT;
+    uint32_t len;
+
+    if(fname==NULL||dentry==NULL)   //check for invalid pointers
+        return -1;
+
+    /*look up one component at a time, every one before the last has to be a directory*/
+    while(*fname=='/')
+        fname++;
+    while(1){
+        for(len=0; fname[len]!='\0' && fname[len]!='/'; len++);
+        if(len==0 || len>FNAME_LENGTH || dir_find(fs,dir,fname,len,dentry)==-1)
+            return -1;  //dentry not found, return -1 
+
+        for(fname+=len; *fname=='/'; fname++);
+        if(*fname=='\0')
+            return 0;   //successfully copied over, return 0
+        if(dentry->ftype!=VFS_TYPE_DIR)
+            return -1;
+        dir=dir_of(fs,dentry);
     }
-    return -1;  //dentry not found, return -1 
 }
 
 /*  
@@ -52,23 +222,46 @@ int32_t read_dentry_by_name(const uint8_t* fname, dentry_t* dentry){
  *    INPUTS: index (to find), dentry (to copy over to)
  *    OUTPUTS: 0 for success, -1 for fail
  *    SIDE EFFECTS: Dentry block is initialized with info upon success
- *    NOTES: See Appendix A
+ *    NOTES: See Appendix A, indexes the root directory's names in the extended format
  */ 
 int32_t read_dentry_by_index(uint32_t index, dentry_t* dentry){
+    bootfs_t* fs=&root_fs;
+    int32_t pos;
+
     if(dentry==NULL)   //check for invalid pointer
         return -1;
 
-    if(index >= boot->num_dentries)    //check if index is out of bounds
+    if(fs->boot.magic==FS_EXT_MAGIC){  //skip index used slots of the root's table
+        for(pos=0; (pos=dir_entry(fs,BOOTFS_ROOT,pos,dentry))!=-1 && index>0; index--);
+        return pos==-1 ? -1 : 0;
+    }
+
+    if(index >= fs->boot.num_dentries)    //check if index is out of bounds
         return -1;
 
     /*index is valid, so copy over dentry file name, type, and index node into dentry block*/
-    strncpy((int8_t*)dentry->fname, (int8_t*)boot->dentries[index].fname,FNAME_LENGTH);
-    dentry->ftype=boot->dentries[index].ftype;
-    dentry->inode=boot->dentries[index].inode;
+    strncpy((int8_t*)dentry->fname, (int8_t*)fs->boot.dentries[index].fname,FNAME_LENGTH);
+    dentry->ftype=fs->boot.dentries[index].ftype;
+    dentry->inode=fs->boot.dentries[index].inode;
     
     return 0;   //successfully copied over, return 0
 }
 
+/*  
+ * fs_name_hash
+ *    DESCRIPTION: Hashes a file name (FNV-1a), picks where it goes in an extended format directory
+ *    INPUTS: name -- up to FNAME_LENGTH characters, NUL-terminated if shorter
+ *    OUTPUTS: The hash, directories use its low bits
+ *    SIDE EFFECTS: none
+ *    NOTES: tools/mkfs.c must hash the same way
+ */
+uint32_t fs_name_hash(const uint8_t* name){
+    uint32_t len;
+
+    for(len=0; len<FNAME_LENGTH && name[len]!='\0'; len++);
+    return name_hash(name,len);
+}
+
 /*  
  * read_data
  *    DESCRIPTION: Finds and copies over dentry info into a dentry block based on given index
@@ -78,155 +271,630 @@ int32_t read_dentry_by_index(uint32_t index, dentry_t* dentry){
  *            nbytes -- number of bytes to read from file
  *    OUTPUTS: number of bytes read
  *    SIDE EFFECTS: buf holds file data
- *    NOTES: See Appendix A
+ *    NOTES: See Appendix A, reads the root image
  */ 
 int32_t read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length){
-    if(buf==NULL)           //check for invalid pointer
-        return 0;
+    return image_read(&root_fs, inode, offset, buf, length);
+}
 
-    if(inode >= boot->num_inodes)      //check if index node is out of bounds
+/*  
+ * image_read
+ *    DESCRIPTION: read_data for any mounted image, a whole block at a time through the block cache
+ *    INPUTS: fs -- the image, the rest as for read_data
+ *    OUTPUTS: number of bytes read
+ *    SIDE EFFECTS: buf holds file data, overlay mode's copies aren't looked at
+ */ 
+static int32_t image_read(bootfs_t* fs, uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length){
+    inode_t* curr_inode;
+    buffer_t* inode_buf;
+    buffer_t* data_buf;
+    uint32_t bytes_read=0, index, start, chunk, size;
+
+    if(buf==NULL)           //check for invalid pointer
         return 0;
-    
-    inode_t* curr_inode=(inode_t*)(&(fs_inode[inode])); //points to the file with inode number inode
 
-    if(offset >= curr_inode->file_size) //check if offset from start of file is out of bounds
+    curr_inode=inode_get(fs, inode, &inode_buf);   //points to the file with inode number inode
+    if(curr_inode==NULL)    //check if index node is out of bounds
         return 0;
 
-    int bytes_read;
-    data_block_t* curr_data_block;
+    size=curr_inode->file_size;
+    if(size>MAX_FILE_BLOCKS*BLOCK_SIZE)
+        size=MAX_FILE_BLOCKS*BLOCK_SIZE;
+    if(offset<size && length>size-offset)   //stop at the end of the file
+        length=size-offset;
 
-    for(bytes_read=0; bytes_read<length; bytes_read++){     //loop through bytes that need to be read
-        if((offset) > curr_inode->file_size)     //break if bytes read go out of file bounds
+    while(offset<size && bytes_read<length){
+        index=curr_inode->index_num[(offset+bytes_read)/BLOCK_SIZE];
+        if(index>=fs->boot.num_data_blocks)
+            break;
+        data_buf=bcache_get(fs->dev, DATA_BLOCK(fs,index));
+        if(data_buf==NULL)
             break;
-        curr_data_block=(data_block_t*)(fs_data_block + (curr_inode->index_num[offset/BLOCK_SIZE])); //finds start of data block of which to read bytes from
-        buf[bytes_read]=curr_data_block->block[offset%BLOCK_SIZE];  //copy data into buf
-        offset++;
+
+        start=(offset+bytes_read)%BLOCK_SIZE;
+        chunk=BLOCK_SIZE-start;
+        if(chunk>length-bytes_read)
+            chunk=length-bytes_read;
+        memcpy(buf+bytes_read, data_buf->data+start, chunk);  //copy data into buf
+        bcache_put(data_buf);
+        bytes_read+=chunk;
     }
+    bcache_put(inode_buf);
     return bytes_read;
 }
 
 
 /*  
- * read_file
- *    DESCRIPTION: Finds and copies over dentry info into a dentry block based on given index
- *    INPUTS: inode -- file inode to read
- *            offset -- offset to start reading from
- *            buf -- output buffer to write file data to
- *            nbytes -- number of bytes to read from file
- *    OUTPUTS: number of bytes read
- *    SIDE EFFECTS: buf holds file data
- *    NOTES: See Appendix A
+ * bootfs_super
+ *    DESCRIPTION: Gives the boot image's super block
+ *    INPUTS: none
+ *    OUTPUTS: The super block, to mount at /
+ *    SIDE EFFECTS: none
+ *    NOTES: Call after init_filesystem
  */
-int32_t read_file(int32_t fd, void* buf, int32_t nbytes){
-    uint32_t inode, offset;
-    pcb_t* pcb=(pcb_t*)(tss.esp0  & 0xFFFFE000); //place holder until we figure out how to initialize pcb
-    
-    offset=pcb->fda[fd].file_pos;
-    inode=pcb->fda[fd].inode;
+super_block_t* bootfs_super(void){
+    return &root_fs.sb;
+}
+
+/*  
+ * bootfs_lookup
+ *    DESCRIPTION: super_ops_t lookup, finds a name in one of the boot image's directories
+ *    INPUTS: sb -- the boot image, dir -- BOOTFS_ROOT or a directory inode, name -- file name
+ *    OUTPUTS: node -- the file, "." is the directory itself and ftype 0 entries are devices
+ *    RETURN VALUE: 0 on success, -1 if the name isn't there (or is a device with no driver)
+ *    SIDE EFFECTS: none
+ */
+static int32_t bootfs_lookup(super_block_t* sb, uint32_t dir, const uint8_t* name, vfs_node_t* node){
+    bootfs_t* fs=sb->priv;
+    dentry_t dentry;
 
+    if(dir_find(fs,dir,name,strlen((const int8_t*)name),&dentry)==-1)
+        return -1;
 
-    pcb->fda[fd].file_pos+=nbytes;  //update file position for next file
-    return read_data(inode, offset, (uint8_t*)buf, nbytes);
+    node->type=dentry.ftype;
+    node->ino=dentry.inode;
+    if(dentry.ftype==VFS_TYPE_DIR){     //the root is always BOOTFS_ROOT
+        node->ino=dir_of(fs,&dentry);
+    }
+    else if(dentry.ftype==VFS_TYPE_DEV){    //device entries get their driver from devfs
+        node->fops=devfs_find(name);
+        if(node->fops==NULL)
+            return -1;
+    }
+    else if(dentry.ftype!=VFS_TYPE_FILE){
+        return -1;
+    }
+    return 0;
 }
 
 /*  
- * write_file
- *    DESCRIPTION: Does nothing due to read-only file system
- *    INPUTS: none
- *    OUTPUTS: Always -1
+ * bootfs_read
+ *    DESCRIPTION: super_ops_t read, reads a file's data blocks
+ *    INPUTS: sb -- the boot image, ino -- inode number, offset -- where to start,
+ *            buf -- where to copy to, len -- most bytes to copy
+ *    OUTPUTS: fills buf
+ *    RETURN VALUE: Bytes read, 0 at the end of the file
  *    SIDE EFFECTS: none
- *    NOTES: See Appendix A
  */
-int32_t write_file(int32_t fd, const void* buf, int32_t nbytes){
-    return -1;          //file system is read-only so writing always fails
+static int32_t bootfs_read(super_block_t* sb, uint32_t ino, uint32_t offset, uint8_t* buf, uint32_t len){
+    bootfs_t* fs=sb->priv;
+    shadow_inode_t* shadow;
+    uint32_t flags;
+
+    if(fs->shadows==NULL || ino>=fs->boot.num_inodes || fs->shadows[ino]==NULL)   //untouched files read straight from the image
+        return image_read(fs, ino, offset, buf, len);
+
+    cli_and_save(flags);
+    shadow=fs->shadows[ino];
+    if(offset>=shadow->file_size){
+        len=0;
+    }
+    else{
+        if(len>shadow->file_size-offset)
+            len=shadow->file_size-offset;
+        shadow_copy(fs, shadow, ino, offset, buf, len, 0);
+    }
+    restore_flags(flags);
+    return len;
 }
 
 /*  
- * open_file
- *    DESCRIPTION: Does nothing for now
- *    INPUTS: filename -- pointer to file
- *    OUTPUTS: Always 0
+ * bootfs_readdir
+ *    DESCRIPTION: super_ops_t readdir, names the first directory entry at or after a position
+ *    INPUTS: sb -- the boot image, dir -- BOOTFS_ROOT or a directory inode, index -- position
+ *    OUTPUTS: name -- FNAME_LENGTH bytes of name, node -- the entry's inode and type (and driver
+ *             for devices, NULL if there's none)
+ *    RETURN VALUE: Position after the entry, -1 past the last entry
  *    SIDE EFFECTS: none
- *    NOTES: See Appendix A
  */
-int32_t open_file(const uint8_t* filename){
-    return 0;           //always success, no need to check for name validity
+static int32_t bootfs_readdir(super_block_t* sb, uint32_t dir, uint32_t index, uint8_t* name, vfs_node_t* node){
+    bootfs_t* fs=sb->priv;
+    dentry_t dentry;
+    uint8_t dev_name[FNAME_LENGTH+1];
+    int32_t next=dir_entry(fs,dir,index,&dentry);
+
+    if(next==-1)
+        return -1;
+
+    memcpy(name, dentry.fname, FNAME_LENGTH);
+    node->type=dentry.ftype;
+    node->ino=dentry.inode;
+    if(dentry.ftype==VFS_TYPE_DIR){
+        node->ino=dir_of(fs,&dentry);
+    }
+    else if(dentry.ftype==VFS_TYPE_DEV){
+        memcpy(dev_name, dentry.fname, FNAME_LENGTH);
+        dev_name[FNAME_LENGTH]='\0';
+        node->fops=devfs_find(dev_name);
+    }
+    return next;
 }
 
 /*  
- * close_file
- *    DESCRIPTION: Does nothing for now
- *    INPUTS: fd -- file descriptor
- *    OUTPUTS: Always 0
+ * dir_find
+ *    DESCRIPTION: Looks a name up in a directory of either format
+ *    INPUTS: dir -- BOOTFS_ROOT or a directory inode, name -- the name (not NUL-terminated),
+ *            len -- its length, at most FNAME_LENGTH
+ *    OUTPUTS: dentry -- the entry
+ *    RETURN VALUE: 0 on success, -1 if the name isn't there or dir isn't a directory
  *    SIDE EFFECTS: none
- *    NOTES: See Appendix A
  */
-int32_t close_file (int32_t fd){
-    return 0;           //closing is always successful
+static int32_t dir_find(bootfs_t* fs, uint32_t dir, const uint8_t* name, uint32_t len, dentry_t* dentry){
+    dentry_t* entry;
+    dentry_t slot_entry;
+    uint32_t ino, slots, slot, i;
+
+    if(fs->boot.magic!=FS_EXT_MAGIC){      //Appendix A: scan the boot block
+        if(dir!=BOOTFS_ROOT)
+            return -1;
+        for(i=0;i<fs->boot.num_dentries;i++){
+            entry=&fs->boot.dentries[i];
+            if(!strncmp((int8_t*)entry->fname,(const int8_t*)name,len) && (len==FNAME_LENGTH || entry->fname[len]=='\0')){
+                *dentry=*entry;
+                return 0;
+            }
+        }
+        return -1;
+    }
+
+    slots=dir_slots(fs,dir,&ino);
+    if(slots==0)
+        return -1;
+
+    /*probe from the name's slot until it turns up or a free slot says it isn't there*/
+    slot=name_hash(name,len)&(slots-1);
+    for(i=0;i<slots;i++){
+        entry=&slot_entry;
+        if(dir_read_slot(fs,ino,slot,entry)==-1 || entry->fname[0]=='\0')
+            return -1;
+        if(!strncmp((int8_t*)entry->fname,(const int8_t*)name,len) && (len==FNAME_LENGTH || entry->fname[len]=='\0')){
+            *dentry=*entry;
+            return 0;
+        }
+        slot=(slot+1)&(slots-1);
+    }
+    return -1;
 }
 
 /*  
- * read_dir
- *    DESCRIPTION: Reads all file names into the buf
- *    INPUTS: fd -- file descriptor
- *            buf -- ptr to buffer to write to
- *            nbytes -- number of bytes to read
- *    OUTPUTS: returns number of bytes read
- *    SIDE EFFECTS: writes file names to buf
- *    NOTES: See Appendix A
+ * dir_entry
+ *    DESCRIPTION: Finds the first entry of a directory at or after a position
+ *    INPUTS: dir -- BOOTFS_ROOT or a directory inode, pos -- where to start (0 for the first)
+ *    OUTPUTS: dentry -- the entry
+ *    RETURN VALUE: Position to pass for the next entry, -1 past the last one
+ *    SIDE EFFECTS: none
+ *    NOTES: Positions are boot block indexes or hash table slots, free slots are skipped
  */
-int32_t read_dir(int32_t fd, void* buf, int32_t nbytes){
-    pcb_t* pcb=(pcb_t*)(tss.esp0  & 0xFFFFE000); //place holder until we figure out how to initialize pcb
-    
-    dentry_t dentry;
-    uint32_t position;
-    int32_t valid;
-    
-    position=pcb->fda[fd].file_pos;                     //initializes file position
-    valid = read_dentry_by_index(position, &dentry);   //checks whether copying over is valid
-    
-    if(buf==NULL || position>=MAX_DENTRY || valid == -1)       //check for null pointer
+static int32_t dir_entry(bootfs_t* fs, uint32_t dir, uint32_t pos, dentry_t* dentry){
+    uint32_t ino, slots;
+
+    if(fs->boot.magic!=FS_EXT_MAGIC){
+        if(dir!=BOOTFS_ROOT || pos>=fs->boot.num_dentries)
+            return -1;
+        *dentry=fs->boot.dentries[pos];
+        return pos+1;
+    }
+
+    slots=dir_slots(fs,dir,&ino);
+    for(; pos<slots; pos++){
+        if(dir_read_slot(fs,ino,pos,dentry)==-1)
+            return -1;
+        if(dentry->fname[0]!='\0')
+            return pos+1;
+    }
+    return -1;
+}
+
+/*  
+ * dir_slots
+ *    DESCRIPTION: Sizes an extended format directory's hash table
+ *    INPUTS: dir -- BOOTFS_ROOT or a directory inode
+ *    OUTPUTS: ino -- the directory's inode
+ *    RETURN VALUE: Number of slots, 0 if dir isn't a well-formed directory
+ *    SIDE EFFECTS: none
+ */
+static uint32_t dir_slots(bootfs_t* fs, uint32_t dir, uint32_t* ino){
+    int32_t size;
+    uint32_t slots;
+
+    *ino=(dir==BOOTFS_ROOT) ? fs->boot.root_inode : dir;
+    size=inode_size(fs, *ino);
+    if(size==-1)
         return 0;
-    
-    position+=1;
-    pcb->fda[fd].file_pos=position;             //update next position in file descriptor array
-    memcpy(buf, (const void*)dentry.fname, FNAME_LENGTH);   //copies over file name into buf
-    return nbytes;
-    
+    slots=size/sizeof(dentry_t);
+    if(slots==0 || (slots&(slots-1)) || slots>MAX_FILE_BLOCKS*DIR_ENTRIES_PER_BLOCK)
+        return 0;
+    return slots;
+}
+
+/*  
+ * dir_read_slot
+ *    DESCRIPTION: Reads a slot of an extended format directory
+ *    INPUTS: ino -- the directory's inode, slot -- slot number (below dir_slots)
+ *    OUTPUTS: dentry -- the slot, an empty name if it's free
+ *    RETURN VALUE: 0 on success, -1 if the directory's block can't be read
+ *    SIDE EFFECTS: none
+ */
+static int32_t dir_read_slot(bootfs_t* fs, uint32_t ino, uint32_t slot, dentry_t* dentry){
+    if(image_read(fs, ino, slot*sizeof(dentry_t), (uint8_t*)dentry, sizeof(dentry_t))!=sizeof(dentry_t))
+        return -1;
+    return 0;
+}
+
+/*  
+ * dir_of
+ *    DESCRIPTION: Gives the number the VFS and dir_find use for a directory entry's directory
+ *    INPUTS: dentry -- an entry with ftype VFS_TYPE_DIR
+ *    OUTPUTS: BOOTFS_ROOT for the root (every directory in the Appendix A format), its inode otherwise
+ *    SIDE EFFECTS: none
+ */
+static uint32_t dir_of(bootfs_t* fs, const dentry_t* dentry){
+    if(fs->boot.magic!=FS_EXT_MAGIC || dentry->inode==fs->boot.root_inode)
+        return BOOTFS_ROOT;
+    return dentry->inode;
+}
+
+/*  
+ * bootfs_size
+ *    DESCRIPTION: super_ops_t size, gives a file's length from its inode
+ *    INPUTS: sb -- the boot image, ino -- inode number
+ *    OUTPUTS: none
+ *    RETURN VALUE: Length in bytes, -1 for a bad inode number
+ *    SIDE EFFECTS: none
+ */
+static int32_t bootfs_size(super_block_t* sb, uint32_t ino){
+    bootfs_t* fs=sb->priv;
+    if(ino >= fs->boot.num_inodes)
+        return -1;
+    if(fs->shadows!=NULL && fs->shadows[ino]!=NULL)
+        return fs->shadows[ino]->file_size;
+    return inode_size(fs, ino);
 }
 
 /*  
- * write_dir
- *    DESCRIPTION: Does nothing for now
+ * bootfs_enable_overlay
+ *    DESCRIPTION: Turns on overlay mode, making the boot image's files writable
  *    INPUTS: none
- *    OUTPUTS: Always -1
+ *    OUTPUTS: 0 on success (or if it was already on), -1 if out of memory
+ *    SIDE EFFECTS: Only allocates the table of shadow pointers, blocks are copied as they're written
+ *    NOTES: Call after init_filesystem
+ */
+int32_t bootfs_enable_overlay(void){
+    bootfs_t* fs=&root_fs;
+    if(fs->shadows!=NULL)
+        return 0;
+
+    fs->shadows=kmalloc(fs->boot.num_inodes*sizeof(shadow_inode_t*));
+    if(fs->shadows==NULL)
+        return -1;
+    memset(fs->shadows, 0, fs->boot.num_inodes*sizeof(shadow_inode_t*));
+    fs->sb.ops=&bootfs_overlay_ops;
+    return 0;
+}
+
+/*  
+ * bootfs_write
+ *    DESCRIPTION: super_ops_t write in overlay mode, copies touched blocks to RAM and writes there
+ *    INPUTS: sb -- the boot image, ino -- inode number, offset -- where to start,
+ *            buf -- data, len -- bytes to write
+ *    OUTPUTS: Bytes written (fewer if memory runs out or the file hits MAX_FILE_BLOCKS),
+ *             -1 if nothing could be written
+ *    SIDE EFFECTS: Writing past the end zero-fills the gap, the image itself is never changed
+ */
+static int32_t bootfs_write(super_block_t* sb, uint32_t ino, uint32_t offset, const uint8_t* buf, uint32_t len){
+    bootfs_t* fs=sb->priv;
+    shadow_inode_t* shadow;
+    uint32_t flags, end;
+    int32_t written;
+
+    if(len==0)
+        return 0;
+    if(offset>=MAX_FILE_BLOCKS*BLOCK_SIZE)
+        return -1;
+    if(len>MAX_FILE_BLOCKS*BLOCK_SIZE-offset)
+        len=MAX_FILE_BLOCKS*BLOCK_SIZE-offset;
+
+    cli_and_save(flags);
+    shadow=shadow_get(fs, ino);
+    if(shadow==NULL){
+        restore_flags(flags);
+        return -1;
+    }
+
+    if(offset>shadow->file_size){       //fill the gap first, so a failure leaves the size alone
+        end=shadow->file_size+shadow_copy(fs, shadow, ino, shadow->file_size, NULL, offset-shadow->file_size, 1);
+        if(end>shadow->file_size)
+            shadow->file_size=end;
+        if(end<offset){
+            restore_flags(flags);
+            return -1;
+        }
+    }
+
+    written=shadow_copy(fs, shadow, ino, offset, (uint8_t*)buf, len, 1);
+    if(offset+written>shadow->file_size)
+        shadow->file_size=offset+written;
+    restore_flags(flags);
+    return written==0 ? -1 : written;
+}
+
+/*  
+ * bootfs_truncate
+ *    DESCRIPTION: super_ops_t truncate in overlay mode, sets a file's length
+ *    INPUTS: sb -- the boot image, ino -- inode number, size -- new length
+ *    OUTPUTS: 0 on success, -1 if size is too big or memory runs out
+ *    SIDE EFFECTS: Shrinking frees the RAM copies of blocks past the new end, growing adds zeros
+ */
+static int32_t bootfs_truncate(super_block_t* sb, uint32_t ino, uint32_t size){
+    bootfs_t* fs=sb->priv;
+    shadow_inode_t* shadow;
+    uint32_t flags, i, end;
+
+    if(size>MAX_FILE_BLOCKS*BLOCK_SIZE)
+        return -1;
+
+    cli_and_save(flags);
+    shadow=shadow_get(fs, ino);
+    if(shadow==NULL){
+        restore_flags(flags);
+        return -1;
+    }
+
+    if(size>shadow->file_size){
+        end=shadow->file_size+shadow_copy(fs, shadow, ino, shadow->file_size, NULL, size-shadow->file_size, 1);
+        shadow->file_size=end;
+        restore_flags(flags);
+        return end==size ? 0 : -1;
+    }
+
+    for(i=(size+BLOCK_SIZE-1)/BLOCK_SIZE; i<MAX_FILE_BLOCKS; i++){     //blocks past the end go back to the frame pool
+        if(shadow->block[i]!=0){
+            frame_free(shadow->block[i], 1);
+            shadow->block[i]=0;
+        }
+    }
+    shadow->file_size=size;
+    restore_flags(flags);
+    return 0;
+}
+
+/*  
+ * shadow_get
+ *    DESCRIPTION: Finds or makes an inode's shadow, call with interrupts off
+ *    INPUTS: ino -- inode number
+ *    OUTPUTS: The shadow, NULL for a bad inode number or if out of memory
+ *    SIDE EFFECTS: A new shadow has the image's size and no blocks of its own
+ */
+static shadow_inode_t* shadow_get(bootfs_t* fs, uint32_t ino){
+    shadow_inode_t* shadow;
+
+    if(ino>=fs->boot.num_inodes)
+        return NULL;
+    if(fs->shadows[ino]!=NULL)
+        return fs->shadows[ino];
+
+    shadow=(shadow_inode_t*)frame_alloc(1, 1);
+    if(shadow==NULL)
+        return NULL;
+    memset(shadow, 0, sizeof(shadow_inode_t));
+    shadow->file_size=inode_size(fs, ino);
+    fs->shadows[ino]=shadow;
+    return shadow;
+}
+
+/*  
+ * shadow_copy
+ *    DESCRIPTION: Copies between a buffer and a shadowed file's blocks, call with interrupts off
+ *    INPUTS: shadow -- the file's shadow, ino -- its inode number, offset -- where to start,
+ *            buf -- the other side (NULL to write zeros), len -- bytes to copy,
+ *            write -- 1 to copy buf into the file, 0 to copy the file into buf
+ *    OUTPUTS: Bytes copied, short on a write if a block can't be allocated
+ *    SIDE EFFECTS: Writing a block still in the image copies it to a new frame first (blocks wholly
+ *                  past the end aren't copied, nothing there is ever read)
+ */
+static int32_t shadow_copy(bootfs_t* fs, shadow_inode_t* shadow, uint32_t ino, uint32_t offset, uint8_t* buf, uint32_t len, int32_t write){
+    uint32_t block, start, chunk, copied, done=0;
+    uint8_t* data;
+
+    while(done<len){
+        block=(offset+done)/BLOCK_SIZE;
+        start=(offset+done)%BLOCK_SIZE;
+        chunk=BLOCK_SIZE-start;
+        if(chunk>len-done)
+            chunk=len-done;
+
+        if(shadow->block[block]!=0){
+            data=(uint8_t*)shadow->block[block];
+        }
+        else if(!write){    //still in the image, bytes past the image's end were never written
+            copied=image_read(fs, ino, offset+done, buf+done, chunk);
+            memset(buf+done+copied, 0, chunk-copied);
+            done+=chunk;
+            continue;
+        }
+        else{
+            data=(uint8_t*)frame_alloc(1, 1);
+            if(data==NULL)
+                break;
+            if(block*BLOCK_SIZE<shadow->file_size)
+                image_read(fs, ino, block*BLOCK_SIZE, data, BLOCK_SIZE);
+            shadow->block[block]=(uint32_t)data;
+        }
+
+        if(!write)
+            memcpy(buf+done, data+start, chunk);
+        else if(buf!=NULL)
+            memcpy(data+start, buf+done, chunk);
+        else
+            memset(data+start, 0, chunk);
+        done+=chunk;
+    }
+    return done;
+}
+
+/*  
+ * name_hash
+ *    DESCRIPTION: FNV-1a hash of a name that may not be NUL-terminated
+ *    INPUTS: name -- the name, len -- its length
+ *    OUTPUTS: The hash
  *    SIDE EFFECTS: none
- *    NOTES: See Appendix A
  */
-int32_t write_dir(int32_t fd, const void* buf, int32_t nbytes){
-    return -1;          //file system is read-only so writing always fails
+static uint32_t name_hash(const uint8_t* name, uint32_t len){
+    uint32_t hash=2166136261U;      //FNV offset basis
+    uint32_t i;
+
+    for(i=0;i<len;i++){
+        hash^=name[i];
+        hash*=16777619;             //FNV prime
+    }
+    return hash;
 }
 
 /*  
- * open_dir
- *    DESCRIPTION: Does nothing for now
- *    INPUTS: dirname -- pointer to directory
- *    OUTPUTS: Always 0
+ * shadows_drop
+ *    DESCRIPTION: Frees every shadow and the RAM copies of blocks, for when the image changes
+ *    INPUTS: num_inodes -- inodes of the image the fs->shadows belong to
+ *    OUTPUTS: none
+ *    SIDE EFFECTS: Turns overlay mode off
+ */
+static void shadows_drop(bootfs_t* fs, uint32_t num_inodes){
+    uint32_t i, j;
+
+    if(fs->shadows==NULL)
+        return;
+
+    for(i=0;i<num_inodes;i++){
+        if(fs->shadows[i]==NULL)
+            continue;
+        for(j=0;j<MAX_FILE_BLOCKS;j++){
+            if(fs->shadows[i]->block[j]!=0)
+                frame_free(fs->shadows[i]->block[j], 1);
+        }
+        frame_free((uint32_t)fs->shadows[i], 1);
+    }
+    kfree(fs->shadows);
+    fs->shadows=NULL;
+    fs->sb.ops=&bootfs_ops;
+}
+
+/*  
+ * bootfs_readahead
+ *    DESCRIPTION: super_ops_t readahead, starts reading part of a file into the block cache
+ *    INPUTS: sb -- the boot image, ino -- inode number, offset -- where the part starts,
+ *            len -- its length
+ *    OUTPUTS: none
+ *    SIDE EFFECTS: Only reads the image's blocks, whatever overlay mode has copied is left alone
+ */
+static void bootfs_readahead(super_block_t* sb, uint32_t ino, uint32_t offset, uint32_t len){
+    bootfs_t* fs=sb->priv;
+    inode_t* inode;
+    buffer_t* inode_buf;
+    uint32_t block, last;
+
+    inode=inode_get(fs, ino, &inode_buf);
+    if(inode==NULL)
+        return;
+
+    if(len>0 && offset<inode->file_size){
+        if(len>inode->file_size-offset)
+            len=inode->file_size-offset;
+        last=(offset+len-1)/BLOCK_SIZE;
+        for(block=offset/BLOCK_SIZE; block<=last && block<MAX_FILE_BLOCKS; block++){
+            if(inode->index_num[block]<fs->boot.num_data_blocks)
+                bcache_readahead(fs->dev, DATA_BLOCK(fs,inode->index_num[block]));
+        }
+    }
+    bcache_put(inode_buf);
+}
+
+/*  
+ * bootfs_map
+ *    DESCRIPTION: super_ops_t map, lends out the block cache's frame holding a page of a file
+ *    INPUTS: sb -- the boot image, ino -- inode number, page -- page (data block) of the file
+ *    OUTPUTS: The frame with a reference for the caller, 0 if the page has to be copied: the
+ *             file has an overlay shadow, or the page is the last partial block (so the rest of
+ *             a mapped page reads as zeros) or past the end
+ *    SIDE EFFECTS: Reads the block into the cache. The cache won't reuse a frame someone else
+ *                  holds, so the mapping keeps seeing this block
+ */
+static uint32_t bootfs_map(super_block_t* sb, uint32_t ino, uint32_t page){
+    bootfs_t* fs=sb->priv;
+    inode_t* inode;
+    buffer_t* inode_buf;
+    buffer_t* data_buf;
+    uint32_t index, frame=0;
+
+    if(fs->shadows!=NULL && ino<fs->boot.num_inodes && fs->shadows[ino]!=NULL)
+        return 0;
+    inode=inode_get(fs, ino, &inode_buf);
+    if(inode==NULL)
+        return 0;
+
+    if(page<MAX_FILE_BLOCKS && inode->file_size/BLOCK_SIZE>page){
+        index=inode->index_num[page];
+        if(index<fs->boot.num_data_blocks && (data_buf=bcache_get(fs->dev, DATA_BLOCK(fs,index)))!=NULL){
+            frame=(uint32_t)data_buf->data;
+            frame_get(frame);
+            bcache_put(data_buf);
+        }
+    }
+    bcache_put(inode_buf);
+    return frame;
+}
+
+/*  
+ * inode_get
+ *    DESCRIPTION: Reads an inode through the block cache
+ *    INPUTS: ino -- inode number
+ *    OUTPUTS: buf -- the cache buffer holding it, bcache_put it when done
+ *    RETURN VALUE: The inode (in buf), NULL for a bad inode number or if it can't be read
  *    SIDE EFFECTS: none
- *    NOTES: See Appendix A
  */
-int32_t open_dir(const uint8_t* dirname){
-    return 0;           //always success, no need to check for name validity
+static inode_t* inode_get(bootfs_t* fs, uint32_t ino, buffer_t** buf){
+    if(ino>=fs->boot.num_inodes)
+        return NULL;
+    *buf=bcache_get(fs->dev, 1+ino);     //inodes start one block (4KB) after start/boot
+    if(*buf==NULL)
+        return NULL;
+    return (inode_t*)(*buf)->data;
 }
 
 /*  
- * close_dir
- *    DESCRIPTION: Does nothing for now
- *    INPUTS: fd -- file descriptor
- *    OUTPUTS: Always 0
+ * inode_size
+ *    DESCRIPTION: Gives the length the image has for a file
+ *    INPUTS: ino -- inode number
+ *    OUTPUTS: Length in bytes, -1 for a bad inode number or if it can't be read
  *    SIDE EFFECTS: none
- *    NOTES: See Appendix A
  */
-int32_t close_dir (int32_t fd){
-    return 0;           //closing is always successful
+static int32_t inode_size(bootfs_t* fs, uint32_t ino){
+    inode_t* inode;
+    buffer_t* buf;
+    int32_t size;
+
+    inode=inode_get(fs, ino, &buf);
+    if(inode==NULL)
+        return -1;
+    size=inode->file_size;
+    bcache_put(buf);
+    return size;
 }
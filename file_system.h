@@ -6,6 +6,10 @@
 #define BLOCK_SIZE 4096         //file system memory is divided into 4KB blocks
 #define FNAME_LENGTH  32        //file name limit is 32 characters 
 #define MAX_DENTRY 64
+#define MAX_FILE_BLOCKS 1023   //index_num entries in an inode, the most blocks a file can have
+#define BOOTFS_ROOT 0xFFFFFFFF  //inode number the VFS uses for the boot image's root directory
+#define FS_EXT_MAGIC 0x52494448 //"HDIR", marks an image whose directories are inodes (see file_system.c)
+#define DIR_ENTRIES_PER_BLOCK (BLOCK_SIZE/sizeof(dentry_t))
 
 typedef struct{ 
     uint8_t block[BLOCK_SIZE];    
@@ -23,41 +27,55 @@ typedef struct{
     uint8_t reserved[24]; //24B reserved in dir entries, Appendix A
 }dentry_t;
 
+/*copy-on-write view of an inode once overlay mode has written to it (exactly one 4KB frame)*/
+typedef struct{
+    uint32_t file_size;
+    uint32_t block[MAX_FILE_BLOCKS];    //RAM copy of each data block, 0 while the image's own block is used
+}shadow_inode_t;
+
 /*first block in file system memory*/
 typedef struct{
     uint32_t num_dentries;
     uint32_t num_inodes;
     uint32_t num_data_blocks;
-    uint8_t reserved[52];   //52B reserved in boot block, Appendix A
+    uint32_t magic;         //FS_EXT_MAGIC in the extended format (reserved and 0 in the Appendix A format)
+    uint32_t root_inode;    //extended format: inode of the root directory
+    uint8_t reserved[44];   //44B still reserved in boot block, 52B in Appendix A
     dentry_t dentries[63]; //64B dir entries in boot block, Appendix A
 }boot_block_t;
 
 
-/*global variables that will keep track of entire file system structure*/
-data_block_t* fs_data_block;
-inode_t* fs_inode;
+/*global variables that will keep track of entire file system structure (inodes and data blocks are read through the block cache)*/
 boot_block_t* boot;       
 dentry_t* fs_dentry;       
 
-//initializes filesystem based off start pointer
+struct block_dev;
+struct super_block;
+
+//initializes filesystem based off start pointer (the boot module)
 extern void init_filesystem(uint32_t start);
 
+//switches the file system to the image on a block device, 0 on success and -1 for a bad image
+extern int32_t mount_filesystem(struct block_dev* dev);
+
+//device the file system is read from
+extern struct block_dev* fs_device(void);
+
+//read-only file system of the image on another block device, NULL if it isn't a good image
+extern struct super_block* bootfs_mount(struct block_dev* dev);
+
 /*these file system functions are specified in Appendix A*/
 extern int32_t read_dentry_by_name(const uint8_t* fname, dentry_t* dentry);
 extern int32_t read_dentry_by_index(uint32_t index, dentry_t* dentry);
 extern int32_t read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length);
 
-/*required system call functions from Appendix B for files and directories*/
-// extern int32_t read_file(int32_t fd, void* buf, int32_t nbytes);         //format cant be used for cp2 bc of fd
-extern int32_t read_file(int32_t fd, void* buf, int32_t nbytes);
-extern int32_t write_file(int32_t fd, const void* buf, int32_t nbytes);
-extern int32_t open_file(const uint8_t* filename);
-extern int32_t close_file (int32_t fd);
-
-// extern int32_t read_dir(int32_t fd, void* buf, int32_t nbytes);          //format cant be used for cp2 bc of fd
-extern int32_t read_dir(int32_t fd, void* buf, int32_t nbytes);
-extern int32_t write_dir(int32_t fd, const void* buf, int32_t nbytes);
-extern int32_t open_dir(const uint8_t* dirname);
-extern int32_t close_dir (int32_t fd);
+//hash of a file name, picks its first slot in an extended format directory (tools/mkfs.c has a copy)
+extern uint32_t fs_name_hash(const uint8_t* name);
+
+/*the boot image as a file system for the VFS (files are read through vfs.c's fops)*/
+extern struct super_block* bootfs_super(void);
+
+//makes the boot image writable, changed blocks are copied to RAM and the image is never modified
+extern int32_t bootfs_enable_overlay(void);
 
 #endif /* _FILE_SYSTEM_H */
@@ -0,0 +1,186 @@
+/* frame.c - Physical page frame allocator
+ * vim:ts=4 noexpandtab
+ */
+
+#include "frame.h"
+#include "lib.h"
+
+/* NOTES: One bit per 4KB frame below FRAME_MEM_LIMIT (1 = in use), plus a reference count
+          per frame so pages can later be shared between address spaces. Physical memory
+          below 128MB is identity mapped by init_paging, so a frame's physical address is
+          also the address the kernel uses to touch it. */
+
+static uint32_t frame_bitmap[MAX_FRAMES / 32];
+static uint16_t frame_refs[MAX_FRAMES];
+static uint32_t frame_count;        // Frames that exist (memory size / 4KB, capped at MAX_FRAMES)
+static uint32_t free_count;
+static uint32_t top_free;           // Highest frame that may be free, where single-frame searches start
+
+#define FRAME_USED(i)       (frame_bitmap[(i) >> 5] & (1 << ((i) & 31)))
+#define FRAME_SET(i)        (frame_bitmap[(i) >> 5] |= (1 << ((i) & 31)))
+#define FRAME_CLEAR(i)      (frame_bitmap[(i) >> 5] &= ~(1 << ((i) & 31)))
+
+/*
+ * init_frames
+ *    DESCRIPTION: Marks every frame from FRAME_POOL_START up to the end of memory as free
+ *    INPUTS: mem_upper -- KB of memory above 1MB as reported by the multiboot loader
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Everything below FRAME_POOL_START (kernel, modules, boot stack) stays reserved
+ */
+void init_frames(uint32_t mem_upper) {
+    uint32_t i;
+
+    frame_count = (mem_upper + ONE_KB) / (FRAME_SIZE / ONE_KB);
+    if(frame_count > MAX_FRAMES)
+        frame_count = MAX_FRAMES;
+
+    // Everything starts reserved, frames that don't exist are never freed
+    memset(frame_bitmap, 0xFF, sizeof(frame_bitmap));
+    memset(frame_refs, 0, sizeof(frame_refs));
+    free_count = 0;
+    for(i = FRAME_POOL_START >> FRAME_SHIFT; i < frame_count; i++) {
+        FRAME_CLEAR(i);
+        free_count++;
+    }
+    top_free = frame_count - 1;
+}
+
+/*
+ * frame_alloc
+ *    DESCRIPTION: Finds and reserves a run of free frames
+ *    INPUTS: npages -- number of contiguous frames wanted
+ *            align_pages -- the first frame's index must be a multiple of this (power of 2, 0 or 1 = any)
+ *    OUTPUTS: none
+ *    RETURN VALUE: Physical (and kernel virtual) address of the first frame, 0 if none fit
+ *    SIDE EFFECTS: Each returned frame starts with a reference count of 1
+ *    NOTES: Single frames are taken from the top of memory down and runs from the bottom up,
+ *           so slab pages don't break up the 4MB blocks user programs need
+ */
+uint32_t frame_alloc(uint32_t npages, uint32_t align_pages) {
+    uint32_t flags;
+    uint32_t start, i, run;
+
+    if(npages == 0)
+        return 0;
+    if(align_pages == 0)
+        align_pages = 1;
+
+    cli_and_save(flags);
+
+    if(npages == 1 && align_pages == 1) {
+        // Everything above top_free is known to be in use
+        for(i = top_free; i >= (FRAME_POOL_START >> FRAME_SHIFT) && i < frame_count; i--) {
+            // Skip whole words of used frames
+            if((i & 31) == 31 && frame_bitmap[i >> 5] == 0xFFFFFFFF) {
+                i -= 31;
+                continue;
+            }
+            if(!FRAME_USED(i)) {
+                FRAME_SET(i);
+                frame_refs[i] = 1;
+                free_count--;
+                top_free = i - 1;
+                restore_flags(flags);
+                return i << FRAME_SHIFT;
+            }
+        }
+        restore_flags(flags);
+        return 0;
+    }
+
+    start = (FRAME_POOL_START >> FRAME_SHIFT);
+    start = (start + align_pages - 1) & ~(align_pages - 1);
+    while(start + npages <= frame_count) {
+        for(run = 0; run < npages; run++) {
+            if(FRAME_USED(start + run))
+                break;
+        }
+        if(run == npages) {
+            for(i = start; i < start + npages; i++) {
+                FRAME_SET(i);
+                frame_refs[i] = 1;
+            }
+            free_count -= npages;
+            restore_flags(flags);
+            return start << FRAME_SHIFT;
+        }
+        // Restart past the used frame on the next aligned boundary
+        start = (start + run + align_pages) & ~(align_pages - 1);
+    }
+
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+ * frame_free
+ *    DESCRIPTION: Drops one reference to each frame of a run
+ *    INPUTS: addr -- address returned by frame_alloc
+ *            npages -- number of frames in the run
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Frames whose count reaches 0 go back to the free pool
+ */
+void frame_free(uint32_t addr, uint32_t npages) {
+    uint32_t flags;
+    uint32_t i = addr >> FRAME_SHIFT;
+
+    cli_and_save(flags);
+    for(; npages > 0; npages--, i++) {
+        if(i < (FRAME_POOL_START >> FRAME_SHIFT) || i >= frame_count || frame_refs[i] == 0)
+            continue;
+        if(--frame_refs[i] == 0) {
+            FRAME_CLEAR(i);
+            free_count++;
+            if(i > top_free)
+                top_free = i;
+        }
+    }
+    restore_flags(flags);
+}
+
+/*
+ * frame_get
+ *    DESCRIPTION: Takes another reference to an allocated frame
+ *    INPUTS: addr -- any address inside the frame
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: The frame stays allocated until every holder calls frame_free
+ */
+void frame_get(uint32_t addr) {
+    uint32_t flags;
+    uint32_t i = addr >> FRAME_SHIFT;
+
+    cli_and_save(flags);
+    if(i < frame_count && frame_refs[i] != 0)
+        frame_refs[i]++;
+    restore_flags(flags);
+}
+
+/*
+ * frame_refcount
+ *    DESCRIPTION: Returns how many holders a frame has
+ *    INPUTS: addr -- any address inside the frame
+ *    OUTPUTS: none
+ *    RETURN VALUE: Reference count, 0 for free or reserved frames
+ *    SIDE EFFECTS: none
+ */
+uint32_t frame_refcount(uint32_t addr) {
+    uint32_t i = addr >> FRAME_SHIFT;
+
+    if(i >= frame_count)
+        return 0;
+    return frame_refs[i];
+}
+
+/*
+ * frames_free
+ *    DESCRIPTION: Returns the number of frames left in the pool
+ *    INPUTS/OUTPUTS: none
+ *    RETURN VALUE: Free frame count
+ *    SIDE EFFECTS: none
+ */
+uint32_t frames_free(void) {
+    return free_count;
+}
@@ -0,0 +1,37 @@
+/* frame.h - Physical page frame allocator
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _FRAME_H
+#define _FRAME_H
+
+#include "types.h"
+#include "x86_desc.h"
+
+#define FRAME_SIZE          FOUR_KB
+#define FRAME_SHIFT         12
+#define FRAME_MEM_LIMIT     ONE_TWO_EIGHT_MB                    // Only memory below 128MB is identity mapped for the kernel
+#define MAX_FRAMES          (FRAME_MEM_LIMIT / FRAME_SIZE)
+
+// Frames handed out start here, everything below is low memory and the kernel page
+#define FRAME_POOL_START    EIGHT_MB
+
+// Sets up the frame bitmap from the amount of memory the bootloader reported
+void init_frames(uint32_t mem_upper);
+
+// Allocates npages contiguous frames aligned to align_pages frames, returns their address or 0
+uint32_t frame_alloc(uint32_t npages, uint32_t align_pages);
+
+// Drops one reference to each of npages frames, freeing the ones nobody else holds
+void frame_free(uint32_t addr, uint32_t npages);
+
+// Takes another reference to an already allocated frame
+void frame_get(uint32_t addr);
+
+// Returns how many holders a frame has (0 if free)
+uint32_t frame_refcount(uint32_t addr);
+
+// Returns the number of frames still free
+uint32_t frames_free(void);
+
+#endif /* _FRAME_H */
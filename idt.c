@@ -16,6 +16,11 @@
 
 #include "system_calls.h"
 
+#include "paging.h"
+#include "signal.h"
+#include "scheduler.h"
+#include "aio.h"
+
 
 /*
 * enter all relevant exceptions into IDT table
@@ -101,9 +106,23 @@ void init_IDT(){
     exception_flag = 0;
 }
 
-// Handles interrupt (print error message and other relevant items like regs)
-// Is stack trace required?
-void exception_handler(int32_t interrupt_vector){
+/*
+ * exception_handler
+ *    DESCRIPTION: Handles exceptions 0-19 except page faults
+ *    INPUTS: interrupt_vector -- 0xFFFFFFFF minus the exception number (see asm_linkage.S)
+ *            cs -- code segment of the faulting code
+ *    OUTPUTS: none
+ *    SIDE EFFECTS: Exceptions in user code the process has a signal handler for (DIV_ZERO for
+ *                  divide errors, SEGFAULT for the rest) raise that signal and return to let it
+ *                  run. Anything else prints the exception and halts the process
+ */
+void exception_handler(int32_t interrupt_vector, uint32_t cs){
+    int32_t signum = (interrupt_vector == 0xFFFFFFFF) ? DIV_ZERO : SEGFAULT;
+    if((cs & 0x3) == 0x3 && signal_handled(current_task, signum)) {
+        signal_raise(current_task, signum);
+        return;
+    }
+
     //clear();
     switch(interrupt_vector){
         case 0xFFFFFFFF:
@@ -166,6 +185,30 @@ void exception_handler(int32_t interrupt_vector){
     }
 }
 
+/*
+ * page_fault_handler
+ *    DESCRIPTION: Handles exception 14
+ *    INPUTS: error_code -- error code pushed by the CPU
+ *            addr -- faulting address from CR2
+ *            cs -- code segment of the faulting code
+ *    OUTPUTS: none
+ *    SIDE EFFECTS: Returns to retry the access if the user page could be mapped, or to run the
+ *                  process's SEGFAULT handler for a bad user access. An async I/O worker fails
+ *                  its request and ends. Otherwise prints the fault and halts the process like
+ *                  the other exceptions
+ */
+void page_fault_handler(uint32_t error_code, uint32_t addr, uint32_t cs){
+    if(user_page_fault(addr, error_code) == 0)
+        return;
+    if((cs & 0x3) == 0x3 && signal_handled(current_task, SEGFAULT)) {
+        signal_raise(current_task, SEGFAULT);
+        return;
+    }
+    aio_worker_fault();         // A worker isn't a process to halt
+    printf(" Page-Fault Exception at 0x%x\n", addr);
+    halt_wrapper();
+}
+
 /*
  * halt_wrapper
  *    DESCRIPTION: Transitions to the halt syscall and setting exception_flag (Not rly a wrapper)
@@ -18,8 +18,11 @@ volatile int exception_flag;
 // Initializes the IDT
 extern void init_IDT();
 
-// Handles exceptions thrown by the processor
-extern void exception_handler(int32_t interrupt_vector);
+// Handles exceptions thrown by the processor, turning user ones into signals if the process handles them
+extern void exception_handler(int32_t interrupt_vector, uint32_t cs);
+
+// Handles page faults, resolving demand-zero and copy-on-write faults and signalling or killing the process otherwise
+extern void page_fault_handler(uint32_t error_code, uint32_t addr, uint32_t cs);
 
 // Wrapper for the halt system call used by the exceptions
 void halt_wrapper();
@@ -16,6 +16,14 @@
 #include "system_calls.h"
 #include "pit.h"
 #include "terminal.h"
+#include "frame.h"
+#include "kmalloc.h"
+#include "process.h"
+#include "vdso.h"
+#include "file.h"
+#include "vfs.h"
+#include "bcache.h"
+#include "ata.h"
 
 #define RUN_TESTS
 
@@ -28,6 +36,8 @@
 void entry(unsigned long magic, unsigned long addr) {
 
     multiboot_info_t *mbi;
+    uint32_t mem_upper = 0;     // KB of memory above 1MB, handed to the frame allocator
+    super_block_t * disk_sb;    // File system on the second IDE disk
 
     // Initialize multi-terminal
     init_terminal();
@@ -48,8 +58,10 @@ void entry(unsigned long magic, unsigned long addr) {
     printf("flags = 0x%#x\n", (unsigned)mbi->flags);
 
     /* Are mem_* valid? */
-    if (CHECK_FLAG(mbi->flags, 0))
+    if (CHECK_FLAG(mbi->flags, 0)) {
         printf("mem_lower = %uKB, mem_upper = %uKB\n", (unsigned)mbi->mem_lower, (unsigned)mbi->mem_upper);
+        mem_upper = mbi->mem_upper;
+    }
 
     /* Is boot_device valid? */
     if (CHECK_FLAG(mbi->flags, 1))
@@ -163,6 +175,22 @@ void entry(unsigned long magic, unsigned long addr) {
     /* Enable paging */
     init_paging();
 
+    // Initialize page frame allocator and the kernel heap on top of it
+    init_frames(mem_upper);
+    init_kmalloc();
+    init_bcache();                              // File system blocks are read through it from here on
+    init_files();
+    init_vfs();
+    bootfs_enable_overlay();                    // Boot image files are writable, changes stay in RAM
+
+    // A file system image on a second IDE disk (QEMU's -hdb) shows up under /disk
+    if(init_ata() == 0 && (disk_sb = bootfs_mount(ata_device())) != NULL)
+        vfs_mount("/disk", disk_sb);
+    init_processes();
+
+    // Map the vDSO page and set up SYSENTER for fast system calls
+    init_vdso();
+
     // MULTI-TERMINAL INITIALIZATION MOVED TO TOP OF FUNCTION AS PRINTING IS TERMINAL-BASED
     
     // Initialize RTC interrupts
@@ -8,7 +8,18 @@
 #include "x86_desc.h"
 #include "terminal.h"
 #include "i8259.h"
+#include "keymap.h"
 
+// Raw scan codes queued by the keyboard IRQ for the bottom half (free-running indices)
+static volatile uint8_t scan_code_ring[SCAN_CODE_RING_SIZE];
+static volatile uint32_t scan_code_head;
+static volatile uint32_t scan_code_tail;
+
+// Set when an 0xE0 prefix was seen so the next scan code is looked up as an extended key
+static int32_t extended_flag;
+
+// Set while keyboard_bottom_half is draining the ring so nested ticks don't re-enter it
+static volatile int32_t bottom_half_active;
 
 /*
  * init_keyboard
@@ -21,252 +32,150 @@ void init_keyboard(){
 }
 
 /*
- * keyboard_handler
- *    DESCRIPTION: Handler for keyboard interrupts
- *    INPUTS/OUTPUTS: none  
+ * process_scan_code
+ *    DESCRIPTION: Bottom-half processing of one raw scan code (modifiers, hotkeys and translation)
+ *    INPUTS: scan_code -- raw scan code pulled off the scan code ring
+ *    OUTPUTS: none
+ *    NOTES: Runs outside of the keyboard IRQ, so interrupts may be enabled while this runs.
+ *           Translation is a single lookup in the active keymap (see keymap.c)
  */
-void keyboard_handler() {
+static void process_scan_code(int scan_code) {
     /* scan_code stores the hex value of the key that is stored in the keyboard port */
     // Scan code + 0x80 is that key but released/"de-pressed"
-    // ASCII + 0x20 is the lower case of that letter
-    
-    // Index is the scan code, the value at an index is that scan code key's ASCII
-    int scan_code_to_ascii[] = {
-    0, 0x1B, '1', '2', '3', '4', '5', '6', '7', '8',
-    '9', '0', '-', '=', '\b', '\t', 'q', 'w', 'e', 'r',
-    't', 'y', 'u', 'i', 'o', 'p', '[', ']', '\n', 0,
-    'a', 's', 'd', 'f', 'g', 'h', 'j', 'k', 'l', ';',
-    '\'', '`', 0, '\\', 'z', 'x', 'c', 'v', 'b', 'n',
-    'm', ',', '.', '/', 0, '*', 0, ' ', 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, '7', '8', '9', '-', '4', '5', '6', '+', '1',
-    '2', '3', '0', '.', 0, 0, 0, 0, 0
-    };
-
-    int temp_i;   // Temp var used for tab loop index
-
-    // Define alias vars for readability (using visible_terminal as the keyboard only types to visible terminal)
-    char * kb_buf = terminals[visible_terminal].kb_buf;
-    volatile int32_t * kb_buf_i = &terminals[visible_terminal].kb_buf_i;
-    char print_allowed = terminals[visible_terminal].in_terminal_read; // Only allow keyboard to putc if in terminal_read
-
-    // Get scan code from keyboard
-    int scan_code = inb(KEYBOARD_PORT);
+    int32_t released = scan_code & SCAN_CODE_RELEASED;
+    uint8_t make_code = scan_code & ~SCAN_CODE_RELEASED;
+    int32_t extended = extended_flag;
+    uint32_t modifiers = 0;
+
+    // 0xE0 means the next scan code is an extended key (arrows, right ctrl/alt, keypad enter...)
+    if(scan_code == EXTENDED_PREFIX) {
+        extended_flag = 1;
+        return;
+    }
+    extended_flag = 0;
 
-    // Set flags is control character key is pressed
-    switch(scan_code){
+    // Set flags if control character key is pressed or released
+    switch(make_code){
         case LEFT_SHIFT_PRESSED:
-            left_shift_flag = 1;
-            break;
-        case LEFT_SHIFT_RELEASED:
-            left_shift_flag = 0;
-            break;
+            if(!extended)               // E0 2A is a fake shift sent around print screen
+                left_shift_flag = !released;
+            return;
         case RIGHT_SHIFT_PRESSED:
-            right_shift_flag = 1;
-            break;
-        case RIGHT_SHIFT_RELEASED:
-            right_shift_flag = 0;
-            break;
+            if(!extended)
+                right_shift_flag = !released;
+            return;
         case CAPS_LOCK_PRESSED:
-            caps_flag = !caps_flag;
-            break;
-        case LEFT_CTRL_PRESSED:
-            ctrl_flag = 1;
-            break;
-        case LEFT_CTRL_RELEASED:
-            ctrl_flag = 0;
-            break;
-        case LEFT_ALT_PRESSED:
-            alt_flag = 1;
-            break;
-        case LEFT_ALT_RELEASED:
-            alt_flag = 0;
-            break;
-    }
-
-    // Ignore key releases (F4 pressed is 0x3B, any scan codes greater than that are releases)
-    if(scan_code >= 0x3E || scan_code == LEFT_SHIFT_PRESSED || scan_code == RIGHT_SHIFT_PRESSED || scan_code == CAPS_LOCK_PRESSED ||
-        scan_code == LEFT_CTRL_PRESSED || scan_code == LEFT_ALT_PRESSED) {
-        send_eoi(KEYBOARD_IRQ);
-        return;
+            if(!released)
+                caps_flag = !caps_flag;
+            return;
+        case LEFT_CTRL_PRESSED:         // E0 1D is right ctrl
+            if(extended)
+                right_ctrl_flag = !released;
+            else
+                ctrl_flag = !released;
+            return;
+        case LEFT_ALT_PRESSED:          // E0 38 is right alt
+            if(extended)
+                right_alt_flag = !released;
+            else
+                alt_flag = !released;
+            return;
     }
 
-    // Convert scan code to ASCII equivalent
-    char key_pressed = scan_code_to_ascii[scan_code];
-
-    // Backspace pressed: delete prev char if buffer isn't empty, then return from interrupt
-    if(key_pressed == '\b') {
-        if(*kb_buf_i > 0) {
-            (*kb_buf_i)--;
-            if(print_allowed)
-                putc('\b',1);
-        }
-        send_eoi(KEYBOARD_IRQ);
+    // Ignore key releases
+    if(released)
         return;
-    }
-    
-    // If enter pressed, print newline, set enter_flag, and return from interrupt (terminal_read will clear buf)
-    if(key_pressed == '\n') {
-        // If visible_terminal isn't in terminal_read, pressing enter should do nothing 
-        if(!print_allowed) {
-            send_eoi(KEYBOARD_IRQ);
-            return;
-        }
-        kb_buf[*kb_buf_i] = key_pressed;
-        (*kb_buf_i)++;
-        terminals[visible_terminal].kb_enter_flag = 1;
-        if(print_allowed)
-            putc('\n',1);
-        send_eoi(KEYBOARD_IRQ);
-        return;
-    }
 
-    // Ctrl + l and Ctrl + L clears screen and prints keyboard buffer again
-    if(ctrl_flag && (key_pressed == 'l' || key_pressed == 'L')) {
-        clear();
-        if(print_allowed) {
-            for(temp_i = 0; temp_i < *kb_buf_i; temp_i++) {
-                putc((uint8_t)kb_buf[temp_i], 1);
-            }
+    // Case for alt flag for terminal switching (Alt + F1/F2/F3) and cycling layouts (Alt + F12)
+    if((alt_flag || right_alt_flag) && !extended) {
+        switch(make_code) {
+            case TERMINAL_ONE:
+                switch_visible_terminal(0);       //pass in terminal id to switch to
+                return;
+            case TERMINAL_TWO:
+                switch_visible_terminal(1);
+                return;
+            case TERMINAL_THREE:
+                switch_visible_terminal(2);
+                return;
+            case KEYMAP_CYCLE:
+                (void)keymap_next_layout();
+                return;
         }
-        send_eoi(KEYBOARD_IRQ);
-        return;
     }
 
-    // Case for alt flag for terminal switching
-    if(alt_flag) {
-        // Alt + F1
-        if(scan_code==TERMINAL_ONE){    
-            switch_visible_terminal(0);       //pass in terminal id to switch to
-            send_eoi(KEYBOARD_IRQ);
-            return;
-        }
+    // Convert scan code to ASCII (or a KEY_* code) with the active layout
+    if(left_shift_flag || right_shift_flag)
+        modifiers |= MOD_SHIFT;
+    if(caps_flag)
+        modifiers |= MOD_CAPS;
+    if(ctrl_flag || right_ctrl_flag)
+        modifiers |= MOD_CTRL;
+    if(alt_flag || right_alt_flag)
+        modifiers |= MOD_ALT;
+    uint8_t key_pressed = keymap_translate(make_code, extended, modifiers);
+
+    // Hand the key to the visible terminal's line discipline (the keyboard only types to the visible terminal)
+    if(key_pressed != 0)
+        terminal_receive_key(visible_terminal, key_pressed);
+}
 
-        // Alt + F2
-        if(scan_code==TERMINAL_TWO){
-            switch_visible_terminal(1);
-            send_eoi(KEYBOARD_IRQ);
-            return;
-        }
+/*
+ * keyboard_handler
+ *    DESCRIPTION: Top half of the keyboard interrupt, only queues the raw scan code
+ *    INPUTS/OUTPUTS: none  
+ *    NOTES: The scan code ring has a single producer (this IRQ) and a single consumer
+ *           (keyboard_bottom_half), so the free-running head/tail indices need no lock.
+ *           If the ring is full the scan code is dropped.
+ */
+void keyboard_handler() {
+    uint8_t scan_code = inb(KEYBOARD_PORT);
+    uint32_t head = scan_code_head;
 
-        // Alt + F3
-        if(scan_code == TERMINAL_THREE) {
-            switch_visible_terminal(2);
-            send_eoi(KEYBOARD_IRQ);
-            return;
-        }
+    if(head - scan_code_tail < SCAN_CODE_RING_SIZE) {
+        scan_code_ring[head & (SCAN_CODE_RING_SIZE - 1)] = scan_code;
+        scan_code_head = head + 1;
     }
 
-    // Ignore any non-printing chars (placed here as we don't want to overlook terminal switcher)
-    if(key_pressed == 0) {
-        send_eoi(KEYBOARD_IRQ);
-        return;
-    }
+    send_eoi(KEYBOARD_IRQ);         // 0x01 is IRQ number for keyboard
+}
 
-    // If entering a char will overflow either buffer (only buf_size-1 chars + '\n' allowed), ignore the key press
-    if(*kb_buf_i == KEYBOARD_BUF_CHAR_MAX || *kb_buf_i == terminal_buf_n_bytes - 1) {
-        send_eoi(KEYBOARD_IRQ);
-        return;
-    }
+/*
+ * keyboard_pending
+ *    DESCRIPTION: Checks whether the top half has queued scan codes that still need processing
+ *    INPUTS: none
+ *    RETURN VALUE: 1 if scan codes are pending, 0 otherwise
+ */
+int32_t keyboard_pending() {
+    return scan_code_head != scan_code_tail;
+}
 
-    if(key_pressed == '\t') {
-        // Tab = 8 spaces, clipping on overflow
-        for(temp_i = 0; temp_i < 8; temp_i++) {
-            if(*kb_buf_i < KEYBOARD_BUF_CHAR_MAX && *kb_buf_i < terminal_buf_n_bytes - 1) {
-                kb_buf[*kb_buf_i] = ' ';
-                (*kb_buf_i)++;
-                if(print_allowed)
-                    putc(' ',1);
-            }
-            else 
-                break;
-        }
-        send_eoi(KEYBOARD_IRQ);
+/*
+ * keyboard_bottom_half
+ *    DESCRIPTION: Drains the scan code ring, translating each key and feeding it to the terminal
+ *    INPUTS/OUTPUTS: none
+ *    SIDE EFFECTS: Updates the visible terminal's keyboard buffer and screen
+ *    NOTES: Called from the PIT handler with interrupts enabled. A nested tick that finds
+ *           the bottom half already running just leaves the remaining scan codes for it.
+ */
+void keyboard_bottom_half() {
+    uint32_t flags;
+    uint32_t tail;
+
+    cli_and_save(flags);
+    if(bottom_half_active) {
+        restore_flags(flags);
         return;
     }
+    bottom_half_active = 1;
+    restore_flags(flags);
 
-    // Handle caps lock and shift for letter keys (ignored if shift is held by XOR)
-    if((caps_flag ^ (left_shift_flag || right_shift_flag)) && (key_pressed >= 97 && key_pressed <= 122)){
-        key_pressed = key_pressed - 32; // Subtracting letter ASCII by 32 maps to caps
+    while((tail = scan_code_tail) != scan_code_head) {
+        uint8_t scan_code = scan_code_ring[tail & (SCAN_CODE_RING_SIZE - 1)];
+        scan_code_tail = tail + 1;
+        process_scan_code(scan_code);
     }
 
-    // Handle shift for special characters
-    if((left_shift_flag || right_shift_flag)) {
-        // Map special characters
-        switch(key_pressed){
-            case '`':
-                key_pressed = '~';
-                break;
-            case '1':
-                key_pressed = '!';
-                break;
-            case '2':
-                key_pressed = '@';
-                break;
-            case '3':
-                key_pressed = '#';
-                break;
-            case '4':
-                key_pressed = '$';
-                break;
-            case '5':
-                key_pressed = '%';
-                break;
-            case '6':
-                key_pressed = '^';
-                break;
-            case '7':
-                key_pressed = '&';
-                break;
-            case '8':
-                key_pressed = '*';
-                break;
-            case '9':
-                key_pressed = '(';
-                break;
-            case '0':
-                key_pressed = ')';
-                break;
-            case '-':
-                key_pressed = '_';
-                break;
-            case '=':
-                key_pressed = '+';
-                break;
-            case '[':
-                key_pressed = '{';
-                break;
-            case ']':
-                key_pressed = '}';
-                break;
-            case '\\':
-                key_pressed = '|';
-                break;
-            case ';':
-                key_pressed = ':';
-                break;
-            case '\'':
-                key_pressed = '"';
-                break;
-            case ',':
-                key_pressed = '<';
-                break;
-            case '.':
-                key_pressed = '>';
-                break;
-            case '/':
-                key_pressed = '?';
-                break;
-        }
-    }
-    
-    // Put key pressed in buffer and on screen and advance buffer index
-    kb_buf[*kb_buf_i] = key_pressed;
-    (*kb_buf_i)++;  
-    if(print_allowed)
-        putc(key_pressed,1);
-    
-    // Send EOI to PIC
-    send_eoi(KEYBOARD_IRQ);         // 0x01 is IRQ number for keyboard
+    bottom_half_active = 0;
 }
 
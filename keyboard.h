@@ -20,11 +20,17 @@
 #define LEFT_CTRL_RELEASED      0x9D
 #define LEFT_ALT_PRESSED        0x38
 #define LEFT_ALT_RELEASED       0xB8
+#define EXTENDED_PREFIX         0xE0        // Next scan code is an extended (0xE0 xx) key
+#define SCAN_CODE_RELEASED      0x80        // Set in the scan code of a released key
+#define CTRL_L                  0x0C        // Ctrl + L after translation
+#define CTRL_C                  0x03        // Ctrl + C after translation
+#define SCAN_CODE_RING_SIZE     256         // Must be a power of 2 (indices are masked)
 #define KEYBOARD_BUF_SIZE       128
 #define KEYBOARD_BUF_CHAR_MAX   127
 #define TERMINAL_ONE            0x3B
 #define TERMINAL_TWO            0x3C
 #define TERMINAL_THREE          0x3D
+#define KEYMAP_CYCLE            0x58        // F12, Alt + F12 cycles keyboard layouts
 
 //------------------------VARS DEPRECATED IN CP5------------------------------ 
 
@@ -49,14 +55,24 @@ int right_shift_flag;
 
 int ctrl_flag;
 
+int right_ctrl_flag;
+
 int caps_flag;
 
 int alt_flag;
 
+int right_alt_flag;
+
 // Initialize the keyboard by enabling the PIC IRQ
 void init_keyboard();
 
-// Handles Keyboard interrupts
+// Top half of keyboard interrupts, queues the raw scan code
 extern void keyboard_handler();
 
+// Returns 1 if the top half has queued scan codes for the bottom half
+int32_t keyboard_pending();
+
+// Bottom half, translates and echoes queued scan codes outside of the IRQ
+void keyboard_bottom_half();
+
 #endif /* _KEYBOARD_H */
@@ -0,0 +1,115 @@
+/* keymap.c - table-driven scan code to key translation
+ *  vim:ts=4 noexpandtab
+ */
+
+#include "keymap.h"
+
+#define IS_LOWER(c)     ((c) >= 'a' && (c) <= 'z')
+
+/* Each KEY(code, plain, shifted) line of a layout description fills in that
+ * scan code in every layer. Caps lock only affects letters, and ctrl turns a
+ * letter into its control character (ctrl + l is 0x0C, ctrl + c is 0x03...) */
+#define KEY(code, plain, shifted)                                           \
+    [KEYMAP_PLAIN][code]        = (plain),                                  \
+    [KEYMAP_SHIFT][code]        = (shifted),                                \
+    [KEYMAP_CAPS][code]         = IS_LOWER(plain) ? (shifted) : (plain),    \
+    [KEYMAP_CAPS_SHIFT][code]   = IS_LOWER(plain) ? (plain) : (shifted),    \
+    [KEYMAP_CTRL][code]         = IS_LOWER(plain) ? ((plain) & 0x1F) : 0,
+
+static const uint8_t us_layers[KEYMAP_LAYERS][KEYMAP_SIZE] = {
+#include "keymap_us.h"
+};
+
+static const uint8_t dvorak_layers[KEYMAP_LAYERS][KEYMAP_SIZE] = {
+#include "keymap_dvorak.h"
+};
+
+#undef KEY
+
+// Keys sent with the 0xE0 prefix are the same on every layout
+static const uint8_t extended_keys[KEYMAP_SIZE] = {
+    [0x1C] = '\n',              // Keypad enter
+    [0x35] = '/',               // Keypad /
+    [0x47] = KEY_HOME,
+    [0x48] = KEY_UP,
+    [0x49] = KEY_PAGE_UP,
+    [0x4B] = KEY_LEFT,
+    [0x4D] = KEY_RIGHT,
+    [0x4F] = KEY_END,
+    [0x50] = KEY_DOWN,
+    [0x51] = KEY_PAGE_DOWN,
+    [0x52] = KEY_INSERT,
+    [0x53] = KEY_DELETE,
+};
+
+static const keymap_t keymaps[NUM_KEYMAPS] = {
+    [KEYMAP_US]     = {"us", us_layers},
+    [KEYMAP_DVORAK] = {"dvorak", dvorak_layers},
+};
+
+static const keymap_t* active_keymap = &keymaps[KEYMAP_US];
+
+/*
+ * keymap_translate
+ *    DESCRIPTION: Looks up the key for a scan code in the active layout
+ *    INPUTS: scan_code -- make code with the release bit stripped
+ *            extended -- nonzero if the scan code followed an 0xE0 prefix
+ *            modifiers -- MOD_* bits currently held/latched
+ *    OUTPUTS: none
+ *    RETURN VALUE: ASCII char or KEY_* code, 0 if the key doesn't produce anything
+ *    NOTES: Constant time, just picks a layer and indexes it
+ */
+uint8_t keymap_translate(uint8_t scan_code, int32_t extended, uint32_t modifiers) {
+    int32_t layer;
+
+    if(scan_code >= KEYMAP_SIZE)
+        return 0;
+
+    if(extended)
+        return extended_keys[scan_code];
+
+    // Ctrl wins over shift/caps, otherwise shift and caps combine into one of four layers
+    if(modifiers & MOD_CTRL)
+        layer = KEYMAP_CTRL;
+    else
+        layer = ((modifiers & MOD_SHIFT) ? KEYMAP_SHIFT : KEYMAP_PLAIN) + ((modifiers & MOD_CAPS) ? KEYMAP_CAPS : 0);
+
+    return active_keymap->layers[layer][scan_code];
+}
+
+/*
+ * keymap_set_layout
+ *    DESCRIPTION: Selects the layout used by keymap_translate
+ *    INPUTS: layout_id -- one of the KEYMAP_* layout ids
+ *    OUTPUTS: none
+ *    RETURN VALUE: 0 on success, -1 if layout_id is invalid
+ */
+int32_t keymap_set_layout(int32_t layout_id) {
+    if(layout_id < 0 || layout_id >= NUM_KEYMAPS)
+        return -1;
+    active_keymap = &keymaps[layout_id];
+    return 0;
+}
+
+/*
+ * keymap_get_layout
+ *    DESCRIPTION: Returns the id of the active layout
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUE: active layout id
+ */
+int32_t keymap_get_layout() {
+    return active_keymap - keymaps;
+}
+
+/*
+ * keymap_next_layout
+ *    DESCRIPTION: Cycles to the next compiled-in layout
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUE: name of the newly active layout
+ */
+const int8_t* keymap_next_layout() {
+    (void)keymap_set_layout((keymap_get_layout() + 1) % NUM_KEYMAPS);
+    return active_keymap->name;
+}
@@ -0,0 +1,60 @@
+/* keymap.h - declarations for the table-driven scan code to key translation
+ *  vim:ts=4 noexpandtab
+ */
+
+#ifndef _KEYMAP_H
+#define _KEYMAP_H
+
+#include "types.h"
+
+#define KEYMAP_SIZE             128         // Set-1 make codes are 0x00 - 0x7F
+
+// Translation layers every layout provides
+#define KEYMAP_PLAIN            0
+#define KEYMAP_SHIFT            1
+#define KEYMAP_CAPS             2
+#define KEYMAP_CAPS_SHIFT       3
+#define KEYMAP_CTRL             4
+#define KEYMAP_LAYERS           5
+
+// Modifier bits passed to keymap_translate
+#define MOD_SHIFT               0x01
+#define MOD_CAPS                0x02
+#define MOD_CTRL                0x04
+#define MOD_ALT                 0x08
+
+// Key codes for non-ASCII keys (ASCII stays below 0x80)
+#define KEY_UP                  0x80
+#define KEY_DOWN                0x81
+#define KEY_LEFT                0x82
+#define KEY_RIGHT               0x83
+#define KEY_HOME                0x84
+#define KEY_END                 0x85
+#define KEY_INSERT              0x86
+#define KEY_DELETE              0x87
+#define KEY_PAGE_UP             0x88
+#define KEY_PAGE_DOWN           0x89
+
+// Compiled-in layouts
+#define KEYMAP_US               0
+#define KEYMAP_DVORAK           1
+#define NUM_KEYMAPS             2
+
+typedef struct {
+    const int8_t* name;
+    const uint8_t (*layers)[KEYMAP_SIZE];   // [KEYMAP_LAYERS][KEYMAP_SIZE] lookup tables
+} keymap_t;
+
+// Translates a make code (without the 0x80 release bit) to ASCII or a KEY_* code, 0 if unmapped
+uint8_t keymap_translate(uint8_t scan_code, int32_t extended, uint32_t modifiers);
+
+// Selects the active layout, returns 0 on success or -1 for a bad layout id
+int32_t keymap_set_layout(int32_t layout_id);
+
+// Returns the id of the active layout
+int32_t keymap_get_layout();
+
+// Switches to the next compiled-in layout and returns its name
+const int8_t* keymap_next_layout();
+
+#endif /* _KEYMAP_H */
@@ -0,0 +1,75 @@
+/* keymap_us.h - Layout description for the US QWERTY keyboard
+ *  vim:ts=4 noexpandtab
+ *
+ * Not a normal header: keymap.c includes it with KEY() defined to generate
+ * its lookup tables at compile time. One line per set-1 scan code:
+ *     KEY(scan code, unshifted char, shifted char)
+ * Caps lock and ctrl layers are derived from these by keymap.c.
+ */
+
+KEY(0x01, 0x1B, 0x1B)           // Escape
+KEY(0x02, '1', '!')
+KEY(0x03, '2', '@')
+KEY(0x04, '3', '#')
+KEY(0x05, '4', '$')
+KEY(0x06, '5', '%')
+KEY(0x07, '6', '^')
+KEY(0x08, '7', '&')
+KEY(0x09, '8', '*')
+KEY(0x0A, '9', '(')
+KEY(0x0B, '0', ')')
+KEY(0x0C, '-', '_')
+KEY(0x0D, '=', '+')
+KEY(0x0E, '\b', '\b')           // Backspace
+KEY(0x0F, '\t', '\t')           // Tab
+KEY(0x10, 'q', 'Q')
+KEY(0x11, 'w', 'W')
+KEY(0x12, 'e', 'E')
+KEY(0x13, 'r', 'R')
+KEY(0x14, 't', 'T')
+KEY(0x15, 'y', 'Y')
+KEY(0x16, 'u', 'U')
+KEY(0x17, 'i', 'I')
+KEY(0x18, 'o', 'O')
+KEY(0x19, 'p', 'P')
+KEY(0x1A, '[', '{')
+KEY(0x1B, ']', '}')
+KEY(0x1C, '\n', '\n')           // Enter
+KEY(0x1E, 'a', 'A')
+KEY(0x1F, 's', 'S')
+KEY(0x20, 'd', 'D')
+KEY(0x21, 'f', 'F')
+KEY(0x22, 'g', 'G')
+KEY(0x23, 'h', 'H')
+KEY(0x24, 'j', 'J')
+KEY(0x25, 'k', 'K')
+KEY(0x26, 'l', 'L')
+KEY(0x27, ';', ':')
+KEY(0x28, '\'', '"')
+KEY(0x29, '`', '~')
+KEY(0x2B, '\\', '|')
+KEY(0x2C, 'z', 'Z')
+KEY(0x2D, 'x', 'X')
+KEY(0x2E, 'c', 'C')
+KEY(0x2F, 'v', 'V')
+KEY(0x30, 'b', 'B')
+KEY(0x31, 'n', 'N')
+KEY(0x32, 'm', 'M')
+KEY(0x33, ',', '<')
+KEY(0x34, '.', '>')
+KEY(0x35, '/', '?')
+KEY(0x37, '*', '*')             // Keypad *
+KEY(0x39, ' ', ' ')             // Space
+KEY(0x47, '7', '7')             // Keypad (num lock assumed on)
+KEY(0x48, '8', '8')
+KEY(0x49, '9', '9')
+KEY(0x4A, '-', '-')
+KEY(0x4B, '4', '4')
+KEY(0x4C, '5', '5')
+KEY(0x4D, '6', '6')
+KEY(0x4E, '+', '+')
+KEY(0x4F, '1', '1')
+KEY(0x50, '2', '2')
+KEY(0x51, '3', '3')
+KEY(0x52, '0', '0')
+KEY(0x53, '.', '.')
@@ -0,0 +1,276 @@
+/* kmalloc.c - Kernel heap built from slab caches on top of the frame allocator
+ * vim:ts=4 noexpandtab
+ */
+
+#include "kmalloc.h"
+#include "frame.h"
+#include "lib.h"
+
+/* NOTES: Every slab is one 4KB frame with its slab_t header at the start, so kfree finds the
+          header by masking the pointer down to the frame. Large allocations are a run of frames
+          with a small header in the same spot (LARGE_MAGIC + frame count). Small requests are
+          rounded up to a power-of-two size class from KMEM_MIN_SIZE to KMEM_MAX_SIZE. */
+
+// Header placed in front of allocations bigger than KMEM_MAX_SIZE
+typedef struct large_header {
+    uint32_t magic;
+    uint32_t npages;
+    uint32_t pad[2];                    // Keep the returned pointer KMEM_MIN_SIZE aligned
+} large_header_t;
+
+static kmem_cache_t caches[KMEM_MAX_CACHES];
+static uint32_t num_caches;
+static kmem_cache_t * size_classes[8];  // 16, 32, ... 2048 bytes
+static uint32_t large_pages;            // Frames currently held by large allocations
+
+static const char * size_class_names[8] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+    "kmalloc-256", "kmalloc-512", "kmalloc-1024", "kmalloc-2048"
+};
+
+/*
+ * init_kmalloc
+ *    DESCRIPTION: Creates the power-of-two size class caches
+ *    INPUTS/OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Must run after init_frames, slabs are only allocated on first use
+ */
+void init_kmalloc(void) {
+    uint32_t i;
+
+    num_caches = 0;
+    large_pages = 0;
+    for(i = 0; i < 8; i++)
+        size_classes[i] = kmem_cache_create(size_class_names[i], KMEM_MIN_SIZE << i);
+}
+
+/*
+ * kmem_cache_create
+ *    DESCRIPTION: Creates a cache of fixed size objects
+ *    INPUTS: name -- label shown by kmem_print_stats
+ *            obj_size -- bytes per object (rounded up to KMEM_MIN_SIZE)
+ *    OUTPUTS: none
+ *    RETURN VALUE: The new cache, NULL if the size is too big or the cache table is full
+ *    SIDE EFFECTS: none
+ */
+kmem_cache_t * kmem_cache_create(const char * name, uint32_t obj_size) {
+    kmem_cache_t * cache;
+    uint32_t flags;
+
+    obj_size = (obj_size + KMEM_MIN_SIZE - 1) & ~(KMEM_MIN_SIZE - 1);
+    if(obj_size == 0 || obj_size > KMEM_MAX_SIZE)
+        return NULL;
+
+    cli_and_save(flags);
+    if(num_caches == KMEM_MAX_CACHES) {
+        restore_flags(flags);
+        return NULL;
+    }
+    cache = &caches[num_caches++];
+    restore_flags(flags);
+
+    memset(cache, 0, sizeof(kmem_cache_t));
+    strncpy((int8_t *)cache->name, (int8_t *)name, KMEM_NAME_LEN - 1);
+    cache->obj_size = obj_size;
+    // The header takes the front of the frame, rounded so objects stay aligned
+    cache->objs_per_slab = (FRAME_SIZE - ((sizeof(slab_t) + KMEM_MIN_SIZE - 1) & ~(KMEM_MIN_SIZE - 1))) / obj_size;
+    return cache;
+}
+
+/*
+ * slab_create
+ *    DESCRIPTION: Grabs a frame and carves it into free objects for a cache
+ *    INPUTS: cache -- cache to grow
+ *    OUTPUTS: none
+ *    RETURN VALUE: The new slab, NULL if out of frames
+ *    SIDE EFFECTS: Pushes the slab onto the cache's partial list, call with interrupts off
+ */
+static slab_t * slab_create(kmem_cache_t * cache) {
+    slab_t * slab = (slab_t *)frame_alloc(1, 1);
+    uint8_t * obj;
+    uint32_t i;
+
+    if(slab == NULL)
+        return NULL;
+
+    slab->magic = SLAB_MAGIC;
+    slab->cache = cache;
+    slab->in_use = 0;
+    slab->free_list = NULL;
+    obj = (uint8_t *)slab + ((sizeof(slab_t) + KMEM_MIN_SIZE - 1) & ~(KMEM_MIN_SIZE - 1));
+    for(i = 0; i < cache->objs_per_slab; i++, obj += cache->obj_size) {
+        *(void **)obj = slab->free_list;
+        slab->free_list = obj;
+    }
+
+    slab->prev = NULL;
+    slab->next = cache->partial;
+    if(cache->partial != NULL)
+        cache->partial->prev = slab;
+    cache->partial = slab;
+    cache->num_slabs++;
+    return slab;
+}
+
+/*
+ * slab_unlink
+ *    DESCRIPTION: Takes a slab off its cache's partial list
+ *    INPUTS: slab -- slab to unlink
+ *    OUTPUTS/RETURN VALUE: none
+ *    SIDE EFFECTS: Call with interrupts off
+ */
+static void slab_unlink(slab_t * slab) {
+    if(slab->prev != NULL)
+        slab->prev->next = slab->next;
+    else
+        slab->cache->partial = slab->next;
+    if(slab->next != NULL)
+        slab->next->prev = slab->prev;
+    slab->prev = NULL;
+    slab->next = NULL;
+}
+
+/*
+ * kmem_cache_alloc
+ *    DESCRIPTION: Allocates one object from a cache
+ *    INPUTS: cache -- cache to allocate from
+ *    OUTPUTS: none
+ *    RETURN VALUE: Pointer to the object (contents undefined), NULL if out of memory
+ *    SIDE EFFECTS: May take a new frame for the cache
+ */
+void * kmem_cache_alloc(kmem_cache_t * cache) {
+    slab_t * slab;
+    void * obj;
+    uint32_t flags;
+
+    if(cache == NULL)
+        return NULL;
+
+    cli_and_save(flags);
+    slab = cache->partial;
+    if(slab == NULL && (slab = slab_create(cache)) == NULL) {
+        restore_flags(flags);
+        return NULL;
+    }
+
+    obj = slab->free_list;
+    slab->free_list = *(void **)obj;
+    slab->in_use++;
+    // Full slabs leave the partial list until something in them is freed
+    if(slab->free_list == NULL)
+        slab_unlink(slab);
+
+    cache->active_objs++;
+    cache->total_allocs++;
+    restore_flags(flags);
+    return obj;
+}
+
+/*
+ * kmem_cache_free
+ *    DESCRIPTION: Gives an object back to its slab
+ *    INPUTS: slab -- slab the object came from
+ *            obj -- the object
+ *    OUTPUTS/RETURN VALUE: none
+ *    SIDE EFFECTS: Empty slabs go back to the frame allocator unless it's the cache's only one
+ */
+static void kmem_cache_free(slab_t * slab, void * obj) {
+    kmem_cache_t * cache = slab->cache;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    // A full slab gets its first free object back, so it's usable again
+    if(slab->free_list == NULL) {
+        slab->prev = NULL;
+        slab->next = cache->partial;
+        if(cache->partial != NULL)
+            cache->partial->prev = slab;
+        cache->partial = slab;
+    }
+    *(void **)obj = slab->free_list;
+    slab->free_list = obj;
+    slab->in_use--;
+    cache->active_objs--;
+    cache->total_frees++;
+
+    // Keep one empty slab around so alloc/free pairs don't bounce frames
+    if(slab->in_use == 0 && (slab->prev != NULL || slab->next != NULL)) {
+        slab_unlink(slab);
+        slab->magic = 0;
+        cache->num_slabs--;
+        frame_free((uint32_t)slab, 1);
+    }
+    restore_flags(flags);
+}
+
+/*
+ * kmalloc
+ *    DESCRIPTION: Allocates memory from the kernel heap
+ *    INPUTS: size -- bytes wanted
+ *    OUTPUTS: none
+ *    RETURN VALUE: KMEM_MIN_SIZE aligned pointer, NULL if size is 0 or memory ran out
+ *    SIDE EFFECTS: none
+ */
+void * kmalloc(uint32_t size) {
+    large_header_t * header;
+    uint32_t npages, i;
+
+    if(size == 0)
+        return NULL;
+
+    // Small requests come from the smallest size class that fits
+    if(size <= KMEM_MAX_SIZE) {
+        for(i = 0; (KMEM_MIN_SIZE << i) < size; i++);
+        return kmem_cache_alloc(size_classes[i]);
+    }
+
+    npages = (size + sizeof(large_header_t) + FRAME_SIZE - 1) / FRAME_SIZE;
+    header = (large_header_t *)frame_alloc(npages, 1);
+    if(header == NULL)
+        return NULL;
+    header->magic = LARGE_MAGIC;
+    header->npages = npages;
+    large_pages += npages;
+    return header + 1;
+}
+
+/*
+ * kfree
+ *    DESCRIPTION: Returns memory to the kernel heap
+ *    INPUTS: ptr -- pointer from kmalloc or kmem_cache_alloc (NULL is ignored)
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Pointers that didn't come from the heap are ignored
+ */
+void kfree(void * ptr) {
+    uint32_t page = (uint32_t)ptr & ~(FRAME_SIZE - 1);
+
+    if(ptr == NULL)
+        return;
+
+    if(((slab_t *)page)->magic == SLAB_MAGIC) {
+        kmem_cache_free((slab_t *)page, ptr);
+    } else if(((large_header_t *)page)->magic == LARGE_MAGIC && ptr == (void *)((large_header_t *)page + 1)) {
+        ((large_header_t *)page)->magic = 0;
+        large_pages -= ((large_header_t *)page)->npages;
+        frame_free(page, ((large_header_t *)page)->npages);
+    }
+}
+
+/*
+ * kmem_print_stats
+ *    DESCRIPTION: Prints usage of every cache plus large allocations and free frames
+ *    INPUTS/OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Prints to the screen
+ */
+void kmem_print_stats(void) {
+    uint32_t i;
+
+    printf("cache          size  slabs  active  allocs  frees\n");
+    for(i = 0; i < num_caches; i++) {
+        printf("%s  %d  %d  %d  %d  %d\n", caches[i].name, caches[i].obj_size, caches[i].num_slabs,
+                caches[i].active_objs, caches[i].total_allocs, caches[i].total_frees);
+    }
+    printf("large pages: %d, free frames: %d\n", large_pages, frames_free());
+}
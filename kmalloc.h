@@ -0,0 +1,60 @@
+/* kmalloc.h - Kernel heap built from slab caches on top of the frame allocator
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _KMALLOC_H
+#define _KMALLOC_H
+
+#include "types.h"
+
+#define KMEM_MAX_CACHES     16          // Size classes plus caches made with kmem_cache_create
+#define KMEM_NAME_LEN       16
+#define KMEM_MIN_SIZE       16          // Smallest size class, also the object alignment
+#define KMEM_MAX_SIZE       2048        // Bigger requests get whole frames
+#define SLAB_MAGIC          0x51AB51AB
+#define LARGE_MAGIC         0x1A46E000
+
+struct kmem_cache;
+
+// Lives at the start of every slab page, objects follow it
+typedef struct slab {
+    uint32_t magic;                     // SLAB_MAGIC, lets kfree tell slabs from large allocations
+    struct kmem_cache * cache;
+    struct slab * prev;                 // Links in the cache's list of slabs with free objects
+    struct slab * next;
+    void * free_list;                   // Singly linked through the first word of each free object
+    uint32_t in_use;
+} slab_t;
+
+// A pool of same-sized objects
+typedef struct kmem_cache {
+    char name[KMEM_NAME_LEN];
+    uint32_t obj_size;
+    uint32_t objs_per_slab;
+    slab_t * partial;                   // Slabs with at least one free object
+    // Stats
+    uint32_t num_slabs;
+    uint32_t active_objs;
+    uint32_t total_allocs;
+    uint32_t total_frees;
+} kmem_cache_t;
+
+// Sets up the generic size classes used by kmalloc
+void init_kmalloc(void);
+
+// Allocates size bytes from the kernel heap, returns NULL on failure
+void * kmalloc(uint32_t size);
+
+// Returns memory from kmalloc or kmem_cache_alloc to the heap
+void kfree(void * ptr);
+
+// Creates a cache of obj_size objects, returns NULL if there's no room for another cache
+kmem_cache_t * kmem_cache_create(const char * name, uint32_t obj_size);
+
+// Allocates one object from a cache, returns NULL on failure
+void * kmem_cache_alloc(kmem_cache_t * cache);
+
+// Prints per-cache usage
+void kmem_print_stats(void);
+
+#endif /* _KMALLOC_H */
@@ -9,9 +9,9 @@
 #define NUM_ROWS    25
 #define ATTRIB      0x7
 
-static int screen_x;
-static int screen_y;
-static char* video_mem = (char *)VIDEO;
+/* Each terminal owns one 4KB VGA text page starting at VIDEO, so terminal i's
+ * screen lives at VIDEO + i * FOUR_KB and is shown by moving the CRTC start address */
+#define TERMINAL_VIDEO_MEM(terminal_id)   ((char *)(VIDEO + (terminal_id) * FOUR_KB))
 
 /* void clear(void);
  * Inputs: void
@@ -20,14 +20,15 @@ static char* video_mem = (char *)VIDEO;
  * NOTES: Only visible terminal will call this (CTRL + L and kernel bootup only) */
 void clear(void) {
     int32_t i;
+    char* video_mem = TERMINAL_VIDEO_MEM(visible_terminal);
     for (i = 0; i < NUM_ROWS * NUM_COLS; i++) {
         *(uint8_t *)(video_mem + (i << 1)) = ' ';
         *(uint8_t *)(video_mem + (i << 1) + 1) = ATTRIB;
     }
     // Reset screen coordinates
-    update_cursor(0, 0);    // update_cursor also sets screen_x and screen_y
     terminals[visible_terminal].cursor_x = 0;
     terminals[visible_terminal].cursor_y = 0;
+    update_cursor(0, 0);
 }
 
 /* Standard printf().
@@ -185,17 +186,14 @@ void enable_cursor(void) {
 }
 
 /* void update_cursor(int, int)
- * Inputs: (x, y) -- coordinate of screen to move cursor to
+ * Inputs: (x, y) -- coordinate of the visible terminal's screen to move cursor to
  * Return Value: void
- *    Function: Moves text-mode cursor to (x,y) of screen and updates screen coordinates
+ *    Function: Moves text-mode cursor to (x,y) of the visible terminal's VGA page
  *    See link: (https://wiki.osdev.org/Text_Mode_Cursor) */
 void update_cursor(int x, int y)
 {
-	uint16_t pos = y * NUM_COLS + x;
- 
-    // Update screen_x and screen_y (when switching terminals, redundant otherwise)
-    screen_x = x;
-    screen_y = y;
+    // Cursor location is absolute in VGA memory, so offset it by the visible terminal's page
+	uint16_t pos = visible_terminal * VGA_PAGE_CHARS + y * NUM_COLS + x;
 
     // Set corresponding VGA register bits to update cursor
 	outb(0x0F, 0x3D4);
@@ -204,29 +202,44 @@ void update_cursor(int x, int y)
 	outb((uint8_t) ((pos >> 8) & 0xFF), 0x3D5);     // Bitmask and update y-coordinate
 }
 
+/* void set_display_page(int32_t)
+ * Inputs: terminal_id -- terminal whose VGA page should be displayed
+ * Return Value: void
+ *    Function: Points the CRTC start address registers at the terminal's VGA page
+ *    See link: (http://www.osdever.net/FreeVGA/vga/crtcreg.htm#0C) */
+void set_display_page(int32_t terminal_id) {
+    uint16_t start = terminal_id * VGA_PAGE_CHARS;
+
+    outb(0x0C, 0x3D4);
+    outb((uint8_t) ((start >> 8) & 0xFF), 0x3D5);   // Start Address High Register
+    outb(0x0D, 0x3D4);
+    outb((uint8_t) (start & 0xFF), 0x3D5);          // Start Address Low Register
+}
+
 /* int get_screen_x(void);
  * Inputs: none
- * Return Value: The x-coordinate of the screen
+ * Return Value: The x-coordinate of the visible terminal's screen
  */
 int get_screen_x() {
-    return screen_x;
+    return terminals[visible_terminal].cursor_x;
 }
 
 /* int get_screen_y(void);
  * Inputs: none
- * Return Value: The y-coordinate of the screen
+ * Return Value: The y-coordinate of the visible terminal's screen
  */
 int get_screen_y() {
-    return screen_y;
+    return terminals[visible_terminal].cursor_y;
 }
 
-/* void scroll(void);
- * Inputs: none
+/* void scroll(int32_t);
+ * Inputs: terminal_id -- terminal whose VGA page should be scrolled
  * Return Value: void
  *  Function: Scrolls each line on screen up by one line, losing the 0th row and clearing the 24th row*/
-void scroll(void){
+void scroll(int32_t terminal_id){
     int i;
     int j;
+    char* video_mem = TERMINAL_VIDEO_MEM(terminal_id);
     for(i = 0; i < NUM_ROWS; i++){
         for(j = 0; j < NUM_COLS; j++){
             // Blank 24th row
@@ -239,88 +252,93 @@ void scroll(void){
     }
 }
 
+/* void shift_cursor(int32_t, int32_t);
+ * Inputs: terminal_id -- terminal whose cursor should move
+ *         delta -- number of cells to move (negative moves back)
+ * Return Value: void
+ *  Function: Moves a terminal's cursor by delta cells, wrapping across rows and clamping to the screen
+ *  NOTES: Used by the line discipline to move around inside the line being edited without printing */
+void shift_cursor(int32_t terminal_id, int32_t delta) {
+    int32_t pos = terminals[terminal_id].cursor_y * NUM_COLS + terminals[terminal_id].cursor_x + delta;
+
+    if(pos < 0)
+        pos = 0;
+    if(pos > NUM_ROWS * NUM_COLS - 1)
+        pos = NUM_ROWS * NUM_COLS - 1;
+    terminals[terminal_id].cursor_x = pos % NUM_COLS;
+    terminals[terminal_id].cursor_y = pos / NUM_COLS;
+
+    if(terminal_id == visible_terminal)
+        update_cursor(terminals[terminal_id].cursor_x, terminals[terminal_id].cursor_y);
+}
+
 /* void putc(uint8_t c);
  * Inputs: uint_8* c = character to print
  *         int keyboard_flag = denotes whether or not this was called from keyboard
  * Return Value: void
- *  Function: Output a character to the console */
+ *  Function: Output a character to the console
+ *  NOTES: Keyboard echoes go to the visible terminal, everything else goes to the scheduled
+ *         terminal. Both write straight into that terminal's own VGA page, so no remapping is needed */
 void putc(uint8_t c, int keyboard_flag) {
 
     // Ignore NULL bytes
     if(c == '\0')
         return;
 
-    // If the scheduled terminal isn't the visible terminal, redirect VIDMEM to point to its backgroud buffer
-    if(visible_terminal != scheduled_terminal) {
-        if(!keyboard_flag){
-            // Note that we won't update the VGA blinking cursor here as it will spaz out the visible terminal
-            redirect_vidmem_page(scheduled_terminal);           //when switching terminals, remap to background buffer
-            screen_x = terminals[scheduled_terminal].cursor_x;  //update cursor coordinates
-            screen_y = terminals[scheduled_terminal].cursor_y;
-        }
-    }
+    // Pick the terminal this char belongs to and alias its screen state
+    int32_t terminal_id = keyboard_flag ? visible_terminal : scheduled_terminal;
+    char* video_mem = TERMINAL_VIDEO_MEM(terminal_id);
+    int32_t* screen_x = &terminals[terminal_id].cursor_x;
+    int32_t* screen_y = &terminals[terminal_id].cursor_y;
 
     if(c == '\n' || c == '\r') {
-        screen_y++;
-        screen_x = 0;
+        (*screen_y)++;
+        *screen_x = 0;
         // If newline is entered while screen is filled, scroll up by one line
-        if(screen_y == NUM_ROWS) {
-            scroll();
-            screen_y = NUM_ROWS - 1;
+        if(*screen_y == NUM_ROWS) {
+            scroll(terminal_id);
+            *screen_y = NUM_ROWS - 1;
         }
     } 
     
     // Backspace case to delete previous char 
     else if(c == '\b') {
         //do nothing if we're at (0,0)
-        if (screen_x + screen_y == 0)
+        if (*screen_x + *screen_y == 0)
             return;
 
         // Set coordinates to previous index
-        screen_x--;
+        (*screen_x)--;
         
         // Go back to previous line (screen_y) if needed
-        if(screen_x == -1) {
-            screen_x = NUM_COLS - 1;
-            screen_y--;
+        if(*screen_x == -1) {
+            *screen_x = NUM_COLS - 1;
+            (*screen_y)--;
         }
 
         // Blank out previous char in vidmem
-        *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1)) = ' ';
-        *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1) + 1) = ATTRIB;
+        *(uint8_t *)(video_mem + ((NUM_COLS * *screen_y + *screen_x) << 1)) = ' ';
+        *(uint8_t *)(video_mem + ((NUM_COLS * *screen_y + *screen_x) << 1) + 1) = ATTRIB;
     } 
     
     else {
-        *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1)) = c;
-        *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1) + 1) = ATTRIB;
-        screen_x++;
-        if (screen_x == NUM_COLS) {
-            screen_x = 0;
-            screen_y++;
+        *(uint8_t *)(video_mem + ((NUM_COLS * *screen_y + *screen_x) << 1)) = c;
+        *(uint8_t *)(video_mem + ((NUM_COLS * *screen_y + *screen_x) << 1) + 1) = ATTRIB;
+        (*screen_x)++;
+        if (*screen_x == NUM_COLS) {
+            *screen_x = 0;
+            (*screen_y)++;
         }
         // If screen gets filled after char gets printed, scroll up by one line
-        if(screen_y == NUM_ROWS) {
-            scroll();
-            screen_y = NUM_ROWS - 1;
+        if(*screen_y == NUM_ROWS) {
+            scroll(terminal_id);
+            *screen_y = NUM_ROWS - 1;
         } 
     }
 
-    // Update background terminal's cursor and restore the visible terminal's cursor and return
-    if(visible_terminal != scheduled_terminal) {
-        if(!keyboard_flag){
-            redirect_vidmem_page(visible_terminal);            // redirect virt_addr 0xB8000 to point back to its virtual address
-            terminals[scheduled_terminal].cursor_x = screen_x; // save cursor to scheduled terminal
-            terminals[scheduled_terminal].cursor_y = screen_y;
-            screen_x = terminals[visible_terminal].cursor_x;  // restore visible cursor coordinates
-            screen_y = terminals[visible_terminal].cursor_y;
-            return;     // Return so that we don't spaz out the VGA blinking cursor
-        }
-    }
-
-    // Update cursor position
-    terminals[visible_terminal].cursor_x = screen_x;
-    terminals[visible_terminal].cursor_y = screen_y;
-    update_cursor(screen_x, screen_y);
+    // Only move the blinking VGA cursor if this terminal is the one on screen
+    if(terminal_id == visible_terminal)
+        update_cursor(*screen_x, *screen_y);
 }
 
 /* int8_t* itoa(uint32_t value, int8_t* buf, int32_t radix);
@@ -8,12 +8,17 @@
 #include "types.h"
 #include "terminal.h"
 
+// Number of character cells in one 4KB VGA text page (2 bytes per cell)
+#define VGA_PAGE_CHARS  2048
+
 int32_t printf(int8_t *format, ...);
 void enable_cursor(void);               // Enables VGA text-mode cursor
 void update_cursor(int x, int y);       // Updates VGA text-mode cursor position
+void set_display_page(int32_t terminal_id); // Displays the terminal's VGA page via the CRTC start address
 int get_screen_x();                     // Returns X-coordinate of screen
 int get_screen_y();                     // Returns Y-coordinate of screen 
-void scroll(void);                      // Scroll each line on screen up by one line
+void scroll(int32_t terminal_id);       // Scroll each line of a terminal's screen up by one line
+void shift_cursor(int32_t terminal_id, int32_t delta); // Move a terminal's cursor by delta cells
 void putc(uint8_t c, int keyboard_flag);
 int32_t puts(int8_t *s);
 int8_t *itoa(uint32_t value, int8_t* buf, int32_t radix);
@@ -104,7 +109,7 @@ do {                                    \
 /* Writes four bytes to four consecutive ports */
 #define outl(data, port)                \
 do {                                    \
-    asm volatile ("outl %l1, (%w0)"     \
+    asm volatile ("outl %k1, (%w0)"     \
             :                           \
             : "d"(port), "a"(data)      \
             : "memory", "cc"            \
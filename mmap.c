@@ -0,0 +1,130 @@
+/* mmap.c - Mapping files into a process's address space
+ * vim:ts=4 noexpandtab
+ */
+
+#include "mmap.h"
+#include "file.h"
+#include "frame.h"
+#include "paging.h"
+#include "vfs.h"
+#include "lib.h"
+
+/* NOTES: A mapping covers a whole file, a page per 4KB, all of them mapped up front so using
+          the data never traps. Each page comes from vfs_map_page: for blocks of the boot image
+          (or a disk image) that's the block cache's own frame, lent out with a reference, so
+          a big table or asset is never copied. Pages the file system can't lend (the last
+          partial block, overlay and tmpfs files) are read into a frame of their own.
+          MMAP_READ maps the pages read-only. MMAP_PRIVATE maps them copy-on-write, so a write
+          copies the page for this process and the file and the cache never change. Either
+          way the mapping is a snapshot: writing to the file later doesn't show through.
+          Mappings stay mapped across fork like any other page, the frames are reference
+          counted and go back to the pool once the cache and every mapping drop them. */
+
+/*
+ * mmap_file
+ *    DESCRIPTION: Maps a file into a process
+ *    INPUTS: pcb -- the process, its page table must be the mapped one
+ *            fd -- open regular file
+ *            addr -- page-aligned user address to map it at
+ *            flags -- MMAP_READ or MMAP_PRIVATE
+ *    OUTPUTS: none
+ *    RETURN VALUE: addr, -1 if fd isn't a non-empty regular file, flags or addr is bad, the file
+ *                  doesn't fit in the user window, it would overlap another mapped file, the
+ *                  process has MMAP_PER_PROCESS files mapped already or we're out of memory
+ *    SIDE EFFECTS: Whatever was mapped in the range before is freed
+ */
+int32_t mmap_file(pcb_t * pcb, int32_t fd, uint32_t addr, int32_t flags) {
+    file_t * file = fd_get(pcb, fd);
+    int32_t size = vfs_file_size(file);
+    uint32_t npages, frame, i;
+    int32_t slot, free_slot = -1, ret;
+
+    if(size <= 0 || (flags != MMAP_READ && flags != MMAP_PRIVATE))
+        return -1;
+    npages = (size + FOUR_KB - 1) / FOUR_KB;
+    if((addr & (FOUR_KB - 1)) || addr < ONE_TWO_EIGHT_MB || npages * FOUR_KB > ONE_THREE_TWO_MB - addr)
+        return -1;
+
+    for(slot = 0; slot < MMAP_PER_PROCESS; slot++) {
+        if(pcb->mmaps[slot].addr == 0) {
+            if(free_slot == -1)
+                free_slot = slot;
+        } else if(addr < pcb->mmaps[slot].addr + pcb->mmaps[slot].npages * FOUR_KB
+                && pcb->mmaps[slot].addr < addr + npages * FOUR_KB) {
+            return -1;
+        }
+    }
+    if(free_slot == -1)
+        return -1;
+
+    for(i = 0; i < npages; i++) {
+        frame = vfs_map_page(file, i);
+        ret = -1;
+        if(frame != 0) {
+            if(flags == MMAP_READ)
+                ret = user_page_map_readonly(addr + i * FOUR_KB, frame);
+            else
+                ret = user_page_install(addr + i * FOUR_KB, frame);
+            if(ret == -1)
+                frame_free(frame, 1);
+        }
+        if(ret == -1) {
+            while(i-- > 0)
+                user_page_unmap(addr + i * FOUR_KB);
+            return -1;
+        }
+    }
+    pcb->mmaps[free_slot].addr = addr;
+    pcb->mmaps[free_slot].npages = npages;
+    return addr;
+}
+
+/*
+ * mmap_unmap
+ *    DESCRIPTION: Unmaps a file from a process
+ *    INPUTS: pcb -- the process, its page table must be the mapped one
+ *            addr -- address the file was mapped at
+ *    OUTPUTS: none
+ *    RETURN VALUE: 0 on success, -1 if no file is mapped at addr
+ *    SIDE EFFECTS: The range reads as zeros again (demand-zero pages)
+ */
+int32_t mmap_unmap(pcb_t * pcb, uint32_t addr) {
+    int32_t slot;
+    uint32_t i;
+
+    if(addr == 0)
+        return -1;
+    for(slot = 0; slot < MMAP_PER_PROCESS && pcb->mmaps[slot].addr != addr; slot++);
+    if(slot == MMAP_PER_PROCESS)
+        return -1;
+
+    for(i = 0; i < pcb->mmaps[slot].npages; i++)
+        user_page_unmap(addr + i * FOUR_KB);
+    pcb->mmaps[slot].addr = 0;
+    return 0;
+}
+
+/*
+ * mmap_fork
+ *    DESCRIPTION: Copies a process's mappings to its forked child
+ *    INPUTS: parent -- the forking process
+ *            child -- the child, its page table already cloned from parent's
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ */
+void mmap_fork(pcb_t * parent, pcb_t * child) {
+    memcpy(child->mmaps, parent->mmaps, sizeof(parent->mmaps));
+}
+
+/*
+ * mmap_release_all
+ *    DESCRIPTION: Forgets every mapping of a process that's exec'ing
+ *    INPUTS: pcb -- the process
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Leaves the page table alone, destroying the address space drops its
+ *                  references to the frames
+ */
+void mmap_release_all(pcb_t * pcb) {
+    memset(pcb->mmaps, 0, sizeof(pcb->mmaps));
+}
@@ -0,0 +1,27 @@
+/* mmap.h - Mapping files into a process's address space
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _MMAP_H
+#define _MMAP_H
+
+#include "types.h"
+#include "system_calls.h"
+
+// mmap flags
+#define MMAP_READ           0           // Read-only, writing to it is a SEGFAULT
+#define MMAP_PRIVATE        1           // Writable, the first write to a page copies it for this process only
+
+// Maps all of an open regular file at addr in pcb's (currently mapped) address space, returns addr or -1
+int32_t mmap_file(pcb_t * pcb, int32_t fd, uint32_t addr, int32_t flags);
+
+// Unmaps the file mapped at addr, returns 0 or -1 if nothing is mapped there
+int32_t mmap_unmap(pcb_t * pcb, uint32_t addr);
+
+// Gives a forked child the parent's mappings (the page tables are cloned separately)
+void mmap_fork(pcb_t * parent, pcb_t * child);
+
+// Forgets every mapping of a process whose address space is going away
+void mmap_release_all(pcb_t * pcb);
+
+#endif /* _MMAP_H */
@@ -14,6 +14,7 @@
 #include "paging.h"
 #include "lib.h"
 #include "terminal.h"
+#include "frame.h"
 
 /* NOTES: Kernel already loaded at FOUR_MB and should be a single 4MB page.
           VidMem already loaded at VIDEO (see paging.h) and should be a single 4KB page.
@@ -66,8 +67,8 @@ void init_paging() {
         // Place blank entry in user video table (placed here to avoid next if case)
         user_video_table[i] = page;
         
-        // Mark page table entries for kernel vidmem and the 3 terminals as present
-        if(i >= VIDMEM_PAGE_BASE && i <= VIDMEM_PAGE_BASE + 3) {
+        // Mark page table entries for the VGA text pages of the 3 terminals as present
+        if(i >= VIDMEM_PAGE_BASE && i < VIDMEM_PAGE_BASE + MAX_TERMINALS) {
             page.present = 1;   
         }   
         
@@ -119,6 +120,13 @@ void init_paging() {
         page_directory[i].pd_mb.base_addr = i;
     }       
 
+    // Identity map 8MB - 128MB for the kernel so frames from the frame allocator can be used directly
+    for(i = EIGHT_MB / FOUR_MB; i < FRAME_MEM_LIMIT / FOUR_MB; i++){
+        page_directory[i].pd_mb.present = 1;
+        page_directory[i].pd_mb.user_supervisor = 0;    //0 for kernel pages
+        page_directory[i].pd_mb.global_bit = 1;         //same in every address space
+    }
+
     /* Flush the TLB as we've made changes to the paging structure */
     flush_tlb();
 
@@ -129,7 +137,7 @@ void init_paging() {
                   "orl $0x00000010, %%eax;"         
                   "movl %%eax, %%cr4;"
                   "movl %%cr0, %%eax;"              //enables page directory
-                  "orl $0x80000000, %%eax;"
+                  "orl $0x80010000, %%eax;"         //also sets WP so the kernel honors copy-on-write pages
                   "movl %%eax, %%cr0;"
                 :                                   // no outputs
                 : "r" (page_directory)              // input: page_directory
@@ -140,30 +148,327 @@ void init_paging() {
 
 /*  
  * set_user_prog_page
- *    DESCRIPTION: Re-maps the user program page for the process with pid
- *    INPUTS: pid -- ID of process
+ *    DESCRIPTION: Maps a process's user page table at the user program page (virtual addr 128MB)
+ *    INPUTS: page_table -- the process's page table (from user_space_create/clone)
  *            present_flag -- set to 0 to mark page not present, 1 to mark as present
  *    RETURNS: none  
- *    SIDE EFFECTS: Maps user program page (virtual addr 128MB) to PhysMem
- *    NOTES: 
+ *    SIDE EFFECTS: Maps the 128MB - 132MB user window through page_table and flushes the TLB
+ *    NOTES: Pages in the window are 4KB so they can be allocated on demand and shared copy-on-write
  */
-void set_user_prog_page(uint32_t pid, int32_t present_flag) {
-    page_directory[USER_PAGE_BASE_ADDR].pd_mb.present = present_flag;
-    page_directory[USER_PAGE_BASE_ADDR].pd_mb.read_write = 1;     //all pages are marked read/write for mp3
-    page_directory[USER_PAGE_BASE_ADDR].pd_mb.user_supervisor = 1;    //1 for user pages
-    page_directory[USER_PAGE_BASE_ADDR].pd_mb.page_write_through = 0;    //we always want writeback, so 0
-    page_directory[USER_PAGE_BASE_ADDR].pd_mb.page_cache_disabled = 1;    //1 for program code and data pages (kernel pages)
-    page_directory[USER_PAGE_BASE_ADDR].pd_mb.accessed = 0;   //not used at all in mp3
-    page_directory[USER_PAGE_BASE_ADDR].pd_mb.dirty = 0;      //not used at all in mp3
-    page_directory[USER_PAGE_BASE_ADDR].pd_mb.page_size = 1;  //1 if 4M page directory entry
-    page_directory[USER_PAGE_BASE_ADDR].pd_mb.global_bit = 0; // user page should not be global
-    page_directory[USER_PAGE_BASE_ADDR].pd_mb.available = 0;  //not used at all in mp3
-    page_directory[USER_PAGE_BASE_ADDR].pd_mb.page_attr_index = 0;  //not used at all in mp3
-    page_directory[USER_PAGE_BASE_ADDR].pd_mb.reserved = 0;       //reserved bits are always set to 0
-    page_directory[USER_PAGE_BASE_ADDR].pd_mb.base_addr = 2 + pid;     // Map physmem [8MB + (pid * 4MB)] as mult of 4MB
+void set_user_prog_page(uint32_t page_table, int32_t present_flag) {
+    page_directory[USER_PAGE_BASE_ADDR].pd_kb.present = present_flag;
+    page_directory[USER_PAGE_BASE_ADDR].pd_kb.read_write = 1;     //per-page permissions are in the page table
+    page_directory[USER_PAGE_BASE_ADDR].pd_kb.user_supervisor = 1;    //1 for user pages
+    page_directory[USER_PAGE_BASE_ADDR].pd_kb.page_write_through = 0;    //we always want writeback, so 0
+    page_directory[USER_PAGE_BASE_ADDR].pd_kb.page_cache_disabled = 0;
+    page_directory[USER_PAGE_BASE_ADDR].pd_kb.accessed = 0;   //not used at all in mp3
+    page_directory[USER_PAGE_BASE_ADDR].pd_kb.reserved = 0;   //reserved bits are always set to 0
+    page_directory[USER_PAGE_BASE_ADDR].pd_kb.page_size = 0;  //0 if 4K page directory entry
+    page_directory[USER_PAGE_BASE_ADDR].pd_kb.global_bit = 0; // user page should not be global
+    page_directory[USER_PAGE_BASE_ADDR].pd_kb.available = 0;  //not used at all in mp3
+    page_directory[USER_PAGE_BASE_ADDR].pd_kb.page_table_addr = page_table >> 12;
     flush_tlb();
 }
 
+/*  
+ * user_pte
+ *    DESCRIPTION: Finds the page table entry of a user address
+ *    INPUTS: addr -- address in the user window
+ *    RETURNS: The entry in the mapped user page table, NULL if addr is outside the window or
+ *             no user page table is mapped
+ */
+static page_tab_desc_t * user_pte(uint32_t addr) {
+    page_tab_desc_t * pt;
+
+    if(addr < ONE_TWO_EIGHT_MB || addr >= ONE_THREE_TWO_MB)
+        return NULL;
+    if(!page_directory[USER_PAGE_BASE_ADDR].pd_kb.present || page_directory[USER_PAGE_BASE_ADDR].pd_kb.page_size)
+        return NULL;
+    pt = (page_tab_desc_t *)(page_directory[USER_PAGE_BASE_ADDR].pd_kb.page_table_addr << 12);
+    return pt + ((addr >> 12) & (ONE_KB - 1));
+}
+
+/*  
+ * user_space_create
+ *    DESCRIPTION: Allocates an empty page table for a user address space
+ *    INPUTS: none
+ *    RETURNS: Address of the page table, 0 if out of memory
+ *    SIDE EFFECTS: none
+ *    NOTES: Every page starts not present and is zero-filled on first touch (see user_page_fault)
+ */
+uint32_t user_space_create(void) {
+    uint32_t page_table = frame_alloc(1, 1);
+
+    if(page_table != 0)
+        memset((void *)page_table, 0, FOUR_KB);
+    return page_table;
+}
+
+/*  
+ * user_space_clone
+ *    DESCRIPTION: Clones a user address space for fork without copying any pages
+ *    INPUTS: page_table -- page table to clone (the running process's)
+ *    RETURNS: Address of the new page table, 0 if out of memory
+ *    SIDE EFFECTS: Every writable page becomes read-only copy-on-write in both tables and gains
+ *                  a reference, the first write from either side copies it (see user_page_fault)
+ */
+uint32_t user_space_clone(uint32_t page_table) {
+    page_tab_desc_t * src = (page_tab_desc_t *)page_table;
+    page_tab_desc_t * dst;
+    uint32_t clone = user_space_create();
+    int i;
+
+    if(clone == 0)
+        return 0;
+    dst = (page_tab_desc_t *)clone;
+
+    for(i = 0; i < ONE_KB; i++) {
+        if(!src[i].present)
+            continue;
+        if(src[i].read_write && !(src[i].avail & PTE_AVAIL_SHARED)) {
+            src[i].read_write = 0;
+            src[i].avail |= PTE_AVAIL_COW;
+        }
+        dst[i] = src[i];
+        frame_get(src[i].page_base_address << 12);
+    }
+
+    // The parent's pages just became read-only
+    flush_tlb();
+    return clone;
+}
+
+/*  
+ * user_space_destroy
+ *    DESCRIPTION: Tears down a user address space
+ *    INPUTS: page_table -- page table to free (must not be the mapped one if it will be used again)
+ *    RETURNS: none
+ *    SIDE EFFECTS: Drops a reference to every mapped page, pages shared copy-on-write live on
+ */
+void user_space_destroy(uint32_t page_table) {
+    page_tab_desc_t * pt = (page_tab_desc_t *)page_table;
+    int i;
+
+    if(page_table == 0)
+        return;
+    for(i = 0; i < ONE_KB; i++) {
+        if(pt[i].present)
+            frame_free(pt[i].page_base_address << 12, 1);
+    }
+    frame_free(page_table, 1);
+}
+
+/*  
+ * user_page_fault
+ *    DESCRIPTION: Resolves a page fault in the mapped user window
+ *    INPUTS: addr -- faulting address (CR2)
+ *            error_code -- error code the CPU pushed
+ *    RETURNS: 0 if the page is now mapped and the access can be retried, -1 otherwise
+ *    SIDE EFFECTS: Missing pages get a zeroed frame. Writes to copy-on-write pages get a private
+ *                  copy, or just regain write access if nobody else shares the frame anymore
+ *    NOTES: Faults from the kernel (e.g. read() filling a user buffer) are handled the same way
+ */
+int32_t user_page_fault(uint32_t addr, uint32_t error_code) {
+    page_tab_desc_t * pte = user_pte(addr);
+    uint32_t old_frame, new_frame;
+
+    if(pte == NULL)
+        return -1;
+
+    // Demand-zero
+    if(!(error_code & PF_PRESENT)) {
+        new_frame = frame_alloc(1, 1);
+        if(new_frame == 0)
+            return -1;
+        memset((void *)new_frame, 0, FOUR_KB);
+        pte->val = 0;
+        pte->page_base_address = new_frame >> 12;
+        pte->user_supervisor = 1;
+        pte->read_write = 1;
+        pte->present = 1;
+        asm volatile ("invlpg (%0)" : : "r"(addr) : "memory");
+        return 0;
+    }
+
+    // Copy-on-write
+    if((error_code & PF_WRITE) && (pte->avail & PTE_AVAIL_COW)) {
+        old_frame = pte->page_base_address << 12;
+        if(frame_refcount(old_frame) > 1) {
+            new_frame = frame_alloc(1, 1);
+            if(new_frame == 0)
+                return -1;
+            memcpy((void *)new_frame, (void *)old_frame, FOUR_KB);
+            pte->page_base_address = new_frame >> 12;
+            frame_free(old_frame, 1);
+        }
+        pte->avail &= ~PTE_AVAIL_COW;
+        pte->read_write = 1;
+        asm volatile ("invlpg (%0)" : : "r"(addr) : "memory");
+        return 0;
+    }
+
+    return -1;
+}
+
+/*  
+ * user_range_prepare
+ *    DESCRIPTION: Faults in every page of a user range up front, the way the kernel touching it would
+ *    INPUTS: addr -- start of the range in the user window
+ *            len -- bytes in the range
+ *            write -- nonzero if the range is going to be written
+ *    RETURNS: 0 if every page is present (and writable, for write), -1 if part of the range is
+ *             outside the window, read-only for good or we're out of memory
+ *    SIDE EFFECTS: Missing pages get a zeroed frame, copy-on-write pages get their copy
+ *    NOTES: For tasks that can't take an unresolved fault (see aio_do). Nothing stops the range
+ *           from being unmapped again afterwards
+ */
+int32_t user_range_prepare(uint32_t addr, uint32_t len, int32_t write) {
+    page_tab_desc_t * pte;
+    uint32_t page;
+
+    if(len == 0)
+        return 0;
+    if(addr < ONE_TWO_EIGHT_MB || len > ONE_THREE_TWO_MB - addr)
+        return -1;
+
+    for(page = addr & ~(FOUR_KB - 1); page < addr + len; page += FOUR_KB) {
+        pte = user_pte(page);
+        if(pte == NULL)
+            return -1;
+        if(!pte->present) {
+            if(user_page_fault(page, write ? PF_WRITE : 0) == -1)
+                return -1;
+        } else if(write && !pte->read_write) {
+            if(user_page_fault(page, PF_PRESENT | PF_WRITE) == -1)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+/*  
+ * user_page_loan
+ *    DESCRIPTION: Lends out the frame behind a mapped user page without copying it
+ *    INPUTS: addr -- page-aligned address in the user window
+ *    RETURNS: Physical address of the frame (with a reference for the borrower), 0 if the page
+ *             isn't present
+ *    SIDE EFFECTS: The page becomes copy-on-write, so the owner's next write gets its own copy
+ *                  while the borrower still sees the old contents
+ */
+uint32_t user_page_loan(uint32_t addr) {
+    page_tab_desc_t * pte = user_pte(addr);
+    uint32_t frame;
+
+    if(pte == NULL || !pte->present || (pte->avail & PTE_AVAIL_SHARED))
+        return 0;
+    if(pte->read_write) {
+        pte->read_write = 0;
+        pte->avail |= PTE_AVAIL_COW;
+        asm volatile ("invlpg (%0)" : : "r"(addr) : "memory");
+    }
+    frame = pte->page_base_address << 12;
+    frame_get(frame);
+    return frame;
+}
+
+/*  
+ * user_page_install
+ *    DESCRIPTION: Maps a frame at a user page in place of whatever was there
+ *    INPUTS: addr -- page-aligned address in the user window
+ *            frame -- frame to map, the caller's reference is handed to the page table
+ *    RETURNS: 0 on success, -1 if no user page table is mapped at addr or it's shared memory
+ *    SIDE EFFECTS: Frees the page previously mapped there. The frame is mapped copy-on-write
+ *                  if someone else still holds a reference to it
+ */
+int32_t user_page_install(uint32_t addr, uint32_t frame) {
+    page_tab_desc_t * pte = user_pte(addr);
+
+    if(pte == NULL || (pte->avail & PTE_AVAIL_SHARED))
+        return -1;
+    if(pte->present)
+        frame_free(pte->page_base_address << 12, 1);
+
+    pte->val = 0;
+    pte->page_base_address = frame >> 12;
+    pte->user_supervisor = 1;
+    if(frame_refcount(frame) > 1)
+        pte->avail = PTE_AVAIL_COW;
+    else
+        pte->read_write = 1;
+    pte->present = 1;
+    asm volatile ("invlpg (%0)" : : "r"(addr) : "memory");
+    return 0;
+}
+
+/*  
+ * user_page_map_readonly
+ *    DESCRIPTION: Maps a frame read-only at a user page in place of whatever was there
+ *    INPUTS: addr -- page-aligned address in the user window
+ *            frame -- frame to map, the caller's reference is handed to the page table
+ *    RETURNS: 0 on success, -1 if no user page table is mapped at addr or it's shared memory
+ *    SIDE EFFECTS: Frees the page previously mapped there. Writes to the page fault for good
+ *                  (it isn't copy-on-write), fork shares it like any other read-only page
+ */
+int32_t user_page_map_readonly(uint32_t addr, uint32_t frame) {
+    page_tab_desc_t * pte = user_pte(addr);
+
+    if(pte == NULL || (pte->avail & PTE_AVAIL_SHARED))
+        return -1;
+    if(pte->present)
+        frame_free(pte->page_base_address << 12, 1);
+
+    pte->val = 0;
+    pte->page_base_address = frame >> 12;
+    pte->user_supervisor = 1;
+    pte->present = 1;
+    asm volatile ("invlpg (%0)" : : "r"(addr) : "memory");
+    return 0;
+}
+
+/*  
+ * user_page_share
+ *    DESCRIPTION: Maps a shared memory frame at a user page
+ *    INPUTS: addr -- page-aligned address in the user window
+ *            frame -- frame to map, the caller's reference is handed to the page table
+ *    RETURNS: 0 on success, -1 if no user page table is mapped at addr
+ *    SIDE EFFECTS: Frees the page previously mapped there. The page is writable and stays
+ *                  shared with everyone else mapping the frame, even across fork
+ */
+int32_t user_page_share(uint32_t addr, uint32_t frame) {
+    page_tab_desc_t * pte = user_pte(addr);
+
+    if(pte == NULL)
+        return -1;
+    if(pte->present)
+        frame_free(pte->page_base_address << 12, 1);
+
+    pte->val = 0;
+    pte->page_base_address = frame >> 12;
+    pte->user_supervisor = 1;
+    pte->read_write = 1;
+    pte->avail = PTE_AVAIL_SHARED;
+    pte->present = 1;
+    asm volatile ("invlpg (%0)" : : "r"(addr) : "memory");
+    return 0;
+}
+
+/*  
+ * user_page_unmap
+ *    DESCRIPTION: Removes a page from the mapped user page table
+ *    INPUTS: addr -- page-aligned address in the user window
+ *    RETURNS: none
+ *    SIDE EFFECTS: Drops the reference to its frame, the next touch gets a zeroed page
+ */
+void user_page_unmap(uint32_t addr) {
+    page_tab_desc_t * pte = user_pte(addr);
+
+    if(pte == NULL || !pte->present)
+        return;
+    frame_free(pte->page_base_address << 12, 1);
+    pte->val = 0;
+    asm volatile ("invlpg (%0)" : : "r"(addr) : "memory");
+}
+
 /*  
  * set_user_video_page
  *    DESCRIPTION: Sets up page for user to interact with video memory
@@ -175,11 +480,8 @@ void set_user_prog_page(uint32_t pid, int32_t present_flag) {
 void set_user_video_page(int32_t present_flag) {
     user_video_table[0].present = present_flag;            // Mark table entry as present
     
-    // Check if vidmap should be writing to screen or to background 
-    if(visible_terminal == scheduled_terminal)
-        user_video_table[0].page_base_address = VIDMEM_PAGE_BASE;  // Set page to point to physical video memory
-    else
-        user_video_table[0].page_base_address = VIDMEM_PAGE_BASE + scheduled_terminal + 1; // Set page to background 
+    // Every terminal owns a VGA page, so vidmap always lands directly in the scheduled terminal's page
+    user_video_table[0].page_base_address = VIDMEM_PAGE_BASE + scheduled_terminal;
     
     page_directory[USER_VID_PAGE_DIR_I].pd_kb.present = present_flag;        //present b/c page is being initialized
     page_directory[USER_VID_PAGE_DIR_I].pd_kb.read_write = 1;     //all pages are marked read/write for mp3
@@ -195,54 +497,6 @@ void set_user_video_page(int32_t present_flag) {
     flush_tlb();
 }
 
-/*
- * change_terminal_video_page
- *    DESCRIPTION: Helper function to save and copy video memory for visible terminal switching
- *    INPUTS: from_terminal_id -- the id of the terminal to switch from
- *            to_terminal_id -- the id of the terminal to switch to
- *    RETURNS: none  
- *    SIDE EFFECTS: Changes the kernel video memory page to track the desired terminal's video page
- *    NOTES: 
- */
-void change_terminal_video_page(int32_t from_terminal_id, int32_t to_terminal_id) {
-    // Bounds check
-    if(from_terminal_id < 0 || from_terminal_id > 2 || to_terminal_id < 0 || to_terminal_id > 2)
-        return;
-
-    // Save current terminal's screen to its background buffer page
-    memcpy((void *)(VIDMEM + (from_terminal_id + 1) * FOUR_KB), (void *)VIDMEM, FOUR_KB);
-
-    // Restore new terminal's screen from background buffer to video memory
-    memcpy((void *)VIDMEM, (void *)(VIDMEM + (to_terminal_id + 1) * FOUR_KB), FOUR_KB);
-    flush_tlb();
-}
-
-/*
- * redirect_vidmem_page
- *    DESCRIPTION: Helper function to remap where virtual addr 0xB8000 for vidmem maps to physically
- *    INPUTS: terminal_id -- The terminal id that wants to write to its video page 
- *    OUTPUTS: none
- *    RETURNS: none 
- *    NOTES: This would only be used for a terminal that is currently scheduled to run but isn't
- *           the currently visible terminal. After this is called, all writes to vidmem will be redirected
- *           to the background buffer page corresponding to terminal_id.
- */ 
-void redirect_vidmem_page(int32_t terminal_id) {
-
-    // Bounds check
-    if(terminal_id < 0 || terminal_id > 2)
-        return;
-
-    // Redirect kernel vidmem page (if it's the currently visible terminal, reset it back to VGA)
-    if(terminal_id == visible_terminal)
-        page_table_one[VIDMEM_PAGE_BASE].page_base_address = VIDMEM_PAGE_BASE;
-    
-    else    //redirects to background buffer so it wont display on screen
-        page_table_one[VIDMEM_PAGE_BASE].page_base_address = VIDMEM_PAGE_BASE + terminal_id + 1;
-
-    flush_tlb();
-}
-
 /*  
  * flush_tlb
  *    DESCRIPTION: Used to flush TLB after making a change to the paging structure
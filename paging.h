@@ -15,9 +15,17 @@
    Each page directory entry corresponds to 4MB of VirtMem, so 256 / 4 = 64 */
 #define USER_VID_PAGE_DIR_I 64
 
-// Page base address for video memory (0xB8000 >> 12)
+// Page base address for video memory (0xB8000 >> 12), terminal i's VGA page is VIDMEM_PAGE_BASE + i
 #define VIDMEM_PAGE_BASE 0xB8
 
+// Bits in a user page table entry's avail field
+#define PTE_AVAIL_COW       0x1     // Write-protected copy-on-write page, copied on the first write
+#define PTE_AVAIL_SHARED    0x2     // Shared memory page, stays shared across fork and is never lent or replaced
+
+// Page fault error code bits
+#define PF_PRESENT          0x1     // Fault was a protection violation, not a missing page
+#define PF_WRITE            0x2     // Fault was caused by a write
+
 // (MP3.1) Page directory
 page_dir_desc_t page_directory[1024] __attribute__((aligned (FOUR_KB)));
 // (MP3.1) Page table
@@ -29,16 +37,40 @@ page_tab_desc_t user_video_table[1024] __attribute__((aligned (FOUR_KB)));
 extern void init_paging(void);
 
 // Helper function to set up user page
-extern void set_user_prog_page(uint32_t pid, int32_t present_flag);
+extern void set_user_prog_page(uint32_t page_table, int32_t present_flag);
 
-// Helper function to set up user video memory page
-extern void set_user_video_page(int32_t present_flag);
+// Makes an empty user page table, returns its address or 0
+extern uint32_t user_space_create(void);
+
+// Makes a copy-on-write clone of a user page table, returns its address or 0
+extern uint32_t user_space_clone(uint32_t page_table);
+
+// Frees a user page table and every page mapped in it
+extern void user_space_destroy(uint32_t page_table);
+
+// Resolves demand-zero and copy-on-write faults in the mapped user page, returns 0 if handled
+extern int32_t user_page_fault(uint32_t addr, uint32_t error_code);
 
-// Helper function to save and copy video memory for visible terminal switching
-void change_terminal_video_page(int32_t from_terminal_id, int32_t to_terminal_id);
+// Faults in every page of a user range (writable if write), returns 0 or -1 if part of it can't be
+extern int32_t user_range_prepare(uint32_t addr, uint32_t len, int32_t write);
 
-// Helper function to remap where virtual video memory maps to physically
-void redirect_vidmem_page(int32_t terminal_id); 
+// Takes a reference to a present user page's frame and makes the page copy-on-write, returns 0 if not present
+extern uint32_t user_page_loan(uint32_t addr);
+
+// Maps a frame at a user page, taking over the caller's reference, returns 0 on success
+extern int32_t user_page_install(uint32_t addr, uint32_t frame);
+
+// Maps a frame read-only (not copy-on-write) at a user page, taking over the caller's reference, returns 0 on success
+extern int32_t user_page_map_readonly(uint32_t addr, uint32_t frame);
+
+// Maps a shared memory frame at a user page, taking over the caller's reference, returns 0 on success
+extern int32_t user_page_share(uint32_t addr, uint32_t frame);
+
+// Unmaps a user page and drops its frame
+extern void user_page_unmap(uint32_t addr);
+
+// Helper function to set up user video memory page
+extern void set_user_video_page(int32_t present_flag);
 
 // Function to flush TLB
 extern void flush_tlb(void);
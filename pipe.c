@@ -0,0 +1,277 @@
+/* pipe.c - Pipes between processes
+ * vim:ts=4 noexpandtab
+ */
+
+#include "pipe.h"
+#include "frame.h"
+#include "kmalloc.h"
+#include "paging.h"
+#include "scheduler.h"
+#include "file.h"
+#include "lib.h"
+
+/* NOTES: A pipe is a ring of up to PIPE_SLOTS pages. Small writes are copied into the newest page
+          while it has room. A write that covers a whole page-aligned user page lends that page to
+          the pipe instead (it turns copy-on-write, so the writer can keep using its buffer), and a
+          read of a whole page into a page-aligned user buffer maps the page straight into the
+          reader. Big transfers between page-aligned buffers never copy any data. Everything runs
+          with interrupts off, readers and writers sleep on the pipe's wait queues. */
+
+static int32_t page_aligned_user(uint32_t addr, int32_t left);
+static void pipe_pop(pipe_t * pipe);
+static void pipe_push(pipe_t * pipe, uint32_t frame, uint32_t end);
+
+/*
+ * pipe_alloc
+ *    DESCRIPTION: Makes an empty pipe
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUE: The pipe with one reader and one writer, NULL if out of memory
+ *    SIDE EFFECTS: Pages are only allocated as data is written
+ */
+pipe_t * pipe_alloc(void) {
+    pipe_t * pipe = kmalloc(sizeof(pipe_t));
+
+    if(pipe == NULL)
+        return NULL;
+    memset(pipe, 0, sizeof(pipe_t));
+    pipe->readers = 1;
+    pipe->writers = 1;
+    return pipe;
+}
+
+/*
+ * pipe_put
+ *    DESCRIPTION: Writes data into a pipe
+ *    INPUTS: pipe -- the pipe
+ *            buf -- data to write
+ *            nbytes -- number of bytes to write
+ *    OUTPUTS: none
+ *    RETURN VALUE: nbytes, fewer if the last reader closes or memory runs out part way,
+ *                  -1 if nothing could be written
+ *    SIDE EFFECTS: Blocks while the pipe is full. Whole page-aligned user pages are lent to the
+ *                  pipe instead of copied
+ */
+int32_t pipe_put(pipe_t * pipe, const uint8_t * buf, int32_t nbytes) {
+    pipe_slot_t * tail;
+    int32_t done = 0;
+    uint32_t len, frame, flags;
+
+    if(nbytes < 0)
+        return -1;
+
+    cli_and_save(flags);
+    while(done < nbytes) {
+        if(pipe->readers == 0)
+            break;
+        tail = pipe->count ? &pipe->slots[(pipe->head + pipe->count - 1) % PIPE_SLOTS] : NULL;
+
+        // Lend whole pages
+        if(pipe->count < PIPE_SLOTS && page_aligned_user((uint32_t)(buf + done), nbytes - done)) {
+            frame = user_page_loan((uint32_t)(buf + done));
+            if(frame != 0) {
+                pipe_push(pipe, frame, FOUR_KB);
+                done += FOUR_KB;
+                continue;
+            }
+        }
+
+        // Top up the newest page (lent pages are always full)
+        if(tail != NULL && tail->end < FOUR_KB) {
+            len = FOUR_KB - tail->end;
+            if(len > nbytes - done)
+                len = nbytes - done;
+            memcpy((uint8_t *)tail->frame + tail->end, buf + done, len);
+            tail->end += len;
+            done += len;
+            continue;
+        }
+
+        if(pipe->count < PIPE_SLOTS) {
+            frame = frame_alloc(1, 1);
+            if(frame == 0)
+                break;
+            pipe_push(pipe, frame, 0);
+            continue;
+        }
+
+        // Full, let the readers drain it
+        wake_up(&pipe->read_wait);
+        sleep_on(&pipe->write_wait);
+    }
+    wake_up(&pipe->read_wait);
+    restore_flags(flags);
+
+    return (done == 0 && nbytes != 0) ? -1 : done;
+}
+
+/*
+ * pipe_get
+ *    DESCRIPTION: Reads data out of a pipe
+ *    INPUTS: pipe -- the pipe
+ *            buf -- where to put the data
+ *            nbytes -- most bytes to read
+ *    OUTPUTS: fills buf
+ *    RETURN VALUE: Bytes read, only blocks until there is some data. 0 if the pipe is empty and
+ *                  every write end is closed, -1 for a bad nbytes
+ *    SIDE EFFECTS: Whole pages going to page-aligned user buffers are mapped instead of copied
+ */
+int32_t pipe_get(pipe_t * pipe, uint8_t * buf, int32_t nbytes) {
+    pipe_slot_t * slot;
+    int32_t done = 0;
+    uint32_t len, flags;
+
+    if(nbytes < 0)
+        return -1;
+
+    cli_and_save(flags);
+    while(pipe->count == 0 && pipe->writers != 0 && nbytes != 0)
+        sleep_on(&pipe->read_wait);
+
+    while(done < nbytes && pipe->count != 0) {
+        slot = &pipe->slots[pipe->head];
+        len = slot->end - slot->start;
+
+        // Hand over a whole page, the reference moves from the pipe to the reader's page table
+        if(len == FOUR_KB && page_aligned_user((uint32_t)(buf + done), nbytes - done)
+                && user_page_install((uint32_t)(buf + done), slot->frame) == 0) {
+            slot->frame = 0;
+            pipe_pop(pipe);
+            done += FOUR_KB;
+            continue;
+        }
+
+        if(len > nbytes - done)
+            len = nbytes - done;
+        memcpy(buf + done, (uint8_t *)slot->frame + slot->start, len);
+        slot->start += len;
+        done += len;
+        if(slot->start == slot->end)
+            pipe_pop(pipe);
+    }
+    wake_up(&pipe->write_wait);
+    restore_flags(flags);
+
+    return done;
+}
+
+/*
+ * pipe_release
+ *    DESCRIPTION: Drops one end of a pipe
+ *    INPUTS: pipe -- the pipe
+ *            writer -- 1 for a write end, 0 for a read end
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Wakes the other side so it sees EOF/no readers, frees the pipe and its pages
+ *                  when both sides are gone
+ */
+void pipe_release(pipe_t * pipe, int32_t writer) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if(writer) {
+        pipe->writers--;
+        wake_up(&pipe->read_wait);
+    } else {
+        pipe->readers--;
+        wake_up(&pipe->write_wait);
+    }
+    if(pipe->readers == 0 && pipe->writers == 0) {
+        while(pipe->count != 0)
+            pipe_pop(pipe);
+        kfree(pipe);
+    }
+    restore_flags(flags);
+}
+
+/*
+ * pipe_read
+ *    DESCRIPTION: read() for the read end of a pipe
+ *    INPUTS: fd -- file descriptor, buf -- output buffer, nbytes -- most bytes to read
+ *    OUTPUTS: fills buf
+ *    RETURN VALUE: See pipe_get
+ */
+int32_t pipe_read(int32_t fd, void * buf, int32_t nbytes) {
+    return pipe_get((pipe_t *)fd_get(current_task, fd)->inode, buf, nbytes);
+}
+
+/*
+ * pipe_write
+ *    DESCRIPTION: write() for the write end of a pipe
+ *    INPUTS: fd -- file descriptor, buf -- data, nbytes -- bytes to write
+ *    OUTPUTS: none
+ *    RETURN VALUE: See pipe_put
+ */
+int32_t pipe_write(int32_t fd, const void * buf, int32_t nbytes) {
+    return pipe_put((pipe_t *)fd_get(current_task, fd)->inode, buf, nbytes);
+}
+
+/*
+ * pipe_read_close
+ *    DESCRIPTION: close() for the read end of a pipe
+ *    INPUTS: fd -- file descriptor
+ *    OUTPUTS: none
+ *    RETURN VALUE: 0
+ */
+int32_t pipe_read_close(int32_t fd) {
+    pipe_release((pipe_t *)fd_get(current_task, fd)->inode, 0);
+    return 0;
+}
+
+/*
+ * pipe_write_close
+ *    DESCRIPTION: close() for the write end of a pipe
+ *    INPUTS: fd -- file descriptor
+ *    OUTPUTS: none
+ *    RETURN VALUE: 0
+ */
+int32_t pipe_write_close(int32_t fd) {
+    pipe_release((pipe_t *)fd_get(current_task, fd)->inode, 1);
+    return 0;
+}
+
+/*
+ * page_aligned_user
+ *    DESCRIPTION: Checks whether a transfer can move a whole page by remapping
+ *    INPUTS: addr -- current position in the caller's buffer
+ *            left -- bytes left in the transfer
+ *    RETURN VALUE: 1 if addr starts a user page and the transfer covers all of it, 0 otherwise
+ */
+static int32_t page_aligned_user(uint32_t addr, int32_t left) {
+    return (addr & (FOUR_KB - 1)) == 0 && left >= FOUR_KB
+        && addr >= ONE_TWO_EIGHT_MB && addr + FOUR_KB <= ONE_THREE_TWO_MB;
+}
+
+/*
+ * pipe_push
+ *    DESCRIPTION: Appends a page to a pipe that has a free slot
+ *    INPUTS: pipe -- the pipe
+ *            frame -- the page, the pipe takes over the caller's reference
+ *            end -- bytes of data already in it
+ *    RETURN VALUE: none
+ */
+static void pipe_push(pipe_t * pipe, uint32_t frame, uint32_t end) {
+    pipe_slot_t * slot = &pipe->slots[(pipe->head + pipe->count) % PIPE_SLOTS];
+
+    slot->frame = frame;
+    slot->start = 0;
+    slot->end = end;
+    pipe->count++;
+}
+
+/*
+ * pipe_pop
+ *    DESCRIPTION: Drops the oldest page of a pipe
+ *    INPUTS: pipe -- the pipe, must not be empty
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Frees the page unless it was handed to a reader
+ */
+static void pipe_pop(pipe_t * pipe) {
+    pipe_slot_t * slot = &pipe->slots[pipe->head];
+
+    if(slot->frame != 0)
+        frame_free(slot->frame, 1);
+    slot->frame = 0;
+    pipe->head = (pipe->head + 1) % PIPE_SLOTS;
+    pipe->count--;
+}
@@ -0,0 +1,49 @@
+/* pipe.h - Pipes between processes
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _PIPE_H
+#define _PIPE_H
+
+#include "types.h"
+#include "system_calls.h"
+
+#define PIPE_SLOTS          16          // Pages a pipe holds before writers block
+
+// One page of data in a pipe, bytes start .. end - 1 of the frame are unread
+typedef struct pipe_slot {
+    uint32_t frame;
+    uint32_t start;
+    uint32_t end;
+} pipe_slot_t;
+
+// Ring of pages, filled by copying small writes or by lending whole pages of the writer's memory
+typedef struct pipe {
+    pipe_slot_t slots[PIPE_SLOTS];
+    uint32_t head;                      // Oldest slot
+    uint32_t count;                     // Slots in use
+    uint32_t readers;                   // Open read ends (fork and dup share one end through its file_t)
+    uint32_t writers;                   // Open write ends
+    wait_queue_t read_wait;             // Readers waiting for data
+    wait_queue_t write_wait;            // Writers waiting for room
+} pipe_t;
+
+// Makes an empty pipe with one reader and one writer, returns NULL if out of memory
+pipe_t * pipe_alloc(void);
+
+// Writes nbytes into the pipe, blocking while it's full, returns bytes written or -1 if nobody reads
+int32_t pipe_put(pipe_t * pipe, const uint8_t * buf, int32_t nbytes);
+
+// Reads up to nbytes, blocking while the pipe is empty, returns bytes read (0 once all writers closed)
+int32_t pipe_get(pipe_t * pipe, uint8_t * buf, int32_t nbytes);
+
+// Drops a read (writer = 0) or write (writer = 1) end, frees the pipe with the last one
+void pipe_release(pipe_t * pipe, int32_t writer);
+
+// fops for the two ends, the pipe is kept in the file descriptor's inode field
+int32_t pipe_read(int32_t fd, void * buf, int32_t nbytes);
+int32_t pipe_write(int32_t fd, const void * buf, int32_t nbytes);
+int32_t pipe_read_close(int32_t fd);
+int32_t pipe_write_close(int32_t fd);
+
+#endif /* _PIPE_H */
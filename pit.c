@@ -3,6 +3,9 @@
 #include "x86_desc.h"
 #include "i8259.h"
 #include "scheduler.h"
+#include "keyboard.h"
+#include "signal.h"
+#include "vdso.h"
 
 
 /*
@@ -26,14 +29,26 @@ void init_PIT(){
 
 /*
  * PIT_interrupt
- *    DESCRIPTION: Calls scheduler on every PIT interrupt
+ *    DESCRIPTION: Runs deferred keyboard work, advances the vvar clock, counts down alarms and
+ *                 calls scheduler on every PIT interrupt
  *    INPUTS: none
  *    OUTPUTS: none
  *    RETURNS: none
  *    SIDE EFFECTS: none
- *    NOTES: 
+ *    NOTES: The keyboard bottom half runs with interrupts enabled so it never adds to the
+ *           time other IRQs spend masked. It's skipped when nothing is queued, which also
+ *           keeps the terminal bootup ticks (keyboard IRQ still off) untouched.
  */ 
 void PIT_handler(){
     send_eoi(PIT_IRQ);  //supplemental session included this before calling scheduler helper
+    
+    if(keyboard_pending()) {
+        sti();
+        keyboard_bottom_half();
+        cli();
+    }
+
+    vvar_tick();        //user-visible clock in the vvar page
+    signal_tick();      //alarms count down in PIT ticks
     scheduler();        //PIT handler calls scheduling algorithm
 }
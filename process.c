@@ -0,0 +1,291 @@
+/* process.c - PID allocation and PCB/kernel stack management
+ * vim:ts=4 noexpandtab
+ */
+
+#include "process.h"
+#include "frame.h"
+#include "paging.h"
+#include "lib.h"
+#include "shm.h"
+#include "file.h"
+#include "signal.h"
+#include "aio.h"
+
+/* NOTES: Every process gets an 8KB block from the frame allocator with its PCB at the bottom and
+          its kernel stack above it. The block is 8KB aligned, so the PCB can still be found by
+          masking tss.esp0 (or any kernel stack address) with PCB_MASK. PIDs come from a bitmap
+          searched from the lowest word that may have a free bit, and live PCBs are chained in a
+          small hash table so lookups by PID don't depend on how many processes exist. */
+
+static uint32_t pid_bitmap[PID_MAX / 32];
+static uint32_t pid_hint;               // Lowest bitmap word that may have a free PID
+static pcb_t * pid_hash[PID_HASH_SIZE];
+static uint32_t num_processes;
+static pcb_t * deferred_free;           // Exited orphans waiting for pcb_reap_deferred, linked through hash_next
+
+/*
+ * init_processes
+ *    DESCRIPTION: Marks every PID free and empties the PID hash
+ *    INPUTS/OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: none
+ */
+void init_processes(void) {
+    memset(pid_bitmap, 0, sizeof(pid_bitmap));
+    memset(pid_hash, 0, sizeof(pid_hash));
+    pid_hint = 0;
+    num_processes = 0;
+}
+
+/*
+ * pid_alloc
+ *    DESCRIPTION: Reserves the lowest free PID
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUE: The PID, -1 if all PID_MAX are in use
+ *    SIDE EFFECTS: Call with interrupts off
+ */
+static int32_t pid_alloc(void) {
+    uint32_t word, bit;
+
+    for(word = pid_hint; word < PID_MAX / 32; word++) {
+        if(pid_bitmap[word] != 0xFFFFFFFF)
+            break;
+    }
+    pid_hint = word;
+    if(word == PID_MAX / 32)
+        return -1;
+
+    // Find first zero: the lowest set bit of the inverted word
+    asm volatile ("bsfl %1, %0" : "=r"(bit) : "r"(~pid_bitmap[word]) : "cc");
+    pid_bitmap[word] |= 1 << bit;
+    return word * 32 + bit;
+}
+
+/*
+ * pid_free
+ *    DESCRIPTION: Returns a PID to the bitmap
+ *    INPUTS: pid -- PID to release
+ *    OUTPUTS/RETURN VALUE: none
+ *    SIDE EFFECTS: Call with interrupts off
+ */
+static void pid_free(int32_t pid) {
+    if(pid < 0 || pid >= PID_MAX)
+        return;
+    pid_bitmap[pid >> 5] &= ~(1 << (pid & 31));
+    if((pid >> 5) < pid_hint)
+        pid_hint = pid >> 5;
+}
+
+/*
+ * pcb_alloc
+ *    DESCRIPTION: Creates a PCB with a fresh PID and its own kernel stack
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUE: The new PCB (process_id set, no address space, no parent or children), NULL if out of PIDs or memory
+ *    SIDE EFFECTS: The PCB is findable with pcb_lookup right away
+ */
+pcb_t * pcb_alloc(void) {
+    pcb_t * pcb;
+    int32_t pid;
+    uint32_t flags;
+
+    pcb = (pcb_t *)frame_alloc(PCB_STACK_SIZE / FRAME_SIZE, PCB_STACK_SIZE / FRAME_SIZE);
+    if(pcb == NULL)
+        return NULL;
+
+    cli_and_save(flags);
+    pid = pid_alloc();
+    if(pid == -1) {
+        restore_flags(flags);
+        frame_free((uint32_t)pcb, PCB_STACK_SIZE / FRAME_SIZE);
+        return NULL;
+    }
+    pcb->process_id = pid;
+    pcb->page_table = 0;
+    pcb->parent_pcb = NULL;
+    pcb->first_child = NULL;
+    pcb->next_sibling = NULL;
+    pcb->pending_signals = 0;
+    pcb->signal_mask = 0;
+    memset(pcb->signal_handlers, 0, sizeof(pcb->signal_handlers));
+    pcb->alarm_interval = 0;
+    pcb->alarm_left = 0;
+    pcb->alarm_next = NULL;
+    pcb->wait_next = NULL;
+    pcb->child_wait.head = NULL;
+    memset(pcb->shm, 0, sizeof(pcb->shm));
+    pcb->aio = NULL;
+    memset(pcb->mmaps, 0, sizeof(pcb->mmaps));
+    fd_table_init(pcb);
+    pcb->hash_next = pid_hash[pid & (PID_HASH_SIZE - 1)];
+    pid_hash[pid & (PID_HASH_SIZE - 1)] = pcb;
+    num_processes++;
+    restore_flags(flags);
+
+    return pcb;
+}
+
+/*
+ * pcb_free
+ *    DESCRIPTION: Tears down a PCB made by pcb_alloc
+ *    INPUTS: pcb -- PCB to free
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Frees the PID, the user address space (if any) and the PCB + kernel stack block.
+ *                  Freeing the running process's own block is fine as long as interrupts stay off
+ *                  until we're off its stack, nothing else can reuse the frames before then
+ */
+void pcb_free(pcb_t * pcb) {
+    pcb_t ** link;
+    uint32_t flags;
+
+    if(pcb == NULL)
+        return;
+
+    cli_and_save(flags);
+    for(link = &pid_hash[pcb->process_id & (PID_HASH_SIZE - 1)]; *link != NULL; link = &(*link)->hash_next) {
+        if(*link == pcb) {
+            *link = pcb->hash_next;
+            break;
+        }
+    }
+    pid_free(pcb->process_id);
+    num_processes--;
+
+    shm_release_all(pcb);
+    aio_release(pcb);
+    signal_exit(pcb);
+    fd_table_free(pcb);
+    user_space_destroy(pcb->page_table);
+    pcb->page_table = 0;
+    frame_free((uint32_t)pcb, PCB_STACK_SIZE / FRAME_SIZE);
+    restore_flags(flags);
+}
+
+/*
+ * pcb_free_deferred
+ *    DESCRIPTION: Queues a PCB to be freed by the next pcb_reap_deferred
+ *    INPUTS: pcb -- PCB of an exiting process that is still running on its kernel stack
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: The PID stays taken until the PCB is really freed
+ */
+void pcb_free_deferred(pcb_t * pcb) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    pcb->state = TASK_ZOMBIE;
+    pcb->run_next = deferred_free;
+    deferred_free = pcb;
+    restore_flags(flags);
+}
+
+/*
+ * pcb_reap_deferred
+ *    DESCRIPTION: Frees every PCB queued by pcb_free_deferred
+ *    INPUTS/OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Must run on a kernel stack other than the queued ones (the scheduler calls it
+ *                  after switching tasks)
+ */
+void pcb_reap_deferred(void) {
+    pcb_t * pcb;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    while(deferred_free != NULL) {
+        pcb = deferred_free;
+        deferred_free = pcb->run_next;
+        pcb_free(pcb);
+    }
+    restore_flags(flags);
+}
+
+/*
+ * process_add_child
+ *    DESCRIPTION: Links a new process under its parent
+ *    INPUTS: parent -- parent process, child -- new process
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Sets child's parent_pcb
+ */
+void process_add_child(pcb_t * parent, pcb_t * child) {
+    child->parent_pcb = parent;
+    child->next_sibling = parent->first_child;
+    parent->first_child = child;
+}
+
+/*
+ * process_remove_child
+ *    DESCRIPTION: Unlinks a process from its parent's children
+ *    INPUTS: child -- process to unlink
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Clears child's parent_pcb
+ */
+void process_remove_child(pcb_t * child) {
+    pcb_t ** link;
+
+    if(child->parent_pcb == NULL)
+        return;
+    for(link = &child->parent_pcb->first_child; *link != NULL; link = &(*link)->next_sibling) {
+        if(*link == child) {
+            *link = child->next_sibling;
+            break;
+        }
+    }
+    child->parent_pcb = NULL;
+    child->next_sibling = NULL;
+}
+
+/*
+ * process_release_children
+ *    DESCRIPTION: Lets go of an exiting process's children
+ *    INPUTS: parent -- the exiting process
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Zombie children are freed, live ones lose their parent and free themselves on exit
+ */
+void process_release_children(pcb_t * parent) {
+    pcb_t * child;
+
+    while((child = parent->first_child) != NULL) {
+        parent->first_child = child->next_sibling;
+        child->parent_pcb = NULL;
+        child->next_sibling = NULL;
+        if(child->state == TASK_ZOMBIE)
+            pcb_free(child);
+    }
+}
+
+/*
+ * pcb_lookup
+ *    DESCRIPTION: Finds a live process by PID
+ *    INPUTS: pid -- PID to look up
+ *    OUTPUTS: none
+ *    RETURN VALUE: Its PCB, NULL if no live process has that PID
+ *    SIDE EFFECTS: none
+ */
+pcb_t * pcb_lookup(int32_t pid) {
+    pcb_t * pcb;
+
+    if(pid < 0 || pid >= PID_MAX)
+        return NULL;
+    for(pcb = pid_hash[pid & (PID_HASH_SIZE - 1)]; pcb != NULL; pcb = pcb->hash_next) {
+        if(pcb->process_id == (uint32_t)pid)
+            return pcb;
+    }
+    return NULL;
+}
+
+/*
+ * process_count
+ *    DESCRIPTION: Returns the number of live processes
+ *    INPUTS/OUTPUTS: none
+ *    RETURN VALUE: Process count
+ *    SIDE EFFECTS: none
+ */
+uint32_t process_count(void) {
+    return num_processes;
+}
@@ -0,0 +1,52 @@
+/* process.h - PID allocation and PCB/kernel stack management
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _PROCESS_H
+#define _PROCESS_H
+
+#include "types.h"
+#include "system_calls.h"
+
+#define PID_MAX             32768       // PIDs are 0 .. PID_MAX - 1
+#define PID_HASH_SIZE       256         // Buckets in the PID -> PCB hash (power of 2)
+#define PCB_STACK_SIZE      EIGHT_KB    // PCB + kernel stack block, also its alignment
+#define PCB_MASK            0xFFFFE000  // ANDing a kernel stack address with this finds its PCB
+
+// Kernel stack pointer (for tss.esp0) of a PCB's block
+#define PCB_KERNEL_STACK(pcb)   ((uint32_t)(pcb) + PCB_STACK_SIZE - 4)
+
+// Registers a system call from user level saved at the top of the PCB's kernel stack
+#define PCB_SYSCALL_CONTEXT(pcb) ((hw_context_t *)(PCB_KERNEL_STACK(pcb) - sizeof(hw_context_t)))
+
+// Resets the PID bitmap and PID hash
+void init_processes(void);
+
+// Allocates a PCB + kernel stack block and a free PID, returns NULL on failure
+pcb_t * pcb_alloc(void);
+
+// Releases a PCB's PID, user address space and PCB + kernel stack block
+void pcb_free(pcb_t * pcb);
+
+// Frees a PCB once we're off its kernel stack (for exiting processes nobody will wait for)
+void pcb_free_deferred(pcb_t * pcb);
+
+// Frees PCBs passed to pcb_free_deferred, call from a different kernel stack
+void pcb_reap_deferred(void);
+
+// Adds child to parent's list of children
+void process_add_child(pcb_t * parent, pcb_t * child);
+
+// Takes child off its parent's list of children
+void process_remove_child(pcb_t * child);
+
+// Frees an exiting process's zombie children and orphans the rest
+void process_release_children(pcb_t * parent);
+
+// Finds the PCB of a live PID, returns NULL if there is none
+pcb_t * pcb_lookup(int32_t pid);
+
+// Returns the number of live processes
+uint32_t process_count(void);
+
+#endif /* _PROCESS_H */
@@ -0,0 +1,40 @@
+/* ramdisk.c - Block device over memory, used for the boot module
+ * vim:ts=4 noexpandtab
+ */
+
+#include "ramdisk.h"
+#include "lib.h"
+
+static int32_t ramdisk_read(block_dev_t * dev, uint32_t block, uint8_t * buf);
+
+/*
+ * ramdisk_init
+ *    DESCRIPTION: Makes a block device out of memory
+ *    INPUTS: dev -- the device to fill in
+ *            name -- its name
+ *            base -- address of block 0 (identity mapped, or physical before paging)
+ *            num_blocks -- its length in BCACHE_BLOCK_SIZE blocks
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: The memory is only ever read
+ */
+void ramdisk_init(block_dev_t * dev, const int8_t * name, uint32_t base, uint32_t num_blocks) {
+    dev->name = name;
+    dev->num_blocks = num_blocks;
+    dev->read = ramdisk_read;
+    dev->priv = (void *)base;
+}
+
+/*
+ * ramdisk_read
+ *    DESCRIPTION: block_dev_t read, copies a block out of memory
+ *    INPUTS: dev -- the ramdisk, block -- block number
+ *    OUTPUTS: buf -- BCACHE_BLOCK_SIZE bytes of the block
+ *    RETURN VALUE: 0 on success, -1 past the end
+ */
+static int32_t ramdisk_read(block_dev_t * dev, uint32_t block, uint8_t * buf) {
+    if(block >= dev->num_blocks)
+        return -1;
+    memcpy(buf, (uint8_t *)dev->priv + block * BCACHE_BLOCK_SIZE, BCACHE_BLOCK_SIZE);
+    return 0;
+}
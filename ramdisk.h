@@ -0,0 +1,14 @@
+/* ramdisk.h - Block device over memory, used for the boot module
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _RAMDISK_H
+#define _RAMDISK_H
+
+#include "types.h"
+#include "bcache.h"
+
+// Makes dev read num_blocks blocks starting at physical address base
+void ramdisk_init(block_dev_t * dev, const int8_t * name, uint32_t base, uint32_t num_blocks);
+
+#endif /* _RAMDISK_H */
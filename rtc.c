@@ -13,6 +13,9 @@
    Ordered as 2^(index + 1) Hz but we don't go above 1024 Hz*/
 // unsigned char freq_list[10] = {0x0F, 0x0E, 0x0D, 0x0C, 0x0B, 0x0A, 0x09, 0x08, 0x07, 0x06};
 
+static uint8_t cmos_read(uint8_t reg);
+static uint32_t days_from_civil(uint32_t year, uint32_t month, uint32_t day);
+
 /*
  * init_RTC
  *    DESCRIPTION: Initialize RTC to 1024Hz and turns on IRQ8
@@ -188,3 +191,87 @@ int32_t RTC_close(int32_t fd) {
     terminals[scheduled_terminal].rtc_virt_interrupt = 0;
     return 0;
 }
+
+/*
+ * RTC_get_time
+ *    DESCRIPTION: Reads the time of day from the CMOS clock
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURNS: Seconds since 1970-01-01 00:00, taking the CMOS clock to be UTC
+ *    SIDE EFFECTS: Spins while the clock is updating (at most a few ms, once a second)
+ *    NOTES: Reads until two passes agree so an update can't land between registers
+ */
+uint32_t RTC_get_time(void) {
+    uint8_t sec, min, hour, day, month, year, reg_b;
+    uint8_t last[6];
+
+    do {
+        while(cmos_read(REGISTER_A) & RTC_UPDATING);
+        last[0] = cmos_read(CMOS_SECONDS);
+        last[1] = cmos_read(CMOS_MINUTES);
+        last[2] = cmos_read(CMOS_HOURS);
+        last[3] = cmos_read(CMOS_DAY);
+        last[4] = cmos_read(CMOS_MONTH);
+        last[5] = cmos_read(CMOS_YEAR);
+
+        while(cmos_read(REGISTER_A) & RTC_UPDATING);
+        sec = cmos_read(CMOS_SECONDS);
+        min = cmos_read(CMOS_MINUTES);
+        hour = cmos_read(CMOS_HOURS);
+        day = cmos_read(CMOS_DAY);
+        month = cmos_read(CMOS_MONTH);
+        year = cmos_read(CMOS_YEAR);
+    } while(sec != last[0] || min != last[1] || hour != last[2]
+            || day != last[3] || month != last[4] || year != last[5]);
+
+    reg_b = cmos_read(REGISTER_B);
+    if(!(reg_b & RTC_BINARY)) {
+        sec = (sec & 0x0F) + (sec >> 4) * 10;
+        min = (min & 0x0F) + (min >> 4) * 10;
+        hour = (hour & 0x0F) + ((hour & 0x70) >> 4) * 10 + (hour & RTC_PM);
+        day = (day & 0x0F) + (day >> 4) * 10;
+        month = (month & 0x0F) + (month >> 4) * 10;
+        year = (year & 0x0F) + (year >> 4) * 10;
+    }
+    // 12-hour clock: 12 AM is hour 0, 12 PM is hour 12
+    if(!(reg_b & RTC_24_HOUR) && (hour & RTC_PM))
+        hour = (hour & ~RTC_PM) % 12 + 12;
+    else if(!(reg_b & RTC_24_HOUR) && hour == 12)
+        hour = 0;
+
+    return ((days_from_civil(RTC_CENTURY + year, month, day) * 24 + hour) * 60 + min) * 60 + sec;
+}
+
+/*
+ * cmos_read
+ *    DESCRIPTION: Reads one CMOS register with NMI disabled
+ *    INPUTS: reg -- register index
+ *    OUTPUTS: none
+ *    RETURNS: The register's value
+ */
+static uint8_t cmos_read(uint8_t reg) {
+    outb(reg | DISABLE_NMI, RTC_PORT);
+    return inb(CMOS_PORT);
+}
+
+/*
+ * days_from_civil
+ *    DESCRIPTION: Counts days from 1970-01-01 to a Gregorian date
+ *    INPUTS: year -- full year, 1970 or later
+ *            month -- 1 to 12
+ *            day -- 1 to 31
+ *    OUTPUTS: none
+ *    RETURNS: Days since the epoch
+ *    NOTES: Counts years from March so the leap day comes last
+ */
+static uint32_t days_from_civil(uint32_t year, uint32_t month, uint32_t day) {
+    uint32_t era, yoe, doy, doe;
+
+    if(month <= 2)
+        year--;
+    era = year / 400;
+    yoe = year - era * 400;                                 // [0, 399]
+    doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;    // [0, 365]
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;            // [0, 146096]
+    return era * 146097 + doe - 719468;                     // 719468 days from 0000-03-01 to 1970-01-01
+}
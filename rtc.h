@@ -24,6 +24,20 @@
 #define REGISTER_C		        0x0C
 #define HIGHEST_FREQ            1024
 #define HIGHEST_FREQ_BITMASK    0x06         // Bitmask to set frequency to 1024Hz
+#define DISABLE_NMI             0x80         // OR into a register index to keep NMI off while selected
+
+// CMOS clock registers and register A/B bits for reading the time of day
+#define CMOS_SECONDS            0x00
+#define CMOS_MINUTES            0x02
+#define CMOS_HOURS              0x04
+#define CMOS_DAY                0x07
+#define CMOS_MONTH              0x08
+#define CMOS_YEAR               0x09
+#define RTC_UPDATING            0x80         // Register A: clock registers are changing
+#define RTC_BINARY              0x04         // Register B: values are binary, not BCD
+#define RTC_24_HOUR             0x02         // Register B: hours are 0-23, not 12-hour with a PM bit
+#define RTC_PM                  0x80         // Set in the hour of a 12-hour clock after noon
+#define RTC_CENTURY             2000         // The CMOS year is only two digits
 
 // Initialize the RTC and turn on IRQ8
 void init_RTC();
@@ -31,6 +45,9 @@ void init_RTC();
 // Handles interrupts from the real-time clock
 extern void RTC_interrupt();
 
+// Reads the CMOS clock as seconds since 1970-01-01 00:00 UTC
+uint32_t RTC_get_time(void);
+
 // Initialize RTC to 2 Hz
 int32_t RTC_open(const uint8_t* filename);
 
@@ -7,72 +7,227 @@
 #include "x86_desc.h"
 #include "rtc.h"
 #include "keyboard.h"
+#include "process.h"
+#include "asm_linkage.h"
+#include "vdso.h"
+
+#define BOOT_STACK_WORDS 2048
+
+pcb_t * current_task = NULL;
+
+// Circular list of runnable tasks, points at the one picked last
+static pcb_t * runqueue = NULL;
+
+// Stack the base shells are executed on while booting (abandoned by each execute)
+static uint32_t boot_stack[BOOT_STACK_WORDS];
+
+// Where the booting context's ESP was saved, in case the shell can't be started
+static uint32_t * boot_return_esp;
+
+// ESP of the kernel idle loop, saved by the first boot and never resumed
+static uint32_t idle_esp;
+
+/*
+ * runqueue_add
+ *    DESCRIPTION: Puts a task on the runqueue
+ *    INPUTS: task -- the task
+ *    OUTPUTS: none
+ *    SIDE EFFECTS: Marks it TASK_RUNNABLE, it runs after every task already queued
+ */
+void runqueue_add(pcb_t * task) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    task->state = TASK_RUNNABLE;
+    if(runqueue == NULL) {
+        task->run_next = task;
+        task->run_prev = task;
+        runqueue = task;
+    } else {
+        // Insert right before the last picked task, which is the end of the current round
+        task->run_next = runqueue;
+        task->run_prev = runqueue->run_prev;
+        runqueue->run_prev->run_next = task;
+        runqueue->run_prev = task;
+    }
+    restore_flags(flags);
+}
+
+/*
+ * runqueue_remove
+ *    DESCRIPTION: Takes a task off the runqueue
+ *    INPUTS: task -- the task, must be on the runqueue
+ *    OUTPUTS: none
+ *    SIDE EFFECTS: The caller sets the task's new state
+ */
+void runqueue_remove(pcb_t * task) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if(task->run_next == task) {
+        runqueue = NULL;
+    } else {
+        task->run_prev->run_next = task->run_next;
+        task->run_next->run_prev = task->run_prev;
+        // Keep round-robin order, the removed task's successor is still next in line
+        if(runqueue == task)
+            runqueue = task->run_prev;
+    }
+    task->run_next = NULL;
+    task->run_prev = NULL;
+    restore_flags(flags);
+}
+
+/*
+ * sleep_on
+ *    DESCRIPTION: Blocks the current task until the wait queue is woken
+ *    INPUTS: wq -- the wait queue
+ *    OUTPUTS: none
+ *    SIDE EFFECTS: Takes the task off the runqueue as TASK_WAITING and runs others meanwhile.
+ *                  If nothing else is runnable, idles with interrupts on until an interrupt
+ *                  handler wakes us
+ *    NOTES: Callers check their condition with interrupts off and call again if it still
+ *           doesn't hold, wake_up wakes every sleeper
+ */
+void sleep_on(wait_queue_t * wq) {
+    pcb_t * self = current_task;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    self->wait_next = wq->head;
+    wq->head = self;
+    runqueue_remove(self);
+    self->state = TASK_WAITING;
+
+    while(self->state == TASK_WAITING) {
+        scheduler();
+        if(self->state == TASK_WAITING) {
+            sti();
+            asm volatile ("hlt");
+            cli();
+        }
+    }
+    restore_flags(flags);
+}
+
+/*
+ * wake_up
+ *    DESCRIPTION: Wakes every task sleeping on a wait queue
+ *    INPUTS: wq -- the wait queue
+ *    OUTPUTS: none
+ *    SIDE EFFECTS: The sleepers go to the end of the runqueue, safe to call from interrupt handlers
+ */
+void wake_up(wait_queue_t * wq) {
+    pcb_t * task;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    while(wq->head != NULL) {
+        task = wq->head;
+        wq->head = task->wait_next;
+        task->wait_next = NULL;
+        if(task->state == TASK_WAITING)
+            runqueue_add(task);
+    }
+    restore_flags(flags);
+}
+
+/*
+ * set_current_task
+ *    DESCRIPTION: Makes a task the current one without switching stacks
+ *    INPUTS: task -- the task
+ *    OUTPUTS: none
+ *    SIDE EFFECTS: Maps its user page table and vidmap page, points the TSS at its kernel stack
+ *                  and makes its terminal the scheduled one
+ */
+void set_current_task(pcb_t * task) {
+    current_task = task;
+    scheduled_terminal = task->terminal_id;
+
+    set_user_video_page(1); //sets up and marks user page for vidmem as present
+
+    // Remap user program page 
+    set_user_prog_page(task->page_table, 1);
+
+    // Update TSS
+    tss.esp0 = PCB_KERNEL_STACK(task);
+    tss.ss0 = KERNEL_DS;
+    vdso_set_kernel_stack(tss.esp0);
+    vvar_set_pid(task->process_id);
+}
+
+/*
+ * boot_terminal
+ *    DESCRIPTION: Runs a terminal's first base shell on the boot stack
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    SIDE EFFECTS: Doesn't return, execute irets into the new shell. If the shell can't start,
+ *                  switches back to whoever was booting it
+ */
+static void boot_terminal() {
+    uint32_t unused_esp;
+
+    execute((uint8_t *)"shell");    //initial bootup for the terminal
+
+    printf("Terminal %d failed to boot\n", shell_count);
+    if(current_task != NULL)
+        scheduled_terminal = current_task->terminal_id;
+    context_switch(&unused_esp, *boot_return_esp);
+}
 
 /*
  * scheduler
  *    DESCRIPTION: Performs process switching and boots up all three terminals
  *    INPUTS: none
  *    OUTPUTS: none
- *    SIDE EFFECTS: Switches active process using round-robin scheduling
+ *    SIDE EFFECTS: Switches active process using round-robin scheduling over the runqueue
+ *    NOTES: Also called directly by tasks that block (waitpid) or exit, which just won't be on
+ *           the runqueue anymore. Returns when the calling task is picked again.
  */
 void scheduler(){   
     // Get the current active process's PCB
-    pcb_t * curr_pcb = terminals[scheduled_terminal].terminal_pcb;
+    pcb_t * curr_pcb = current_task;
+    pcb_t * next_pcb;
+    uint32_t * boot_esp;
         
     // Boot up the three terminals
-    if(curr_pcb == NULL && shell_count < 3){
-        pcb_t temp_pcb;
-        asm volatile(       // Retrieve initial ESP and EBP before booting base shells
-            "movl %%esp, %0;"
-            "movl %%ebp, %1;"
-            : "=r"(temp_pcb.curr_esp), "=r"(temp_pcb.curr_ebp) // Outputs
-        );
+    if(shell_count < MAX_TERMINALS){
+        scheduled_terminal = shell_count;
         shell_count++;
-        terminals[scheduled_terminal].terminal_pcb = &temp_pcb;
-        terminals[scheduled_terminal].last_assigned_pid = scheduled_terminal;   //mark terminal as booted and initialize its pid
 
-        switch_visible_terminal(scheduled_terminal);    // Switch video page so the bootup text stays in that terminal
-        
         // Enable keyboard IRQ now that all 3 terminals are booted to avoid race condition during bootup
-        if(shell_count == 3)
+        if(shell_count == MAX_TERMINALS)
             init_keyboard();
 
         printf("Terminal %d booting...\n", shell_count);
-        execute((uint8_t *)"shell");    //initial bootup for all three terminals
-    }
-
-    // Save old process's stack
-    // This properly sets up first base shell's ESP/EBP by forcing it into this context
-    asm volatile(       
-        "movl %%esp, %0;"
-        "movl %%ebp, %1;"
-        : "=r"(curr_pcb->curr_esp), "=r"(curr_pcb->curr_ebp) // Outputs
-    );
-
-    // Round-robin increment
-    scheduled_terminal = (scheduled_terminal + 1) % MAX_TERMINALS;
 
-    // If the next terminal hasn't been booted yet, boot it on the next PIT interrupt
-    if(terminals[scheduled_terminal].terminal_pcb == NULL)
+        // Run execute on the boot stack, this task carries on when it's scheduled again
+        boot_esp = &boot_stack[BOOT_STACK_WORDS - 6];
+        boot_esp[0] = 0;                            // edi
+        boot_esp[1] = 0;                            // esi
+        boot_esp[2] = 0;                            // ebx
+        boot_esp[3] = 0;                            // ebp
+        boot_esp[4] = (uint32_t)boot_terminal;      // context_switch returns into boot_terminal
+        boot_esp[5] = 0;                            // boot_terminal never returns
+        boot_return_esp = (curr_pcb != NULL) ? &curr_pcb->curr_esp : &idle_esp;
+        context_switch(boot_return_esp, (uint32_t)boot_esp);
         return;
-    
-    set_user_video_page(1); //sets up and marks user page for vidmem as present
-
-    pcb_t * next_pcb = terminals[scheduled_terminal].terminal_pcb;
+    }
 
-    // Remap user program page 
-    set_user_prog_page(next_pcb->process_id, 1);
+    // Round-robin: the task after the current one, or the next in line if the current one left the queue
+    if(runqueue == NULL)
+        return;
+    if(curr_pcb != NULL && curr_pcb->state == TASK_RUNNABLE)
+        next_pcb = curr_pcb->run_next;
+    else
+        next_pcb = runqueue->run_next;
+    runqueue = next_pcb;
+    if(next_pcb == curr_pcb)
+        return;
 
-    // Update TSS
-    tss.esp0 = EIGHT_MB - (next_pcb->process_id * EIGHT_KB) - 4;
-    tss.ss0 = KERNEL_DS;
+    set_current_task(next_pcb);
+    context_switch((curr_pcb != NULL) ? &curr_pcb->curr_esp : &idle_esp, next_pcb->curr_esp);
 
-    asm volatile(       //Switch to next process's stack
-        "movl %0, %%esp;"
-        "movl %1, %%ebp;"
-        : 
-        :"r"(next_pcb->curr_esp), "r"(next_pcb->curr_ebp) // Inputs
-        :"esp", "ebp"   //clobbers esp, ebp
-    );
-    
+    // Back on our own stack, free anything that exited on the stack we just left
+    pcb_reap_deferred();
 }
@@ -1,7 +1,26 @@
 #ifndef _SCHEDULER_H
 #define _SCHEDULER_H
 
+#include "system_calls.h"
+
+// Process whose kernel stack and address space are live (NULL until the first shell boots)
+extern pcb_t * current_task;
+
 extern void scheduler();    //holds scheduling algorithm for PIT
 
+// Puts a task on the runqueue
+extern void runqueue_add(pcb_t * task);
+
+// Takes a task off the runqueue
+extern void runqueue_remove(pcb_t * task);
+
+// Puts the current task to sleep on a wait queue until someone calls wake_up on it
+extern void sleep_on(wait_queue_t * wq);
+
+// Puts every task sleeping on a wait queue back on the runqueue
+extern void wake_up(wait_queue_t * wq);
+
+// Loads a task's address space, kernel stack and terminal without switching stacks
+extern void set_current_task(pcb_t * task);
 
 #endif /* _SCHEDULER_H */
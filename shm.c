@@ -0,0 +1,197 @@
+/* shm.c - Shared memory segments
+ * vim:ts=4 noexpandtab
+ */
+
+#include "shm.h"
+#include "frame.h"
+#include "kmalloc.h"
+#include "paging.h"
+#include "lib.h"
+
+/* NOTES: A segment's frames are allocated once by shm_get and mapped writable into every process
+          that attaches it, with PTE_AVAIL_SHARED so fork keeps them shared instead of
+          copy-on-write. Each frame is reference counted like any other user page, and the segment
+          holds one more reference of its own that it drops when the last attached process
+          detaches or exits. A segment nobody ever attaches stays around for a later shmat. */
+
+static shm_segment_t segments[SHM_MAX_SEGMENTS];
+
+static void shm_put(int32_t id);
+
+/*
+ * shm_get
+ *    DESCRIPTION: Looks up or creates a shared memory segment
+ *    INPUTS: key -- key other processes use to find the segment, SHM_KEY_PRIVATE for a new one
+ *            size -- size in bytes, rounded up to whole pages (at most the 4MB user window)
+ *    OUTPUTS: none
+ *    RETURN VALUE: Segment id, -1 if size is bad, an existing segment with the key is smaller
+ *                  than size, or we're out of segments or memory
+ *    SIDE EFFECTS: New segments are zero-filled
+ */
+int32_t shm_get(int32_t key, uint32_t size) {
+    uint32_t npages = (size + FOUR_KB - 1) / FOUR_KB;
+    shm_segment_t * seg;
+    int32_t id, free_id = -1;
+    uint32_t i;
+
+    if(size == 0 || size > FOUR_MB)
+        return -1;
+
+    for(id = 0; id < SHM_MAX_SEGMENTS; id++) {
+        if(!segments[id].in_use) {
+            if(free_id == -1)
+                free_id = id;
+            continue;
+        }
+        if(key != SHM_KEY_PRIVATE && segments[id].key == key)
+            return (segments[id].npages >= npages) ? id : -1;
+    }
+    if(free_id == -1)
+        return -1;
+
+    seg = &segments[free_id];
+    seg->frames = kmalloc(npages * sizeof(uint32_t));
+    if(seg->frames == NULL)
+        return -1;
+    for(i = 0; i < npages; i++) {
+        seg->frames[i] = frame_alloc(1, 1);
+        if(seg->frames[i] == 0) {
+            while(i-- > 0)
+                frame_free(seg->frames[i], 1);
+            kfree(seg->frames);
+            return -1;
+        }
+        memset((void *)seg->frames[i], 0, FOUR_KB);
+    }
+    seg->key = key;
+    seg->npages = npages;
+    seg->attached = 0;
+    seg->in_use = 1;
+    return free_id;
+}
+
+/*
+ * shm_attach
+ *    DESCRIPTION: Maps a segment into a process
+ *    INPUTS: pcb -- the process, its page table must be the mapped one
+ *            id -- segment id from shm_get
+ *            addr -- page-aligned user address to map it at
+ *    OUTPUTS: none
+ *    RETURN VALUE: addr, -1 if id or addr is bad, the segment doesn't fit in the user window or
+ *                  the process has SHM_PER_PROCESS segments attached already
+ *    SIDE EFFECTS: Whatever was mapped in the range before is freed
+ */
+int32_t shm_attach(pcb_t * pcb, int32_t id, uint32_t addr) {
+    shm_segment_t * seg;
+    int32_t slot;
+    uint32_t i;
+
+    if(id < 0 || id >= SHM_MAX_SEGMENTS || !segments[id].in_use)
+        return -1;
+    seg = &segments[id];
+    if((addr & (FOUR_KB - 1)) || addr < ONE_TWO_EIGHT_MB || addr + seg->npages * FOUR_KB > ONE_THREE_TWO_MB)
+        return -1;
+
+    for(slot = 0; slot < SHM_PER_PROCESS && pcb->shm[slot].addr != 0; slot++);
+    if(slot == SHM_PER_PROCESS)
+        return -1;
+
+    for(i = 0; i < seg->npages; i++) {
+        frame_get(seg->frames[i]);
+        if(user_page_share(addr + i * FOUR_KB, seg->frames[i]) == -1) {
+            frame_free(seg->frames[i], 1);
+            while(i-- > 0)
+                user_page_unmap(addr + i * FOUR_KB);
+            return -1;
+        }
+    }
+    pcb->shm[slot].id = id;
+    pcb->shm[slot].addr = addr;
+    seg->attached++;
+    return addr;
+}
+
+/*
+ * shm_detach
+ *    DESCRIPTION: Unmaps a segment from a process
+ *    INPUTS: pcb -- the process, its page table must be the mapped one
+ *            addr -- address the segment was attached at
+ *    OUTPUTS: none
+ *    RETURN VALUE: 0 on success, -1 if no segment is attached at addr
+ *    SIDE EFFECTS: Frees the segment if this was its last attachment
+ */
+int32_t shm_detach(pcb_t * pcb, uint32_t addr) {
+    int32_t slot;
+    uint32_t i;
+
+    if(addr == 0)
+        return -1;
+    for(slot = 0; slot < SHM_PER_PROCESS && pcb->shm[slot].addr != addr; slot++);
+    if(slot == SHM_PER_PROCESS)
+        return -1;
+
+    for(i = 0; i < segments[pcb->shm[slot].id].npages; i++)
+        user_page_unmap(addr + i * FOUR_KB);
+    pcb->shm[slot].addr = 0;
+    shm_put(pcb->shm[slot].id);
+    return 0;
+}
+
+/*
+ * shm_fork
+ *    DESCRIPTION: Copies a process's attachments to its forked child
+ *    INPUTS: parent -- the forking process
+ *            child -- the child, its page table already cloned from parent's
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ */
+void shm_fork(pcb_t * parent, pcb_t * child) {
+    int32_t slot;
+
+    for(slot = 0; slot < SHM_PER_PROCESS; slot++) {
+        child->shm[slot] = parent->shm[slot];
+        if(child->shm[slot].addr != 0)
+            segments[child->shm[slot].id].attached++;
+    }
+}
+
+/*
+ * shm_release_all
+ *    DESCRIPTION: Detaches every segment from a process that's exiting or exec'ing
+ *    INPUTS: pcb -- the process
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Leaves the page table alone, destroying the address space drops its
+ *                  references to the frames
+ */
+void shm_release_all(pcb_t * pcb) {
+    int32_t slot;
+
+    for(slot = 0; slot < SHM_PER_PROCESS; slot++) {
+        if(pcb->shm[slot].addr == 0)
+            continue;
+        pcb->shm[slot].addr = 0;
+        shm_put(pcb->shm[slot].id);
+    }
+}
+
+/*
+ * shm_put
+ *    DESCRIPTION: Drops an attachment of a segment
+ *    INPUTS: id -- segment id
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: The last one frees the segment, frames still mapped somewhere live on until
+ *                  those mappings go away
+ */
+static void shm_put(int32_t id) {
+    shm_segment_t * seg = &segments[id];
+    uint32_t i;
+
+    if(--seg->attached != 0)
+        return;
+    for(i = 0; i < seg->npages; i++)
+        frame_free(seg->frames[i], 1);
+    kfree(seg->frames);
+    seg->in_use = 0;
+}
@@ -0,0 +1,38 @@
+/* shm.h - Shared memory segments
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _SHM_H
+#define _SHM_H
+
+#include "types.h"
+#include "system_calls.h"
+
+#define SHM_MAX_SEGMENTS    16          // Segments that can exist at once
+#define SHM_KEY_PRIVATE     0           // shmget key that always makes a new segment
+
+// A set of frames any number of processes can map
+typedef struct shm_segment {
+    int32_t key;
+    uint32_t npages;
+    uint32_t * frames;                  // npages frames, the segment holds a reference to each
+    uint32_t attached;                  // Processes that have it attached
+    uint8_t in_use;
+} shm_segment_t;
+
+// Finds the segment with a key or makes a zeroed one of size bytes, returns its id or -1
+int32_t shm_get(int32_t key, uint32_t size);
+
+// Maps a segment at addr in pcb's (currently mapped) address space, returns addr or -1
+int32_t shm_attach(pcb_t * pcb, int32_t id, uint32_t addr);
+
+// Unmaps the segment attached at addr, returns 0 or -1 if nothing is attached there
+int32_t shm_detach(pcb_t * pcb, uint32_t addr);
+
+// Gives a forked child the parent's attachments (the page tables are cloned separately)
+void shm_fork(pcb_t * parent, pcb_t * child);
+
+// Drops every attachment of a process whose address space is going away
+void shm_release_all(pcb_t * pcb);
+
+#endif /* _SHM_H */
@@ -0,0 +1,252 @@
+/* signal.c - Signal delivery to user programs
+ * vim:ts=4 noexpandtab
+ */
+
+#include "signal.h"
+#include "scheduler.h"
+#include "process.h"
+#include "idt.h"
+#include "pit.h"
+#include "x86_desc.h"
+#include "lib.h"
+
+/* NOTES: Signals are only ever delivered on the way back to user mode: the system call, IRQ and
+          exception paths in asm_linkage.S call do_signal with the hw_context_t they are about to
+          iret with. If a handler is set, do_signal pushes a signal_frame_t onto the user stack
+          (the saved context plus a two-instruction trampoline) and points the context at the
+          handler. When the handler returns it lands in the trampoline, which calls sigreturn to
+          copy the saved context back. Kernel code never gets interrupted by a signal, a process
+          blocked in the kernel sees it once it returns. */
+
+// movl $SIGRETURN_SYSCALL, %eax; int $0x80; nop
+static const uint8_t sigreturn_code[SIGNAL_CODE_SIZE] = {0xB8, SIGRETURN_SYSCALL, 0x00, 0x00, 0x00, 0xCD, 0x80, 0x90};
+
+// Processes with an alarm set, linked through alarm_next
+static pcb_t * alarm_list;
+
+/*
+ * signal_raise
+ *    DESCRIPTION: Sends a signal to a process
+ *    INPUTS: pcb -- the process
+ *            signum -- the signal
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Safe to call from interrupt handlers. Raising a pending signal again does nothing
+ */
+void signal_raise(pcb_t * pcb, int32_t signum) {
+    uint32_t flags;
+
+    if(pcb == NULL || signum < 0 || signum >= NUM_SIGNALS)
+        return;
+    cli_and_save(flags);
+    pcb->pending_signals |= (1 << signum);
+    restore_flags(flags);
+}
+
+/*
+ * signal_handled
+ *    DESCRIPTION: Checks whether a signal would run a user handler
+ *    INPUTS: pcb -- the process
+ *            signum -- the signal
+ *    OUTPUTS: none
+ *    RETURN VALUE: 1 if pcb has a handler for signum and signum isn't blocked, 0 otherwise
+ */
+int32_t signal_handled(pcb_t * pcb, int32_t signum) {
+    return pcb != NULL && pcb->signal_handlers[signum] != NULL && !(pcb->signal_mask & (1 << signum));
+}
+
+/*
+ * signal_pending
+ *    DESCRIPTION: Checks whether a process has a signal waiting to be delivered
+ *    INPUTS: pcb -- the process
+ *    OUTPUTS: none
+ *    RETURN VALUE: 1 if an unblocked signal is pending, 0 otherwise
+ *    NOTES: Lets kernel loops that wait for user input give up early
+ */
+int32_t signal_pending(pcb_t * pcb) {
+    return pcb != NULL && (pcb->pending_signals & ~pcb->signal_mask) != 0;
+}
+
+/*
+ * do_signal
+ *    DESCRIPTION: Delivers the current process's pending signals
+ *    INPUTS: ctx -- registers the kernel is about to return to user mode with
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Runs the default action (halting for DIV_ZERO, SEGFAULT and INTERRUPT,
+ *                  nothing otherwise) of pending signals without a handler. For the first one
+ *                  with a handler, builds a signal_frame_t on the user stack and changes ctx
+ *                  so the iret enters the handler with that signal blocked
+ */
+void do_signal(hw_context_t * ctx) {
+    pcb_t * pcb = current_task;
+    signal_frame_t * frame;
+    uint32_t pending;
+    int32_t signum;
+
+    if(pcb == NULL)
+        return;
+
+    while((pending = pcb->pending_signals & ~pcb->signal_mask) != 0) {
+        for(signum = 0; !(pending & (1 << signum)); signum++);
+        pcb->pending_signals &= ~(1 << signum);
+
+        if(pcb->signal_handlers[signum] == NULL) {
+            if(signum == DIV_ZERO || signum == SEGFAULT || signum == INTERRUPT)
+                halt_wrapper();
+            continue;
+        }
+
+        // The frame has to fit on the user stack
+        frame = (signal_frame_t *)((ctx->esp - sizeof(signal_frame_t)) & ~0x3);
+        if(ctx->esp > ONE_THREE_TWO_MB || (uint32_t)frame < ONE_TWO_EIGHT_MB)
+            halt_wrapper();
+
+        memcpy(frame->code, sigreturn_code, SIGNAL_CODE_SIZE);
+        frame->old_mask = pcb->signal_mask;
+        frame->context = *ctx;
+        frame->signum = signum;
+        frame->ret_addr = (uint32_t)frame->code;
+
+        pcb->signal_mask |= (1 << signum);
+        ctx->esp = (uint32_t)frame;
+        ctx->eip = (uint32_t)pcb->signal_handlers[signum];
+        return;
+    }
+}
+
+/*
+ * signal_set_handler
+ *    DESCRIPTION: Sets a process's user handler for a signal
+ *    INPUTS: pcb -- the process
+ *            signum -- the signal
+ *            handler -- handler taking the signal number, NULL for the default action
+ *    OUTPUTS: none
+ *    RETURN VALUE: 0 on success, -1 for a bad signum or a handler outside the user page
+ */
+int32_t signal_set_handler(pcb_t * pcb, int32_t signum, void * handler) {
+    if(signum < 0 || signum >= NUM_SIGNALS)
+        return -1;
+    if(handler != NULL && ((uint32_t)handler < ONE_TWO_EIGHT_MB || (uint32_t)handler >= ONE_THREE_TWO_MB))
+        return -1;
+    pcb->signal_handlers[signum] = handler;
+    return 0;
+}
+
+/*
+ * signal_return
+ *    DESCRIPTION: Goes back from a signal handler to where the process was interrupted
+ *    INPUTS: pcb -- the process, inside its sigreturn system call
+ *    OUTPUTS: none
+ *    RETURN VALUE: The interrupted code's eax (systems_handler stores it back in the context), -1
+ *                  if the stack doesn't hold a signal frame
+ *    SIDE EFFECTS: Replaces the system call's saved context with the one do_signal saved, keeping
+ *                  the user segments and interrupts on, and restores the signal mask
+ */
+int32_t signal_return(pcb_t * pcb) {
+    hw_context_t * ctx = PCB_SYSCALL_CONTEXT(pcb);
+    signal_frame_t * frame;
+    uint32_t eflags;
+
+    // The handler's ret popped ret_addr, so esp points at signum
+    frame = (signal_frame_t *)(ctx->esp - sizeof(uint32_t));
+    if((uint32_t)frame < ONE_TWO_EIGHT_MB || (uint32_t)frame > ONE_THREE_TWO_MB - sizeof(signal_frame_t))
+        return -1;
+
+    eflags = (ctx->eflags & ~USER_EFLAGS) | (frame->context.eflags & USER_EFLAGS) | EFLAGS_IF;
+    *ctx = frame->context;
+    ctx->cs = USER_CS;
+    ctx->ss = USER_DS;
+    ctx->eflags = eflags;
+    pcb->signal_mask = frame->old_mask;
+
+    return ctx->eax;
+}
+
+/*
+ * signal_fork
+ *    DESCRIPTION: Copies signal state to a forked child
+ *    INPUTS: parent -- the forking process
+ *            child -- its child
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: The child starts with no pending signals and no alarm
+ */
+void signal_fork(pcb_t * parent, pcb_t * child) {
+    memcpy(child->signal_handlers, parent->signal_handlers, sizeof(child->signal_handlers));
+    child->signal_mask = parent->signal_mask;
+}
+
+/*
+ * signal_exec
+ *    DESCRIPTION: Forgets handlers that point into the program being replaced
+ *    INPUTS: pcb -- process that's loading a new program
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Cancels the alarm and unblocks every signal, pending signals stay pending
+ */
+void signal_exec(pcb_t * pcb) {
+    memset(pcb->signal_handlers, 0, sizeof(pcb->signal_handlers));
+    pcb->signal_mask = 0;
+    signal_alarm(pcb, 0);
+}
+
+/*
+ * signal_alarm
+ *    DESCRIPTION: Sets or cancels a process's periodic alarm
+ *    INPUTS: pcb -- the process
+ *            ms -- period in milliseconds (rounded up to PIT ticks), 0 to cancel
+ *    OUTPUTS: none
+ *    RETURN VALUE: Milliseconds that were left on the old alarm, 0 if none was set
+ */
+uint32_t signal_alarm(pcb_t * pcb, uint32_t ms) {
+    pcb_t ** link;
+    uint32_t flags, left;
+
+    cli_and_save(flags);
+    left = pcb->alarm_interval ? pcb->alarm_left * PIT_TICK_MS : 0;
+
+    if(pcb->alarm_interval == 0 && ms != 0) {
+        pcb->alarm_next = alarm_list;
+        alarm_list = pcb;
+    } else if(pcb->alarm_interval != 0 && ms == 0) {
+        for(link = &alarm_list; *link != pcb; link = &(*link)->alarm_next);
+        *link = pcb->alarm_next;
+        pcb->alarm_next = NULL;
+    }
+    pcb->alarm_interval = (ms + PIT_TICK_MS - 1) / PIT_TICK_MS;
+    pcb->alarm_left = pcb->alarm_interval;
+    restore_flags(flags);
+
+    return left;
+}
+
+/*
+ * signal_exit
+ *    DESCRIPTION: Cancels a dying process's alarm
+ *    INPUTS: pcb -- the process
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ */
+void signal_exit(pcb_t * pcb) {
+    signal_alarm(pcb, 0);
+}
+
+/*
+ * signal_tick
+ *    DESCRIPTION: Counts down every alarm by one PIT tick
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Raises ALARM in processes whose alarm ran out and restarts their period
+ */
+void signal_tick(void) {
+    pcb_t * pcb;
+
+    for(pcb = alarm_list; pcb != NULL; pcb = pcb->alarm_next) {
+        if(--pcb->alarm_left == 0) {
+            pcb->alarm_left = pcb->alarm_interval;
+            signal_raise(pcb, ALARM);
+        }
+    }
+}
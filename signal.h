@@ -0,0 +1,58 @@
+/* signal.h - Signal delivery to user programs
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _SIGNAL_H
+#define _SIGNAL_H
+
+#include "types.h"
+#include "system_calls.h"
+
+#define SIGRETURN_SYSCALL   10          // sigreturn's system call number, used by the trampoline
+#define SIGNAL_CODE_SIZE    8           // Bytes of trampoline code in a signal frame
+#define USER_EFLAGS         0x0DD5      // EFLAGS bits a handler may change in its saved context (CF PF AF ZF SF TF DF OF)
+#define EFLAGS_IF           0x200
+
+// What do_signal leaves on the user stack for a handler, lowest address first
+typedef struct signal_frame {
+    uint32_t ret_addr;                  // Handler returns into code[]
+    int32_t signum;                     // Handler's argument
+    hw_context_t context;               // Registers to go back to after sigreturn
+    uint32_t old_mask;                  // signal_mask before the handler ran
+    uint8_t code[SIGNAL_CODE_SIZE];     // movl $SIGRETURN_SYSCALL, %eax; int $0x80
+} signal_frame_t;
+
+// Marks a signal pending for a process, it's delivered the next time the process returns to user mode
+void signal_raise(pcb_t * pcb, int32_t signum);
+
+// Returns 1 if the process has a handler for signum that isn't blocked right now
+int32_t signal_handled(pcb_t * pcb, int32_t signum);
+
+// Returns 1 if the process has an unblocked signal pending
+int32_t signal_pending(pcb_t * pcb);
+
+// Delivers pending signals before returning to user mode with ctx (called from asm_linkage.S)
+void do_signal(hw_context_t * ctx);
+
+// Sets a process's handler for signum (NULL for the default action), returns 0 or -1
+int32_t signal_set_handler(pcb_t * pcb, int32_t signum, void * handler);
+
+// Restores the context a handler interrupted, returns the restored eax or -1
+int32_t signal_return(pcb_t * pcb);
+
+// Gives a forked child the parent's handlers and mask
+void signal_fork(pcb_t * parent, pcb_t * child);
+
+// Resets handlers and the alarm for a process that's loading a new program
+void signal_exec(pcb_t * pcb);
+
+// Sets a process's periodic alarm, returns the ms left on the old one
+uint32_t signal_alarm(pcb_t * pcb, uint32_t ms);
+
+// Cancels the alarm of a process that's going away
+void signal_exit(pcb_t * pcb);
+
+// Counts down alarms, called on every PIT tick
+void signal_tick(void);
+
+#endif /* _SIGNAL_H */
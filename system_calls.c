@@ -6,20 +6,34 @@
 #include "file_system.h"
 #include "terminal.h"
 #include "idt.h"
+#include "kmalloc.h"
+#include "process.h"
+#include "frame.h"
+#include "scheduler.h"
+#include "asm_linkage.h"
+#include "pipe.h"
+#include "shm.h"
+#include "signal.h"
+#include "file.h"
+#include "vfs.h"
+#include "aio.h"
+#include "mmap.h"
 
-/*fops tables for different types*/
-fops_jump_table_t rtc_table = {RTC_read, RTC_write, RTC_open, RTC_close};
-fops_jump_table_t directory_table = {read_dir, write_dir, open_dir, close_dir};
-fops_jump_table_t file_table = {read_file, write_file, open_file, close_file};
+/*fops tables for devices, open files point at these (regular files and directories use vfs.c's)*/
+const fops_jump_table_t rtc_table = {RTC_read, RTC_write, RTC_open, RTC_close, bad_call};
 
-fops_jump_table_t stdin_table = {terminal_read,bad_call,bad_call,bad_call};
-fops_jump_table_t stdout_table = {bad_call,terminal_write,bad_call,bad_call};
-
-fops_jump_table_t bad_table = {bad_call,bad_call,bad_call,bad_call};
-
-uint32_t processes[MAX_PROCESSES] = {0, 0, 0, 0, 0, 0}; // Array of flags (should they be PCBs?) to track currently running processes
+const fops_jump_table_t stdin_table = {terminal_read,bad_call,terminal_open,terminal_close,terminal_ioctl};
+const fops_jump_table_t stdout_table = {bad_call,terminal_write,terminal_open,terminal_close,bad_call};
 
+const fops_jump_table_t pipe_read_table = {pipe_read,bad_call,bad_call,pipe_read_close,bad_call};
+const fops_jump_table_t pipe_write_table = {bad_call,pipe_write,bad_call,pipe_write_close,bad_call};
 
+static int32_t execute_abort(pcb_t * next_pcb_ptr);
+static int32_t load_program(const uint8_t* command, int8_t* args, uint32_t* page_table, uint32_t* entry);
+static int32_t init_fda(pcb_t * pcb_ptr);
+static void start_at_syscall_exit(pcb_t * pcb_ptr);
+static int32_t user_range_ok(const void * addr, uint32_t size);
+static int32_t transfer_iov(int32_t fd, const iovec_t * iov, int32_t iovcnt, int32_t writing);
 
 /*
  * bad_call
@@ -37,54 +51,81 @@ int32_t bad_call(){
  *    INPUTS: status -- Return code of the halting process
  *    OUTPUTS: none
  *    RETURNS: should never return, it should instantly jump to execute
+ *    NOTES: A process started by execute returns straight into its parent's execute. A forked
+ *           process becomes a zombie for its parent's waitpid and switches to another task.
  */
 int32_t halt(uint8_t status){
 
-    pcb_t *pcb_ptr =(pcb_t*)terminals[scheduled_terminal].terminal_pcb;  //initialize to current running terminal's pcb
+    pcb_t *pcb_ptr = current_task;  //initialize to current running process's pcb
+
+    // Close every fd, open files shared with other processes stay open for them
+    fd_close_all(pcb_ptr);
+
+    // Check for exceptions and return 256 if so
+    int32_t real_status;
+    if(exception_flag) {
+        exception_flag = 0;
+        real_status = 256;
+    }
+    else
+        real_status = status;
+
+    // Zombies of our own forked children can go now, live ones free themselves when they exit
+    process_release_children(pcb_ptr);
+    runqueue_remove(pcb_ptr);
+
+    // Forked process: leave the status for waitpid and never run again
+    if(!pcb_ptr->executed){
+        pcb_t *parent_pcb_ptr = pcb_ptr->parent_pcb;
+
+        // Nothing is going to run on our pages again (unless our async I/O worker is busy, then it frees them)
+        aio_release(pcb_ptr);
+        user_space_destroy(pcb_ptr->page_table);
+        pcb_ptr->page_table = 0;
+        pcb_ptr->exit_status = real_status;
 
-    //initalize pcb
-    int i;
-    for(i = 2; i < 8; i++) {
-        if(pcb_ptr->fda[i].flags==1){   //close any file descriptors in use
-            close(i);   
-            pcb_ptr->fda[i].fops_table_ptr=bad_table;
-        }    
+        if(parent_pcb_ptr == NULL){
+            pcb_free_deferred(pcb_ptr);
+        }
+        else{
+            pcb_ptr->state = TASK_ZOMBIE;
+            parent_pcb_ptr->pending_signals |= (1 << SIGCHLD);
+            wake_up(&parent_pcb_ptr->child_wait);
+        }
+        scheduler();
+        return -1;      // Should never reach here
     }
 
-    // Mark PID as free
-    processes[pcb_ptr->process_id] = 0;
+    // A raw/cbreak program may have left the terminal's line discipline in its mode
+    terminal_reset_mode(scheduled_terminal);
     terminals[scheduled_terminal].last_assigned_pid = pcb_ptr->parent_process_id;
     
     // Check if we're at base shell and spawn new base shell if so
+    // (execute runs on our stack, so the scheduler frees the PCB once it's off it)
     if(pcb_ptr->parent_process_id == pcb_ptr->process_id){
+        pcb_free_deferred(pcb_ptr);
+        terminals[scheduled_terminal].last_assigned_pid = -1;
         execute((uint8_t*)"shell");
     }
 
-    // restore paging
-    set_user_prog_page(pcb_ptr -> parent_process_id, 1);
-    
+    // Grab what we need from the PCB, then free its PID, address space and stack block
+    pcb_t *parent_pcb_ptr = pcb_ptr->parent_pcb;
+    uint32_t parent_esp = pcb_ptr->parent_esp;
+    uint32_t parent_ebp = pcb_ptr->parent_ebp;
+    process_remove_child(pcb_ptr);
 
-    // Update TSS to return to parent context
-    tss.esp0 = EIGHT_MB - (pcb_ptr -> parent_process_id * EIGHT_KB) - 4;    //setting ESP0 to base of new kernel stack
-    tss.ss0 = KERNEL_DS;    //setting SS0 to kernel data segment
+    // The parent picks up where it left off in execute: restore paging and TSS to its context
+    runqueue_add(parent_pcb_ptr);
+    set_current_task(parent_pcb_ptr);
+    pcb_free(pcb_ptr);
 
     // Check to see if parent called vidmap and turn it back on if so
-    pcb_t *parent_pcb_ptr = pcb_ptr->parent_pcb;
     if(parent_pcb_ptr->called_vidmap)
         set_user_video_page(1);
 
     // Terminal's PCB var should track parent process
     terminals[scheduled_terminal].terminal_pcb = parent_pcb_ptr;
 
-    // Check for exceptions and return 256 if so
-    int32_t real_status;
-    if(exception_flag) {
-        exception_flag = 0;
-        real_status = 256;
-    }
-    else
-        real_status = status;
-
     // Jump back to execute so we can return
     asm volatile(
         "movl %0, %%esp;"
@@ -93,7 +134,7 @@ int32_t halt(uint8_t status){
         "movl %2, %%eax;"
         "jmp EXECUTE_LABEL;"
         :       // Outputs
-        : "r"(pcb_ptr->parent_esp), "r"(pcb_ptr->parent_ebp), "r"(real_status) // Inputs
+        : "r"(parent_esp), "r"(parent_ebp), "r"(real_status) // Inputs
         : "eax" // Clobbers
     );
     return -1;      // Should never reach here
@@ -104,7 +145,7 @@ int32_t halt(uint8_t status){
  *    DESCRIPTION: Executes a program
  *    INPUTS: command -- the executable to run including its arguments
  *    OUTPUTS: none
- *    SIDE EFFECTS: Copies program to corresponding page and runs it
+ *    SIDE EFFECTS: Copies program to a new address space and runs it, blocking the caller until it halts
  *    RETURNS: Returns code given by program, or -1 if unsuccessful
  */
 int32_t execute(const uint8_t* command){
@@ -114,47 +155,121 @@ int32_t execute(const uint8_t* command){
         return -1;
     }
 
-    // Find next available PID to assign
-    int i, next_pid; 
-    for(i = 0; i < MAX_PROCESSES; i++) {    //find next available process index
-        // If we've found a free PID, mark it and break from loop
-        if(processes[i] == 0) {
-            next_pid = i;
-            break;
-        }
-        // If we've reached end without finding a free PID, cannot execute
-        if(i == MAX_PROCESSES - 1)
-            return -1;
-    }
+    // A terminal with no process yet (or whose base shell just halted) gets a new base shell
+    int32_t base_shell = (terminals[scheduled_terminal].last_assigned_pid == -1);
+    pcb_t * parent_pcb_ptr = base_shell ? NULL : current_task;
 
-    // Allocate PCB
-    // Calculate pointer to next PCB
-    pcb_t * next_pcb_ptr = (pcb_t *)(EIGHT_MB - ((next_pid + 1) * EIGHT_KB));
+    // Allocate PCB and kernel stack, which also assigns the next available PID
+    int next_pid; 
+    pcb_t * next_pcb_ptr = pcb_alloc();
+    if(next_pcb_ptr == NULL)
+        return -1;
+    next_pid = next_pcb_ptr->process_id;
+
+    // Open stdin and stdout, every other fd starts closed
+    if(init_fda(next_pcb_ptr) == -1)
+        return execute_abort(next_pcb_ptr);
 
-    // Initialize every fda entry and activate stdin and stdout
-    for(i = 0; i < 2; i++) {
-        next_pcb_ptr->fda[i].inode = 0;
-        next_pcb_ptr->fda[i].file_pos = 0;
-        next_pcb_ptr->fda[i].flags = 1;
+    // Parse the command, check the executable and load it into a fresh address space
+    uint32_t prog_entry_addr;
+    if(load_program(command, next_pcb_ptr->arg, &next_pcb_ptr->page_table, &prog_entry_addr) == -1)
+        return execute_abort(next_pcb_ptr);
+
+    if(base_shell){    // base shell of terminal: assign given pid as both parent and process to denote base shell 
+        next_pcb_ptr->parent_process_id = next_pid;
     }
-    for(i = 2; i < 8; i++) {
-        next_pcb_ptr->fda[i].inode = 0;
-        next_pcb_ptr->fda[i].file_pos = 0;
-        next_pcb_ptr->fda[i].flags = 0;
+    else{
+        next_pcb_ptr->parent_process_id = parent_pcb_ptr->process_id;
+        process_add_child(parent_pcb_ptr, next_pcb_ptr);
     }
 
-    // Set up fops tables for stdin and stdout respectively in the new pcb
-    next_pcb_ptr->fda[0].fops_table_ptr = stdin_table;
-    next_pcb_ptr->fda[1].fops_table_ptr = stdout_table;
+    // Track the terminal's newest process
+    terminals[scheduled_terminal].last_assigned_pid = next_pid;
+
+    
+    // Initialize vidmap flag and task state
+    next_pcb_ptr->called_vidmap = 0;
+    next_pcb_ptr->terminal_id = scheduled_terminal;
+    next_pcb_ptr->exit_status = 0;
+    next_pcb_ptr->executed = 1;
+    next_pcb_ptr->curr_esp = NULL;      // The scheduler fills this in when it first switches away
+
+    // The parent sleeps in execute until the new program halts
+    if(parent_pcb_ptr != NULL){
+        runqueue_remove(parent_pcb_ptr);
+        parent_pcb_ptr->state = TASK_EXECUTING;
+    }
+    runqueue_add(next_pcb_ptr);
+
+    // Prepare TSS and paging for context switch
+    set_current_task(next_pcb_ptr);
+    
+    // Save state of current/parent stack into PCB
+    asm volatile ("movl %%esp, %0;"
+                  "movl %%ebp, %1;"
+                : "=r" (next_pcb_ptr->parent_esp), "=r" (next_pcb_ptr->parent_ebp)    // Outputs
+    );
+
+    next_pcb_ptr->parent_pcb = parent_pcb_ptr; // Save existing PCB as parent
+    terminals[scheduled_terminal].terminal_pcb = next_pcb_ptr; // Update pcb pointer for current terminal
+    
+    // Push items to stack and context switch using IRET
+    asm volatile (
+        
+        "movl %1, %%ds;"
+        
+        "pushl %1;"                 //push USER_DS, 0x2B
+        
+        "pushl $0x083ffffc;"        // Set ESP to point to the user page (132MB - 4B)
+        
+        "pushfl;"                   //push flags
+        "popl %%eax;"
+        "orl $0x200, %%eax;"        //sets bit 9 to 1 in the flags register to sti
+        "pushl %%eax;"
+
+        "pushl %2;"                 //push USER_CS, 0x23
+        
+        "pushl %0;"                 // Push the addr of exec's first instruction for EIP
+
+        "iret;"
+
+        "EXECUTE_LABEL: "
+        :                       // No Outputs
+        : "r"(prog_entry_addr), "r"(USER_DS), "r"(USER_CS)      // Inputs
+        : "eax"                     // Clobbers
+    );
+
+    // Maintain program's return value
+    register int32_t retval asm("eax");
+    return retval;
+}
+
+/*
+ * load_program
+ *    DESCRIPTION: Parses a command and loads its executable into a new user address space
+ *    INPUTS: command -- the executable to run including its arguments
+ *            args -- MAX_ARGS buffer the arguments are copied to
+ *            page_table -- where to put the new address space
+ *            entry -- where to put the address of the program's first instruction
+ *    OUTPUTS: fills args, page_table and entry
+ *    RETURNS: 0 on success, -1 if the command isn't an executable or memory ran out
+ *    SIDE EFFECTS: On success the new address space is left mapped at 128MB. On failure the
+ *                  user window may be unmapped, the caller maps its own address space back
+ *    NOTES: Pages are only allocated as the image is copied in, the rest are zero-filled on demand
+ */
+static int32_t load_program(const uint8_t* command, int8_t* args, uint32_t* page_table, uint32_t* entry){
 
     // Parse command
     uint32_t command_length = strlen((int8_t *)command) + 1;    // Adding 1 allows us to add a NULL terminator
-    uint8_t exec_name[command_length];
-    dentry_t file_dentry;
+    uint8_t * exec_name = kmalloc(command_length);     // Commands can be long, keep them off the 8KB kernel stack
+    vfs_node_t file_node;
+    int i, j;
+    if(exec_name == NULL)
+        return -1;
 
     // Find command from entry (IMPORTANT: Strip leading spaces?)
     i = 0;
-    int j = 0;
+    j = 0;
     memset(exec_name, '\0', command_length);    // Zero out exec_name
     while(command[i] != NULL && i < command_length){
         // Strip spaces before cmd
@@ -173,7 +288,7 @@ int32_t execute(const uint8_t* command){
 
     // Parse possible arguments (strips spaces between cmd and arg)
     j = 0;
-    memset(next_pcb_ptr->arg, '\0', MAX_ARGS);  // Zero out PCB's args array
+    memset(args, '\0', MAX_ARGS);  // Zero out args array
     if(command[i] != NULL){
         i++;
         while(command[i] != NULL && i < command_length && j<MAX_ARGS){
@@ -182,7 +297,7 @@ int32_t execute(const uint8_t* command){
                 i++;
                 continue;
             }
-            next_pcb_ptr->arg[j] = command[i];
+            args[j] = command[i];
             i++;
             j++;
         }
@@ -190,125 +305,373 @@ int32_t execute(const uint8_t* command){
 
     // Find file and do executable check
     //check whether file exists within directory
-    int dentry_res = read_dentry_by_name(exec_name, &file_dentry);  
-    if(dentry_res == -1){       
+    int dentry_res = vfs_resolve(exec_name, &file_node);  
+    kfree(exec_name);
+    if(dentry_res == -1 || file_node.type != VFS_TYPE_FILE){       
         return -1;
     }
 
-    // Copy program file to allocated page
-    // Allocate Page and flush TLB
-    set_user_prog_page(next_pid, 1); // Set present bit in execute and 0 in halt
+    // Check ELF constant to see if file is an executable
+    uint8_t elf_check[4];
+    if(vfs_node_read(&file_node, 0, elf_check, 4) != 4)
+        return -1;
+    if(elf_check[0] != 0x7f || elf_check[1] != 0x45 || elf_check[2] != 0x4c || elf_check[3] != 0x46){
+        return -1;
+    }
+
+    // Get addr exec's first instruction (bytes 24-27 of the exec file)
+    uint8_t prog_entry_buf[4];
+    vfs_node_read(&file_node, 24, prog_entry_buf, 4);
+    *entry = *((uint32_t*)prog_entry_buf);
+
+    // Copy program file to a fresh address space
+    *page_table = user_space_create();
+    if(*page_table == 0)
+        return -1;
+    set_user_prog_page(*page_table, 1);
     
     // Load executable into user page
-    int val = read_data(file_dentry.inode, 0, (uint8_t*)PROG_IMG_ADDR, 100000);
+    int val = vfs_node_read(&file_node, 0, (uint8_t*)PROG_IMG_ADDR, 100000);
     if(val == -1){
-        set_user_prog_page(next_pid, 0);
-        set_user_prog_page(terminals[scheduled_terminal].last_assigned_pid, 1);
+        set_user_prog_page(0, 0);
+        user_space_destroy(*page_table);
+        *page_table = 0;
         return -1;
     }
+    return 0;
+}
 
-    // Check ELF constant to see if file is an executable
-    uint8_t elf_check[4];
-    read_data(file_dentry.inode, 0, elf_check, 4);
-    if(elf_check[0] != 0x7f){
-        set_user_prog_page(next_pid, 0);
-        set_user_prog_page(terminals[scheduled_terminal].last_assigned_pid, 1);
+/*
+ * execute_abort
+ *    DESCRIPTION: Undoes a failed execute
+ *    INPUTS: next_pcb_ptr -- the PCB execute allocated for the new program
+ *    OUTPUTS: none
+ *    RETURNS: Always -1 so execute can return it directly
+ *    SIDE EFFECTS: Frees the new PCB, its stdin/stdout and its address space and maps the caller's
+ *                  address space back
+ */
+static int32_t execute_abort(pcb_t * next_pcb_ptr) {
+    fd_close_all(next_pcb_ptr);     // Only stdin and stdout, their close doesn't need the process running
+    pcb_free(next_pcb_ptr);
+    // Booting terminals may not have a process to go back to yet
+    if(current_task != NULL)
+        set_user_prog_page(current_task->page_table, 1);
+    else
+        set_user_prog_page(0, 0);
+    return -1;
+}
+
+/*
+ * init_fda
+ *    DESCRIPTION: Opens stdin and stdout as fds 0 and 1 of a new process
+ *    INPUTS: pcb_ptr -- the new process's PCB, its fd table empty
+ *    OUTPUTS: none
+ *    RETURNS: 0 on success, -1 if out of memory (whatever was opened stays in the table)
+ */
+static int32_t init_fda(pcb_t * pcb_ptr) {
+    file_t * in = file_alloc(&stdin_table, 0);
+    file_t * out;
+
+    if(in == NULL)
         return -1;
-    }
-    if(elf_check[1] != 0x45){
-        set_user_prog_page(next_pid, 0);
-        set_user_prog_page(terminals[scheduled_terminal].last_assigned_pid, 1);
+    pcb_ptr->fds[0] = in;
+    out = file_alloc(&stdout_table, 0);
+    if(out == NULL)
         return -1;
-    }
-    if(elf_check[2] != 0x4c){
-        set_user_prog_page(next_pid, 0);
-        set_user_prog_page(terminals[scheduled_terminal].last_assigned_pid, 1);
+    pcb_ptr->fds[1] = out;
+    return 0;
+}
+
+/*
+ * start_at_syscall_exit
+ *    DESCRIPTION: Makes a new task's kernel stack look like it was switched away from at the
+ *                 end of a system call
+ *    INPUTS: pcb_ptr -- the new task, its PCB_SYSCALL_CONTEXT already filled in
+ *    OUTPUTS: none
+ *    RETURNS: none
+ *    SIDE EFFECTS: The first context_switch to the task pops the callee-saved registers and
+ *                  "returns" into syscall_exit, which irets with the saved context
+ */
+static void start_at_syscall_exit(pcb_t * pcb_ptr) {
+    uint32_t * esp = (uint32_t *)PCB_SYSCALL_CONTEXT(pcb_ptr);
+
+    *(--esp) = (uint32_t)syscall_exit;
+    *(--esp) = 0;     // ebp
+    *(--esp) = 0;     // ebx
+    *(--esp) = 0;     // esi
+    *(--esp) = 0;     // edi
+    pcb_ptr->curr_esp = (uint32_t)esp;
+}
+
+/*
+ * fork
+ *    DESCRIPTION: Creates a copy of the calling process
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURNS: The child's PID in the parent, 0 in the child, -1 if out of PIDs or memory
+ *    SIDE EFFECTS: The child shares every user page with the parent copy-on-write, shares the
+ *                  parent's open files (and their positions) and is put on the runqueue. It resumes from the same
+ *                  int 0x80 as the parent, through syscall_exit with a return value of 0
+ */
+int32_t fork(void){
+    pcb_t * parent_pcb_ptr = current_task;
+    pcb_t * child_pcb_ptr = pcb_alloc();
+    hw_context_t * child_context;
+
+    if(child_pcb_ptr == NULL)
         return -1;
-    }
-    if(elf_check[3] != 0x46){
-        set_user_prog_page(next_pid, 0);
-        set_user_prog_page(terminals[scheduled_terminal].last_assigned_pid, 1);
+
+    child_pcb_ptr->page_table = user_space_clone(parent_pcb_ptr->page_table);
+    if(child_pcb_ptr->page_table == 0 || fd_fork(parent_pcb_ptr, child_pcb_ptr) == -1){
+        pcb_free(child_pcb_ptr);
         return -1;
     }
+    memcpy(child_pcb_ptr->arg, parent_pcb_ptr->arg, MAX_ARGS);
+    child_pcb_ptr->called_vidmap = parent_pcb_ptr->called_vidmap;
+    child_pcb_ptr->terminal_id = parent_pcb_ptr->terminal_id;
+    child_pcb_ptr->parent_process_id = parent_pcb_ptr->process_id;
+    child_pcb_ptr->exit_status = 0;
+    child_pcb_ptr->executed = 0;
+    process_add_child(parent_pcb_ptr, child_pcb_ptr);
+    shm_fork(parent_pcb_ptr, child_pcb_ptr);
+    mmap_fork(parent_pcb_ptr, child_pcb_ptr);
+    signal_fork(parent_pcb_ptr, child_pcb_ptr);
 
-    if(next_pid <= 2){    // base shell of terminal: assign given pid as both parent and process to denote base shell 
-        next_pcb_ptr->parent_process_id = next_pid;
-        next_pcb_ptr->process_id = next_pid;
-    }
-    else{
-        next_pcb_ptr->parent_process_id = terminals[scheduled_terminal].last_assigned_pid;
-        next_pcb_ptr->process_id = next_pid;
-    }
+    // Same user registers as the parent's int 0x80, except the return value
+    child_context = PCB_SYSCALL_CONTEXT(child_pcb_ptr);
+    *child_context = *PCB_SYSCALL_CONTEXT(parent_pcb_ptr);
+    child_context->eax = 0;
 
-    // Mark PID as in use and set PCB
-    processes[next_pid] = 1;
-    terminals[scheduled_terminal].last_assigned_pid = next_pid;
+    start_at_syscall_exit(child_pcb_ptr);
+    runqueue_add(child_pcb_ptr);
+    return child_pcb_ptr->process_id;
+}
 
-    
-    // Initialize vidmap flag
-    next_pcb_ptr->called_vidmap = 0;
-    
-    // Get addr exec's first instruction (bytes 24-27 of the exec file)
-    uint8_t prog_entry_buf[4];
-    uint32_t prog_entry_addr;
-    read_data(file_dentry.inode, 24, prog_entry_buf, 4);
-    prog_entry_addr = *((uint32_t*)prog_entry_buf);
+/*
+ * exec
+ *    DESCRIPTION: Replaces the calling process's program
+ *    INPUTS: command -- the executable to run including its arguments
+ *    OUTPUTS: none
+ *    RETURNS: Doesn't return on success (the new program starts), -1 if the command can't be run
+ *    SIDE EFFECTS: Keeps the PID, parent and open files, throws away the old address space
+ */
+int32_t exec(const uint8_t* command){
+    pcb_t * pcb = current_task;
+    hw_context_t * context = PCB_SYSCALL_CONTEXT(pcb);
+    int8_t args[MAX_ARGS];
+    uint32_t page_table, entry;
 
-    // Prepare TSS for context switch
-    tss.esp0 = EIGHT_MB - (next_pid * EIGHT_KB) - 4;    //setting ESP0 to base of new kernel stack
-    tss.ss0 = KERNEL_DS;    //setting SS0 to kernel data segment
-    
-    // If we're executing the first base shells for the terminals, the scheduler already got their ESP/EBP
-    if(next_pid <= 2){
-        next_pcb_ptr->curr_esp = terminals[scheduled_terminal].terminal_pcb->curr_esp;
-        next_pcb_ptr->curr_ebp = terminals[scheduled_terminal].terminal_pcb->curr_ebp;
+    if(command == NULL)
+        return -1;
+
+    if(load_program(command, args, &page_table, &entry) == -1){
+        set_user_prog_page(pcb->page_table, 1);
+        return -1;
     }
-    // Otherwise, the scheduler will put the exec's ESP/EBP into the PCB later
-    else{
-        next_pcb_ptr->curr_esp = NULL;
-        next_pcb_ptr->curr_ebp = NULL;
+
+    shm_release_all(pcb);
+    mmap_release_all(pcb);
+    aio_release(pcb);
+    signal_exec(pcb);
+    user_space_destroy(pcb->page_table);
+    pcb->page_table = page_table;
+    memcpy(pcb->arg, args, MAX_ARGS);
+
+    // Return to the new program's entry point on a fresh stack
+    context->eip = entry;
+    context->esp = USER_STACK_TOP;
+    return 0;
+}
+
+/*
+ * waitpid
+ *    DESCRIPTION: Waits for a forked child to exit and collects its status
+ *    INPUTS: pid -- child to wait for, or -1 for any child
+ *            status -- where to store the child's exit status (may be NULL)
+ *    OUTPUTS: writes the exit status to *status
+ *    RETURNS: PID of the child that exited, -1 if there is no such child or status is bad
+ *    SIDE EFFECTS: Sleeps off the runqueue until a child exits, then frees the child
+ */
+int32_t waitpid(int32_t pid, int32_t* status){
+    pcb_t * pcb = current_task;
+    pcb_t * child;
+    int32_t found, child_pid, child_status;
+
+    // Status has to be inside the user page
+    if(status != NULL && ((uint32_t)status < ONE_TWO_EIGHT_MB || (uint32_t)status > ONE_THREE_TWO_MB - sizeof(int32_t)))
+        return -1;
+
+    while(1){
+        found = 0;
+        for(child = pcb->first_child; child != NULL; child = child->next_sibling){
+            if(pid != -1 && child->process_id != (uint32_t)pid)
+                continue;
+            found = 1;
+            if(child->state == TASK_ZOMBIE)
+                break;
+        }
+        if(!found)
+            return -1;
+
+        if(child != NULL){
+            child_pid = child->process_id;
+            child_status = child->exit_status;
+            process_remove_child(child);
+            pcb_free(child);
+            // SIGCHLD stays pending while there are more children to collect
+            for(child = pcb->first_child; child != NULL && child->state != TASK_ZOMBIE; child = child->next_sibling);
+            if(child == NULL)
+                pcb->pending_signals &= ~(1 << SIGCHLD);
+            if(status != NULL)
+                *status = child_status;
+            return child_pid;
+        }
+
+        // Sleep until one of our children exits
+        sleep_on(&pcb->child_wait);
     }
-    
-    // Save state of current/parent stack into PCB
-    asm volatile ("movl %%esp, %0;"
-                  "movl %%ebp, %1;"
-                : "=r" (next_pcb_ptr->parent_esp), "=r" (next_pcb_ptr->parent_ebp)    // Outputs
-    );
+}
 
-    next_pcb_ptr->parent_pcb = terminals[scheduled_terminal].terminal_pcb; // Save existing PCB as parent
-    terminals[scheduled_terminal].terminal_pcb = next_pcb_ptr; // Update pcb pointer for current terminal
-    
-    // Push items to stack and context switch using IRET
-    asm volatile (
-        
-        "movl %1, %%ds;"
-        
-        "pushl %1;"                 //push USER_DS, 0x2B
-        
-        "pushl $0x083ffffc;"        // Set ESP to point to the user page (132MB - 4B)
-        
-        "pushfl;"                   //push flags
-        "popl %%eax;"
-        "orl $0x200, %%eax;"        //sets bit 9 to 1 in the flags register to sti
-        "pushl %%eax;"
+/*
+ * spawn
+ *    DESCRIPTION: Starts a program as a background child without waiting for it
+ *    INPUTS: command -- the executable to run including its arguments
+ *    OUTPUTS: none
+ *    RETURNS: PID of the new process, -1 if the command can't be run or we're out of PIDs or memory
+ *    SIDE EFFECTS: The child gets its own address space and stdin/stdout on the caller's terminal
+ *                  and is put on the runqueue. When it halts the caller gets SIGCHLD and collects
+ *                  it with wait or waitpid like a forked child
+ */
+int32_t spawn(const uint8_t* command){
+    pcb_t * parent_pcb_ptr = current_task;
+    pcb_t * child_pcb_ptr;
+    hw_context_t * child_context;
+    uint32_t prog_entry_addr;
 
-        "pushl %2;"                 //push USER_CS, 0x23
-        
-        "pushl %0;"                 // Push the addr of exec's first instruction for EIP
+    if(command == NULL)
+        return -1;
 
-        "iret;"
+    child_pcb_ptr = pcb_alloc();
+    if(child_pcb_ptr == NULL)
+        return -1;
+    if(init_fda(child_pcb_ptr) == -1 || load_program(command, child_pcb_ptr->arg, &child_pcb_ptr->page_table, &prog_entry_addr) == -1)
+        return execute_abort(child_pcb_ptr);
+    // load_program left the child's pages mapped, we keep running in ours
+    set_user_prog_page(parent_pcb_ptr->page_table, 1);
 
-        "EXECUTE_LABEL: "
-        :                       // No Outputs
-        : "r"(prog_entry_addr), "r"(USER_DS), "r"(USER_CS)      // Inputs
-        : "eax"                     // Clobbers
-    );
+    child_pcb_ptr->parent_process_id = parent_pcb_ptr->process_id;
+    child_pcb_ptr->called_vidmap = 0;
+    child_pcb_ptr->terminal_id = parent_pcb_ptr->terminal_id;
+    child_pcb_ptr->exit_status = 0;
+    child_pcb_ptr->executed = 0;
+    process_add_child(parent_pcb_ptr, child_pcb_ptr);
 
-    // Maintain program's return value
-    register int32_t retval asm("eax");
-    return retval;
+    // Same frame execute irets with: program entry, fresh user stack, interrupts on
+    child_context = PCB_SYSCALL_CONTEXT(child_pcb_ptr);
+    memset(child_context, 0, sizeof(hw_context_t));
+    child_context->eip = prog_entry_addr;
+    child_context->cs = USER_CS;
+    child_context->eflags = 0x200;
+    child_context->esp = USER_STACK_TOP;
+    child_context->ss = USER_DS;
+    start_at_syscall_exit(child_pcb_ptr);
+
+    runqueue_add(child_pcb_ptr);
+    return child_pcb_ptr->process_id;
 }
 
+/*
+ * wait
+ *    DESCRIPTION: Waits for any forked or spawned child to exit
+ *    INPUTS: status -- where to store the child's exit status (may be NULL)
+ *    OUTPUTS: writes the exit status to *status
+ *    RETURNS: PID of the child that exited, -1 if there are no children
+ *    SIDE EFFECTS: Same as waitpid(-1, status)
+ */
+int32_t wait(int32_t* status){
+    return waitpid(-1, status);
+}
+
+/*
+ * pipe
+ *    DESCRIPTION: Creates a pipe
+ *    INPUTS: fds -- array of two ints in the user page
+ *    OUTPUTS: fds[0] is the read end and fds[1] the write end
+ *    RETURNS: 0 on success, -1 if fds is bad, there aren't two free file descriptors or we're out of memory
+ *    SIDE EFFECTS: Both ends are shared with children made by fork afterwards, each end is
+ *                  closed once every fd pointing at it is
+ */
+int32_t pipe(int32_t* fds){
+    pcb_t * pcb = current_task;
+    pipe_t * new_pipe;
+    file_t * read_end, * write_end;
+    int32_t read_fd, write_fd;
+
+    // fds has to be inside the user page
+    if((uint32_t)fds < ONE_TWO_EIGHT_MB || (uint32_t)fds > ONE_THREE_TWO_MB - 2 * sizeof(int32_t))
+        return -1;
+
+    new_pipe = pipe_alloc();
+    if(new_pipe == NULL)
+        return -1;
+    read_end = file_alloc(&pipe_read_table, (uint32_t)new_pipe);
+    write_end = file_alloc(&pipe_write_table, (uint32_t)new_pipe);
+    read_fd = (read_end == NULL) ? -1 : fd_install(pcb, read_end);
+    write_fd = (read_fd == -1 || write_end == NULL) ? -1 : fd_install(pcb, write_end);
+
+    // Undo whatever got made, the pipe goes away with its last end
+    if(write_fd == -1) {
+        if(read_fd != -1)
+            pcb->fds[read_fd] = NULL;
+        if(read_end != NULL)
+            kfree(read_end);
+        if(write_end != NULL)
+            kfree(write_end);
+        pipe_release(new_pipe, 0);
+        pipe_release(new_pipe, 1);
+        return -1;
+    }
+
+    fds[0] = read_fd;
+    fds[1] = write_fd;
+    return 0;
+}
+
+/*
+ * shmget
+ *    DESCRIPTION: Gets a shared memory segment
+ *    INPUTS: key -- key shared by the cooperating processes, 0 for a new private segment
+ *            size -- size in bytes
+ *    OUTPUTS: none
+ *    RETURNS: Segment id for shmat, -1 on failure (see shm_get)
+ */
+int32_t shmget(int32_t key, uint32_t size){
+    return shm_get(key, size);
+}
+
+/*
+ * shmat
+ *    DESCRIPTION: Maps a shared memory segment into the calling process
+ *    INPUTS: shmid -- segment id from shmget
+ *            addr -- page-aligned address in the user page to map it at
+ *    OUTPUTS: none
+ *    RETURNS: addr on success, -1 on failure (see shm_attach)
+ *    SIDE EFFECTS: Children forked afterwards share the mapping, halt and exec detach it
+ */
+int32_t shmat(int32_t shmid, void* addr){
+    return shm_attach(current_task, shmid, (uint32_t)addr);
+}
+
+/*
+ * shmdt
+ *    DESCRIPTION: Unmaps a shared memory segment from the calling process
+ *    INPUTS: addr -- address the segment was attached at
+ *    OUTPUTS: none
+ *    RETURNS: 0 on success, -1 if no segment is attached there
+ */
+int32_t shmdt(void* addr){
+    return shm_detach(current_task, (uint32_t)addr);
+}
 
 /*
  * read
@@ -321,16 +684,14 @@ int32_t execute(const uint8_t* command){
  */
 int32_t read(int32_t fd, void* buf, int32_t nbytes){
     sti();
-    pcb_t *pcb = (pcb_t*)(tss.esp0  & 0xFFFFE000); //ANDing the process's ESP register w/ appropriate bit mask to reach top of stack
-    if(fd<0 || fd>7 || pcb->fda[fd].flags == 0) //check for valid fd index, max 8 files
+    file_t *file = fd_get(current_task, fd);   //check for an open fd
+    if(file == NULL)
         return -1;
 
     if(buf==NULL)
         return -1;
-    
-    //question is how do i initialize the pcb??
 
-    return pcb->fda[fd].fops_table_ptr.read(fd, buf, nbytes);
+    return file->ops->read(fd, buf, nbytes);
 }
 
 /*
@@ -344,67 +705,30 @@ int32_t read(int32_t fd, void* buf, int32_t nbytes){
  */
 int32_t write(int32_t fd, const void* buf, int32_t nbytes){
     
-    pcb_t *pcb=(pcb_t*)(tss.esp0  & 0xFFFFE000);    //temp placeholder until we figure out how to initialize the pcb
-    if(fd<0 || fd>7 || pcb->fda[fd].flags == 0) //check for valid fd index, max 8 files
+    file_t *file = fd_get(current_task, fd);   //check for an open fd
+    if(file == NULL)
         return -1;
 
     if(buf==NULL)
         return -1;
     
-    return pcb->fda[fd].fops_table_ptr.write(fd, buf, nbytes);
+    return file->ops->write(fd, buf, nbytes);
 }
 
 /*
  * open
  *    DESCRIPTION: Opens the desired file
- *    INPUTS: filename -- name of the file to open
+ *    INPUTS: filename -- path of the file to open ("/dev/rtc", "frame0.txt", ...)
  *    OUTPUTS: none
  *    RETURNS: The file descriptor the opened file was assigned to, or -1 if unsuccessful
  */
 int32_t open(const uint8_t* filename){
     
-    pcb_t *pcb=(pcb_t*)(tss.esp0  & 0xFFFFE000);    //temp placeholder until we figure out how to initialize the pcb
     if(filename==NULL)  //check for valid file
         return -1;
 
-    dentry_t dentry;
-    if(read_dentry_by_name(filename,&dentry)==-1)   //check if file exists within dentry
-        return -1;
-    
-
-    /*find an available space in file descriptor array, 
-    * 0 and 1 indices are reserved for stdin and stdout
-    * max 8 open files at a time
-    */
-    uint32_t i;
-    uint32_t available=0;       //flags whether available space is found
-    /* IMPORTANT */ // Ask if we need to include stdin and stdout below
-    for(i=2; i<8; i++){         
-        if(pcb->fda[i].flags==0){   //if available space is found, initialize file descriptor
-            pcb->fda[i].file_pos=0; //should always start at beginning of file
-            pcb->fda[i].flags=1;    //mark space as used
-            available=1;            
-            break;
-        }
-    }
-
-    if(available==0)             //if no available space is found, fail
-        return -1;
-    
-    uint32_t file_type = dentry.ftype;
-    if(file_type==0){   //ftype 0 for RTC
-        pcb->fda[i].fops_table_ptr=rtc_table;
-        (void)RTC_open((uint8_t *)"rtc");
-    }
-    else if(file_type==1){   //ftype 1 for directory (don't need to call open_dir as it's successful at this point)
-        pcb->fda[i].fops_table_ptr=directory_table;
-    }
-    else if(file_type==2){   //ftype 2 for regular file (don't need to call open_file as it's successful at this point)
-        pcb->fda[i].fops_table_ptr=file_table;
-        pcb->fda[i].inode=dentry.inode;
-    }
-
-    return i;                   //return index of file assigned in file descriptor array
+    // The VFS finds the file system, opens the file at position 0 and gives it the lowest free fd
+    return vfs_open(current_task, filename);
 }
 
 /*
@@ -412,18 +736,15 @@ int32_t open(const uint8_t* filename){
  *    DESCRIPTION: Calls the corresponding close function
  *    INPUTS: fd -- the file descriptor 
  *    OUTPUTS: none
- *    RETURNS: The return value of the desired close function
+ *    RETURNS: The return value of the desired close function if this was the last fd for the file,
+ *             0 if other fds still share it, -1 for a bad fd
  */
 int32_t close(int32_t fd){
     
-    pcb_t* pcb=(pcb_t*)(tss.esp0  & 0xFFFFE000); //temp placeholder until we figure out how to initialize the pcb
-    
-    if(fd<2 || fd>7 || pcb->fda[fd].flags == 0) //check for valid fd index, max 8 files
+    if(fd<2)    //stdin and stdout can't be closed
         return -1;
     
-    pcb->fda[fd].flags=0; //mark index in file descriptor array as available
-    
-    return pcb->fda[fd].fops_table_ptr.close(fd);
+    return fd_close(current_task, fd);  //the driver's close only runs for the file's last fd
 }
 
 /*
@@ -436,7 +757,7 @@ int32_t close(int32_t fd){
  */
 int32_t getargs(uint8_t * buf, int32_t nbytes) {
     
-    pcb_t *pcb=(pcb_t*)(tss.esp0  & 0xFFFFE000);
+    pcb_t *pcb=current_task;
 
     // Check for valid buf and bytes to be read, or no args were passed
     if(buf==NULL || nbytes < MAX_ARGS || pcb->arg[0] == '\0')
@@ -463,7 +784,7 @@ int32_t vidmap(uint8_t ** screen_start) {
     }
     
     // Mark that the process called vidmap
-    pcb_t *pcb=(pcb_t*)(tss.esp0  & 0xFFFFE000);
+    pcb_t *pcb=current_task;
     pcb->called_vidmap = 1;
 
     // Set the page entry and copy the VirtMem address to user space
@@ -474,16 +795,301 @@ int32_t vidmap(uint8_t ** screen_start) {
 
 /*
  * set_handler
- *    DESCRIPTION: Does nothing for now
+ *    DESCRIPTION: Sets the calling process's handler for a signal
+ *    INPUTS: signum -- the signal (DIV_ZERO, SEGFAULT, INTERRUPT, ALARM, USER1 or SIGCHLD)
+ *            handler_address -- user function taking the signal number, NULL for the default action
+ *    OUTPUTS: none
+ *    RETURNS: 0 on success, -1 for a bad signum or handler address
  */
 int32_t set_handler(int32_t signum, void* handler_address) {
-    return -1;
+    return signal_set_handler(current_task, signum, handler_address);
 }
 
 /*
- * getargs
- *    DESCRIPTION: Does nothing for now
+ * sigreturn
+ *    DESCRIPTION: Returns from a signal handler, called by the code do_signal puts on the user stack
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURNS: The eax of the interrupted code, -1 if there's no signal frame on the stack
+ *    SIDE EFFECTS: The process continues where the signal interrupted it
  */
 int32_t sigreturn(void) {
-    return -1;
+    return signal_return(current_task);
+}
+
+/*
+ * alarm
+ *    DESCRIPTION: Sets a periodic ALARM signal for the calling process
+ *    INPUTS: ms -- period in milliseconds, 0 to cancel
+ *    OUTPUTS: none
+ *    RETURNS: Milliseconds that were left until the previous alarm, 0 if none was set
+ */
+int32_t alarm(uint32_t ms) {
+    return signal_alarm(current_task, ms);
+}
+
+/*
+ * ioctl
+ *    DESCRIPTION: Calls the corresponding driver's ioctl function to query or change the fd's mode
+ *    INPUTS: fd -- the file descriptor
+ *            request -- driver-specific request number (see terminal.h for the terminal's)
+ *            arg -- request argument
+ *    OUTPUTS: none
+ *    RETURNS: The return value of the driver's ioctl function, -1 for a bad fd or unsupported request
+ */
+int32_t ioctl(int32_t fd, int32_t request, uint32_t arg) {
+
+    file_t *file = fd_get(current_task, fd);   //check for an open fd
+
+    if(file == NULL)
+        return -1;
+
+    return file->ops->ioctl(fd, request, arg);
+}
+
+/*
+ * dup
+ *    DESCRIPTION: Makes another fd for an open file
+ *    INPUTS: fd -- an open fd
+ *    OUTPUTS: none
+ *    RETURNS: The lowest free fd, now sharing fd's file (and its position), -1 if fd isn't open or
+ *             every fd is taken
+ */
+int32_t dup(int32_t fd) {
+    return fd_dup(current_task, fd, -1);
+}
+
+/*
+ * dup2
+ *    DESCRIPTION: Makes a chosen fd point at an open file
+ *    INPUTS: fd -- an open fd
+ *            newfd -- fd to use, closed first if it's open (can be stdin or stdout)
+ *    OUTPUTS: none
+ *    RETURNS: newfd, -1 if fd isn't open or newfd is out of range (0 to FD_MAX - 1)
+ */
+int32_t dup2(int32_t fd, int32_t newfd) {
+    if(newfd < 0)
+        return -1;
+    return fd_dup(current_task, fd, newfd);
+}
+
+/*
+ * creat
+ *    DESCRIPTION: Opens a file for writing, making it first if needed
+ *    INPUTS: filename -- path of the file (only /tmp is writable)
+ *    OUTPUTS: none
+ *    RETURNS: The lowest free fd, -1 if the file can't be made or opened
+ *    SIDE EFFECTS: A file that already exists is emptied
+ */
+int32_t creat(const uint8_t* filename) {
+    if(filename == NULL)
+        return -1;
+    return vfs_create(current_task, filename);
+}
+
+/*
+ * unlink
+ *    DESCRIPTION: Removes a file
+ *    INPUTS: filename -- path of the file
+ *    OUTPUTS: none
+ *    RETURNS: 0 on success, -1 if it doesn't exist or is on a read-only file system
+ *    SIDE EFFECTS: Open fds keep working until they're closed
+ */
+int32_t unlink(const uint8_t* filename) {
+    if(filename == NULL)
+        return -1;
+    return vfs_unlink(filename);
+}
+
+/*
+ * truncate
+ *    DESCRIPTION: Sets a file's length
+ *    INPUTS: filename -- path of the file
+ *            length -- new length in bytes, growing the file adds zeros
+ *    OUTPUTS: none
+ *    RETURNS: 0 on success, -1 if it isn't a writable regular file or memory ran out
+ */
+int32_t truncate(const uint8_t* filename, uint32_t length) {
+    if(filename == NULL)
+        return -1;
+    return vfs_truncate(filename, length);
+}
+
+/*
+ * lseek
+ *    DESCRIPTION: Moves the position of an open regular file
+ *    INPUTS: fd -- an open fd
+ *            offset -- bytes to move by
+ *            whence -- VFS_SEEK_SET, VFS_SEEK_CUR or VFS_SEEK_END
+ *    OUTPUTS: none
+ *    RETURNS: The new position, -1 if fd isn't a regular file or the position would be bad
+ */
+int32_t lseek(int32_t fd, int32_t offset, int32_t whence) {
+    return vfs_seek(fd_get(current_task, fd), offset, whence);
+}
+
+/*
+ * aio_setup
+ *    DESCRIPTION: Sets up the calling process's asynchronous I/O rings
+ *    INPUTS: ring -- page-aligned address in the user page to map the aio_ring_t page at
+ *    OUTPUTS: none
+ *    RETURNS: 0 on success, -1 on failure (see aio_attach)
+ */
+int32_t aio_setup(void* ring) {
+    return aio_attach(current_task, (uint32_t)ring);
+}
+
+/*
+ * aio_enter
+ *    DESCRIPTION: Submits the requests added to the submission ring and optionally waits
+ *    INPUTS: min_complete -- completions to wait for, 0 to return right away
+ *    OUTPUTS: none
+ *    RETURNS: Completions ready on the completion ring, -1 on failure (see aio_wait)
+ *    SIDE EFFECTS: Sleeps until min_complete requests have completed or a signal arrives
+ */
+int32_t aio_enter(int32_t min_complete) {
+    return aio_wait(current_task, min_complete);
+}
+
+/*
+ * mmap
+ *    DESCRIPTION: Maps an open file into the calling process
+ *    INPUTS: fd -- open regular file
+ *            addr -- page-aligned address in the user page to map it at
+ *            flags -- MMAP_READ for read-only, MMAP_PRIVATE for private copy-on-write
+ *    OUTPUTS: none
+ *    RETURNS: addr on success, -1 on failure (see mmap_file)
+ *    SIDE EFFECTS: The whole file is mapped, rounded up to 4KB with zeros past its end
+ */
+int32_t mmap(int32_t fd, void* addr, int32_t flags) {
+    return mmap_file(current_task, fd, (uint32_t)addr, flags);
+}
+
+/*
+ * munmap
+ *    DESCRIPTION: Unmaps a file mapped by mmap
+ *    INPUTS: addr -- address mmap returned
+ *    OUTPUTS: none
+ *    RETURNS: 0 on success, -1 if no file is mapped at addr
+ */
+int32_t munmap(void* addr) {
+    return mmap_unmap(current_task, (uint32_t)addr);
+}
+
+/*
+ * readv
+ *    DESCRIPTION: Reads from a file into several buffers in one system call
+ *    INPUTS: fd -- file descriptor
+ *            iov -- array of iovcnt buffers, filled in order
+ *            iovcnt -- number of buffers, at most IOV_MAX
+ *    OUTPUTS: fills the buffers
+ *    RETURNS: Total bytes read, stopping after the first short read or a buffer outside the user
+ *             page. -1 if the arguments are bad or the first read fails
+ */
+int32_t readv(int32_t fd, const iovec_t* iov, int32_t iovcnt) {
+    sti();
+    return transfer_iov(fd, iov, iovcnt, 0);
+}
+
+/*
+ * writev
+ *    DESCRIPTION: Writes several buffers to a file in one system call
+ *    INPUTS: fd -- file descriptor
+ *            iov -- array of iovcnt buffers, written in order
+ *            iovcnt -- number of buffers, at most IOV_MAX
+ *    OUTPUTS: none
+ *    RETURNS: Total bytes written, stopping after the first short write or a buffer outside the
+ *             user page. -1 if the arguments are bad or the first write fails
+ */
+int32_t writev(int32_t fd, const iovec_t* iov, int32_t iovcnt) {
+    return transfer_iov(fd, iov, iovcnt, 1);
+}
+
+/*
+ * batch
+ *    DESCRIPTION: Runs several system calls in one kernel entry
+ *    INPUTS: calls -- array of count system calls, run in order
+ *            count -- number of calls, at most BATCH_MAX
+ *    OUTPUTS: Writes each call's return value into its ret
+ *    RETURNS: Number of calls that ran, -1 if the arguments are bad
+ *    SIDE EFFECTS: Stops early at a call that isn't allowed in a batch (its ret is -1 and it
+ *                  doesn't count as run) or when a signal is waiting to be delivered
+ *    NOTES: halt, execute, sigreturn, fork, exec and batch itself depend on how the process
+ *           entered the kernel, so they have to be made on their own
+ */
+int32_t batch(syscall_desc_t* calls, int32_t count) {
+    int32_t i, num;
+
+    if(count < 0 || count > BATCH_MAX || !user_range_ok(calls, count * sizeof(syscall_desc_t)))
+        return -1;
+
+    for(i = 0; i < count; i++) {
+        num = calls[i].num;
+        if(num < 1 || num > SYSCALL_MAX || num == SYS_HALT || num == SYS_EXECUTE || num == SYS_SIGRETURN
+                || num == SYS_FORK || num == SYS_EXEC || num == SYS_BATCH) {
+            calls[i].ret = -1;
+            break;
+        }
+        calls[i].ret = systems_jump_table[num](calls[i].args[0], calls[i].args[1], calls[i].args[2]);
+        if(signal_pending(current_task)) {
+            i++;
+            break;
+        }
+    }
+    return i;
+}
+
+/*
+ * user_range_ok
+ *    DESCRIPTION: Checks a buffer lies in the user program page
+ *    INPUTS: addr -- start of the buffer
+ *            size -- its length in bytes
+ *    OUTPUTS: none
+ *    RETURNS: 1 if it does, 0 otherwise
+ */
+static int32_t user_range_ok(const void * addr, uint32_t size) {
+    return (uint32_t)addr >= ONE_TWO_EIGHT_MB && size <= ONE_THREE_TWO_MB - (uint32_t)addr;
+}
+
+/*
+ * transfer_iov
+ *    DESCRIPTION: Shared body of readv and writev
+ *    INPUTS: fd -- file descriptor
+ *            iov -- buffers
+ *            iovcnt -- number of buffers
+ *            writing -- 1 to write the buffers, 0 to read into them
+ *    OUTPUTS: fills the buffers when reading
+ *    RETURNS: See readv and writev
+ *    SIDE EFFECTS: Looks the fd up once and calls its driver once per buffer
+ */
+static int32_t transfer_iov(int32_t fd, const iovec_t * iov, int32_t iovcnt, int32_t writing) {
+    file_t * file = fd_get(current_task, fd);
+    iovec_t vec;
+    int32_t i, ret, done = 0;
+
+    if(file == NULL)
+        return -1;
+    if(iovcnt < 0 || iovcnt > IOV_MAX || !user_range_ok(iov, iovcnt * sizeof(iovec_t)))
+        return -1;
+
+    for(i = 0; i < iovcnt; i++) {
+        // Copied so the program can't change it between the check and the driver call
+        vec = iov[i];
+        if(vec.len < 0 || !user_range_ok(vec.base, vec.len))
+            return done ? done : -1;
+        if(vec.len == 0)
+            continue;
+
+        if(writing)
+            ret = file->ops->write(fd, vec.base, vec.len);
+        else
+            ret = file->ops->read(fd, vec.base, vec.len);
+
+        if(ret < 0)
+            return done ? done : -1;
+        done += ret;
+        if(ret < vec.len)
+            break;
+    }
+    return done;
 }
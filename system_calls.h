@@ -3,8 +3,53 @@
 
 #include "types.h"
 
-#define MAX_PROCESSES 6
 #define MAX_ARGS 100
+#define SHM_PER_PROCESS 4           // Shared memory segments a process can have attached at once
+#define MMAP_PER_PROCESS 8          // Files a process can have mapped at once
+#define FD_INLINE 8                 // fds every process starts with, the table grows past this (see file.c)
+#define USER_STACK_TOP 0x083ffffc   // Initial user ESP (132MB - 4B)
+#define IOV_MAX 16                  // Most buffers one readv/writev can take
+#define BATCH_MAX 32                // Most system calls one batch can run
+
+// System call numbers that batch calls by number (the rest are in asm_linkage.S's jump table)
+#define SYS_HALT        1
+#define SYS_EXECUTE     2
+#define SYS_SIGRETURN   10
+#define SYS_FORK        12
+#define SYS_EXEC        13
+#define SYS_BATCH       24
+
+// Task states
+#define TASK_RUNNABLE   0           // On the runqueue
+#define TASK_EXECUTING  1           // Blocked in execute until its child halts
+#define TASK_WAITING    2           // Asleep on a wait queue (waitpid, pipes)
+#define TASK_ZOMBIE     3           // Exited, waiting for its parent to collect the status
+
+// Signal numbers (Appendix B numbers 0-4, ours start after them)
+#define DIV_ZERO        0           // Divide error in user code, kills by default
+#define SEGFAULT        1           // Any other exception in user code, kills by default
+#define INTERRUPT       2           // Ctrl+C in the process's terminal, kills by default
+#define ALARM           3           // Alarm set with the alarm system call went off, ignored by default
+#define USER1           4           // Free for programs to use, ignored by default
+#define SIGCHLD         5           // A child exited and can be collected with wait/waitpid, ignored by default
+#define NUM_SIGNALS     6
+
+// Registers saved on the kernel stack by a system call (pushal, then the iret frame)
+typedef struct hw_context {
+    uint32_t edi;
+    uint32_t esi;
+    uint32_t ebp;
+    uint32_t esp_k;             // Kernel ESP at the pushal, ignored by popal
+    uint32_t ebx;
+    uint32_t edx;
+    uint32_t ecx;
+    uint32_t eax;
+    uint32_t eip;
+    uint32_t cs;
+    uint32_t eflags;
+    uint32_t esp;
+    uint32_t ss;
+} hw_context_t;
 
 //Appendix A 8.2, fops table should contain entries for open, read, write, and close
 //Note: functions are casted to pointers, otherwise C won't recognize them in struct
@@ -13,29 +58,89 @@ typedef struct{
     int32_t (*write)(int32_t fd, const void* buf, int32_t nbytes);
     int32_t (*open)(const uint8_t* filename);
     int32_t (*close)(int32_t fd);
+    int32_t (*ioctl)(int32_t fd, int32_t request, uint32_t arg);
 } fops_jump_table_t;
 
 
-// File descriptor struct for entries in the file descriptor array (FDA)
-typedef struct file_descriptor_t {
-    fops_jump_table_t fops_table_ptr;      
-    uint32_t inode;
+// Driver tables shared by every open file of that kind (system_calls.c)
+extern const fops_jump_table_t rtc_table;
+extern const fops_jump_table_t stdin_table;
+extern const fops_jump_table_t stdout_table;
+
+// An open file, shared by every fd that points at it (after fork or dup), see file.c
+typedef struct file {
+    const fops_jump_table_t * ops;  // The driver's functions
+    uint32_t inode;     // Driver data (inode number for files, pipe_t * for pipes)
     uint32_t file_pos; 
-    uint32_t flags;     //marks whether is in use
-} file_descriptor_t;
+    uint32_t mode;      // driver-specific mode set through ioctl (input mode for stdin)
+    uint32_t refcount;  // fds pointing at this file, in any process
+} file_t;
+
+// One buffer of a readv/writev
+typedef struct iovec {
+    void * base;                // Start of the buffer
+    int32_t len;                // Its length in bytes
+} iovec_t;
+
+// One system call of a batch, ret is filled in once it has run
+typedef struct syscall_desc {
+    int32_t num;                // System call number
+    uint32_t args[3];           // Arguments, as they would go in ebx, ecx and edx
+    int32_t ret;                // Return value
+} syscall_desc_t;
+
+// A shared memory segment attached to a process (see shm.c)
+typedef struct shm_attach {
+    int32_t id;                 // Segment id
+    uint32_t addr;              // Where it's mapped, 0 if this entry is unused
+} shm_attach_t;
+
+// A file mapped into a process (see mmap.c)
+typedef struct mmap_region {
+    uint32_t addr;              // Where it's mapped, 0 if this entry is unused
+    uint32_t npages;            // Pages it covers
+} mmap_region_t;
+
+// Tasks sleeping until some event, see sleep_on and wake_up
+typedef struct wait_queue {
+    struct pcb * head;          // Sleepers, linked through wait_next
+} wait_queue_t;
 
 //Process control block (PCB) struct described in Appendix A 8.2
 typedef struct pcb {
-    file_descriptor_t fda[8];    //up to 8 open files are represented with a file array in PCB
+    file_t ** fds;              // Open files indexed by fd, fd_count entries (NULL if closed)
+    uint32_t fd_count;
+    file_t * fd_inline[FD_INLINE];  // fds starts out pointing here
     uint32_t process_id;
     uint32_t parent_process_id;
     uint32_t parent_esp;        // Used to restore parent's ESP when process halts
     uint32_t parent_ebp;        // Used to restore parent's EBP when process halts
-    uint32_t curr_esp;          // ESP for this process so its not corrupted upon scheduler task switching
-    uint32_t curr_ebp;          // EBP for this process so its not corrupted upon scheduler task switching
+    uint32_t curr_esp;          // Saved kernel ESP while the scheduler runs other tasks (see context_switch)
     uint8_t called_vidmap;
     int8_t arg[MAX_ARGS];             // holds the arguments passed by the shell cmd 
     struct pcb * parent_pcb;
+    uint32_t page_table;        // This process's user page table (0 if none yet)
+    struct pcb * hash_next;     // Next PCB in the same PID hash bucket
+
+    int32_t state;              // TASK_* state
+    int32_t terminal_id;        // Terminal the process runs in
+    int32_t exit_status;        // Status passed to halt, kept for waitpid while a zombie
+    uint8_t executed;           // 1 if started by execute (the parent is blocked until we halt), 0 if forked or spawned
+    uint32_t pending_signals;   // Bit n set if signal n has been raised and not handled yet
+    uint32_t signal_mask;       // Bit n set if signal n is blocked (while its handler runs)
+    void * signal_handlers[NUM_SIGNALS];    // User handlers, NULL for the default action
+    uint32_t alarm_interval;    // Alarm period in PIT ticks, 0 if no alarm is set
+    uint32_t alarm_left;        // Ticks until the next ALARM
+    struct pcb * alarm_next;    // Next process with an alarm set
+    struct pcb * run_next;      // Links in the scheduler's runqueue
+    struct pcb * run_prev;
+    struct pcb * first_child;   // Children, linked through next_sibling
+    struct pcb * next_sibling;
+    struct pcb * wait_next;     // Next sleeper on the same wait queue
+    wait_queue_t child_wait;    // Where waitpid sleeps until a child exits
+    shm_attach_t shm[SHM_PER_PROCESS];  // Attached shared memory segments
+    struct aio_ctx * aio;       // Async I/O rings set up with aio_setup, NULL if none (see aio.c)
+    mmap_region_t mmaps[MMAP_PER_PROCESS];  // Mapped files
 }pcb_t;
 
 
@@ -67,4 +172,52 @@ int32_t set_handler(int32_t signum, void* handler_address);
 
 int32_t sigreturn(void);
 
+int32_t ioctl(int32_t fd, int32_t request, uint32_t arg);
+
+int32_t fork(void);
+
+int32_t exec(const uint8_t* command);
+
+int32_t waitpid(int32_t pid, int32_t* status);
+
+int32_t spawn(const uint8_t* command);
+
+int32_t wait(int32_t* status);
+
+int32_t pipe(int32_t* fds);
+
+int32_t shmget(int32_t key, uint32_t size);
+
+int32_t shmat(int32_t shmid, void* addr);
+
+int32_t shmdt(void* addr);
+
+int32_t alarm(uint32_t ms);
+
+int32_t readv(int32_t fd, const iovec_t* iov, int32_t iovcnt);
+
+int32_t writev(int32_t fd, const iovec_t* iov, int32_t iovcnt);
+
+int32_t batch(syscall_desc_t* calls, int32_t count);
+
+int32_t dup(int32_t fd);
+
+int32_t dup2(int32_t fd, int32_t newfd);
+
+int32_t creat(const uint8_t* filename);
+
+int32_t unlink(const uint8_t* filename);
+
+int32_t truncate(const uint8_t* filename, uint32_t length);
+
+int32_t lseek(int32_t fd, int32_t offset, int32_t whence);
+
+int32_t aio_setup(void* ring);
+
+int32_t aio_enter(int32_t min_complete);
+
+int32_t mmap(int32_t fd, void* addr, int32_t flags);
+
+int32_t munmap(void* addr);
+
 #endif /* _SYSTEM_CALLS_H */
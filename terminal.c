@@ -6,6 +6,20 @@
 #include "lib.h"
 #include "paging.h"
 #include "system_calls.h"
+#include "x86_desc.h"
+#include "keymap.h"
+#include "scheduler.h"
+#include "signal.h"
+#include "file.h"
+
+static int32_t terminal_read_chars(void * buf, int32_t n_bytes, uint32_t nonblock);
+static int32_t ldisc_line_max();
+static void ldisc_redraw_from(int32_t terminal_id, int32_t from, int32_t erase);
+static void ldisc_insert(int32_t terminal_id, char c, int32_t count);
+static void ldisc_delete(int32_t terminal_id);
+static void ldisc_replace_line(int32_t terminal_id, const char * line, int32_t len);
+static void ldisc_history_add(int32_t terminal_id);
+static void ldisc_history_walk(int32_t terminal_id, int32_t older);
 
 
 /*
@@ -33,8 +47,14 @@ void init_terminal(){
         terminals[i].rtc_countdown = 0;
         terminals[i].rtc_virt_interrupt = 0;
         terminals[i].in_terminal_read = 0;
+        terminals[i].kb_mode = TERMINAL_MODE_COOKED;
+        terminals[i].history_head = 0;
+        terminals[i].history_count = 0;
         clear_keyboard_vars(i);                 // Initialize each terminal's keyboard buffer 
     }
+
+    // Display terminal 0's VGA page (the other terminals' pages sit right after it)
+    set_display_page(visible_terminal);
 }
 
 /*
@@ -43,7 +63,8 @@ void init_terminal(){
  *    INPUTS: terminal_id -- the terminal whose keyboard vars are to be reset 
  *    OUTPUTS: none
  *    RETURN VALUE: none
- *    SIDE EFFECTS: clears keyboard buffer and resets kb flags and buffer index  
+ *    SIDE EFFECTS: clears keyboard buffer and resets kb flags, buffer index and edit cursor
+ *    NOTES: The history ring is kept, only the current position in it is reset
  */
 void clear_keyboard_vars(int32_t terminal_id) {
     if(terminal_id < 0 || terminal_id >= MAX_TERMINALS)
@@ -51,6 +72,9 @@ void clear_keyboard_vars(int32_t terminal_id) {
     int i;      // Loop index
     terminals[terminal_id].kb_buf_i = 0;        //set keyboard index to start
     terminals[terminal_id].kb_enter_flag = 0;   //enter key has not been pressed
+    terminals[terminal_id].kb_cursor = 0;
+    terminals[terminal_id].history_pos = 0;
+    terminals[terminal_id].history_edit_len = 0;
     for(i = 0; i < KEYBOARD_BUF_SIZE; i++) {
         terminals[terminal_id].kb_buf[i] = 0;   //clear keyboard buffer
     }
@@ -58,26 +82,26 @@ void clear_keyboard_vars(int32_t terminal_id) {
 
 /*
  * terminal_open
- *    DESCRIPTION: Open the terminal (stdin)
- *    INPUTS: none
+ *    DESCRIPTION: Open the terminal (stdin or stdout, also as /dev/stdin and /dev/stdout)
+ *    INPUTS: filename -- ignored
  *    OUTPUTS: none
  *    RETURN VALUE: Always 0 (success)
  *    SIDE EFFECTS: none
  */
-int32_t terminal_open(int32_t fd) {
+int32_t terminal_open(const uint8_t * filename) {
     return 0;
 }
 
 /*
  * terminal_close
- *    DESCRIPTION: This should never be called
- *    INPUTS: none
+ *    DESCRIPTION: Called when the last fd for a stdin/stdout file closes (halt, or a dup'ed copy)
+ *    INPUTS: fd -- ignored
  *    OUTPUTS: none
- *    RETURN VALUE: Always -1 as terminal should never be closed
+ *    RETURN VALUE: Always 0, the terminal itself stays open
  *    SIDE EFFECTS: none
  */
 int32_t terminal_close(int32_t fd) {
-    return -1;
+    return 0;
 }
 
 /*
@@ -85,8 +109,13 @@ int32_t terminal_close(int32_t fd) {
  *    DESCRIPTION: Reads from the buffer 
  *    INPUTS: file descriptor, buf -- ptr to output buffer that we copy keyboard_buf to, n_bytes
  *    OUTPUTS: copies buf to terminal_buf
- *    RETURN VALUE: Number of bytes written
+ *    RETURN VALUE: Number of bytes written, -1 if nothing is ready on a TERMINAL_NONBLOCK fd or
+ *                  a signal cut the wait short
  *    SIDE EFFECTS: Writes to buffer pointed to by input
+ *    NOTES: Cooked fds get a whole line once enter is pressed. Raw and cbreak fds get whatever
+ *           keys are queued as soon as there is at least one. With TERMINAL_NONBLOCK set, -1 is
+ *           returned right away when no line/key is ready instead of waiting (0 would read as
+ *           end of file).
  */
 int32_t terminal_read(int32_t fd, void * buf, int32_t n_bytes) {
     
@@ -94,17 +123,32 @@ int32_t terminal_read(int32_t fd, void * buf, int32_t n_bytes) {
     if(buf == 0 || n_bytes <= 0)
         return 0; 
 
+    // The keyboard follows the input mode of whoever is reading the terminal
+    uint32_t mode = fd_get(current_task, fd)->mode;
+    terminals[scheduled_terminal].kb_mode = mode & TERMINAL_MODE_MASK;
+
+    if((mode & TERMINAL_MODE_MASK) != TERMINAL_MODE_COOKED)
+        return terminal_read_chars(buf, n_bytes, mode & TERMINAL_NONBLOCK);
+
+    // Non-blocking cooked reads only succeed once a full line is waiting
+    if((mode & TERMINAL_NONBLOCK) && !terminals[scheduled_terminal].kb_enter_flag)
+        return -1;
+
     // Let keyboard know how many bytes the buffer is (is this meaningless?)
     terminal_buf_n_bytes = n_bytes;
 
     // Set flag to allow keyboard inputs to write to screen
     terminals[scheduled_terminal].in_terminal_read = 1;
 
-    // Block until enter ('\n') has been pressed for the scheduled terminal
-    while(!terminals[scheduled_terminal].kb_enter_flag);
+    // Block until enter ('\n') has been pressed for the scheduled terminal, or a signal (Ctrl+C) comes in
+    while(!terminals[scheduled_terminal].kb_enter_flag && !signal_pending(current_task));
 
     // Clear flag to have keyboard inputs be invisible
     terminals[scheduled_terminal].in_terminal_read = 0;
+
+    // Interrupted, the signal is delivered on the way back to user mode
+    if(!terminals[scheduled_terminal].kb_enter_flag)
+        return -1;
     
     // Alias vars for readability (using scheduled_terminal as we might be in a background process)
     char * kb_buf = terminals[scheduled_terminal].kb_buf;
@@ -134,6 +178,41 @@ int32_t terminal_read(int32_t fd, void * buf, int32_t n_bytes) {
     return bytes_written;
 }
 
+/*
+ * terminal_read_chars
+ *    DESCRIPTION: Raw/cbreak read, hands back queued keys without waiting for a line
+ *    INPUTS: buf -- output buffer
+ *            n_bytes -- max bytes to copy
+ *            nonblock -- nonzero to fail right away if no keys are queued
+ *    OUTPUTS: copies up to n_bytes queued keys into buf
+ *    RETURN VALUE: Number of bytes copied, -1 if there were none (nonblock, or a signal came in)
+ *    SIDE EFFECTS: Removes the copied keys from the front of the terminal's keyboard buffer
+ */
+static int32_t terminal_read_chars(void * buf, int32_t n_bytes, uint32_t nonblock) {
+    terminal_t * terminal = &terminals[scheduled_terminal];
+    int32_t count;
+    uint32_t flags;
+
+    // Allow cbreak echo while we're waiting, then block until at least one key is queued
+    terminal->in_terminal_read = 1;
+    if(!nonblock) {
+        while(terminal->kb_buf_i == 0 && !signal_pending(current_task));
+    }
+    terminal->in_terminal_read = 0;
+
+    // The keyboard bottom half appends from interrupt context, so take the keys out atomically
+    cli_and_save(flags);
+    count = terminal->kb_buf_i;
+    if(count > n_bytes)
+        count = n_bytes;
+    memcpy(buf, terminal->kb_buf, count);
+    memmove(terminal->kb_buf, terminal->kb_buf + count, terminal->kb_buf_i - count);
+    terminal->kb_buf_i -= count;
+    restore_flags(flags);
+
+    return (count == 0) ? -1 : count;
+}
+
 /*
  * terminal_write
  *    DESCRIPTION: Writes the bytes from input buf to the screen
@@ -160,6 +239,8 @@ int32_t terminal_write(int32_t fd, const void * buf, int32_t n_bytes) {
        Prints out the keyboard buffer again if the shell prompt (length 7) is the argument */
     if(!strncmp((int8_t *)buf, "391OS> ", 7) && shell_count == 3) {
         terminal_write(NULL, terminals[scheduled_terminal].kb_buf, terminals[scheduled_terminal].kb_buf_i);
+        // Put the cursor back where the user was editing inside the line
+        shift_cursor(scheduled_terminal, terminals[scheduled_terminal].kb_cursor - terminals[scheduled_terminal].kb_buf_i);
     }
 
     return i;
@@ -171,21 +252,366 @@ int32_t terminal_write(int32_t fd, const void * buf, int32_t n_bytes) {
  *    INPUTS: terminal_id -- the terminal to switch to
  *    OUTPUTS: none
  *    RETURN VALUE: none
- *    SIDE EFFECTS: Switches to the desired terminal (including video page)
+ *    SIDE EFFECTS: Points the VGA display at the desired terminal's page and moves the cursor there
+ *    NOTES: Each terminal's text permanently lives in its own VGA page, so nothing is copied
  */
 void switch_visible_terminal(int32_t terminal_id) {
     if(terminal_id == visible_terminal)  //check if we are switching to same terminal
         return;
+    if(terminal_id < 0 || terminal_id >= MAX_TERMINALS)
+        return;
 
-    // Save visible terminal to its video page and load the one to change to
-    change_terminal_video_page(visible_terminal, terminal_id);
-
-    // Save cursor
-    terminals[visible_terminal].cursor_x = get_screen_x();
-    terminals[visible_terminal].cursor_y = get_screen_y();
+    visible_terminal = terminal_id;  // Update visible terminal ID to the one we switch to
 
-    // Update keyboard buffer and screen coordinates
+    // Display the new terminal's page and restore its cursor
+    set_display_page(terminal_id);
     update_cursor(terminals[terminal_id].cursor_x, terminals[terminal_id].cursor_y);
+}
 
-    visible_terminal = terminal_id;  // Update visible terminal ID to the one we switch to
+/*
+ * terminal_ioctl
+ *    DESCRIPTION: Gets or sets the input mode of a stdin fd
+ *    INPUTS: fd -- the stdin file descriptor
+ *            request -- TIOCGMODE or TIOCSMODE
+ *            arg -- new TERMINAL_MODE_* value, optionally ORed with TERMINAL_NONBLOCK (TIOCSMODE only)
+ *    OUTPUTS: none
+ *    RETURN VALUE: Current mode for TIOCGMODE, 0 on a successful TIOCSMODE, -1 otherwise
+ *    SIDE EFFECTS: Switches the scheduled terminal's line discipline right away so keys typed
+ *                  before the next read are queued the way the new mode expects
+ */
+int32_t terminal_ioctl(int32_t fd, int32_t request, uint32_t arg) {
+    file_t* file = fd_get(current_task, fd);
+
+    switch(request) {
+        case TIOCGMODE:
+            return file->mode;
+
+        case TIOCSMODE:
+            if((arg & ~(TERMINAL_MODE_MASK | TERMINAL_NONBLOCK)) || (arg & TERMINAL_MODE_MASK) > TERMINAL_MODE_RAW)
+                return -1;
+            file->mode = arg;
+            terminals[scheduled_terminal].kb_mode = arg & TERMINAL_MODE_MASK;
+            return 0;
+    }
+    return -1;
+}
+
+/*
+ * terminal_reset_mode
+ *    DESCRIPTION: Puts a terminal's line discipline back into cooked mode
+ *    INPUTS: terminal_id -- the terminal to reset
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Drops any keys a raw/cbreak program left unread
+ */
+void terminal_reset_mode(int32_t terminal_id) {
+    if(terminal_id < 0 || terminal_id >= MAX_TERMINALS)
+        return;
+    if(terminals[terminal_id].kb_mode == TERMINAL_MODE_COOKED)
+        return;
+    terminals[terminal_id].kb_mode = TERMINAL_MODE_COOKED;
+    clear_keyboard_vars(terminal_id);
+}
+
+/*
+ * terminal_receive_key
+ *    DESCRIPTION: Line discipline entry point, applies one translated key to a terminal's line
+ *    INPUTS: terminal_id -- terminal the key was typed into (the visible one)
+ *            key -- ASCII char or KEY_* code from the keymap
+ *    OUTPUTS: echoes the edit to the screen if the terminal is inside terminal_read
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Edits kb_buf/kb_cursor, walks the history ring, sets kb_enter_flag on enter
+ *    NOTES: Raw and cbreak readers get every key queued as is. Cooked lines support
+ *           left/right/home/end, insert anywhere, backspace/delete and up/down history, and
+ *           only the part of the line after the edit is redrawn
+ */
+void terminal_receive_key(int32_t terminal_id, uint8_t key) {
+    terminal_t * t = &terminals[terminal_id];
+    char print_allowed = t->in_terminal_read;  // Only allow keyboard to putc if in terminal_read
+
+    // Ctrl + C interrupts the program in the foreground, except raw readers who get it as a key.
+    // The base shell isn't interrupted, a half-typed line is just thrown away
+    if(key == CTRL_C && t->kb_mode != TERMINAL_MODE_RAW) {
+        if(t->terminal_pcb != NULL && t->terminal_pcb->parent_process_id != t->terminal_pcb->process_id)
+            signal_raise(t->terminal_pcb, INTERRUPT);
+        if(t->kb_mode == TERMINAL_MODE_COOKED && !t->kb_enter_flag) {
+            if(print_allowed)
+                ldisc_replace_line(terminal_id, "", 0);
+            t->kb_buf_i = 0;
+            t->kb_cursor = 0;
+        }
+        return;
+    }
+
+    // Raw and cbreak readers get every key (control chars and KEY_* codes included) as soon as it's typed
+    if(t->kb_mode != TERMINAL_MODE_COOKED) {
+        if(t->kb_buf_i >= KEYBOARD_BUF_SIZE)
+            return;
+        t->kb_buf[t->kb_buf_i] = key;
+        t->kb_buf_i++;
+        // Only cbreak echoes, and only printable chars
+        if(print_allowed && t->kb_mode == TERMINAL_MODE_CBREAK &&
+            ((key >= ' ' && key < KEY_UP) || key == '\n'))
+            putc(key, 1);
+        return;
+    }
+
+    // A finished line is waiting for terminal_read to pick it up
+    if(t->kb_enter_flag)
+        return;
+
+    // Ctrl + l and Ctrl + L clears screen and prints keyboard buffer again
+    if(key == CTRL_L) {
+        clear();
+        if(print_allowed)
+            ldisc_redraw_from(terminal_id, 0, 0);
+        return;
+    }
+
+    // Backspace and printable chars are allowed while nobody is reading (typed ahead and shown
+    // when the shell prompt comes back), the rest only make sense on an echoed line
+    if(key == '\b') {
+        if(t->kb_cursor > 0) {
+            if(print_allowed)
+                shift_cursor(terminal_id, -1);
+            t->kb_cursor--;
+            ldisc_delete(terminal_id);
+        }
+        return;
+    }
+
+    if(key == '\t') {
+        ldisc_insert(terminal_id, ' ', 8);    // Tab = 8 spaces, clipping on overflow
+        return;
+    }
+
+    if(key >= ' ' && key < KEY_UP) {
+        ldisc_insert(terminal_id, key, 1);
+        return;
+    }
+
+    // If visible_terminal isn't in terminal_read, editing keys and enter should do nothing
+    if(!print_allowed)
+        return;
+
+    switch(key) {
+        case '\n':
+            // Enter always takes the whole line no matter where the cursor is
+            shift_cursor(terminal_id, t->kb_buf_i - t->kb_cursor);
+            ldisc_history_add(terminal_id);
+            t->kb_buf[t->kb_buf_i] = '\n';
+            t->kb_buf_i++;
+            t->kb_cursor = t->kb_buf_i;
+            t->kb_enter_flag = 1;
+            putc('\n', 1);
+            return;
+        case KEY_LEFT:
+            if(t->kb_cursor > 0) {
+                t->kb_cursor--;
+                shift_cursor(terminal_id, -1);
+            }
+            return;
+        case KEY_RIGHT:
+            if(t->kb_cursor < t->kb_buf_i) {
+                t->kb_cursor++;
+                shift_cursor(terminal_id, 1);
+            }
+            return;
+        case KEY_HOME:
+            shift_cursor(terminal_id, -t->kb_cursor);
+            t->kb_cursor = 0;
+            return;
+        case KEY_END:
+            shift_cursor(terminal_id, t->kb_buf_i - t->kb_cursor);
+            t->kb_cursor = t->kb_buf_i;
+            return;
+        case KEY_DELETE:
+            if(t->kb_cursor < t->kb_buf_i)
+                ldisc_delete(terminal_id);
+            return;
+        case KEY_UP:
+            ldisc_history_walk(terminal_id, 1);
+            return;
+        case KEY_DOWN:
+            ldisc_history_walk(terminal_id, 0);
+            return;
+    }
+
+    // Ignore unmapped keys, other control chars and the remaining KEY_* codes
+}
+
+/*
+ * ldisc_line_max
+ *    DESCRIPTION: Longest line the cooked line discipline will accept
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUE: Max chars before '\n' (only buf_size-1 chars + '\n' fit in either buffer)
+ *    SIDE EFFECTS: none
+ */
+static int32_t ldisc_line_max() {
+    if(terminal_buf_n_bytes > 0 && terminal_buf_n_bytes - 1 < KEYBOARD_BUF_CHAR_MAX)
+        return terminal_buf_n_bytes - 1;
+    return KEYBOARD_BUF_CHAR_MAX;
+}
+
+/*
+ * ldisc_redraw_from
+ *    DESCRIPTION: Reprints the tail of the line after an edit
+ *    INPUTS: terminal_id -- terminal being edited, its screen cursor must sit at line position from
+ *            from -- first line position to reprint
+ *            erase -- number of cells past the new end of line to blank (the line got shorter)
+ *    OUTPUTS: writes kb_buf[from..kb_buf_i) and the blanks to the screen
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Leaves the screen cursor at kb_cursor
+ */
+static void ldisc_redraw_from(int32_t terminal_id, int32_t from, int32_t erase) {
+    terminal_t * t = &terminals[terminal_id];
+    int32_t i;
+
+    for(i = from; i < t->kb_buf_i; i++)
+        putc((uint8_t)t->kb_buf[i], 1);
+    for(i = 0; i < erase; i++)
+        putc(' ', 1);
+    shift_cursor(terminal_id, t->kb_cursor - (t->kb_buf_i + erase));
+}
+
+/*
+ * ldisc_insert
+ *    DESCRIPTION: Inserts count copies of c at the edit cursor
+ *    INPUTS: terminal_id -- terminal being edited
+ *            c -- char to insert
+ *            count -- how many copies, clipped to what fits in the line
+ *    OUTPUTS: redraws the line from the old cursor position if echoing
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Shifts the rest of the line right and advances kb_cursor
+ */
+static void ldisc_insert(int32_t terminal_id, char c, int32_t count) {
+    terminal_t * t = &terminals[terminal_id];
+    int32_t pos = t->kb_cursor;
+    int32_t i;
+
+    // If entering a char will overflow either buffer, ignore the key press
+    if(count > ldisc_line_max() - t->kb_buf_i)
+        count = ldisc_line_max() - t->kb_buf_i;
+    if(count <= 0)
+        return;
+
+    memmove(t->kb_buf + pos + count, t->kb_buf + pos, t->kb_buf_i - pos);
+    for(i = 0; i < count; i++)
+        t->kb_buf[pos + i] = c;
+    t->kb_buf_i += count;
+    t->kb_cursor += count;
+
+    if(t->in_terminal_read)
+        ldisc_redraw_from(terminal_id, pos, 0);
+}
+
+/*
+ * ldisc_delete
+ *    DESCRIPTION: Deletes the char under the edit cursor
+ *    INPUTS: terminal_id -- terminal being edited, its screen cursor must sit at kb_cursor
+ *    OUTPUTS: redraws the rest of the line if echoing
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Shifts the rest of the line left
+ */
+static void ldisc_delete(int32_t terminal_id) {
+    terminal_t * t = &terminals[terminal_id];
+    int32_t pos = t->kb_cursor;
+
+    memmove(t->kb_buf + pos, t->kb_buf + pos + 1, t->kb_buf_i - pos - 1);
+    t->kb_buf_i--;
+    t->kb_buf[t->kb_buf_i] = 0;
+
+    if(t->in_terminal_read)
+        ldisc_redraw_from(terminal_id, pos, 1);
+}
+
+/*
+ * ldisc_replace_line
+ *    DESCRIPTION: Swaps the whole line for another one (history recall)
+ *    INPUTS: terminal_id -- terminal being edited
+ *            line -- new contents, len -- its length
+ *    OUTPUTS: redraws only from the first char that differs from the old line
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Leaves kb_cursor at the end of the new line
+ */
+static void ldisc_replace_line(int32_t terminal_id, const char * line, int32_t len) {
+    terminal_t * t = &terminals[terminal_id];
+    int32_t old_len = t->kb_buf_i;
+    int32_t same = 0;
+
+    if(len > ldisc_line_max())
+        len = ldisc_line_max();
+
+    // Skip the common prefix, those cells are already on screen
+    while(same < len && same < old_len && t->kb_buf[same] == line[same])
+        same++;
+
+    shift_cursor(terminal_id, same - t->kb_cursor);
+    memcpy(t->kb_buf + same, line + same, len - same);
+    t->kb_buf_i = len;
+    t->kb_cursor = len;
+    ldisc_redraw_from(terminal_id, same, old_len > len ? old_len - len : 0);
+}
+
+/*
+ * ldisc_history_add
+ *    DESCRIPTION: Remembers the line about to be entered in the history ring
+ *    INPUTS: terminal_id -- terminal whose line was entered
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Overwrites the oldest entry once the ring is full, skips empty lines and
+ *                  repeats of the most recent entry
+ */
+static void ldisc_history_add(int32_t terminal_id) {
+    terminal_t * t = &terminals[terminal_id];
+    int32_t last = (t->history_head + TERMINAL_HISTORY_SIZE - 1) % TERMINAL_HISTORY_SIZE;
+
+    t->history_pos = 0;
+    if(t->kb_buf_i == 0)
+        return;
+    if(t->history_count > 0 && t->history_len[last] == t->kb_buf_i &&
+        !strncmp((int8_t *)t->history[last], (int8_t *)t->kb_buf, t->kb_buf_i))
+        return;
+
+    memcpy(t->history[t->history_head], t->kb_buf, t->kb_buf_i);
+    t->history_len[t->history_head] = t->kb_buf_i;
+    t->history_head = (t->history_head + 1) % TERMINAL_HISTORY_SIZE;
+    if(t->history_count < TERMINAL_HISTORY_SIZE)
+        t->history_count++;
+}
+
+/*
+ * ldisc_history_walk
+ *    DESCRIPTION: Moves one entry back (up) or forward (down) through the history ring
+ *    INPUTS: terminal_id -- terminal being edited
+ *            older -- nonzero for up, 0 for down
+ *    OUTPUTS: replaces the line on screen with the recalled one
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Saves the line being typed when leaving it and restores it when coming back
+ */
+static void ldisc_history_walk(int32_t terminal_id, int32_t older) {
+    terminal_t * t = &terminals[terminal_id];
+    int32_t slot;
+
+    if(older) {
+        if(t->history_pos == t->history_count)
+            return;
+        if(t->history_pos == 0) {
+            memcpy(t->history_edit, t->kb_buf, t->kb_buf_i);
+            t->history_edit_len = t->kb_buf_i;
+        }
+        t->history_pos++;
+    } else {
+        if(t->history_pos == 0)
+            return;
+        t->history_pos--;
+    }
+
+    if(t->history_pos == 0) {
+        ldisc_replace_line(terminal_id, t->history_edit, t->history_edit_len);
+        return;
+    }
+    slot = (t->history_head + TERMINAL_HISTORY_SIZE - t->history_pos) % TERMINAL_HISTORY_SIZE;
+    ldisc_replace_line(terminal_id, t->history[slot], t->history_len[slot]);
 }
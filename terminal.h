@@ -10,6 +10,19 @@
 
 #define MAX_TERMINALS 3
 
+// Input modes for the terminal line discipline, selected per stdin fd through ioctl
+#define TERMINAL_MODE_COOKED    0x0     // Line-buffered, echoed, returned on enter
+#define TERMINAL_MODE_CBREAK    0x1     // Every key returned as soon as it's typed, echoed
+#define TERMINAL_MODE_RAW       0x2     // Every key returned as soon as it's typed, no echo or editing
+#define TERMINAL_MODE_MASK      0x3
+#define TERMINAL_NONBLOCK       0x4     // read fails with -1 right away instead of waiting for input
+
+// ioctl requests understood by terminal_ioctl
+#define TIOCGMODE               1       // Returns the fd's current mode bits
+#define TIOCSMODE               2       // Sets the fd's mode bits to arg
+
+#define TERMINAL_HISTORY_SIZE   16      // Lines remembered per terminal for up/down recall
+
 typedef struct{
     struct pcb* terminal_pcb;
     int32_t terminal_id;                //keeps track of which terminal we are on
@@ -17,10 +30,20 @@ typedef struct{
     int32_t cursor_y;
     int32_t last_assigned_pid;          //keeps track of last assigned pid of the terminal
 
-    volatile int32_t kb_buf_i;          // This terminal's keyboard buffer index
+    volatile int32_t kb_buf_i;          // This terminal's keyboard buffer index (length of the line)
+    int32_t kb_cursor;                  // Edit position inside kb_buf, always <= kb_buf_i
     volatile char kb_enter_flag;        //flags whether the kb enter key has been used
     char kb_buf[KEYBOARD_BUF_SIZE];     // This terminal's keyboard buffer
     char in_terminal_read;              // flags whether the keyboard_handler is allowed to write to screen
+    volatile uint8_t kb_mode;           // TERMINAL_MODE_* of the process reading this terminal
+
+    char history[TERMINAL_HISTORY_SIZE][KEYBOARD_BUF_SIZE];  // Ring of previously entered lines (no '\n')
+    int32_t history_len[TERMINAL_HISTORY_SIZE];
+    int32_t history_head;               // Slot the next entered line goes in
+    int32_t history_count;              // Number of valid lines in the ring
+    int32_t history_pos;                // How far back up/down has walked, 0 = the line being typed
+    char history_edit[KEYBOARD_BUF_SIZE];   // The line being typed, saved while browsing history
+    int32_t history_edit_len;
 
     volatile uint8_t rtc_active;                 // Boolean that denotes if this terminal's process opened the RTC
     volatile uint8_t rtc_virt_interrupt;         // Flag that denotes that the virtual RTC interrupt has occurred
@@ -52,7 +75,7 @@ extern void init_terminal();
 void clear_keyboard_vars(int32_t terminal_id);
 
 // Open syscall for terminal
-int32_t terminal_open(int32_t fd);
+int32_t terminal_open(const uint8_t * filename);
 
 // Clear terminal specific vars
 int32_t terminal_close(int32_t fd);
@@ -63,6 +86,15 @@ int32_t terminal_read(int32_t fd, void * buf, int32_t n_bytes);
 // Writes to the screen from buf and returns num bytes written or -1
 int32_t terminal_write(int32_t fd, const void * buf, int32_t n_bytes);
 
+// Gets or sets the input mode of a stdin fd
+int32_t terminal_ioctl(int32_t fd, int32_t request, uint32_t arg);
+
+// Line discipline entry point for one translated key typed into a terminal
+void terminal_receive_key(int32_t terminal_id, uint8_t key);
+
+// Puts a terminal's line discipline back into cooked mode
+void terminal_reset_mode(int32_t terminal_id);
+
 // Switches to the desired terminal
 void switch_visible_terminal(int32_t terminal_id);
 
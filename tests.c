@@ -6,6 +6,23 @@
 #include "terminal.h"
 #include "paging.h"
 #include "system_calls.h"
+#include "kmalloc.h"
+#include "frame.h"
+#include "process.h"
+#include "pipe.h"
+#include "shm.h"
+#include "signal.h"
+#include "pit.h"
+#include "vdso.h"
+#include "asm_linkage.h"
+#include "scheduler.h"
+#include "file.h"
+#include "vfs.h"
+#include "bcache.h"
+#include "ramdisk.h"
+#include "ata.h"
+#include "aio.h"
+#include "mmap.h"
 
 #define PASS 1
 #define FAIL 0
@@ -23,6 +40,57 @@ static inline void assertion_failure(){
 	asm volatile("int $15");
 }
 
+/* Frames a test may end up short because kmalloc kept the slabs it grew (pipes, files, rings) */
+#define TEST_SLAB_FRAMES	3
+
+/* What test_process_enter swapped out */
+static pcb_t * test_old_task;
+static uint32_t test_old_esp0;
+
+/*
+ * test_process_enter
+ *    DESCRIPTION: Makes a fake process with an empty user window and runs the test as it
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUES: The process, NULL if out of PIDs or memory
+ *    SIDE EFFECTS: Maps its user window, current_task and tss.esp0 point at it until
+ *                  test_process_leave. Its fds 0 and 1 are free, but close won't take them,
+ *                  so a test opens stand-ins for stdin and stdout first if it closes fds
+ */
+static pcb_t * test_process_enter(void) {
+	pcb_t * pcb = pcb_alloc();
+
+	if(pcb == NULL)
+		return NULL;
+	pcb->page_table = user_space_create();
+	if(pcb->page_table == 0) {
+		pcb_free(pcb);
+		return NULL;
+	}
+	test_old_task = current_task;
+	test_old_esp0 = tss.esp0;
+	set_user_prog_page(pcb->page_table, 1);
+	current_task = pcb;
+	tss.esp0 = PCB_KERNEL_STACK(pcb);
+	return pcb;
+}
+
+/*
+ * test_process_leave
+ *    DESCRIPTION: Switches back from a test_process_enter process and frees it
+ *    INPUTS: pcb -- the process
+ *    OUTPUTS: none
+ *    RETURN VALUES: none
+ *    SIDE EFFECTS: Closes its fds, unmaps the user window and drops its address space
+ */
+static void test_process_leave(pcb_t * pcb) {
+	fd_close_all(pcb);
+	tss.esp0 = test_old_esp0;
+	current_task = test_old_task;
+	set_user_prog_page(0, 0);
+	pcb_free(pcb);
+}
+
 
 /* Checkpoint 1 (MP3.1) tests */
 
@@ -157,7 +225,7 @@ int read_file_by_name(){
 	int32_t nbytes;
 	uint8_t buffer[512];
 	uint32_t length;
-	uint32_t finode;
+	super_block_t * sb = bootfs_super();
 	int i;
 
 	uint8_t* fname= (uint8_t*)"frame0.txt";
@@ -165,8 +233,7 @@ int read_file_by_name(){
 	(void)read_dentry_by_name((uint8_t*)fname, &dentry);
 
 	index=dentry.inode;
-	finode=((uint32_t)boot + (BLOCK_SIZE * (index + 1)));
-	length=((inode_t*)finode)->file_size;
+	length=sb->ops->size(sb, index);
 
 	for(i = 0; i < length; i++){
 		buffer[i] = 0x34;
@@ -272,6 +339,1097 @@ int test_terminal_keyboard(){
 /* Checkpoint 5 (MP3.5) tests */
 
 
+/* Kernel heap tests */
+
+/*
+ * kmalloc_test
+ *    DESCRIPTION: Allocates and frees small and large blocks from the kernel heap
+ *    INPUTS: none
+ *    OUTPUTS: PASS/FAIL
+ *    RETURN VALUES: none
+ *    SIDE EFFECTS: Prints the heap stats, every frame taken should be given back
+ */
+int kmalloc_test(){
+	TEST_HEADER;
+	uint32_t free_before = frames_free();
+	uint8_t * small[64];
+	uint8_t * large;
+	int i;
+
+	for(i = 0; i < 64; i++) {
+		small[i] = kmalloc(24 + i);
+		if(small[i] == NULL || ((uint32_t)small[i] & (KMEM_MIN_SIZE - 1)))
+			return FAIL;
+		memset(small[i], i, 24 + i);
+	}
+	large = kmalloc(3 * FOUR_KB);
+	if(large == NULL)
+		return FAIL;
+	memset(large, 0xAA, 3 * FOUR_KB);
+
+	// Blocks must not overlap
+	for(i = 0; i < 64; i++) {
+		if(small[i][0] != i || small[i][23 + i] != i)
+			return FAIL;
+	}
+	kmem_print_stats();
+
+	for(i = 0; i < 64; i++)
+		kfree(small[i]);
+	kfree(large);
+
+	// Only the one empty slab each size class keeps may still be held
+	if(frames_free() + 8 < free_before)
+		return FAIL;
+	return PASS;
+}
+
+/*
+ * process_table_test
+ *    DESCRIPTION: Allocates more PCBs than the old fixed table held and looks each one up by PID
+ *    INPUTS: none
+ *    OUTPUTS: PASS/FAIL
+ *    RETURN VALUES: none
+ *    SIDE EFFECTS: Frees every PCB it made, so the PIDs are handed out again afterwards
+ */
+int process_table_test(){
+	TEST_HEADER;
+	pcb_t * pcbs[64];
+	int i;
+
+	for(i = 0; i < 64; i++) {
+		pcbs[i] = pcb_alloc();
+		if(pcbs[i] == NULL)
+			return FAIL;
+		// The PCB must stay findable from any address on its kernel stack
+		if((PCB_KERNEL_STACK(pcbs[i]) & PCB_MASK) != (uint32_t)pcbs[i])
+			return FAIL;
+	}
+	for(i = 0; i < 64; i++) {
+		if(pcb_lookup(pcbs[i]->process_id) != pcbs[i])
+			return FAIL;
+	}
+
+	// A freed PID is the next one handed out
+	i = pcbs[10]->process_id;
+	pcb_free(pcbs[10]);
+	if(pcb_lookup(i) != NULL)
+		return FAIL;
+	pcbs[10] = pcb_alloc();
+	if(pcbs[10] == NULL || pcbs[10]->process_id != i)
+		return FAIL;
+
+	for(i = 0; i < 64; i++)
+		pcb_free(pcbs[i]);
+	return PASS;
+}
+
+/*
+ * cow_test
+ *    DESCRIPTION: Clones a user address space and writes to it from both sides
+ *    INPUTS: none
+ *    OUTPUTS: PASS/FAIL
+ *    RETURN VALUES: none
+ *    SIDE EFFECTS: Maps and unmaps the user window, every frame taken should be given back
+ */
+int cow_test(){
+	TEST_HEADER;
+	uint32_t free_before = frames_free();
+	uint32_t parent, child, frame;
+	volatile uint32_t * user = (uint32_t *)PROG_IMG_ADDR;
+
+	parent = user_space_create();
+	if(parent == 0)
+		return FAIL;
+	set_user_prog_page(parent, 1);
+	if(*user != 0)		// Demand-zero fault
+		return FAIL;
+	*user = 0x1234;
+
+	child = user_space_clone(parent);
+	if(child == 0)
+		return FAIL;
+	frame = ((page_tab_desc_t *)parent)[(PROG_IMG_ADDR >> 12) & (ONE_KB - 1)].page_base_address << 12;
+	if(frame_refcount(frame) != 2)
+		return FAIL;
+
+	// Child writes get their own copy, parent keeps its value
+	set_user_prog_page(child, 1);
+	*user = 0x5678;
+	if(frame_refcount(frame) != 1)
+		return FAIL;
+	set_user_prog_page(parent, 1);
+	if(*user != 0x1234)
+		return FAIL;
+	*user = 0x9abc;		// Last reference, just regains write access
+
+	set_user_prog_page(0, 0);
+	user_space_destroy(child);
+	user_space_destroy(parent);
+	if(frames_free() != free_before)
+		return FAIL;
+	return PASS;
+}
+
+
+/*
+ * pipe_test
+ *    DESCRIPTION: Pushes more than a page through a pipe in uneven pieces
+ *    INPUTS: none
+ *    OUTPUTS: PASS/FAIL
+ *    RETURN VALUES: none
+ *    SIDE EFFECTS: Frees the pipe, every frame taken should be given back
+ */
+int pipe_test(){
+	TEST_HEADER;
+	uint32_t free_before = frames_free();
+	static uint8_t in[6000], out[6000];
+	pipe_t * p;
+	int i, got;
+
+	for(i = 0; i < 6000; i++)
+		in[i] = i * 7;
+	p = pipe_alloc();
+	if(p == NULL)
+		return FAIL;
+	if(pipe_put(p, in, 100) != 100 || pipe_put(p, in + 100, 5900) != 5900)
+		return FAIL;
+
+	// Reads return at most what's asked for and stop once the pipe is empty
+	got = pipe_get(p, out, 1000);
+	if(got != 1000)
+		return FAIL;
+	while(got < 6000) {
+		i = pipe_get(p, out + got, 6000);
+		if(i <= 0)
+			return FAIL;
+		got += i;
+	}
+	for(i = 0; i < 6000; i++) {
+		if(out[i] != in[i])
+			return FAIL;
+	}
+
+	// No writers left and nothing buffered is EOF
+	pipe_put(p, in, 10);
+	pipe_release(p, 1);
+	if(pipe_get(p, out, 6000) != 10 || pipe_get(p, out, 6000) != 0)
+		return FAIL;
+	pipe_release(p, 0);
+	if(frames_free() + TEST_SLAB_FRAMES < free_before)
+		return FAIL;
+	return PASS;
+}
+
+/*
+ * shm_test
+ *    DESCRIPTION: Attaches one segment to two address spaces and writes through one of them
+ *    INPUTS: none
+ *    OUTPUTS: PASS/FAIL
+ *    RETURN VALUES: none
+ *    SIDE EFFECTS: Maps and unmaps the user window, every frame taken should be given back
+ */
+int shm_test(){
+	TEST_HEADER;
+	uint32_t free_before = frames_free();
+	volatile uint32_t * shared = (uint32_t *)(ONE_TWO_EIGHT_MB + 2 * FOUR_KB);
+	pcb_t * a = pcb_alloc();
+	pcb_t * b = pcb_alloc();
+	int32_t id;
+
+	if(a == NULL || b == NULL)
+		return FAIL;
+	a->page_table = user_space_create();
+	b->page_table = user_space_create();
+	if(a->page_table == 0 || b->page_table == 0)
+		return FAIL;
+
+	id = shm_get(391, 2 * FOUR_KB);
+	if(id == -1 || shm_get(391, FOUR_KB) != id)
+		return FAIL;
+
+	set_user_prog_page(a->page_table, 1);
+	if(shm_attach(a, id, (uint32_t)shared) != (uint32_t)shared)
+		return FAIL;
+	shared[FOUR_KB / 4] = 0xC0FFEE;
+
+	set_user_prog_page(b->page_table, 1);
+	if(shm_attach(b, id, (uint32_t)shared) != (uint32_t)shared || shared[FOUR_KB / 4] != 0xC0FFEE)
+		return FAIL;
+	if(shm_detach(b, (uint32_t)shared) != 0 || shm_detach(b, (uint32_t)shared) != -1)
+		return FAIL;
+
+	// The segment goes away with its last process
+	set_user_prog_page(0, 0);
+	pcb_free(a);
+	pcb_free(b);
+	if(frames_free() + TEST_SLAB_FRAMES < free_before)
+		return FAIL;
+	return PASS;
+}
+
+/*
+ * alarm_test
+ *    DESCRIPTION: Runs a process's alarm for a few fake PIT ticks
+ *    INPUTS: none
+ *    OUTPUTS: PASS/FAIL
+ *    RETURN VALUES: none
+ *    SIDE EFFECTS: none
+ */
+int alarm_test(){
+	TEST_HEADER;
+	pcb_t * pcb = pcb_alloc();
+	int i;
+
+	if(pcb == NULL)
+		return FAIL;
+	if(signal_alarm(pcb, 25) != 0)		// Rounds up to 3 ticks
+		return FAIL;
+	for(i = 0; i < 2; i++)
+		signal_tick();
+	if(pcb->pending_signals & (1 << ALARM))
+		return FAIL;
+	signal_tick();
+	if(!(pcb->pending_signals & (1 << ALARM)) || !signal_pending(pcb))
+		return FAIL;
+
+	// Periodic: restarted with the full period, cancelling reports what was left
+	signal_tick();
+	if(signal_alarm(pcb, 0) != 2 * PIT_TICK_MS)
+		return FAIL;
+	pcb_free(pcb);
+	return PASS;
+}
+
+/*
+ * vdso_test
+ *    DESCRIPTION: Checks the vDSO page is mapped read-only for users and holds a system call stub
+ *    INPUTS: none
+ *    OUTPUTS: PASS/FAIL
+ *    RETURN VALUES: none
+ *    SIDE EFFECTS: none
+ */
+int vdso_test(){
+	TEST_HEADER;
+	page_tab_desc_t * pte = &user_video_table[VDSO_PAGE_INDEX];
+	uint8_t * page = (uint8_t *)(pte->page_base_address << 12);
+	uint8_t * stub;
+	uint32_t i, size;
+
+	if(!pte->present || !pte->user_supervisor || pte->read_write)
+		return FAIL;
+
+	// sysexit_return_addr is only set when SYSENTER is in use
+	if(sysexit_return_addr != 0) {
+		stub = vdso_sysenter_start;
+		size = vdso_sysenter_end - vdso_sysenter_start;
+		if(sysexit_return_addr != VDSO_ADDR + (vdso_sysenter_return - vdso_sysenter_start))
+			return FAIL;
+	} else {
+		stub = vdso_int80_start;
+		size = vdso_int80_end - vdso_int80_start;
+	}
+	for(i = 0; i < size; i++) {
+		if(page[i] != stub[i])
+			return FAIL;
+	}
+	return PASS;
+}
+
+/*
+ * vvar_test
+ *    DESCRIPTION: Checks the vvar page is mapped read-only for users and that updates keep seq even
+ *    INPUTS: none
+ *    OUTPUTS: PASS/FAIL
+ *    RETURN VALUES: none
+ *    SIDE EFFECTS: Advances the vvar clock by one tick and changes its PID until the next switch
+ */
+int vvar_test(){
+	TEST_HEADER;
+	page_tab_desc_t * pte = &user_video_table[VVAR_PAGE_INDEX];
+	uint32_t seq, ticks, flags;
+	int32_t pid;
+
+	if(!pte->present || !pte->user_supervisor || pte->read_write)
+		return FAIL;
+	if((pte->page_base_address << 12) != (uint32_t)vvar)
+		return FAIL;
+
+	cli_and_save(flags);
+	seq = vvar->seq;
+	ticks = vvar->ticks;
+	pid = vvar->pid;
+	vvar_tick();
+	vvar_set_pid(pid + 1);
+	if(vvar->seq != seq + 4 || (vvar->seq & 1) || vvar->ticks != ticks + 1 || vvar->pid != pid + 1) {
+		restore_flags(flags);
+		return FAIL;
+	}
+	vvar_set_pid(pid);
+	restore_flags(flags);
+
+	// Boot time came from the RTC, anything before 2020 means it wasn't read
+	if(vvar->time < 1577836800)
+		return FAIL;
+	return PASS;
+}
+
+/*
+ * iov_batch_test
+ *    DESCRIPTION: Moves data through a pipe with writev, readv and batch from a fake process
+ *    INPUTS: none
+ *    OUTPUTS: PASS/FAIL
+ *    RETURN VALUES: none
+ *    SIDE EFFECTS: Maps and unmaps the user window, every frame taken should be given back
+ */
+int iov_batch_test(){
+	TEST_HEADER;
+	uint32_t free_before = frames_free();
+	pcb_t * a = test_process_enter();
+	// Arguments have to live in the user page
+	int32_t * fds = (int32_t *)ONE_TWO_EIGHT_MB;
+	iovec_t * iov = (iovec_t *)(ONE_TWO_EIGHT_MB + 16);
+	syscall_desc_t * calls = (syscall_desc_t *)(ONE_TWO_EIGHT_MB + 64);
+	char * text = (char *)(ONE_TWO_EIGHT_MB + 256);
+	char * out = (char *)(ONE_TWO_EIGHT_MB + 512);
+	int32_t result = PASS;
+
+	if(a == NULL)
+		return FAIL;
+
+	// Stand-ins for stdin and stdout first (see test_process_enter)
+	strcpy(text, "hello world");
+	if(pipe(fds) != 0 || pipe(fds) != 0)
+		result = FAIL;
+
+	iov[0].base = text;
+	iov[0].len = 6;
+	iov[1].base = text + 6;
+	iov[1].len = 5;
+	if(result == PASS && writev(fds[1], iov, 2) != 11)
+		result = FAIL;
+	iov[0].base = out;
+	iov[0].len = 4;
+	iov[1].base = out + 4;
+	iov[1].len = 20;
+	if(result == PASS && (readv(fds[0], iov, 2) != 11 || strncmp(out, text, 11) != 0))
+		result = FAIL;
+
+	// A buffer in kernel memory is refused before the driver sees it
+	iov[0].base = (void *)FOUR_MB;
+	if(result == PASS && readv(fds[0], iov, 2) != -1)
+		result = FAIL;
+
+	// Runs up to the fork, which isn't allowed in a batch
+	calls[0].num = 4;
+	calls[0].args[0] = fds[1];
+	calls[0].args[1] = (uint32_t)text;
+	calls[0].args[2] = 3;
+	calls[1].num = 3;
+	calls[1].args[0] = fds[0];
+	calls[1].args[1] = (uint32_t)out;
+	calls[1].args[2] = 20;
+	calls[2].num = SYS_FORK;
+	if(result == PASS && (batch(calls, 3) != 2 || calls[0].ret != 3 || calls[1].ret != 3 || calls[2].ret != -1))
+		result = FAIL;
+
+	calls[0].num = 6;
+	calls[0].args[0] = fds[0];
+	calls[1].num = 6;
+	calls[1].args[0] = fds[1];
+	if(result == PASS && (batch(calls, 2) != 2 || calls[0].ret != 0 || calls[1].ret != 0))
+		result = FAIL;
+
+	test_process_leave(a);
+	if(frames_free() + TEST_SLAB_FRAMES < free_before)
+		return FAIL;
+	return result;
+}
+
+/*
+ * dup_test
+ *    DESCRIPTION: Shares a pipe's write end between two fds of a fake process, one past FD_INLINE
+ *    INPUTS: none
+ *    OUTPUTS: PASS/FAIL
+ *    RETURN VALUES: none
+ *    SIDE EFFECTS: Maps and unmaps the user window, every frame taken should be given back
+ */
+int dup_test(){
+	TEST_HEADER;
+	uint32_t free_before = frames_free();
+	pcb_t * a = test_process_enter();
+	int32_t * fds = (int32_t *)ONE_TWO_EIGHT_MB;
+	char * buf = (char *)(ONE_TWO_EIGHT_MB + 64);
+	int32_t result = PASS;
+
+	if(a == NULL)
+		return FAIL;
+
+	// Stand-ins for stdin and stdout first (see test_process_enter)
+	if(pipe(fds) != 0 || pipe(fds) != 0 || fds[0] != 2 || fds[1] != 3)
+		result = FAIL;
+
+	// The table grows to fit fd 20, both fds share one write end
+	if(result == PASS && (dup2(fds[1], 20) != 20 || a->fd_count <= 20 || a->fds[20] != a->fds[fds[1]]))
+		result = FAIL;
+	if(result == PASS && (dup(fds[0]) != 4 || close(4) != 0))
+		result = FAIL;
+
+	// The pipe only sees EOF once the last fd for the write end is closed
+	strcpy(buf, "dup");
+	if(result == PASS && (close(fds[1]) != 0 || write(20, buf, 3) != 3 || read(fds[0], buf, 10) != 3))
+		result = FAIL;
+	if(result == PASS && (close(20) != 0 || read(fds[0], buf, 10) != 0))
+		result = FAIL;
+
+	test_process_leave(a);
+	if(frames_free() + TEST_SLAB_FRAMES < free_before)
+		return FAIL;
+	return result;
+}
+
+/*
+ * vfs_test
+ *    DESCRIPTION: Resolves paths on both mounts and checks repeats come from the dentry cache
+ *    INPUTS: none
+ *    OUTPUTS: PASS/FAIL
+ *    RETURN VALUES: none
+ *    SIDE EFFECTS: Fills a few dentry cache entries
+ */
+int vfs_test(){
+	TEST_HEADER;
+	vfs_node_t node;
+	dcache_stats_t before, after;
+	uint8_t buf[4];
+
+	if(vfs_resolve((uint8_t *)"/frame0.txt", &node) != 0 || node.type != VFS_TYPE_FILE)
+		return FAIL;
+	if(vfs_node_read(&node, 0, buf, 4) != 4)
+		return FAIL;
+
+	// Same name again, with and without the leading '/', and a name that isn't there twice
+	before = dcache_get_stats();
+	if(vfs_resolve((uint8_t *)"frame0.txt", &node) != 0 || node.type != VFS_TYPE_FILE)
+		return FAIL;
+	if(vfs_resolve((uint8_t *)"no_such_file", &node) != -1 || vfs_resolve((uint8_t *)"no_such_file", &node) != -1)
+		return FAIL;
+	after = dcache_get_stats();
+	if(after.hits != before.hits + 2 || after.misses != before.misses + 1)
+		return FAIL;
+
+	// devfs, and the boot image's own device entry
+	if(vfs_resolve((uint8_t *)"/dev/rtc", &node) != 0 || node.type != VFS_TYPE_DEV || node.fops != &rtc_table)
+		return FAIL;
+	if(vfs_resolve((uint8_t *)"rtc", &node) != 0 || node.fops != &rtc_table)
+		return FAIL;
+	if(vfs_resolve((uint8_t *)"/dev", &node) != 0 || node.type != VFS_TYPE_DIR)
+		return FAIL;
+
+	// Only directories have names under them
+	if(vfs_resolve((uint8_t *)"frame0.txt/x", &node) != -1)
+		return FAIL;
+	return PASS;
+}
+
+/*
+ * tmpfs_test
+ *    DESCRIPTION: Makes, grows, seeks in, truncates and unlinks files in /tmp
+ *    INPUTS: none
+ *    OUTPUTS: PASS/FAIL
+ *    RETURN VALUES: none
+ *    SIDE EFFECTS: Runs as a fake process, frees everything it allocates
+ */
+int tmpfs_test(){
+	TEST_HEADER;
+	uint32_t free_before = frames_free();
+	pcb_t * a = test_process_enter();
+	int32_t * fds = (int32_t *)ONE_TWO_EIGHT_MB;
+	uint8_t * page;
+	vfs_node_t node;
+	int32_t fd, i, result = PASS;
+
+	if(a == NULL)
+		return FAIL;
+	page = (uint8_t *)frame_alloc(1, 1);
+	if(page == NULL) {
+		test_process_leave(a);
+		return FAIL;
+	}
+
+	// Stand-ins for stdin and stdout first (see test_process_enter)
+	if(pipe(fds) != 0)
+		result = FAIL;
+
+	// Five pages of 'a', then one byte well past the end
+	memset(page, 'a', FOUR_KB);
+	fd = creat((uint8_t *)"/tmp/t");
+	for(i = 0; result == PASS && i < 5; i++) {
+		if(write(fd, page, FOUR_KB) != FOUR_KB)
+			result = FAIL;
+	}
+	if(result == PASS && (lseek(fd, 0, VFS_SEEK_END) != 5 * FOUR_KB || lseek(fd, 40000, VFS_SEEK_SET) != 40000))
+		result = FAIL;
+	if(result == PASS && (write(fd, "z", 1) != 1 || lseek(fd, 0, VFS_SEEK_END) != 40001))
+		result = FAIL;
+
+	// The gap reads as zeros, data across a page boundary is intact
+	if(result == PASS && (lseek(fd, 30000, VFS_SEEK_SET) != 30000 || read(fd, page, 8) != 8 || page[0] != 0 || page[7] != 0))
+		result = FAIL;
+	if(result == PASS && (lseek(fd, FOUR_KB - 1, VFS_SEEK_SET) != FOUR_KB - 1 || read(fd, page, 2) != 2 || page[0] != 'a' || page[1] != 'a'))
+		result = FAIL;
+	if(result == PASS && (lseek(fd, -1, VFS_SEEK_END) != 40000 || read(fd, page, 8) != 1 || page[0] != 'z'))
+		result = FAIL;
+
+	// Shrinking and growing
+	if(result == PASS && (truncate((uint8_t *)"/tmp/t", 10) != 0 || lseek(fd, 0, VFS_SEEK_END) != 10))
+		result = FAIL;
+	if(result == PASS && (truncate((uint8_t *)"/tmp/t", 5000) != 0 || lseek(fd, 9, VFS_SEEK_SET) != 9 || read(fd, page, 8) != 8))
+		result = FAIL;
+	if(result == PASS && (page[0] != 'a' || page[1] != 0 || page[7] != 0))
+		result = FAIL;
+
+	// Unlinked while open: the name goes away, the data stays until close
+	if(result == PASS && (vfs_resolve((uint8_t *)"/tmp/t", &node) != 0 || unlink((uint8_t *)"/tmp/t") != 0))
+		result = FAIL;
+	if(result == PASS && (vfs_resolve((uint8_t *)"/tmp/t", &node) != -1 || unlink((uint8_t *)"/tmp/t") != -1))
+		result = FAIL;
+	if(result == PASS && (lseek(fd, 0, VFS_SEEK_SET) != 0 || read(fd, page, 1) != 1 || page[0] != 'a' || close(fd) != 0))
+		result = FAIL;
+
+	// The boot image's directory is fixed (its files are writable in overlay mode)
+	if(result == PASS && (creat((uint8_t *)"/no_such_file") != -1 || unlink((uint8_t *)"frame0.txt") != -1))
+		result = FAIL;
+
+	test_process_leave(a);
+	frame_free((uint32_t)page, 1);
+	if(frames_free() + TEST_SLAB_FRAMES < free_before)
+		return FAIL;
+	return result;
+}
+
+/*
+ * overlay_test
+ *    DESCRIPTION: Writes to and grows a boot image file in overlay mode and checks the image itself
+ *                 is untouched and only written blocks get copied
+ *    INPUTS: none
+ *    OUTPUTS: PASS/FAIL
+ *    RETURN VALUES: none
+ *    SIDE EFFECTS: Turns overlay mode on, frame1.txt ends up with its original contents but keeps
+ *                  its shadow and one copied block
+ */
+int overlay_test(){
+	TEST_HEADER;
+	vfs_node_t node;
+	super_block_t * sb;
+	uint8_t orig[4], buf[8];
+	int32_t size;
+	uint32_t free_before;
+
+	if(bootfs_enable_overlay() != 0 || vfs_resolve((uint8_t *)"frame1.txt", &node) != 0)
+		return FAIL;
+	sb = node.sb;
+	size = sb->ops->size(sb, node.ino);
+	if(size < 4 || size > FOUR_KB || vfs_node_read(&node, 0, orig, 4) != 4)
+		return FAIL;
+
+	// One write costs the shadow and one block, the image keeps the old bytes
+	free_before = frames_free();
+	if(sb->ops->write(sb, node.ino, 0, (uint8_t *)"COW!", 4) != 4 || vfs_node_read(&node, 0, buf, 4) != 4)
+		return FAIL;
+	if(strncmp((int8_t *)buf, "COW!", 4) || read_data(node.ino, 0, buf, 4) != 4 || strncmp((int8_t *)buf, (int8_t *)orig, 4))
+		return FAIL;
+	if(free_before - frames_free() > 2 || sb->ops->size(sb, node.ino) != size)
+		return FAIL;
+
+	// Growing past the end zero-fills the gap, truncating back frees the new blocks
+	if(sb->ops->write(sb, node.ino, size + 5000, (uint8_t *)"x", 1) != 1 || sb->ops->size(sb, node.ino) != size + 5001)
+		return FAIL;
+	if(vfs_node_read(&node, size + 4996, buf, 8) != 5 || buf[0] != 0 || buf[3] != 0 || buf[4] != 'x')
+		return FAIL;
+	if(sb->ops->truncate(sb, node.ino, size) != 0 || sb->ops->write(sb, node.ino, 0, orig, 4) != 4)
+		return FAIL;
+	if(free_before - frames_free() > 2 || sb->ops->size(sb, node.ino) != size)
+		return FAIL;
+	return PASS;
+}
+
+/*
+ * put_dentry
+ *    DESCRIPTION: Adds a name to an extended format directory table the way tools/mkfs.c does
+ *    INPUTS: table -- DIR_ENTRIES_PER_BLOCK slots, name, ftype, inode -- the entry
+ *    OUTPUTS: none
+ *    RETURN VALUES: none
+ */
+static void put_dentry(dentry_t * table, const char * name, uint32_t ftype, uint32_t inode){
+	uint32_t slot = fs_name_hash((const uint8_t *)name) & (DIR_ENTRIES_PER_BLOCK - 1);
+
+	while(table[slot].fname[0] != '\0')
+		slot = (slot + 1) & (DIR_ENTRIES_PER_BLOCK - 1);
+	strncpy((int8_t *)table[slot].fname, name, FNAME_LENGTH);
+	table[slot].ftype = ftype;
+	table[slot].inode = inode;
+}
+
+/*
+ * hier_fs_test
+ *    DESCRIPTION: Builds a small extended format image (/sub/a.txt) and looks paths up in it
+ *    INPUTS: none
+ *    OUTPUTS: PASS/FAIL
+ *    RETURN VALUES: none
+ *    SIDE EFFECTS: Mounts the test image and then the boot image again (dropping overlay changes)
+ */
+int hier_fs_test(){
+	TEST_HEADER;
+	uint32_t img = frame_alloc(7, 1);
+	block_dev_t * saved = fs_device();
+	block_dev_t test_dev;
+	boot_block_t * test_boot = (boot_block_t *)img;
+	inode_t * inodes = (inode_t *)(img + BLOCK_SIZE);
+	dentry_t * root_dir = (dentry_t *)(img + 4 * BLOCK_SIZE);
+	dentry_t * sub_dir = (dentry_t *)(img + 5 * BLOCK_SIZE);
+	dentry_t dentry;
+	vfs_node_t node;
+	uint8_t buf[8];
+	int32_t i, result = PASS;
+
+	if(img == 0)
+		return FAIL;
+	memset((void *)img, 0, 7 * BLOCK_SIZE);
+
+	// Leave a hit and a miss in the dentry cache, neither may outlive the switch
+	if(vfs_resolve((uint8_t *)"/frame0.txt", &node) != 0 || vfs_resolve((uint8_t *)"/sub", &node) != -1)
+		result = FAIL;
+
+	// Inode 0 is /, 1 is /sub, 2 is /sub/a.txt, with data blocks 0, 1 and 2
+	test_boot->num_inodes = 3;
+	test_boot->num_data_blocks = 3;
+	test_boot->magic = FS_EXT_MAGIC;
+	test_boot->root_inode = 0;
+	inodes[0].file_size = BLOCK_SIZE;
+	inodes[0].index_num[0] = 0;
+	inodes[1].file_size = BLOCK_SIZE;
+	inodes[1].index_num[0] = 1;
+	inodes[2].file_size = 5;
+	inodes[2].index_num[0] = 2;
+	put_dentry(root_dir, ".", 1, 0);
+	put_dentry(root_dir, "..", 1, 0);
+	put_dentry(root_dir, "sub", 1, 1);
+	put_dentry(sub_dir, ".", 1, 1);
+	put_dentry(sub_dir, "..", 1, 0);
+	put_dentry(sub_dir, "a.txt", 2, 2);
+	memcpy((void *)(img + 6 * BLOCK_SIZE), "hello", 5);
+
+	ramdisk_init(&test_dev, "test", img, 7);
+	if(mount_filesystem(&test_dev) != 0)
+		result = FAIL;
+	if(result == PASS && (read_dentry_by_name((uint8_t *)"sub/a.txt", &dentry) != 0 || dentry.ftype != 2 || dentry.inode != 2))
+		result = FAIL;
+	if(result == PASS && (read_data(dentry.inode, 0, buf, 5) != 5 || strncmp((int8_t *)buf, "hello", 5)))
+		result = FAIL;
+	if(result == PASS && (read_dentry_by_name((uint8_t *)"/sub/../sub/./a.txt", &dentry) != 0 || dentry.inode != 2))
+		result = FAIL;
+	if(result == PASS && (read_dentry_by_name((uint8_t *)"a.txt", &dentry) != -1 || read_dentry_by_name((uint8_t *)"sub/a.txt/b", &dentry) != -1))
+		result = FAIL;
+
+	// The root lists ".", ".." and "sub" in slot order
+	for(i = 0; result == PASS && i < 3; i++) {
+		if(read_dentry_by_index(i, &dentry) != 0 || dentry.ftype != 1)
+			result = FAIL;
+	}
+	if(result == PASS && read_dentry_by_index(3, &dentry) != -1)
+		result = FAIL;
+	if(result == PASS && (vfs_resolve((uint8_t *)"/sub", &node) != 0 || node.type != VFS_TYPE_DIR
+			|| vfs_resolve((uint8_t *)"/frame0.txt", &node) != -1))
+		result = FAIL;
+
+	mount_filesystem(saved);
+	if(result == PASS && vfs_resolve((uint8_t *)"/frame0.txt", &node) != 0)
+		result = FAIL;
+	frame_free(img, 7);
+	return result;
+}
+
+/*
+ * dirents_test
+ *    DESCRIPTION: Lists the root directory with one read in VFS_DIR_DIRENTS mode
+ *    INPUTS: none
+ *    OUTPUTS: PASS/FAIL
+ *    RETURN VALUES: none
+ *    SIDE EFFECTS: Runs as a fake process, frees everything it allocates
+ */
+int dirents_test(){
+	TEST_HEADER;
+	pcb_t * a = test_process_enter();
+	int32_t * fds = (int32_t *)ONE_TWO_EIGHT_MB;
+	vfs_dirent_t * dirents;
+	int32_t fd, n, i, found = 0, result = PASS;
+	uint8_t name[FNAME_LENGTH];
+
+	if(a == NULL)
+		return FAIL;
+	dirents = (vfs_dirent_t *)frame_alloc(1, 1);
+	if(dirents == NULL) {
+		test_process_leave(a);
+		return FAIL;
+	}
+
+	// Stand-ins for stdin and stdout first (see test_process_enter)
+	if(pipe(fds) != 0 || (fd = open((uint8_t *)".")) == -1)
+		result = FAIL;
+
+	// Names by default, then the rest of the directory in one read
+	if(result == PASS && (ioctl(fd, DIRIOCGMODE, 0) != VFS_DIR_NAMES || read(fd, name, FNAME_LENGTH) != FNAME_LENGTH))
+		result = FAIL;
+	if(result == PASS && (ioctl(fd, DIRIOCSMODE, 7) != -1 || ioctl(fd, DIRIOCSMODE, VFS_DIR_DIRENTS) != 0))
+		result = FAIL;
+	if(result == PASS && read(fd, dirents, sizeof(vfs_dirent_t) - 1) != -1)
+		result = FAIL;
+	n = result == PASS ? read(fd, dirents, FOUR_KB) : -1;
+	if(n <= 0 || n % sizeof(vfs_dirent_t) != 0 || read(fd, dirents + 1, FOUR_KB - sizeof(vfs_dirent_t)) != 0)
+		result = FAIL;
+
+	// Entries carry the type, inode and size a lookup would give
+	for(i = 0; result == PASS && i < n / (int32_t)sizeof(vfs_dirent_t); i++) {
+		if(!strncmp((int8_t *)dirents[i].name, "frame0.txt", FNAME_LENGTH)) {
+			found = dirents[i].type == VFS_TYPE_FILE && dirents[i].size == 187;
+		} else if(!strncmp((int8_t *)dirents[i].name, "rtc", FNAME_LENGTH)) {
+			if(dirents[i].type != VFS_TYPE_DEV || dirents[i].size != 0)
+				result = FAIL;
+		}
+	}
+	if(!found)
+		result = FAIL;
+
+	test_process_leave(a);
+	frame_free((uint32_t)dirents, 1);
+	return result;
+}
+
+/*
+ * bcache_test
+ *    DESCRIPTION: Reads ramdisk blocks through the block cache and checks hits, misses, readahead
+ *                 hits, LRU eviction and invalidation
+ *    INPUTS: none
+ *    OUTPUTS: PASS/FAIL
+ *    RETURN VALUES: none
+ *    SIDE EFFECTS: Evicts everything else from the cache, frees the ramdisk's frames
+ */
+int bcache_test(){
+	TEST_HEADER;
+	uint32_t img = frame_alloc(4, 1);
+	block_dev_t dev, big;
+	bcache_stats_t before, after;
+	buffer_t * buf;
+	int32_t i, result = PASS;
+
+	if(img == 0)
+		return FAIL;
+	for(i = 0; i < 4; i++)
+		memset((void *)(img + i * BCACHE_BLOCK_SIZE), i, BCACHE_BLOCK_SIZE);
+	ramdisk_init(&dev, "test", img, 4);
+
+	// A miss, then a hit on the same buffer, and nothing past the end
+	before = bcache_get_stats();
+	buf = bcache_get(&dev, 1);
+	if(buf == NULL || buf->data[0] != 1 || buf->data[BCACHE_BLOCK_SIZE - 1] != 1)
+		result = FAIL;
+	if(buf != NULL)
+		bcache_put(buf);
+	if(result == PASS && ((buf = bcache_get(&dev, 1)) == NULL || bcache_get(&dev, 4) != NULL))
+		result = FAIL;
+	if(buf != NULL)
+		bcache_put(buf);
+	after = bcache_get_stats();
+	if(after.misses - before.misses != 1 || after.hits - before.hits != 1)
+		result = FAIL;
+
+	// A block read ahead is a hit, and counts as a readahead hit once
+	bcache_readahead(&dev, 2);
+	bcache_readahead(&dev, 2);
+	buf = bcache_get(&dev, 2);
+	if(buf == NULL || buf->data[0] != 2)
+		result = FAIL;
+	if(buf != NULL)
+		bcache_put(buf);
+	if(result == PASS && (buf = bcache_get(&dev, 2)) != NULL)
+		bcache_put(buf);
+	before = after;
+	after = bcache_get_stats();
+	if(after.readaheads - before.readaheads != 1 || after.readahead_hits - before.readahead_hits != 1 || after.misses != before.misses)
+		result = FAIL;
+
+	// Changes under the cache show up only after invalidating
+	memset((void *)(img + BCACHE_BLOCK_SIZE), 9, BCACHE_BLOCK_SIZE);
+	if(result == PASS && ((buf = bcache_get(&dev, 1)) == NULL || buf->data[0] != 1))
+		result = FAIL;
+	if(buf != NULL)
+		bcache_put(buf);
+	bcache_invalidate(&dev);
+	if(result == PASS && ((buf = bcache_get(&dev, 1)) == NULL || buf->data[0] != 9))
+		result = FAIL;
+	if(buf != NULL)
+		bcache_put(buf);
+
+	// Reading one block more than the cache holds evicts the least recently used one
+	ramdisk_init(&big, "big", FRAME_POOL_START, BCACHE_BUFFERS + 1);
+	before = bcache_get_stats();
+	for(i = 0; result == PASS && i <= BCACHE_BUFFERS; i++) {
+		if((buf = bcache_get(&big, i)) == NULL)
+			result = FAIL;
+		else
+			bcache_put(buf);
+	}
+	if(result == PASS && (buf = bcache_get(&big, 0)) != NULL)
+		bcache_put(buf);
+	after = bcache_get_stats();
+	if(after.misses - before.misses != BCACHE_BUFFERS + 2 || after.evictions - before.evictions < 2)
+		result = FAIL;
+
+	bcache_invalidate(&big);
+	bcache_invalidate(&dev);
+	frame_free(img, 4);
+	return result;
+}
+
+/*
+ * ata_test
+ *    DESCRIPTION: Reads the second IDE disk directly and through the block cache and checks the
+ *                 file system on it is mounted at /disk (passes if QEMU has no -hdb)
+ *    INPUTS: none
+ *    OUTPUTS: PASS/FAIL
+ *    RETURN VALUES: none
+ *    SIDE EFFECTS: none
+ */
+int ata_test(){
+	TEST_HEADER;
+	block_dev_t * disk = ata_device();
+	uint8_t * block = (uint8_t *)frame_alloc(1, 1);
+	boot_block_t * disk_boot = (boot_block_t *)block;
+	buffer_t * buf;
+	vfs_node_t node;
+	int32_t i, result = PASS;
+
+	if(disk == NULL)
+		return PASS;
+	if(block == NULL)
+		return FAIL;
+
+	// The boot block reads the same both ways, and describes an image that fits the disk
+	if(disk->read(disk, 0, block) != 0 || 1 + disk_boot->num_inodes + disk_boot->num_data_blocks > disk->num_blocks)
+		result = FAIL;
+	buf = bcache_get(disk, 0);
+	for(i = 0; buf != NULL && i < BCACHE_BLOCK_SIZE; i++) {
+		if(buf->data[i] != block[i])
+			result = FAIL;
+	}
+	if(buf == NULL)
+		result = FAIL;
+	else
+		bcache_put(buf);
+	if(disk->read(disk, disk->num_blocks, block) != -1)
+		result = FAIL;
+
+	if(vfs_resolve((uint8_t *)"/disk", &node) != 0 || node.type != VFS_TYPE_DIR)
+		result = FAIL;
+	frame_free((uint32_t)block, 1);
+	return result;
+}
+
+/*
+ * aio_test
+ *    DESCRIPTION: Writes and reads a pipe through a fake process's rings, running the requests
+ *                 in the test itself the way the worker task would
+ *    INPUTS: none
+ *    OUTPUTS: PASS/FAIL
+ *    RETURN VALUES: none
+ *    SIDE EFFECTS: Maps and unmaps the user window, every frame taken should be given back
+ */
+int aio_test(){
+	TEST_HEADER;
+	uint32_t free_before = frames_free();
+	pcb_t * a = test_process_enter();
+	int32_t * fds = (int32_t *)ONE_TWO_EIGHT_MB;
+	char * text = (char *)(ONE_TWO_EIGHT_MB + 64);
+	char * out = (char *)(ONE_TWO_EIGHT_MB + 128);
+	aio_ring_t * ring = (aio_ring_t *)(ONE_TWO_EIGHT_MB + FOUR_KB);
+	int32_t i, result = PASS;
+
+	if(a == NULL)
+		return FAIL;
+
+	if(pipe(fds) != 0 || aio_setup((void *)(ONE_TWO_EIGHT_MB + 100)) != -1 || aio_setup(ring) != 0 || aio_setup(ring) != -1)
+		result = FAIL;
+	strcpy(text, "async");
+
+	// A write, a read of what it wrote, a no-op and a bad fd, completed in order
+	ring->sq[0].op = AIO_WRITE;
+	ring->sq[0].fd = fds[1];
+	ring->sq[0].buf = (uint32_t)text;
+	ring->sq[0].len = 5;
+	ring->sq[1].op = AIO_READ;
+	ring->sq[1].fd = fds[0];
+	ring->sq[1].buf = (uint32_t)out;
+	ring->sq[1].len = 20;
+	ring->sq[2].op = AIO_NOP;
+	ring->sq[3].op = AIO_READ;
+	ring->sq[3].fd = 40;
+	ring->sq[3].buf = (uint32_t)out;
+	ring->sq[3].len = 1;
+	for(i = 0; i < 4; i++)
+		ring->sq[i].user_data = 100 + i;
+	ring->sq_tail = 4;
+
+	for(i = 0; result == PASS && i < 4; i++) {
+		if(aio_run_next(a->aio) != 1)
+			result = FAIL;
+	}
+	if(result == PASS && (aio_run_next(a->aio) != 0 || ring->sq_head != 4 || aio_enter(0) != 4))
+		result = FAIL;
+	for(i = 0; result == PASS && i < 4; i++) {
+		if(ring->cq[i].user_data != (uint32_t)(100 + i))
+			result = FAIL;
+	}
+	if(result == PASS && (ring->cq[0].res != 5 || ring->cq[1].res != 5 || strncmp(out, text, 5) != 0
+			|| ring->cq[2].res != 0 || ring->cq[3].res != -1))
+		result = FAIL;
+
+	// The borrowed fds are gone, a full completion ring holds requests back
+	if(result == PASS && a->fds[2] != NULL)
+		result = FAIL;
+	ring->cq_head = 4 - AIO_ENTRIES;
+	ring->sq[4].op = AIO_NOP;
+	ring->sq_tail = 5;
+	if(result == PASS && (aio_run_next(a->aio) != 0 || aio_enter(AIO_ENTRIES + 1) != -1))
+		result = FAIL;
+
+	test_process_leave(a);
+	if(frames_free() + TEST_SLAB_FRAMES < free_before)
+		return FAIL;
+	return result;
+}
+
+/*
+ * mmap_test
+ *    DESCRIPTION: Maps a file of the boot image into a fake process, read-only and private
+ *    INPUTS: none
+ *    OUTPUTS: PASS/FAIL
+ *    RETURN VALUES: none
+ *    SIDE EFFECTS: Maps and unmaps the user window, every frame taken should be given back
+ */
+int mmap_test(){
+	TEST_HEADER;
+	uint32_t free_before = frames_free();
+	pcb_t * a;
+	char * name = (char *)ONE_TWO_EIGHT_MB;
+	uint8_t * copy = (uint8_t *)(ONE_TWO_EIGHT_MB + 64);
+	uint8_t * map = (uint8_t *)(ONE_TWO_EIGHT_MB + 16 * FOUR_KB);
+	uint8_t * priv = (uint8_t *)(ONE_TWO_EIGHT_MB + 32 * FOUR_KB);
+	dentry_t dentry;
+	uint32_t size, i, free_mapped;
+	int32_t fd, dir, result = PASS;
+
+	if(read_dentry_by_name((const uint8_t *)"fish", &dentry) != 0 || (a = test_process_enter()) == NULL)
+		return FAIL;
+
+	strcpy(name, "fish");
+	fd = open((uint8_t *)name);
+	strcpy(name, ".");
+	dir = open((uint8_t *)name);
+	size = vfs_file_size(fd_get(a, fd));
+	if(fd < 0 || dir < 0 || size <= FOUR_KB || size > 15 * FOUR_KB - 64 || read_data(dentry.inode, 0, copy, size) != (int32_t)size)
+		result = FAIL;
+
+	// The whole file shows up, only the last partial block takes a frame of its own
+	free_mapped = frames_free();
+	if(result == PASS && mmap(fd, map, MMAP_READ) != (int32_t)map)
+		result = FAIL;
+	if(result == PASS && free_mapped - frames_free() > ((size % FOUR_KB) ? 1 : 0))
+		result = FAIL;
+	for(i = 0; result == PASS && i < size; i++) {
+		if(map[i] != copy[i])
+			result = FAIL;
+	}
+
+	// Overlapping, misaligned, bad flags and directories are refused
+	if(result == PASS && (mmap(fd, map + FOUR_KB, MMAP_READ) != -1 || mmap(fd, priv + 1, MMAP_READ) != -1
+			|| mmap(fd, priv, 5) != -1 || mmap(dir, priv, MMAP_READ) != -1))
+		result = FAIL;
+
+	// A private mapping's writes stay in this process
+	if(result == PASS && mmap(fd, priv, MMAP_PRIVATE) != (int32_t)priv)
+		result = FAIL;
+	if(result == PASS) {
+		priv[0] = ~copy[0];
+		if(map[0] != copy[0] || read_data(dentry.inode, 0, (uint8_t *)name, 1) != 1 || (uint8_t)name[0] != copy[0])
+			result = FAIL;
+	}
+
+	if(result == PASS && (munmap(map) != 0 || munmap(map) != -1 || munmap(priv) != 0 || a->mmaps[0].addr != 0))
+		result = FAIL;
+
+	test_process_leave(a);
+	if(frames_free() + TEST_SLAB_FRAMES < free_before)
+		return FAIL;
+	return result;
+}
+
+/*
+ * aio_mmap_test
+ *    DESCRIPTION: Submits async reads into a read-only and a private mapping of a file
+ *    INPUTS: none
+ *    OUTPUTS: PASS/FAIL
+ *    RETURN VALUES: none
+ *    SIDE EFFECTS: Maps and unmaps the user window, every frame taken should be given back
+ */
+int aio_mmap_test(){
+	TEST_HEADER;
+	uint32_t free_before = frames_free();
+	pcb_t * a;
+	char * name = (char *)ONE_TWO_EIGHT_MB;
+	uint8_t * copy = (uint8_t *)(ONE_TWO_EIGHT_MB + 64);
+	aio_ring_t * ring = (aio_ring_t *)(ONE_TWO_EIGHT_MB + FOUR_KB);
+	uint8_t * map = (uint8_t *)(ONE_TWO_EIGHT_MB + 16 * FOUR_KB);
+	uint8_t * priv = (uint8_t *)(ONE_TWO_EIGHT_MB + 32 * FOUR_KB);
+	dentry_t dentry;
+	int32_t fd, i, result = PASS;
+
+	if(read_dentry_by_name((const uint8_t *)"fish", &dentry) != 0 || (a = test_process_enter()) == NULL)
+		return FAIL;
+
+	strcpy(name, "fish");
+	fd = open((uint8_t *)name);
+	if(fd < 0 || read_data(dentry.inode, 0, copy, 64) != 64 || aio_setup(ring) != 0
+			|| mmap(fd, map, MMAP_READ) != (int32_t)map || mmap(fd, priv, MMAP_PRIVATE) != (int32_t)priv)
+		result = FAIL;
+
+	// The read-only page fails the request up front (the worker would have faulted), the
+	// private one gets its copy and the read goes on from the same offset
+	ring->sq[0].op = AIO_READ;
+	ring->sq[0].fd = fd;
+	ring->sq[0].buf = (uint32_t)map;
+	ring->sq[0].len = 64;
+	ring->sq[1] = ring->sq[0];
+	ring->sq[1].buf = (uint32_t)(priv + 100);
+	ring->sq[0].user_data = 0;
+	ring->sq[1].user_data = 1;
+	ring->sq_tail = 2;
+	for(i = 0; result == PASS && i < 2; i++) {
+		if(aio_run_next(a->aio) != 1)
+			result = FAIL;
+	}
+	if(result == PASS && (aio_enter(0) != 2 || ring->cq[0].res != -1 || ring->cq[1].res != 64 || a->fds[fd + 1] != NULL))
+		result = FAIL;
+	for(i = 0; result == PASS && i < 64; i++) {
+		if(map[i] != copy[i] || priv[100 + i] != copy[i])
+			result = FAIL;
+	}
+
+	test_process_leave(a);
+	if(frames_free() + TEST_SLAB_FRAMES < free_before)
+		return FAIL;
+	return result;
+}
+
 /* Test suite entry point */
 void launch_tests(){
 	TEST_OUTPUT("idt_test", idt_test());							// Checks descriptor offset field for NULL
@@ -286,4 +1444,24 @@ void launch_tests(){
 	//TEST_OUTPUT("test_terminal_keyboard", test_terminal_keyboard());
 	//TEST_OUTPUT("list_all_files", list_all_files());
 	//TEST_OUTPUT("read_file_by_name", read_file_by_name());
+	//TEST_OUTPUT("kmalloc_test", kmalloc_test());
+	//TEST_OUTPUT("process_table_test", process_table_test());
+	//TEST_OUTPUT("cow_test", cow_test());
+	//TEST_OUTPUT("pipe_test", pipe_test());
+	//TEST_OUTPUT("shm_test", shm_test());
+	//TEST_OUTPUT("alarm_test", alarm_test());
+	//TEST_OUTPUT("vdso_test", vdso_test());
+	//TEST_OUTPUT("vvar_test", vvar_test());
+	//TEST_OUTPUT("iov_batch_test", iov_batch_test());
+	//TEST_OUTPUT("dup_test", dup_test());
+	//TEST_OUTPUT("vfs_test", vfs_test());
+	//TEST_OUTPUT("tmpfs_test", tmpfs_test());
+	//TEST_OUTPUT("overlay_test", overlay_test());
+	//TEST_OUTPUT("hier_fs_test", hier_fs_test());
+	//TEST_OUTPUT("dirents_test", dirents_test());
+	//TEST_OUTPUT("bcache_test", bcache_test());
+	//TEST_OUTPUT("ata_test", ata_test());
+	//TEST_OUTPUT("aio_test", aio_test());
+	//TEST_OUTPUT("mmap_test", mmap_test());
+	//TEST_OUTPUT("aio_mmap_test", aio_mmap_test());
 }
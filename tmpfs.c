@@ -0,0 +1,474 @@
+/* tmpfs.c - Writable file system kept in RAM, mounted at /tmp
+ * vim:ts=4 noexpandtab
+ */
+
+#include "tmpfs.h"
+#include "frame.h"
+#include "lib.h"
+
+/* NOTES: tmpfs is one flat directory of regular files whose data lives in frames from the frame
+          allocator. A file's data is a short list of extents, runs of contiguous frames, so reads
+          and writes copy a whole extent with one memcpy and finding an offset walks at most
+          TMPFS_EXTENTS entries. Growing a file allocates a new extent as big as everything the
+          file already has (up to TMPFS_EXTENT_MAX frames), so sequential writes need few
+          extents; when memory is fragmented it settles for smaller runs, and a run that happens to
+          follow the last extent is merged into it. Frames are identity mapped, the kernel uses
+          them directly. Every operation runs with interrupts off. */
+
+static tmpfs_inode_t inodes[TMPFS_MAX_FILES];   // Inode n is inodes[n - 1]
+
+static int32_t tmpfs_lookup(super_block_t * sb, uint32_t dir, const uint8_t * name, vfs_node_t * node);
+static int32_t tmpfs_read(super_block_t * sb, uint32_t ino, uint32_t offset, uint8_t * buf, uint32_t len);
+static int32_t tmpfs_write(super_block_t * sb, uint32_t ino, uint32_t offset, const uint8_t * buf, uint32_t len);
+static int32_t tmpfs_readdir(super_block_t * sb, uint32_t dir, uint32_t index, uint8_t * name, vfs_node_t * node);
+static int32_t tmpfs_size(super_block_t * sb, uint32_t ino);
+static int32_t tmpfs_create(super_block_t * sb, uint32_t dir, const uint8_t * name, vfs_node_t * node);
+static int32_t tmpfs_unlink(super_block_t * sb, uint32_t dir, const uint8_t * name);
+static int32_t tmpfs_truncate(super_block_t * sb, uint32_t ino, uint32_t size);
+static void tmpfs_hold(super_block_t * sb, uint32_t ino);
+static void tmpfs_release(super_block_t * sb, uint32_t ino);
+
+static tmpfs_inode_t * tmpfs_inode(uint32_t ino);
+static int32_t tmpfs_find(const uint8_t * name);
+static uint32_t tmpfs_capacity(tmpfs_inode_t * inode);
+static int32_t tmpfs_reserve(tmpfs_inode_t * inode, uint32_t size);
+static void tmpfs_shrink(tmpfs_inode_t * inode, uint32_t size);
+static void tmpfs_copy(tmpfs_inode_t * inode, uint32_t offset, uint8_t * buf, uint32_t len, int32_t write);
+
+static const super_ops_t tmpfs_ops = {tmpfs_lookup, tmpfs_read, tmpfs_write, tmpfs_readdir, tmpfs_size,
+                                      tmpfs_create, tmpfs_unlink, tmpfs_truncate, tmpfs_hold, tmpfs_release, NULL, NULL};
+static super_block_t tmpfs_sb = {&tmpfs_ops, TMPFS_ROOT, NULL};
+
+/*
+ * tmpfs_super
+ *    DESCRIPTION: Gives tmpfs's super block
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUE: The super block, to mount
+ */
+super_block_t * tmpfs_super(void) {
+    return &tmpfs_sb;
+}
+
+/*
+ * tmpfs_lookup
+ *    DESCRIPTION: super_ops_t lookup, finds a file in the root directory
+ *    INPUTS: sb -- tmpfs, dir -- must be the root, name -- file name
+ *    OUTPUTS: node -- the file, "." is the directory itself
+ *    RETURN VALUE: 0 on success, -1 if there's no such file
+ */
+static int32_t tmpfs_lookup(super_block_t * sb, uint32_t dir, const uint8_t * name, vfs_node_t * node) {
+    uint32_t flags;
+    int32_t ino;
+
+    if(dir != TMPFS_ROOT)
+        return -1;
+    if(!strncmp((const int8_t *)name, ".", VFS_NAME_LEN)) {
+        node->ino = TMPFS_ROOT;
+        node->type = VFS_TYPE_DIR;
+        return 0;
+    }
+
+    cli_and_save(flags);
+    ino = tmpfs_find(name);
+    restore_flags(flags);
+    if(ino == -1)
+        return -1;
+    node->ino = ino;
+    node->type = VFS_TYPE_FILE;
+    return 0;
+}
+
+/*
+ * tmpfs_read
+ *    DESCRIPTION: super_ops_t read, copies file data out
+ *    INPUTS: sb -- tmpfs, ino -- the file, offset -- where to start,
+ *            buf -- where to copy to, len -- most bytes to copy
+ *    OUTPUTS: fills buf
+ *    RETURN VALUE: Bytes read, 0 at the end of the file, -1 for a bad inode
+ */
+static int32_t tmpfs_read(super_block_t * sb, uint32_t ino, uint32_t offset, uint8_t * buf, uint32_t len) {
+    tmpfs_inode_t * inode = tmpfs_inode(ino);
+    uint32_t flags;
+
+    if(inode == NULL)
+        return -1;
+
+    cli_and_save(flags);
+    if(offset >= inode->size) {
+        len = 0;
+    } else {
+        if(len > inode->size - offset)
+            len = inode->size - offset;
+        tmpfs_copy(inode, offset, buf, len, 0);
+    }
+    restore_flags(flags);
+    return len;
+}
+
+/*
+ * tmpfs_write
+ *    DESCRIPTION: super_ops_t write, copies data into a file, growing it as needed
+ *    INPUTS: sb -- tmpfs, ino -- the file, offset -- where to start,
+ *            buf -- data, len -- bytes to write
+ *    OUTPUTS: none
+ *    RETURN VALUE: Bytes written (fewer if memory ran out), -1 if nothing could be written
+ *    SIDE EFFECTS: Writing past the end zero-fills the gap
+ */
+static int32_t tmpfs_write(super_block_t * sb, uint32_t ino, uint32_t offset, const uint8_t * buf, uint32_t len) {
+    tmpfs_inode_t * inode = tmpfs_inode(ino);
+    uint32_t flags, capacity;
+
+    if(inode == NULL || offset + len < offset)
+        return -1;
+    if(len == 0)
+        return 0;
+
+    cli_and_save(flags);
+    if(tmpfs_reserve(inode, offset + len) == -1) {
+        capacity = tmpfs_capacity(inode);
+        if(capacity <= offset) {
+            restore_flags(flags);
+            return -1;
+        }
+        len = capacity - offset;
+    }
+    if(offset > inode->size)
+        tmpfs_copy(inode, inode->size, NULL, offset - inode->size, 1);
+    tmpfs_copy(inode, offset, (uint8_t *)buf, len, 1);
+    if(offset + len > inode->size)
+        inode->size = offset + len;
+    restore_flags(flags);
+    return len;
+}
+
+/*
+ * tmpfs_readdir
+ *    DESCRIPTION: super_ops_t readdir, lists the files
+ *    INPUTS: sb -- tmpfs, dir -- must be the root, index -- position, an inode table index
+ *    OUTPUTS: name -- the file's name, node -- the file
+ *    RETURN VALUE: Position after the file, -1 past the last file
+ *    SIDE EFFECTS: Files made or removed between calls don't move the others
+ */
+static int32_t tmpfs_readdir(super_block_t * sb, uint32_t dir, uint32_t index, uint8_t * name, vfs_node_t * node) {
+    uint32_t flags, i;
+
+    if(dir != TMPFS_ROOT)
+        return -1;
+
+    cli_and_save(flags);
+    for(i = index; i < TMPFS_MAX_FILES; i++) {
+        if(inodes[i].linked) {
+            memcpy(name, inodes[i].name, VFS_NAME_LEN);
+            restore_flags(flags);
+            node->ino = i + 1;
+            node->type = VFS_TYPE_FILE;
+            return i + 1;
+        }
+    }
+    restore_flags(flags);
+    return -1;
+}
+
+/*
+ * tmpfs_size
+ *    DESCRIPTION: super_ops_t size, gives a file's length
+ *    INPUTS: sb -- tmpfs, ino -- the file
+ *    OUTPUTS: none
+ *    RETURN VALUE: Length in bytes, -1 for a bad inode
+ */
+static int32_t tmpfs_size(super_block_t * sb, uint32_t ino) {
+    tmpfs_inode_t * inode = tmpfs_inode(ino);
+
+    return inode == NULL ? -1 : (int32_t)inode->size;
+}
+
+/*
+ * tmpfs_create
+ *    DESCRIPTION: super_ops_t create, makes an empty file
+ *    INPUTS: sb -- tmpfs, dir -- must be the root, name -- new file's name
+ *    OUTPUTS: node -- the new file
+ *    RETURN VALUE: 0 on success, -1 if the name is taken or every inode is in use
+ *    SIDE EFFECTS: No frames are allocated until data is written
+ */
+static int32_t tmpfs_create(super_block_t * sb, uint32_t dir, const uint8_t * name, vfs_node_t * node) {
+    uint32_t flags, i;
+
+    if(dir != TMPFS_ROOT)
+        return -1;
+
+    cli_and_save(flags);
+    if(tmpfs_find(name) != -1) {
+        restore_flags(flags);
+        return -1;
+    }
+    for(i = 0; i < TMPFS_MAX_FILES; i++) {
+        if(!inodes[i].linked && inodes[i].opens == 0) {
+            memset(&inodes[i], 0, sizeof(tmpfs_inode_t));
+            strncpy((int8_t *)inodes[i].name, (const int8_t *)name, VFS_NAME_LEN);
+            inodes[i].linked = 1;
+            restore_flags(flags);
+
+            node->ino = i + 1;
+            node->type = VFS_TYPE_FILE;
+            return 0;
+        }
+    }
+    restore_flags(flags);
+    return -1;
+}
+
+/*
+ * tmpfs_unlink
+ *    DESCRIPTION: super_ops_t unlink, removes a file's name
+ *    INPUTS: sb -- tmpfs, dir -- must be the root, name -- the file
+ *    OUTPUTS: none
+ *    RETURN VALUE: 0 on success, -1 if there's no such file
+ *    SIDE EFFECTS: Frees the data now, or on the last close if the file is open
+ */
+static int32_t tmpfs_unlink(super_block_t * sb, uint32_t dir, const uint8_t * name) {
+    tmpfs_inode_t * inode;
+    uint32_t flags;
+    int32_t ino;
+
+    if(dir != TMPFS_ROOT)
+        return -1;
+
+    cli_and_save(flags);
+    ino = tmpfs_find(name);
+    if(ino == -1) {
+        restore_flags(flags);
+        return -1;
+    }
+    inode = tmpfs_inode(ino);
+    inode->linked = 0;
+    if(inode->opens == 0)
+        tmpfs_shrink(inode, 0);
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+ * tmpfs_truncate
+ *    DESCRIPTION: super_ops_t truncate, sets a file's length
+ *    INPUTS: sb -- tmpfs, ino -- the file, size -- new length
+ *    OUTPUTS: none
+ *    RETURN VALUE: 0 on success, -1 for a bad inode or if there's no memory to grow it
+ *    SIDE EFFECTS: Shrinking frees the frames past the new end, growing adds zeros
+ */
+static int32_t tmpfs_truncate(super_block_t * sb, uint32_t ino, uint32_t size) {
+    tmpfs_inode_t * inode = tmpfs_inode(ino);
+    uint32_t flags;
+
+    if(inode == NULL)
+        return -1;
+
+    cli_and_save(flags);
+    if(size > inode->size) {
+        if(tmpfs_reserve(inode, size) == -1) {
+            restore_flags(flags);
+            return -1;
+        }
+        tmpfs_copy(inode, inode->size, NULL, size - inode->size, 1);
+    }
+    tmpfs_shrink(inode, size);
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+ * tmpfs_hold
+ *    DESCRIPTION: super_ops_t hold, counts an open file
+ *    INPUTS: sb -- tmpfs, ino -- the file (the root is ignored)
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ */
+static void tmpfs_hold(super_block_t * sb, uint32_t ino) {
+    tmpfs_inode_t * inode = tmpfs_inode(ino);
+    uint32_t flags;
+
+    if(inode == NULL)
+        return;
+    cli_and_save(flags);
+    inode->opens++;
+    restore_flags(flags);
+}
+
+/*
+ * tmpfs_release
+ *    DESCRIPTION: super_ops_t release, counts a closed file
+ *    INPUTS: sb -- tmpfs, ino -- the file (the root is ignored)
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Frees the data of an unlinked file on its last close
+ */
+static void tmpfs_release(super_block_t * sb, uint32_t ino) {
+    tmpfs_inode_t * inode = tmpfs_inode(ino);
+    uint32_t flags;
+
+    if(inode == NULL)
+        return;
+    cli_and_save(flags);
+    if(--inode->opens == 0 && !inode->linked)
+        tmpfs_shrink(inode, 0);
+    restore_flags(flags);
+}
+
+/*
+ * tmpfs_inode
+ *    DESCRIPTION: Finds an inode by number
+ *    INPUTS: ino -- inode number
+ *    OUTPUTS: none
+ *    RETURN VALUE: The inode, NULL for the root or a number out of range
+ */
+static tmpfs_inode_t * tmpfs_inode(uint32_t ino) {
+    if(ino == TMPFS_ROOT || ino > TMPFS_MAX_FILES)
+        return NULL;
+    return &inodes[ino - 1];
+}
+
+/*
+ * tmpfs_find
+ *    DESCRIPTION: Finds a file by name, call with interrupts off
+ *    INPUTS: name -- the name
+ *    OUTPUTS: none
+ *    RETURN VALUE: Its inode number, -1 if no file has that name
+ */
+static int32_t tmpfs_find(const uint8_t * name) {
+    uint32_t i;
+
+    for(i = 0; i < TMPFS_MAX_FILES; i++) {
+        if(inodes[i].linked && !strncmp((const int8_t *)inodes[i].name, (const int8_t *)name, VFS_NAME_LEN))
+            return i + 1;
+    }
+    return -1;
+}
+
+/*
+ * tmpfs_capacity
+ *    DESCRIPTION: Counts the bytes a file's extents can hold
+ *    INPUTS: inode -- the file
+ *    OUTPUTS: none
+ *    RETURN VALUE: Bytes allocated
+ */
+static uint32_t tmpfs_capacity(tmpfs_inode_t * inode) {
+    uint32_t i, frames = 0;
+
+    for(i = 0; i < inode->num_extents; i++)
+        frames += inode->extents[i].frames;
+    return frames * FRAME_SIZE;
+}
+
+/*
+ * tmpfs_reserve
+ *    DESCRIPTION: Allocates frames until a file can hold size bytes, call with interrupts off
+ *    INPUTS: inode -- the file
+ *            size -- bytes it needs to hold
+ *    OUTPUTS: none
+ *    RETURN VALUE: 0 on success, -1 if memory or extents ran out (what was allocated is kept)
+ *    SIDE EFFECTS: New frames aren't zeroed, size doesn't change
+ */
+static int32_t tmpfs_reserve(tmpfs_inode_t * inode, uint32_t size) {
+    tmpfs_extent_t * last;
+    uint32_t have = tmpfs_capacity(inode) / FRAME_SIZE;
+    uint32_t need = (size + FRAME_SIZE - 1) / FRAME_SIZE;
+    uint32_t want, addr;
+
+    if(size > 0 && need == 0)           // size rounded past 4GB
+        return -1;
+
+    while(have < need) {
+        // Double the file, but at least what's missing
+        want = have > need - have ? have : need - have;
+        if(want > TMPFS_EXTENT_MAX)
+            want = TMPFS_EXTENT_MAX;
+        while((addr = frame_alloc(want, 1)) == 0 && want > 1)
+            want /= 2;
+        if(addr == 0)
+            return -1;
+
+        last = inode->num_extents ? &inode->extents[inode->num_extents - 1] : NULL;
+        if(last != NULL && last->addr + last->frames * FRAME_SIZE == addr) {
+            last->frames += want;
+        } else if(inode->num_extents < TMPFS_EXTENTS) {
+            inode->extents[inode->num_extents].addr = addr;
+            inode->extents[inode->num_extents].frames = want;
+            inode->num_extents++;
+        } else {
+            frame_free(addr, want);
+            return -1;
+        }
+        have += want;
+    }
+    return 0;
+}
+
+/*
+ * tmpfs_shrink
+ *    DESCRIPTION: Cuts a file down, call with interrupts off
+ *    INPUTS: inode -- the file
+ *            size -- new length, at most the current one
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Frees every frame past the one holding the new last byte
+ */
+static void tmpfs_shrink(tmpfs_inode_t * inode, uint32_t size) {
+    tmpfs_extent_t * last;
+    uint32_t keep = (size + FRAME_SIZE - 1) / FRAME_SIZE;
+    uint32_t have = tmpfs_capacity(inode) / FRAME_SIZE;
+    uint32_t drop;
+
+    while(have > keep) {
+        last = &inode->extents[inode->num_extents - 1];
+        drop = have - keep < last->frames ? have - keep : last->frames;
+        frame_free(last->addr + (last->frames - drop) * FRAME_SIZE, drop);
+        last->frames -= drop;
+        have -= drop;
+        if(last->frames == 0)
+            inode->num_extents--;
+    }
+    inode->size = size;
+}
+
+/*
+ * tmpfs_copy
+ *    DESCRIPTION: Copies between a buffer and a file's extents, call with interrupts off
+ *    INPUTS: inode -- the file, with frames for offset + len bytes
+ *            offset -- where in the file to start
+ *            buf -- the other side, NULL to write zeros
+ *            len -- bytes to copy
+ *            write -- 1 to copy buf into the file, 0 to copy the file into buf
+ *    OUTPUTS: fills buf when reading
+ *    RETURN VALUE: none
+ */
+static void tmpfs_copy(tmpfs_inode_t * inode, uint32_t offset, uint8_t * buf, uint32_t len, int32_t write) {
+    tmpfs_extent_t * extent = inode->extents;
+    uint32_t bytes, chunk;
+
+    if(len == 0)
+        return;
+
+    // Skip the extents before offset
+    while(offset >= (bytes = extent->frames * FRAME_SIZE)) {
+        offset -= bytes;
+        extent++;
+    }
+
+    while(len > 0) {
+        chunk = extent->frames * FRAME_SIZE - offset;
+        if(chunk > len)
+            chunk = len;
+        if(!write)
+            memcpy(buf, (uint8_t *)extent->addr + offset, chunk);
+        else if(buf != NULL)
+            memcpy((uint8_t *)extent->addr + offset, buf, chunk);
+        else
+            memset((uint8_t *)extent->addr + offset, 0, chunk);
+
+        if(buf != NULL)
+            buf += chunk;
+        len -= chunk;
+        offset = 0;
+        extent++;
+    }
+}
@@ -0,0 +1,34 @@
+/* tmpfs.h - Writable file system kept in RAM, mounted at /tmp
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _TMPFS_H
+#define _TMPFS_H
+
+#include "types.h"
+#include "vfs.h"
+
+#define TMPFS_MAX_FILES     64          // Inodes, a file keeps its inode until it's unlinked and closed
+#define TMPFS_EXTENTS       16          // Runs of contiguous frames one file can have
+#define TMPFS_EXTENT_MAX    256         // Most frames (1MB) allocated for one extent at a time
+#define TMPFS_ROOT          0           // Inode number of the directory, files are 1 and up
+
+// A run of contiguous frames holding part of a file's data
+typedef struct tmpfs_extent {
+    uint32_t addr;                      // First frame (identity mapped)
+    uint32_t frames;
+} tmpfs_extent_t;
+
+typedef struct tmpfs_inode {
+    uint8_t name[VFS_NAME_LEN];         // Not always NUL-terminated
+    uint8_t linked;                     // 1 while the name is in the directory
+    uint32_t opens;                     // Open files using it
+    uint32_t size;                      // Bytes of data
+    uint32_t num_extents;
+    tmpfs_extent_t extents[TMPFS_EXTENTS];  // In file order, only the last one can have room past size
+} tmpfs_inode_t;
+
+// Returns tmpfs's super block for vfs_mount
+super_block_t * tmpfs_super(void);
+
+#endif /* _TMPFS_H */
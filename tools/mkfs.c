@@ -0,0 +1,275 @@
+/* mkfs.c - Builds an extended format file system image from a directory tree on the host
+ * vim:ts=4 noexpandtab
+ *
+ * Host program, build with tools/Makefile:
+ *     mkfs [-d device]... <source dir> <image>
+ * Every directory under source dir becomes a directory inode whose data blocks hold a hash table
+ * of dentry_t (see the NOTES in file_system.c), regular files become file inodes, and each -d
+ * adds a device entry to the root. The first 63 root entries are also put in the boot block, so
+ * kernels that only know the Appendix A format still see the top level. Names longer than 32
+ * characters are cut to 32.
+ */
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// Must match file_system.h
+#define BLOCK_SIZE          4096
+#define FNAME_LENGTH        32
+#define MAX_FILE_BLOCKS     1023
+#define FS_EXT_MAGIC        0x52494448
+#define BOOT_DENTRIES       63
+#define TYPE_DEV            0
+#define TYPE_DIR            1
+#define TYPE_FILE           2
+
+#define DIR_MIN_SLOTS       64          // One block
+#define DENTRIES_PER_BLOCK  (BLOCK_SIZE / sizeof(dentry_t))
+
+typedef struct {
+    char fname[FNAME_LENGTH];
+    uint32_t ftype;
+    uint32_t inode;
+    uint8_t reserved[24];
+} dentry_t;
+
+typedef struct {
+    uint32_t num_dentries;
+    uint32_t num_inodes;
+    uint32_t num_data_blocks;
+    uint32_t magic;
+    uint32_t root_inode;
+    uint8_t reserved[44];
+    dentry_t dentries[BOOT_DENTRIES];
+} boot_block_t;
+
+typedef struct {
+    uint32_t file_size;
+    uint32_t index_num[MAX_FILE_BLOCKS];
+} inode_t;
+
+typedef struct node {
+    char name[FNAME_LENGTH + 1];
+    char * path;                        // Host path, NULL for devices
+    uint32_t type;
+    uint32_t ino;
+    uint32_t size;                      // Bytes of data (the hash table for directories)
+    uint32_t first_block;
+    uint32_t nblocks;
+    struct node * parent;
+    struct node ** children;
+    uint32_t nchildren;
+} node_t;
+
+static uint32_t num_inodes, num_blocks;
+
+static void die(const char * what, const char * path) {
+    fprintf(stderr, "mkfs: %s: %s\n", path, what);
+    exit(1);
+}
+
+// Same as fs_name_hash in file_system.c
+static uint32_t name_hash(const char * name) {
+    uint32_t hash = 2166136261U;
+    int i;
+
+    for(i = 0; i < FNAME_LENGTH && name[i] != '\0'; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+static node_t * new_node(const char * name, const char * path, uint32_t type, node_t * parent) {
+    node_t * node = calloc(1, sizeof(node_t));
+    uint32_t i;
+
+    if(node == NULL)
+        die("out of memory", path);
+    if(strlen(name) > FNAME_LENGTH)
+        fprintf(stderr, "mkfs: %s: name cut to %d characters\n", path, FNAME_LENGTH);
+    strncpy(node->name, name, FNAME_LENGTH);
+    node->path = path ? strdup(path) : NULL;
+    node->type = type;
+    node->parent = parent ? parent : node;
+
+    if(parent != NULL) {
+        if(!strcmp(node->name, ".") || !strcmp(node->name, ".."))
+            die("reserved name", path ? path : name);
+        for(i = 0; i < parent->nchildren; i++) {
+            if(!strcmp(parent->children[i]->name, node->name))
+                die("duplicate name", path ? path : name);
+        }
+        parent->children = realloc(parent->children, (parent->nchildren + 1) * sizeof(node_t *));
+        if(parent->children == NULL)
+            die("out of memory", path);
+        parent->children[parent->nchildren++] = node;
+    }
+    return node;
+}
+
+// Adds path and everything under it
+static node_t * scan(const char * path, const char * name, node_t * parent) {
+    struct stat st;
+    struct dirent * ent;
+    node_t * node;
+    DIR * dir;
+    char * child;
+
+    if(stat(path, &st) != 0)
+        die("can't stat", path);
+
+    if(S_ISREG(st.st_mode)) {
+        node = new_node(name, path, TYPE_FILE, parent);
+        node->size = st.st_size;
+        if(st.st_size > (off_t)MAX_FILE_BLOCKS * BLOCK_SIZE)
+            die("file too big", path);
+        return node;
+    }
+    if(!S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "mkfs: %s: skipped, not a file or directory\n", path);
+        return NULL;
+    }
+
+    node = new_node(name, path, TYPE_DIR, parent);
+    dir = opendir(path);
+    if(dir == NULL)
+        die("can't open directory", path);
+    while((ent = readdir(dir)) != NULL) {
+        if(!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+            continue;
+        child = malloc(strlen(path) + strlen(ent->d_name) + 2);
+        if(child == NULL)
+            die("out of memory", path);
+        sprintf(child, "%s/%s", path, ent->d_name);
+        scan(child, ent->d_name, node);
+        free(child);
+    }
+    closedir(dir);
+    return node;
+}
+
+// Gives inodes and data blocks to node and everything under it
+static void layout(node_t * node) {
+    uint32_t slots = DIR_MIN_SLOTS, i;
+
+    if(node->type == TYPE_DEV)
+        return;
+    node->ino = num_inodes++;
+
+    if(node->type == TYPE_DIR) {
+        // At most half full, counting "." and ".."
+        while(slots < 2 * (node->nchildren + 2))
+            slots *= 2;
+        node->size = slots * sizeof(dentry_t);
+    }
+    node->nblocks = (node->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if(node->nblocks > MAX_FILE_BLOCKS)
+        die("too many entries", node->path);
+    node->first_block = num_blocks;
+    num_blocks += node->nblocks;
+
+    for(i = 0; i < node->nchildren; i++)
+        layout(node->children[i]);
+}
+
+static void set_dentry(dentry_t * dentry, const char * name, uint32_t type, uint32_t ino) {
+    memset(dentry, 0, sizeof(dentry_t));
+    memcpy(dentry->fname, name, strnlen(name, FNAME_LENGTH));     // Not terminated if it's 32 long
+    dentry->ftype = type;
+    dentry->inode = ino;
+}
+
+// Puts a name in the first free slot at or after its hash
+static void dir_insert(dentry_t * table, uint32_t slots, const char * name, uint32_t type, uint32_t ino) {
+    uint32_t slot = name_hash(name) & (slots - 1);
+
+    while(table[slot].fname[0] != '\0')
+        slot = (slot + 1) & (slots - 1);
+    set_dentry(&table[slot], name, type, ino);
+}
+
+// Fills in node's inode and data blocks, and everything under it
+static void emit(uint8_t * image, node_t * node) {
+    inode_t * inode;
+    uint8_t * data;
+    FILE * file;
+    uint32_t i;
+
+    if(node->type == TYPE_DEV)
+        return;
+
+    inode = (inode_t *)(image + BLOCK_SIZE * (1 + node->ino));
+    inode->file_size = node->size;
+    for(i = 0; i < node->nblocks; i++)
+        inode->index_num[i] = node->first_block + i;
+    data = image + BLOCK_SIZE * (1 + num_inodes + node->first_block);
+
+    if(node->type == TYPE_FILE) {
+        file = fopen(node->path, "rb");
+        if(file == NULL || fread(data, 1, node->size, file) != node->size)
+            die("can't read", node->path);
+        fclose(file);
+        return;
+    }
+
+    dir_insert((dentry_t *)data, node->size / sizeof(dentry_t), ".", TYPE_DIR, node->ino);
+    dir_insert((dentry_t *)data, node->size / sizeof(dentry_t), "..", TYPE_DIR, node->parent->ino);
+    for(i = 0; i < node->nchildren; i++) {
+        dir_insert((dentry_t *)data, node->size / sizeof(dentry_t), node->children[i]->name,
+                   node->children[i]->type, node->children[i]->ino);
+        emit(image, node->children[i]);
+    }
+}
+
+int main(int argc, char ** argv) {
+    boot_block_t * boot;
+    node_t * root, * dev;
+    uint8_t * image;
+    FILE * out;
+    size_t size;
+    uint32_t i;
+    int arg = 1;
+
+    while(arg + 1 < argc && !strcmp(argv[arg], "-d"))
+        arg += 2;
+    if(argc - arg != 2) {
+        fprintf(stderr, "usage: %s [-d device]... <source dir> <image>\n", argv[0]);
+        return 1;
+    }
+
+    root = scan(argv[arg], ".", NULL);
+    if(root == NULL || root->type != TYPE_DIR)
+        die("not a directory", argv[arg]);
+    for(i = 1; i < (uint32_t)arg; i += 2) {
+        dev = new_node(argv[i + 1], NULL, TYPE_DEV, root);
+        dev->ino = 0;
+    }
+
+    layout(root);
+    size = (size_t)BLOCK_SIZE * (1 + num_inodes + num_blocks);
+    image = calloc(1, size);
+    if(image == NULL)
+        die("out of memory", argv[arg + 1]);
+    emit(image, root);
+
+    boot = (boot_block_t *)image;
+    boot->num_inodes = num_inodes;
+    boot->num_data_blocks = num_blocks;
+    boot->magic = FS_EXT_MAGIC;
+    boot->root_inode = root->ino;
+    set_dentry(&boot->dentries[0], ".", TYPE_DIR, root->ino);
+    for(i = 0; i < root->nchildren && i + 1 < BOOT_DENTRIES; i++)
+        set_dentry(&boot->dentries[i + 1], root->children[i]->name, root->children[i]->type, root->children[i]->ino);
+    boot->num_dentries = i + 1;
+
+    out = fopen(argv[arg + 1], "wb");
+    if(out == NULL || fwrite(image, 1, size, out) != size || fclose(out) != 0)
+        die("can't write", argv[arg + 1]);
+    printf("%s: %u inodes, %u data blocks\n", argv[arg + 1], num_inodes, num_blocks);
+    return 0;
+}
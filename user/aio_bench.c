@@ -0,0 +1,170 @@
+/* aio_bench.c - Compares reading a file with read and with the async I/O rings while computing
+ * vim:ts=4 noexpandtab
+ *
+ * Standalone user program, build with user/Makefile and add the binary to the file system
+ * image. Usage: aio_bench <file>. Reads the file a chunk at a time and runs a checksum over
+ * every chunk, the first half with plain reads and the second half with up to IN_FLIGHT reads
+ * queued on the rings so the next chunks are read while the current one is summed. Each half
+ * is read once so neither pass finds the other's blocks in the cache. Prints the cycles per
+ * KB of each pass. The difference is largest for a file on /disk, where a block that isn't
+ * cached is a DMA read the worker sleeps through.
+ */
+
+#include "ulib.h"
+
+#define SYS_READ        3
+#define SYS_OPEN        5
+#define SYS_CLOSE       6
+#define SYS_GETARGS     7
+#define SYS_LSEEK       30
+#define SYS_AIO_SETUP   31
+#define SYS_AIO_ENTER   32
+#define SEEK_SET        0               // Must match VFS_SEEK_SET and VFS_SEEK_END in vfs.h
+#define SEEK_END        2
+#define MAX_ARGS        100
+#define CHUNK           4096
+#define IN_FLIGHT       8
+#define ROUNDS          64              // Checksum passes over each chunk, stands in for real work
+
+// Must match aio.h
+#define AIO_ENTRIES     128
+#define AIO_MASK        (AIO_ENTRIES - 1)
+#define AIO_READ        1
+
+typedef struct aio_sqe {
+    int op;
+    int fd;
+    uint32_t buf;
+    int len;
+    uint32_t user_data;
+} aio_sqe_t;
+
+typedef struct aio_cqe {
+    uint32_t user_data;
+    int res;
+} aio_cqe_t;
+
+typedef struct aio_ring {
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    aio_sqe_t sq[AIO_ENTRIES];
+    aio_cqe_t cq[AIO_ENTRIES];
+} aio_ring_t;
+
+static aio_ring_t ring __attribute__((aligned (4096)));
+static char bufs[IN_FLIGHT][CHUNK];
+static volatile uint32_t sink;          // Keeps the checksums from being optimized away
+
+static void fail(const char * msg) {
+    print(msg);
+    int80_call(SYS_HALT, 1, 0, 0);
+}
+
+static uint32_t checksum(const char * data, int len, uint32_t sum) {
+    int round, i;
+
+    for(round = 0; round < ROUNDS; round++) {
+        for(i = 0; i < len; i++)
+            sum = (sum << 5) + sum + (unsigned char)data[i];
+    }
+    return sum;
+}
+
+// Queues a read of the next chunk into buffer slot
+static void submit_read(int fd, int slot) {
+    aio_sqe_t * sqe = &ring.sq[ring.sq_tail & AIO_MASK];
+
+    sqe->op = AIO_READ;
+    sqe->fd = fd;
+    sqe->buf = (uint32_t)bufs[slot];
+    sqe->len = CHUNK;
+    sqe->user_data = slot;
+    ring.sq_tail++;
+}
+
+static uint32_t sync_pass(int fd, int bytes) {
+    uint32_t sum = 0;
+    int got;
+
+    for(; bytes > 0; bytes -= CHUNK) {
+        got = int80_call(SYS_READ, fd, (int)bufs[0], CHUNK);
+        if(got <= 0)
+            break;
+        sum = checksum(bufs[0], got, sum);
+    }
+    return sum;
+}
+
+// Reads complete in order (the worker runs them one at a time), so chunks are summed in file order
+static uint32_t async_pass(int fd) {
+    uint32_t sum = 0;
+    aio_cqe_t * cqe;
+    int slot, done = 0;
+
+    for(slot = 0; slot < IN_FLIGHT; slot++)
+        submit_read(fd, slot);
+    int80_call(SYS_AIO_ENTER, 0, 0, 0);
+
+    while(!done) {
+        if(ring.cq_head == ring.cq_tail && int80_call(SYS_AIO_ENTER, 1, 0, 0) < 1)
+            fail("aio_bench: aio_enter failed\n");
+        cqe = &ring.cq[ring.cq_head & AIO_MASK];
+        slot = cqe->user_data;
+        if(cqe->res <= 0) {
+            done = 1;
+        } else {
+            sum = checksum(bufs[slot], cqe->res, sum);
+            submit_read(fd, slot);
+            int80_call(SYS_AIO_ENTER, 0, 0, 0);
+        }
+        ring.cq_head++;
+    }
+
+    // Let the reads still queued past the end finish before the buffers go away
+    while(ring.cq_tail != ring.sq_tail)
+        int80_call(SYS_AIO_ENTER, ring.sq_tail - ring.cq_head, 0, 0);
+    return sum;
+}
+
+static void report(const char * name, uint64_t cycles, int bytes) {
+    print(name);
+    print_num(cycles_per(cycles, bytes / 1024));
+    print(" cycles/KB\n");
+}
+
+void _start(void) {
+    static char path[MAX_ARGS];
+    uint64_t start, sync_cycles, async_cycles;
+    int fd, size, half;
+
+    if(int80_call(SYS_GETARGS, (int)path, MAX_ARGS, 0) != 0)
+        fail("usage: aio_bench <file>\n");
+    fd = int80_call(SYS_OPEN, (int)path, 0, 0);
+    if(fd < 0)
+        fail("aio_bench: can't open the file\n");
+    if(int80_call(SYS_AIO_SETUP, (int)&ring, 0, 0) != 0)
+        fail("aio_bench: aio_setup failed\n");
+
+    size = int80_call(SYS_LSEEK, fd, 0, SEEK_END);
+    half = (size / 2) & ~(CHUNK - 1);
+    if(half == 0)
+        fail("aio_bench: the file has to be at least 8KB\n");
+    int80_call(SYS_LSEEK, fd, 0, SEEK_SET);
+
+    start = rdtsc();
+    sink = sync_pass(fd, half);
+    sync_cycles = rdtsc() - start;
+
+    // Carries on from half
+    start = rdtsc();
+    sink = async_pass(fd);
+    async_cycles = rdtsc() - start;
+
+    report("read: ", sync_cycles, half);
+    report("aio:  ", async_cycles, size - half);
+
+    int80_call(SYS_CLOSE, fd, 0, 0);
+    int80_call(SYS_HALT, 0, 0, 0);
+}
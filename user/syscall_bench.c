@@ -0,0 +1,51 @@
+/* syscall_bench.c - Compares the cost of a null system call through int $0x80 and SYSENTER
+ * vim:ts=4 noexpandtab
+ *
+ * Standalone user program, build with user/Makefile and add the binary to the file system
+ * image. close(0) always fails right away (stdin can't be closed), so it measures just the
+ * entry and exit path of each mechanism.
+ */
+
+#include "ulib.h"
+
+#define VDSO_ADDR       0x10001000      // Must match vdso.h
+#define SYS_CLOSE       6
+#define ITERATIONS      100000
+
+static inline int vdso_call(int num, int a, int b, int c) {
+    int ret;
+    asm volatile ("call *%1" : "=a"(ret) : "r"(VDSO_ADDR), "a"(num), "b"(a), "c"(b), "d"(c) : "memory", "cc");
+    return ret;
+}
+
+static void report(const char * name, uint64_t cycles) {
+    print(name);
+    print_num(cycles_per(cycles, ITERATIONS));
+    print(" cycles/call\n");
+}
+
+void _start(void) {
+    uint64_t start, int80_cycles, vdso_cycles;
+    int i;
+
+    // Warm up both paths (and fault in the stack) before timing
+    for(i = 0; i < 1000; i++) {
+        int80_call(SYS_CLOSE, 0, 0, 0);
+        vdso_call(SYS_CLOSE, 0, 0, 0);
+    }
+
+    start = rdtsc();
+    for(i = 0; i < ITERATIONS; i++)
+        int80_call(SYS_CLOSE, 0, 0, 0);
+    int80_cycles = rdtsc() - start;
+
+    start = rdtsc();
+    for(i = 0; i < ITERATIONS; i++)
+        vdso_call(SYS_CLOSE, 0, 0, 0);
+    vdso_cycles = rdtsc() - start;
+
+    report("int $0x80: ", int80_cycles);
+    report("vDSO:      ", vdso_cycles);
+
+    int80_call(SYS_HALT, 0, 0, 0);
+}
@@ -0,0 +1,75 @@
+/* tmpfs_bench.c - Measures tmpfs write throughput for sequential and random 4KB writes
+ * vim:ts=4 noexpandtab
+ *
+ * Standalone user program, build with user/Makefile and add the binary to the file system
+ * image. Writes FILE_KB of data to a new file in /tmp one chunk at a time, then overwrites
+ * random chunk-aligned offsets of the same file the same number of times, and prints the cost
+ * of each pass per KB. The sequential pass includes growing the file, the random pass doesn't.
+ */
+
+#include "ulib.h"
+
+#define SYS_CLOSE       6
+#define SYS_CREAT       27
+#define SYS_UNLINK      28
+#define SYS_LSEEK       30
+#define SEEK_SET        0               // Must match VFS_SEEK_SET in vfs.h
+#define CHUNK           4096
+#define FILE_KB         4096            // 4MB
+#define CHUNKS          (FILE_KB * 1024 / CHUNK)
+
+static char chunk[CHUNK];
+
+static void report(const char * name, uint64_t cycles) {
+    print(name);
+    print_num(cycles_per(cycles, FILE_KB));
+    print(" cycles/KB\n");
+}
+
+// xorshift, good enough to scatter offsets
+static uint32_t next_random(uint32_t * state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+void _start(void) {
+    static const char path[] = "/tmp/bench";
+    uint64_t start, seq_cycles, rand_cycles;
+    uint32_t seed = 2463534242u;
+    int fd, i;
+
+    for(i = 0; i < CHUNK; i++)
+        chunk[i] = (char)i;
+
+    fd = int80_call(SYS_CREAT, (int)path, 0, 0);
+    if(fd < 0) {
+        print("tmpfs_bench: can't create /tmp/bench\n");
+        int80_call(SYS_HALT, 1, 0, 0);
+    }
+
+    start = rdtsc();
+    for(i = 0; i < CHUNKS; i++) {
+        if(int80_call(SYS_WRITE, fd, (int)chunk, CHUNK) != CHUNK) {
+            print("tmpfs_bench: out of memory\n");
+            int80_call(SYS_UNLINK, (int)path, 0, 0);
+            int80_call(SYS_HALT, 1, 0, 0);
+        }
+    }
+    seq_cycles = rdtsc() - start;
+
+    start = rdtsc();
+    for(i = 0; i < CHUNKS; i++) {
+        int80_call(SYS_LSEEK, fd, (next_random(&seed) % CHUNKS) * CHUNK, SEEK_SET);
+        int80_call(SYS_WRITE, fd, (int)chunk, CHUNK);
+    }
+    rand_cycles = rdtsc() - start;
+
+    report("sequential: ", seq_cycles);
+    report("random:     ", rand_cycles);
+
+    int80_call(SYS_CLOSE, fd, 0, 0);
+    int80_call(SYS_UNLINK, (int)path, 0, 0);
+    int80_call(SYS_HALT, 0, 0, 0);
+}
@@ -0,0 +1,71 @@
+/* ulib.h - Helpers shared by the standalone user programs
+ * vim:ts=4 noexpandtab
+ *
+ * There's no libc (or libgcc) for these, everything a program needs beyond its own system
+ * calls lives here. All static inline so a program only gets what it uses.
+ */
+
+#ifndef _ULIB_H
+#define _ULIB_H
+
+#define SYS_HALT        1
+#define SYS_WRITE       4
+#define STDOUT          1
+
+typedef int int32_t;
+typedef unsigned int uint32_t;
+typedef unsigned long long uint64_t;
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline int int80_call(int num, int a, int b, int c) {
+    int ret;
+    asm volatile ("int $0x80" : "=a"(ret) : "a"(num), "b"(a), "c"(b), "d"(c) : "memory", "cc");
+    return ret;
+}
+
+// Length of s, looking at no more than max chars (names in fixed-size fields aren't terminated)
+static inline int length(const char * s, int max) {
+    int len = 0;
+    while(len < max && s[len] != '\0')
+        len++;
+    return len;
+}
+
+static inline void print_n(const char * s, int max) {
+    int80_call(SYS_WRITE, STDOUT, (int)s, length(s, max));
+}
+
+static inline void print(const char * s) {
+    print_n(s, 0x7FFFFFFF);
+}
+
+static inline void print_num(uint32_t value) {
+    char buf[11];
+    int i = sizeof(buf) - 1;
+
+    buf[i] = '\0';
+    do {
+        buf[--i] = '0' + value % 10;
+        value /= 10;
+    } while(value != 0);
+    print(&buf[i]);
+}
+
+// cycles / units without 64-bit division: halves cycles until it fits in 32 bits and scales the
+// quotient back up, which only drops the low bits of a huge total
+static inline uint32_t cycles_per(uint64_t cycles, uint32_t units) {
+    int shift = 0;
+
+    while(cycles >> 32) {
+        cycles >>= 1;
+        shift++;
+    }
+    return ((uint32_t)cycles / units) << shift;
+}
+
+#endif /* _ULIB_H */
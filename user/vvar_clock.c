@@ -0,0 +1,48 @@
+/* vvar_clock.c - Prints the uptime, wall clock and PID from the vvar page without system calls
+ * vim:ts=4 noexpandtab
+ *
+ * Standalone user program, build with user/Makefile. Only the final write and halt enter the
+ * kernel.
+ */
+
+#include "ulib.h"
+
+#define VVAR_ADDR       0x10002000      // Must match vdso.h
+#define PIT_TICK_MS     10              // Must match pit.h
+
+// Must match vvar_t in vdso.h
+typedef struct vvar {
+    volatile uint32_t seq;
+    uint32_t ticks;
+    uint32_t time;
+    uint32_t time_ticks;
+    int32_t pid;
+} vvar_t;
+
+#define barrier()   asm volatile ("" : : : "memory")
+
+void _start(void) {
+    const vvar_t * v = (const vvar_t *)VVAR_ADDR;
+    vvar_t snap;
+    uint32_t seq;
+
+    // Seqlock read: retry if the kernel was part way through an update
+    do {
+        seq = v->seq;
+        barrier();
+        snap.ticks = v->ticks;
+        snap.time = v->time;
+        snap.pid = v->pid;
+        barrier();
+    } while((seq & 1) || seq != v->seq);
+
+    print("uptime ms: ");
+    print_num(snap.ticks * PIT_TICK_MS);
+    print("\nunix time: ");
+    print_num(snap.time);
+    print("\npid: ");
+    print_num(snap.pid);
+    print("\n");
+
+    int80_call(SYS_HALT, 0, 0, 0);
+}
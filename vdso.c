@@ -0,0 +1,155 @@
+/* vdso.c - SYSENTER/SYSEXIT setup and the user-visible system call page
+ * vim:ts=4 noexpandtab
+ */
+
+#include "vdso.h"
+#include "x86_desc.h"
+#include "paging.h"
+#include "asm_linkage.h"
+#include "pit.h"
+#include "rtc.h"
+#include "lib.h"
+
+/* NOTES: The vDSO page is one read-only user page right after the vidmap page, mapped through
+          user_video_table so every process sees it. It holds the system call stub from
+          asm_linkage.S: on CPUs with SYSENTER it saves the registers sysexit clobbers and enters
+          sysenter_entry, otherwise it's just int $0x80. Programs call it the same way either way.
+          sysenter_entry builds the same hw_context_t as int $0x80 at the top of the kernel stack,
+          so fork, exec, signals and PCB_SYSCALL_CONTEXT work the same on both paths.
+          The vvar page right after it holds a vvar_t the kernel keeps current from PIT_handler
+          and set_current_task, so reading the time or the PID doesn't need a system call. */
+
+#define TICKS_PER_SECOND    (1000 / PIT_TICK_MS)
+
+// Keeps the compiler from moving memory accesses across a seq update
+#define barrier()   asm volatile ("" : : : "memory")
+
+static uint8_t vdso_page[FOUR_KB] __attribute__((aligned (FOUR_KB)));
+static uint8_t vvar_page[FOUR_KB] __attribute__((aligned (FOUR_KB)));
+static uint8_t sysenter_enabled;
+
+uint32_t sysexit_return_addr;
+vvar_t * const vvar = (vvar_t *)vvar_page;
+
+static void wrmsr(uint32_t msr, uint32_t value);
+static void map_user_page(uint32_t index, void * page);
+
+/*
+ * init_vdso
+ *    DESCRIPTION: Sets up the fast system call path
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Copies the right stub into the vDSO page, maps it at VDSO_ADDR and, with
+ *                  SYSENTER support, loads the SYSENTER CS/EIP MSRs (ESP is set per task).
+ *                  Maps the vvar page at VVAR_ADDR and starts its clock from the RTC
+ */
+void init_vdso(void) {
+    uint32_t eax, ebx, ecx, edx;
+    uint32_t stub_size;
+
+    eax = CPUID_FEATURES;
+    asm volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    sysenter_enabled = (edx & CPUID_EDX_SEP) != 0;
+
+    if(sysenter_enabled) {
+        stub_size = (uint32_t)vdso_sysenter_end - (uint32_t)vdso_sysenter_start;
+        memcpy(vdso_page, vdso_sysenter_start, stub_size);
+        sysexit_return_addr = VDSO_ADDR + ((uint32_t)vdso_sysenter_return - (uint32_t)vdso_sysenter_start);
+
+        // sysenter loads CS and SS = CS + 8, sysexit USER_CS = CS + 16 and USER_DS = CS + 24
+        wrmsr(MSR_SYSENTER_CS, KERNEL_CS);
+        wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
+    } else {
+        stub_size = (uint32_t)vdso_int80_end - (uint32_t)vdso_int80_start;
+        memcpy(vdso_page, vdso_int80_start, stub_size);
+    }
+
+    vvar->time = RTC_get_time();
+    vvar->pid = -1;
+
+    map_user_page(VDSO_PAGE_INDEX, vdso_page);
+    map_user_page(VVAR_PAGE_INDEX, vvar_page);
+    flush_tlb();
+}
+
+/*
+ * vdso_set_kernel_stack
+ *    DESCRIPTION: Makes SYSENTER land on a task's kernel stack
+ *    INPUTS: esp0 -- the task's kernel stack pointer (its tss.esp0)
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Does nothing without SYSENTER support
+ */
+void vdso_set_kernel_stack(uint32_t esp0) {
+    if(sysenter_enabled)
+        wrmsr(MSR_SYSENTER_ESP, esp0);
+}
+
+/*
+ * vvar_tick
+ *    DESCRIPTION: Advances the vvar clock by one PIT tick
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Bumps seq around the update, call with interrupts off
+ */
+void vvar_tick(void) {
+    vvar->seq++;
+    barrier();
+    vvar->ticks++;
+    if(++vvar->time_ticks == TICKS_PER_SECOND) {
+        vvar->time_ticks = 0;
+        vvar->time++;
+    }
+    barrier();
+    vvar->seq++;
+}
+
+/*
+ * vvar_set_pid
+ *    DESCRIPTION: Publishes the PID of the task that's about to run
+ *    INPUTS: pid -- its PID
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Bumps seq around the update with interrupts off so a tick can't land in between
+ */
+void vvar_set_pid(int32_t pid) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    vvar->seq++;
+    barrier();
+    vvar->pid = pid;
+    barrier();
+    vvar->seq++;
+    restore_flags(flags);
+}
+
+/*
+ * wrmsr
+ *    DESCRIPTION: Writes a model-specific register
+ *    INPUTS: msr -- MSR number
+ *            value -- low 32 bits to write (the high half is 0)
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ */
+static void wrmsr(uint32_t msr, uint32_t value) {
+    asm volatile ("wrmsr" : : "c"(msr), "a"(value), "d"(0));
+}
+
+/*
+ * map_user_page
+ *    DESCRIPTION: Maps a kernel page read-only for every user program
+ *    INPUTS: index -- entry in user_video_table
+ *            page -- 4KB-aligned kernel page
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Caller flushes the TLB
+ */
+static void map_user_page(uint32_t index, void * page) {
+    user_video_table[index].page_base_address = (uint32_t)page >> 12;
+    user_video_table[index].read_write = 0;
+    user_video_table[index].user_supervisor = 1;
+    user_video_table[index].present = 1;
+}
@@ -0,0 +1,57 @@
+/* vdso.h - SYSENTER/SYSEXIT setup and the user-visible system call page
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _VDSO_H
+#define _VDSO_H
+
+#include "types.h"
+
+// User programs make fast system calls with "call *VDSO_ADDR" (eax = number, ebx/ecx/edx = args)
+#define VDSO_ADDR           (TWO_FIVE_SIX_MB + FOUR_KB)     // Right after the vidmap page
+#define VDSO_PAGE_INDEX     1                               // Entry of the vDSO page in user_video_table
+
+// Read-only data page user programs can read the time and their PID from (see vvar_t)
+#define VVAR_ADDR           (TWO_FIVE_SIX_MB + 2 * FOUR_KB)
+#define VVAR_PAGE_INDEX     2
+
+#define MSR_SYSENTER_CS     0x174
+#define MSR_SYSENTER_ESP    0x175
+#define MSR_SYSENTER_EIP    0x176
+#define CPUID_FEATURES      1
+#define CPUID_EDX_SEP       (1 << 11)   // SYSENTER/SYSEXIT supported
+
+#ifndef ASM
+
+/* Layout of the page at VVAR_ADDR. The kernel makes seq odd while it changes the other fields,
+ * so readers copy what they need and retry if seq was odd or changed:
+ *     do { s = v->seq; ...copy fields... } while((s & 1) || s != v->seq);
+ * (with compiler barriers around the copy). The page is the same for every process, pid is
+ * whoever is running, which is always the reader. */
+typedef struct vvar {
+    volatile uint32_t seq;      // Sequence count, odd while an update is in progress
+    uint32_t ticks;             // PIT ticks since boot (PIT_TICK_MS each), never goes backwards
+    uint32_t time;              // Wall clock, seconds since 1970-01-01 (read from the RTC at boot)
+    uint32_t time_ticks;        // PIT ticks into the current second
+    int32_t pid;                // PID of the running process
+} vvar_t;
+
+extern vvar_t * const vvar;
+
+// Where sysexit returns to in the vDSO page, also the eip of every SYSENTER hw_context_t
+extern uint32_t sysexit_return_addr;
+
+// Fills and maps the vDSO page and sets up the SYSENTER MSRs if the CPU has them
+void init_vdso(void);
+
+// Points SYSENTER at a task's kernel stack, call whenever tss.esp0 changes
+void vdso_set_kernel_stack(uint32_t esp0);
+
+// Advances the vvar clock by one PIT tick
+void vvar_tick(void);
+
+// Publishes the PID of the task that's about to run
+void vvar_set_pid(int32_t pid);
+
+#endif /* ASM */
+#endif /* _VDSO_H */
@@ -0,0 +1,793 @@
+/* vfs.c - Mount table, path lookup and the dentry cache shared by every file system
+ * vim:ts=4 noexpandtab
+ */
+
+#include "vfs.h"
+#include "devfs.h"
+#include "tmpfs.h"
+#include "file.h"
+#include "kmalloc.h"
+#include "frame.h"
+#include "scheduler.h"
+#include "lib.h"
+
+/* NOTES: Every path goes through here. The longest mount point that prefixes the path picks the
+          file system, then each component is looked up in the directory before it. Lookups go
+          through the dentry cache first, a hash of (file system, directory, name) that also
+          remembers names that don't exist, so repeated opens and executes never reach a file
+          system's lookup. Paths without a leading '/' start at / too (there's no working
+          directory), which keeps names like "shell" and "frame0.txt" working.
+          Regular files and directories are opened with the generic fops below, which call into
+          the file system through the vfs_node_t kept in the file_t. Devices are opened with
+          their own driver's fops.
+          Creating and removing names works on file systems that implement those super_ops_t
+          members (tmpfs), they take the directory and the last component from resolve_parent.
+          The dentry cache entry for the name is dropped afterwards either way.
+          Each open file remembers where a sequential read would continue. While reads keep
+          starting there, the file system is asked to read ahead past them (if it has a block
+          cache), starting with VFS_RA_MIN bytes and doubling the window up to VFS_RA_MAX on every
+          read. A read anywhere else (after a seek) shrinks the window back to nothing. */
+
+typedef struct mount {
+    int8_t path[VFS_MOUNT_PATH];        // Mount point without the leading '/', "" for /
+    super_block_t * sb;                 // NULL if the entry is unused
+} mount_t;
+
+static int32_t vfs_file_read(int32_t fd, void * buf, int32_t nbytes);
+static int32_t vfs_file_write(int32_t fd, const void * buf, int32_t nbytes);
+static int32_t vfs_dir_read(int32_t fd, void * buf, int32_t nbytes);
+static int32_t vfs_dir_ioctl(int32_t fd, int32_t request, uint32_t arg);
+static int32_t vfs_dir_read_dirents(file_t * file, vfs_dirent_t * dirents, int32_t nbytes);
+static int32_t vfs_open_nothing(const uint8_t * filename);
+static int32_t vfs_close(int32_t fd);
+
+static const fops_jump_table_t vfs_file_table = {vfs_file_read, vfs_file_write, vfs_open_nothing, vfs_close, bad_call};
+static const fops_jump_table_t vfs_dir_table = {vfs_dir_read, bad_call, vfs_open_nothing, vfs_close, vfs_dir_ioctl};
+
+static mount_t mounts[VFS_MAX_MOUNTS];
+
+static dcache_entry_t dcache[DCACHE_ENTRIES];
+static dcache_entry_t * dcache_hash[DCACHE_BUCKETS];
+static dcache_entry_t * dcache_lru;     // Most recently used, lru_prev of it is the least recent
+static dcache_stats_t dcache_stats;
+
+static int32_t resolve_parent(const uint8_t * path, vfs_node_t * dir, uint8_t * name);
+static int32_t lookup(vfs_node_t * dir, const uint8_t * name, vfs_node_t * node);
+static uint32_t dcache_hash_of(super_block_t * sb, uint32_t dir, const uint8_t * name);
+static void dcache_unhash(dcache_entry_t * entry);
+static void dcache_touch(dcache_entry_t * entry);
+
+/*
+ * init_vfs
+ *    DESCRIPTION: Sets up the dentry cache and mounts the boot image, devfs and tmpfs
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ *    SIDE EFFECTS: Call after init_filesystem
+ */
+void init_vfs(void) {
+    int32_t i;
+
+    // Every entry starts unused on the LRU ring
+    for(i = 0; i < DCACHE_ENTRIES; i++) {
+        dcache[i].sb = NULL;
+        dcache[i].lru_next = &dcache[(i + 1) % DCACHE_ENTRIES];
+        dcache[i].lru_prev = &dcache[(i + DCACHE_ENTRIES - 1) % DCACHE_ENTRIES];
+    }
+    dcache_lru = &dcache[0];
+
+    vfs_mount("/", bootfs_super());
+    vfs_mount("/dev", devfs_super());
+    vfs_mount("/tmp", tmpfs_super());
+}
+
+/*
+ * vfs_mount
+ *    DESCRIPTION: Makes a file system reachable under a path
+ *    INPUTS: path -- "/" or "/name", the mount point
+ *            sb -- the file system
+ *    OUTPUTS: none
+ *    RETURN VALUE: 0 on success, -1 if the path is bad or taken or the mount table is full
+ *    SIDE EFFECTS: Names under the mount point hide whatever the parent file system has there
+ */
+int32_t vfs_mount(const int8_t * path, super_block_t * sb) {
+    int32_t i, slot = -1;
+
+    if(path == NULL || sb == NULL || path[0] != '/' || strlen(path + 1) >= VFS_MOUNT_PATH)
+        return -1;
+    path++;
+
+    for(i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if(mounts[i].sb == NULL) {
+            if(slot == -1)
+                slot = i;
+        } else if(!strncmp(mounts[i].path, path, VFS_MOUNT_PATH)) {
+            return -1;
+        }
+    }
+    if(slot == -1)
+        return -1;
+
+    strncpy(mounts[slot].path, path, VFS_MOUNT_PATH);
+    mounts[slot].sb = sb;
+    return 0;
+}
+
+/*
+ * vfs_resolve
+ *    DESCRIPTION: Finds what a path names
+ *    INPUTS: path -- '/'-separated path, a leading '/' is optional
+ *    OUTPUTS: node -- what it names
+ *    RETURN VALUE: 0 on success, -1 if the path is too long, a component is too long or missing,
+ *                  or a component before the last isn't a directory
+ */
+int32_t vfs_resolve(const uint8_t * path, vfs_node_t * node) {
+    const int8_t * p = (const int8_t *)path;
+    uint8_t name[VFS_NAME_LEN + 1];
+    mount_t * mount = NULL;
+    uint32_t len, best = 0;
+    int32_t i;
+
+    if(path == NULL || node == NULL || strlen(p) >= VFS_MAX_PATH)
+        return -1;
+    while(*p == '/')
+        p++;
+
+    // Longest mount point that is a whole-component prefix of the path
+    for(i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if(mounts[i].sb == NULL)
+            continue;
+        len = strlen(mounts[i].path);
+        if((mount == NULL || len > best) && !strncmp(mounts[i].path, p, len) && (p[len] == '/' || p[len] == '\0')) {
+            mount = &mounts[i];
+            best = len;
+        }
+    }
+    if(mount == NULL)
+        return -1;
+    p += best;
+
+    node->sb = mount->sb;
+    node->ino = mount->sb->root;
+    node->type = VFS_TYPE_DIR;
+    node->fops = NULL;
+
+    while(1) {
+        while(*p == '/')
+            p++;
+        if(*p == '\0')
+            return 0;
+
+        for(len = 0; p[len] != '/' && p[len] != '\0'; len++) {
+            if(len == VFS_NAME_LEN)
+                return -1;
+            name[len] = p[len];
+        }
+        name[len] = '\0';
+        p += len;
+
+        if(node->type != VFS_TYPE_DIR || lookup(node, name, node) == -1)
+            return -1;
+    }
+}
+
+/*
+ * vfs_node_read
+ *    DESCRIPTION: Reads file data through a resolved node
+ *    INPUTS: node -- a VFS_TYPE_FILE node from vfs_resolve
+ *            offset -- where in the file to start
+ *            buf -- where to put the data
+ *            len -- most bytes to read
+ *    OUTPUTS: fills buf
+ *    RETURN VALUE: Bytes read, 0 at the end of the file, -1 if node isn't a regular file
+ */
+int32_t vfs_node_read(vfs_node_t * node, uint32_t offset, uint8_t * buf, uint32_t len) {
+    if(node->type != VFS_TYPE_FILE)
+        return -1;
+    return node->sb->ops->read(node->sb, node->ino, offset, buf, len);
+}
+
+/*
+ * vfs_open
+ *    DESCRIPTION: Opens a path
+ *    INPUTS: pcb -- the running process
+ *            path -- what to open
+ *    OUTPUTS: none
+ *    RETURN VALUE: The lowest free fd, -1 if the path doesn't resolve, a device refuses to open,
+ *                  no fd is free or we're out of memory
+ *    SIDE EFFECTS: The new file starts at position 0
+ */
+int32_t vfs_open(pcb_t * pcb, const uint8_t * path) {
+    vfs_node_t node;
+    vfs_file_t * copy = NULL;
+    file_t * file;
+    int32_t fd;
+
+    if(vfs_resolve(path, &node) == -1)
+        return -1;
+
+    if(node.type == VFS_TYPE_DEV) {
+        file = file_alloc(node.fops, 0);
+    } else {
+        copy = kmalloc(sizeof(vfs_file_t));
+        if(copy == NULL)
+            return -1;
+        copy->node = node;
+        copy->ra_next = 0;
+        copy->ra_end = 0;
+        copy->ra_window = 0;
+        file = file_alloc(node.type == VFS_TYPE_DIR ? &vfs_dir_table : &vfs_file_table, (uint32_t)copy);
+    }
+    if(file == NULL) {
+        kfree(copy);
+        return -1;
+    }
+
+    fd = fd_install(pcb, file);
+    if(fd == -1 || file->ops->open(path) == -1) {
+        if(fd != -1)
+            pcb->fds[fd] = NULL;
+        kfree(copy);
+        kfree(file);
+        return -1;
+    }
+    if(copy != NULL && node.sb->ops->hold != NULL)
+        node.sb->ops->hold(node.sb, node.ino);
+    return fd;
+}
+
+/*
+ * vfs_create
+ *    DESCRIPTION: Opens a path as an empty regular file, like creat
+ *    INPUTS: pcb -- the running process
+ *            path -- the file
+ *    OUTPUTS: none
+ *    RETURN VALUE: The lowest free fd, -1 if the directory doesn't exist or can't be written, the
+ *                  path names something other than a regular file, or vfs_open fails
+ *    SIDE EFFECTS: Makes the file if it's missing, otherwise truncates it to 0 bytes
+ */
+int32_t vfs_create(pcb_t * pcb, const uint8_t * path) {
+    vfs_node_t dir, node;
+    uint8_t name[VFS_NAME_LEN + 1];
+    super_block_t * sb;
+
+    if(resolve_parent(path, &dir, name) == -1)
+        return -1;
+    sb = dir.sb;
+
+    if(lookup(&dir, name, &node) == 0) {
+        if(node.type != VFS_TYPE_FILE || sb->ops->truncate == NULL || sb->ops->truncate(sb, node.ino, 0) == -1)
+            return -1;
+    } else {
+        if(sb->ops->create == NULL || sb->ops->create(sb, dir.ino, name, &node) == -1)
+            return -1;
+        dcache_invalidate(sb, dir.ino, name);   // The miss above was cached
+    }
+    return vfs_open(pcb, path);
+}
+
+/*
+ * vfs_unlink
+ *    DESCRIPTION: Removes a regular file's name
+ *    INPUTS: path -- the file
+ *    OUTPUTS: none
+ *    RETURN VALUE: 0 on success, -1 if the name doesn't exist or its file system is read-only
+ *    SIDE EFFECTS: Files that are still open keep their data until their last close
+ */
+int32_t vfs_unlink(const uint8_t * path) {
+    vfs_node_t dir;
+    uint8_t name[VFS_NAME_LEN + 1];
+    int32_t ret;
+
+    if(resolve_parent(path, &dir, name) == -1 || dir.sb->ops->unlink == NULL)
+        return -1;
+    ret = dir.sb->ops->unlink(dir.sb, dir.ino, name);
+    dcache_invalidate(dir.sb, dir.ino, name);
+    return ret;
+}
+
+/*
+ * vfs_truncate
+ *    DESCRIPTION: Sets a regular file's length
+ *    INPUTS: path -- the file
+ *            size -- new length in bytes
+ *    OUTPUTS: none
+ *    RETURN VALUE: 0 on success, -1 if path isn't a regular file on a writable file system or
+ *                  there's no memory to grow it
+ *    SIDE EFFECTS: Growing the file adds zeros
+ */
+int32_t vfs_truncate(const uint8_t * path, uint32_t size) {
+    vfs_node_t node;
+
+    if(vfs_resolve(path, &node) == -1 || node.type != VFS_TYPE_FILE || node.sb->ops->truncate == NULL)
+        return -1;
+    return node.sb->ops->truncate(node.sb, node.ino, size);
+}
+
+/*
+ * vfs_seek
+ *    DESCRIPTION: Moves an open regular file's position
+ *    INPUTS: file -- the open file
+ *            offset -- bytes to move by
+ *            whence -- VFS_SEEK_SET, VFS_SEEK_CUR or VFS_SEEK_END, what offset is relative to
+ *    OUTPUTS: none
+ *    RETURN VALUE: The new position, -1 if file isn't a regular file, whence is bad or the
+ *                  position would be negative or past 2GB
+ *    SIDE EFFECTS: The position can go past the end, a write there zero-fills the gap
+ */
+int32_t vfs_seek(file_t * file, int32_t offset, int32_t whence) {
+    vfs_node_t * node;
+    int32_t base;
+
+    if(file == NULL || file->ops != &vfs_file_table)
+        return -1;
+    node = (vfs_node_t *)file->inode;
+
+    switch(whence) {
+        case VFS_SEEK_SET:
+            base = 0;
+            break;
+        case VFS_SEEK_CUR:
+            base = file->file_pos;
+            break;
+        case VFS_SEEK_END:
+            base = node->sb->ops->size(node->sb, node->ino);
+            break;
+        default:
+            return -1;
+    }
+    if(base < 0 || offset < -base || (offset > 0 && base > 0x7FFFFFFF - offset))
+        return -1;
+
+    file->file_pos = base + offset;
+    return file->file_pos;
+}
+
+/*
+ * vfs_file_size
+ *    DESCRIPTION: Gives the length of an open regular file
+ *    INPUTS: file -- the open file
+ *    OUTPUTS: none
+ *    RETURN VALUE: Length in bytes, -1 if file is NULL or not a regular file
+ */
+int32_t vfs_file_size(file_t * file) {
+    vfs_node_t * node;
+
+    if(file == NULL || file->ops != &vfs_file_table)
+        return -1;
+    node = (vfs_node_t *)file->inode;
+    return node->sb->ops->size(node->sb, node->ino);
+}
+
+/*
+ * vfs_map_page
+ *    DESCRIPTION: Gives a page of an open regular file for mmap
+ *    INPUTS: file -- the open file
+ *            page -- page number (bytes page * FOUR_KB onwards)
+ *    OUTPUTS: none
+ *    RETURN VALUE: A frame holding the page with a reference for the caller, 0 if file isn't a
+ *                  regular file or we're out of memory
+ *    SIDE EFFECTS: Uses the file system's own frame when its map gives one, so nothing is
+ *                  copied. Otherwise reads the page into a new frame, zero-filled past the end
+ *                  of the file
+ */
+uint32_t vfs_map_page(file_t * file, uint32_t page) {
+    vfs_node_t * node;
+    uint32_t frame;
+
+    if(file == NULL || file->ops != &vfs_file_table)
+        return 0;
+    node = (vfs_node_t *)file->inode;
+
+    if(node->sb->ops->map != NULL) {
+        frame = node->sb->ops->map(node->sb, node->ino, page);
+        if(frame != 0)
+            return frame;
+    }
+
+    frame = frame_alloc(1, 1);
+    if(frame == 0)
+        return 0;
+    memset((void *)frame, 0, FOUR_KB);
+    if(node->sb->ops->read(node->sb, node->ino, page * FOUR_KB, (uint8_t *)frame, FOUR_KB) < 0) {
+        frame_free(frame, 1);
+        return 0;
+    }
+    return frame;
+}
+
+/*
+ * dcache_invalidate
+ *    DESCRIPTION: Forgets a cached lookup
+ *    INPUTS: sb -- file system
+ *            dir -- directory inode number
+ *            name -- name in it
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ */
+void dcache_invalidate(super_block_t * sb, uint32_t dir, const uint8_t * name) {
+    dcache_entry_t * entry;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    for(entry = dcache_hash[dcache_hash_of(sb, dir, name)]; entry != NULL; entry = entry->hash_next) {
+        if(entry->sb == sb && entry->dir == dir && !strncmp((int8_t *)entry->name, (int8_t *)name, VFS_NAME_LEN)) {
+            dcache_unhash(entry);
+            entry->sb = NULL;
+            break;
+        }
+    }
+    restore_flags(flags);
+}
+
+/*
+ * dcache_invalidate_sb
+ *    DESCRIPTION: Forgets every cached lookup in a file system
+ *    INPUTS: sb -- file system
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ */
+void dcache_invalidate_sb(super_block_t * sb) {
+    uint32_t flags;
+    int32_t i;
+
+    cli_and_save(flags);
+    for(i = 0; i < DCACHE_ENTRIES; i++) {
+        if(dcache[i].sb == sb) {
+            dcache_unhash(&dcache[i]);
+            dcache[i].sb = NULL;
+        }
+    }
+    restore_flags(flags);
+}
+
+/*
+ * dcache_get_stats
+ *    DESCRIPTION: Returns the dentry cache counters
+ *    INPUTS: none
+ *    OUTPUTS: none
+ *    RETURN VALUE: Hits and misses since boot
+ */
+dcache_stats_t dcache_get_stats(void) {
+    return dcache_stats;
+}
+
+/*
+ * resolve_parent
+ *    DESCRIPTION: Splits a path into its directory and last component
+ *    INPUTS: path -- '/'-separated path, trailing '/'s are ignored
+ *    OUTPUTS: dir -- the directory the last component is in
+ *             name -- the last component, NUL-terminated (VFS_NAME_LEN + 1 bytes)
+ *    RETURN VALUE: 0 on success, -1 if the path is too long, the last component is empty, "." or
+ *                  too long, or the rest doesn't resolve to a directory
+ */
+static int32_t resolve_parent(const uint8_t * path, vfs_node_t * dir, uint8_t * name) {
+    uint8_t parent[VFS_MAX_PATH];
+    int32_t end, start;
+
+    if(path == NULL || strlen((const int8_t *)path) >= VFS_MAX_PATH)
+        return -1;
+
+    for(end = strlen((const int8_t *)path); end > 0 && path[end - 1] == '/'; end--);
+    for(start = end; start > 0 && path[start - 1] != '/'; start--);
+    if(end == start || end - start > VFS_NAME_LEN)
+        return -1;
+
+    memcpy(name, path + start, end - start);
+    name[end - start] = '\0';
+    if(!strncmp((const int8_t *)name, ".", VFS_NAME_LEN))
+        return -1;
+
+    memcpy(parent, path, start);
+    parent[start] = '\0';
+    if(vfs_resolve(parent, dir) == -1 || dir->type != VFS_TYPE_DIR)
+        return -1;
+    return 0;
+}
+
+/*
+ * lookup
+ *    DESCRIPTION: Finds a name in a directory, through the dentry cache
+ *    INPUTS: dir -- the directory
+ *            name -- NUL-terminated name, at most VFS_NAME_LEN characters
+ *    OUTPUTS: node -- what name is (can be the same as dir)
+ *    RETURN VALUE: 0 on success, -1 if the name doesn't exist
+ *    SIDE EFFECTS: Caches the answer either way, replacing the least recently used entry
+ */
+static int32_t lookup(vfs_node_t * dir, const uint8_t * name, vfs_node_t * node) {
+    super_block_t * sb = dir->sb;
+    uint32_t dir_ino = dir->ino;
+    uint32_t bucket = dcache_hash_of(sb, dir_ino, name);
+    dcache_entry_t * entry;
+    vfs_node_t found;
+    int32_t ret;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    for(entry = dcache_hash[bucket]; entry != NULL; entry = entry->hash_next) {
+        if(entry->sb == sb && entry->dir == dir_ino && !strncmp((int8_t *)entry->name, (int8_t *)name, VFS_NAME_LEN)) {
+            dcache_stats.hits++;
+            dcache_touch(entry);
+            ret = entry->ino == -1 ? -1 : 0;
+            if(ret == 0) {
+                node->sb = sb;
+                node->ino = entry->ino;
+                node->type = entry->type;
+                node->fops = entry->fops;
+            }
+            restore_flags(flags);
+            return ret;
+        }
+    }
+    dcache_stats.misses++;
+    restore_flags(flags);
+
+    found.sb = sb;
+    found.type = 0;
+    found.fops = NULL;
+    ret = sb->ops->lookup(sb, dir_ino, name, &found);
+
+    // Reuse the least recently used entry
+    cli_and_save(flags);
+    entry = dcache_lru->lru_prev;
+    if(entry->sb != NULL)
+        dcache_unhash(entry);
+    entry->sb = sb;
+    entry->dir = dir_ino;
+    strncpy((int8_t *)entry->name, (int8_t *)name, VFS_NAME_LEN);
+    entry->ino = ret == -1 ? -1 : (int32_t)found.ino;
+    entry->type = found.type;
+    entry->fops = found.fops;
+    entry->hash_next = dcache_hash[bucket];
+    dcache_hash[bucket] = entry;
+    dcache_touch(entry);
+    restore_flags(flags);
+
+    if(ret == 0)
+        *node = found;
+    return ret;
+}
+
+/*
+ * dcache_hash_of
+ *    DESCRIPTION: Picks the hash bucket of a (file system, directory, name) key
+ *    INPUTS: sb, dir, name -- the key
+ *    OUTPUTS: none
+ *    RETURN VALUE: Bucket index
+ */
+static uint32_t dcache_hash_of(super_block_t * sb, uint32_t dir, const uint8_t * name) {
+    uint32_t hash = (uint32_t)sb ^ (dir * 31);
+    int32_t i;
+
+    for(i = 0; i < VFS_NAME_LEN && name[i] != '\0'; i++)
+        hash = hash * 33 + name[i];
+    return hash & (DCACHE_BUCKETS - 1);
+}
+
+/*
+ * dcache_unhash
+ *    DESCRIPTION: Takes an entry out of its hash chain
+ *    INPUTS: entry -- a used entry
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ */
+static void dcache_unhash(dcache_entry_t * entry) {
+    dcache_entry_t ** link = &dcache_hash[dcache_hash_of(entry->sb, entry->dir, entry->name)];
+
+    for(; *link != NULL; link = &(*link)->hash_next) {
+        if(*link == entry) {
+            *link = entry->hash_next;
+            return;
+        }
+    }
+}
+
+/*
+ * dcache_touch
+ *    DESCRIPTION: Makes an entry the most recently used
+ *    INPUTS: entry -- the entry
+ *    OUTPUTS: none
+ *    RETURN VALUE: none
+ */
+static void dcache_touch(dcache_entry_t * entry) {
+    if(entry == dcache_lru)
+        return;
+    entry->lru_prev->lru_next = entry->lru_next;
+    entry->lru_next->lru_prev = entry->lru_prev;
+    entry->lru_next = dcache_lru;
+    entry->lru_prev = dcache_lru->lru_prev;
+    dcache_lru->lru_prev->lru_next = entry;
+    dcache_lru->lru_prev = entry;
+    dcache_lru = entry;
+}
+
+/*
+ * vfs_file_read
+ *    DESCRIPTION: read() for regular files
+ *    INPUTS: fd -- file descriptor, buf -- output buffer, nbytes -- most bytes to read
+ *    OUTPUTS: fills buf
+ *    RETURN VALUE: Bytes read, 0 at the end of the file
+ *    SIDE EFFECTS: Moves the file position past what was read, reads ahead if the reads are sequential
+ */
+static int32_t vfs_file_read(int32_t fd, void * buf, int32_t nbytes) {
+    file_t * file = fd_get(current_task, fd);
+    vfs_file_t * open_file = (vfs_file_t *)file->inode;
+    vfs_node_t * node = &open_file->node;
+    uint32_t start, end;
+    int32_t ret;
+
+    if(nbytes < 0)
+        return -1;
+
+    // Sequential reads grow the window, anything else drops it
+    if(file->file_pos == open_file->ra_next) {
+        open_file->ra_window = open_file->ra_window == 0 ? VFS_RA_MIN : open_file->ra_window * 2;
+        if(open_file->ra_window > VFS_RA_MAX)
+            open_file->ra_window = VFS_RA_MAX;
+    } else {
+        open_file->ra_window = 0;
+        open_file->ra_end = 0;
+    }
+
+    ret = node->sb->ops->read(node->sb, node->ino, file->file_pos, buf, nbytes);
+    if(ret <= 0)
+        return ret;
+    file->file_pos += ret;
+    open_file->ra_next = file->file_pos;
+
+    // Only ask for what earlier reads haven't already read ahead
+    if(open_file->ra_window != 0 && node->sb->ops->readahead != NULL) {
+        start = open_file->ra_end > file->file_pos ? open_file->ra_end : file->file_pos;
+        end = file->file_pos + open_file->ra_window;
+        if(end > start) {
+            node->sb->ops->readahead(node->sb, node->ino, start, end - start);
+            open_file->ra_end = end;
+        }
+    }
+    return ret;
+}
+
+/*
+ * vfs_file_write
+ *    DESCRIPTION: write() for regular files
+ *    INPUTS: fd -- file descriptor, buf -- data, nbytes -- bytes to write
+ *    OUTPUTS: none
+ *    RETURN VALUE: Bytes written, -1 on a read-only file system
+ *    SIDE EFFECTS: Moves the file position past what was written
+ */
+static int32_t vfs_file_write(int32_t fd, const void * buf, int32_t nbytes) {
+    file_t * file = fd_get(current_task, fd);
+    vfs_node_t * node = (vfs_node_t *)file->inode;
+    int32_t ret;
+
+    if(nbytes < 0 || node->sb->ops->write == NULL)
+        return -1;
+    ret = node->sb->ops->write(node->sb, node->ino, file->file_pos, buf, nbytes);
+    if(ret > 0)
+        file->file_pos += ret;
+    return ret;
+}
+
+/*
+ * vfs_dir_read
+ *    DESCRIPTION: read() for directories, gives one name per call, or packed entries in
+ *                 VFS_DIR_DIRENTS mode
+ *    INPUTS: fd -- file descriptor, buf -- output buffer, nbytes -- most bytes to copy
+ *    OUTPUTS: fills buf with the next name (NUL-padded to VFS_NAME_LEN, not always terminated)
+ *    RETURN VALUE: Bytes copied (nbytes up to VFS_NAME_LEN), 0 after the last name
+ */
+static int32_t vfs_dir_read(int32_t fd, void * buf, int32_t nbytes) {
+    file_t * file = fd_get(current_task, fd);
+    vfs_node_t * node = (vfs_node_t *)file->inode;
+    vfs_node_t entry;
+    uint8_t name[VFS_NAME_LEN];
+    int32_t next;
+
+    if(file->mode == VFS_DIR_DIRENTS)
+        return vfs_dir_read_dirents(file, buf, nbytes);
+
+    if(buf == NULL || nbytes <= 0)
+        return 0;
+    memset(name, 0, VFS_NAME_LEN);
+    next = node->sb->ops->readdir(node->sb, node->ino, file->file_pos, name, &entry);
+    if(next == -1)
+        return 0;
+    file->file_pos = next;
+
+    if(nbytes > VFS_NAME_LEN)
+        nbytes = VFS_NAME_LEN;
+    memcpy(buf, name, nbytes);
+    return nbytes;
+}
+
+/*
+ * vfs_dir_read_dirents
+ *    DESCRIPTION: read() for directories in VFS_DIR_DIRENTS mode
+ *    INPUTS: file -- the open directory
+ *            dirents -- output buffer
+ *            nbytes -- its size
+ *    OUTPUTS: fills dirents with as many whole entries as fit
+ *    RETURN VALUE: Bytes copied (a multiple of sizeof(vfs_dirent_t)), 0 after the last entry,
+ *                  -1 if not even one entry fits
+ *    SIDE EFFECTS: Moves the file position past the entries copied
+ */
+static int32_t vfs_dir_read_dirents(file_t * file, vfs_dirent_t * dirents, int32_t nbytes) {
+    vfs_node_t * node = (vfs_node_t *)file->inode;
+    vfs_node_t entry;
+    int32_t count = 0, next, size;
+
+    if(dirents == NULL || nbytes < (int32_t)sizeof(vfs_dirent_t))
+        return -1;
+
+    while((count + 1) * (int32_t)sizeof(vfs_dirent_t) <= nbytes) {
+        memset(&dirents[count], 0, sizeof(vfs_dirent_t));
+        entry.sb = node->sb;
+        entry.type = 0;
+        entry.fops = NULL;
+        next = node->sb->ops->readdir(node->sb, node->ino, file->file_pos, dirents[count].name, &entry);
+        if(next == -1)
+            break;
+        file->file_pos = next;
+
+        dirents[count].type = entry.type;
+        dirents[count].ino = entry.ino;
+        if(entry.type == VFS_TYPE_FILE && (size = node->sb->ops->size(node->sb, entry.ino)) != -1)
+            dirents[count].size = size;
+        count++;
+    }
+    return count * sizeof(vfs_dirent_t);
+}
+
+/*
+ * vfs_dir_ioctl
+ *    DESCRIPTION: ioctl() for directories, gets or sets the read mode
+ *    INPUTS: fd -- file descriptor
+ *            request -- DIRIOCGMODE or DIRIOCSMODE
+ *            arg -- VFS_DIR_NAMES or VFS_DIR_DIRENTS for DIRIOCSMODE
+ *    OUTPUTS: none
+ *    RETURN VALUE: Current mode for DIRIOCGMODE, 0 on a successful DIRIOCSMODE, -1 otherwise
+ *    SIDE EFFECTS: The position is kept, a listing can switch modes part way
+ */
+static int32_t vfs_dir_ioctl(int32_t fd, int32_t request, uint32_t arg) {
+    file_t * file = fd_get(current_task, fd);
+
+    switch(request) {
+        case DIRIOCGMODE:
+            return file->mode;
+        case DIRIOCSMODE:
+            if(arg != VFS_DIR_NAMES && arg != VFS_DIR_DIRENTS)
+                return -1;
+            file->mode = arg;
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+/*
+ * vfs_open_nothing
+ *    DESCRIPTION: open() for regular files and directories, vfs_open already did the work
+ *    INPUTS: filename -- ignored
+ *    OUTPUTS: none
+ *    RETURN VALUE: 0
+ */
+static int32_t vfs_open_nothing(const uint8_t * filename) {
+    return 0;
+}
+
+/*
+ * vfs_close
+ *    DESCRIPTION: close() for regular files and directories
+ *    INPUTS: fd -- file descriptor
+ *    OUTPUTS: none
+ *    RETURN VALUE: 0
+ *    SIDE EFFECTS: Releases the inode and frees the file's vfs_node_t
+ */
+static int32_t vfs_close(int32_t fd) {
+    vfs_node_t * node = (vfs_node_t *)fd_get(current_task, fd)->inode;
+
+    if(node->sb->ops->release != NULL)
+        node->sb->ops->release(node->sb, node->ino);
+    kfree(node);
+    return 0;
+}
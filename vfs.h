@@ -0,0 +1,166 @@
+/* vfs.h - Mount table, path lookup and the dentry cache shared by every file system
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _VFS_H
+#define _VFS_H
+
+#include "types.h"
+#include "system_calls.h"
+#include "file_system.h"
+
+#define VFS_MAX_MOUNTS      8           // File systems mounted at once
+#define VFS_MOUNT_PATH      16          // Longest mount point, without the leading '/'
+#define VFS_MAX_PATH        128         // Longest path open and execute take
+#define VFS_NAME_LEN        FNAME_LENGTH    // Longest name in a directory (not always NUL-terminated)
+
+#define VFS_SEEK_SET        0           // lseek whence values
+#define VFS_SEEK_CUR        1
+#define VFS_SEEK_END        2
+
+// ioctl requests understood by directories
+#define DIRIOCGMODE         1           // Returns the fd's read mode
+#define DIRIOCSMODE         2           // Sets the fd's read mode to arg
+
+// Directory read modes
+#define VFS_DIR_NAMES       0           // Each read gives one name (the default)
+#define VFS_DIR_DIRENTS     1           // Each read packs as many vfs_dirent_t as fit
+
+#define VFS_RA_MIN          (16 * 1024) // First readahead window of a file read sequentially
+#define VFS_RA_MAX          (128 * 1024)    // The window doubles up to this
+
+#define DCACHE_ENTRIES      128         // Cached lookups, the least recently used is replaced
+#define DCACHE_BUCKETS      64          // Hash buckets (power of 2)
+
+// Node types, the same numbers as the boot image's ftype
+#define VFS_TYPE_DEV        0           // Device, opened with the device's own fops
+#define VFS_TYPE_DIR        1
+#define VFS_TYPE_FILE       2
+
+struct super_block;
+
+// What a lookup finds, open regular files and directories keep a copy in their file_t's inode
+typedef struct vfs_node {
+    struct super_block * sb;            // File system it's on
+    uint32_t ino;                       // Inode number within that file system
+    uint32_t type;                      // VFS_TYPE_*
+    const fops_jump_table_t * fops;     // VFS_TYPE_DEV only: the device's driver
+} vfs_node_t;
+
+// What a file system implements, offsets and names are relative to its own inode numbers
+typedef struct super_ops {
+    // Finds name in directory dir, fills node's ino, type (and fops for devices), returns 0 or -1
+    int32_t (*lookup)(struct super_block * sb, uint32_t dir, const uint8_t * name, vfs_node_t * node);
+    // Reads file data, returns bytes read (0 at the end of the file) or -1
+    int32_t (*read)(struct super_block * sb, uint32_t ino, uint32_t offset, uint8_t * buf, uint32_t len);
+    // Writes file data, returns bytes written or -1, NULL for read-only file systems
+    int32_t (*write)(struct super_block * sb, uint32_t ino, uint32_t offset, const uint8_t * buf, uint32_t len);
+    // Copies the name (VFS_NAME_LEN bytes) of the first entry of directory dir at or after position
+    // index (0 is the start) and fills node like lookup would, returns the position after it or -1
+    // past the end
+    int32_t (*readdir)(struct super_block * sb, uint32_t dir, uint32_t index, uint8_t * name, vfs_node_t * node);
+    // Returns a file's length in bytes or -1
+    int32_t (*size)(struct super_block * sb, uint32_t ino);
+
+    // The rest can be NULL for read-only file systems
+    // Makes an empty regular file name in directory dir, fills node, returns 0 or -1
+    int32_t (*create)(struct super_block * sb, uint32_t dir, const uint8_t * name, vfs_node_t * node);
+    // Removes name from directory dir, returns 0 or -1
+    int32_t (*unlink)(struct super_block * sb, uint32_t dir, const uint8_t * name);
+    // Cuts or zero-extends a file to size bytes, returns 0 or -1
+    int32_t (*truncate)(struct super_block * sb, uint32_t ino, uint32_t size);
+    // An open file starts/stops using an inode, unlinked inodes stay around until released
+    void (*hold)(struct super_block * sb, uint32_t ino);
+    void (*release)(struct super_block * sb, uint32_t ino);
+    // Starts reading len bytes of a file at offset into the block cache, NULL if there's no cache
+    void (*readahead)(struct super_block * sb, uint32_t ino, uint32_t offset, uint32_t len);
+    // Gives the frame already holding 4KB page `page` of a file with a reference for the caller,
+    // 0 if the page has to be copied (see vfs_map_page), NULL if it never can be mapped as is
+    uint32_t (*map)(struct super_block * sb, uint32_t ino, uint32_t page);
+} super_ops_t;
+
+// What an open regular file or directory keeps in its file_t's inode
+typedef struct vfs_file {
+    vfs_node_t node;                    // First, so the inode is also a vfs_node_t *
+    uint32_t ra_next;                   // Offset a sequential read would start at
+    uint32_t ra_end;                    // End of what has been read ahead
+    uint32_t ra_window;                 // Bytes to read ahead, 0 until reads look sequential
+} vfs_file_t;
+
+// A mounted file system
+typedef struct super_block {
+    const super_ops_t * ops;
+    uint32_t root;                      // Inode number of its root directory
+    void * priv;                        // File system's own data
+} super_block_t;
+
+// One entry of a VFS_DIR_DIRENTS directory read
+typedef struct vfs_dirent {
+    uint8_t name[VFS_NAME_LEN];         // NUL-padded, not always terminated
+    uint32_t type;                      // VFS_TYPE_*
+    uint32_t ino;                       // Inode number within the directory's file system
+    uint32_t size;                      // Bytes, 0 for anything but regular files
+} vfs_dirent_t;
+
+// Cached result of looking up one name in one directory, ino -1 caches a name that isn't there
+typedef struct dcache_entry {
+    super_block_t * sb;                 // NULL if the entry is unused
+    uint32_t dir;
+    uint8_t name[VFS_NAME_LEN];
+    int32_t ino;
+    uint32_t type;
+    const fops_jump_table_t * fops;
+    struct dcache_entry * hash_next;
+    struct dcache_entry * lru_prev;     // Most recently used first
+    struct dcache_entry * lru_next;
+} dcache_entry_t;
+
+// Dentry cache counters
+typedef struct dcache_stats {
+    uint32_t hits;
+    uint32_t misses;
+} dcache_stats_t;
+
+// Mounts the boot image at /, devfs at /dev and tmpfs at /tmp, call after init_files
+void init_vfs(void);
+
+// Makes sb reachable under path ("/" or "/name"), returns 0 or -1 if the table is full or path is taken
+int32_t vfs_mount(const int8_t * path, super_block_t * sb);
+
+// Finds what a path names, returns 0 or -1 if it doesn't exist
+int32_t vfs_resolve(const uint8_t * path, vfs_node_t * node);
+
+// Reads file data through a resolved node
+int32_t vfs_node_read(vfs_node_t * node, uint32_t offset, uint8_t * buf, uint32_t len);
+
+// Opens a path as the lowest free fd of pcb, returns the fd or -1
+int32_t vfs_open(pcb_t * pcb, const uint8_t * path);
+
+// Opens a path, first making it an empty regular file (or emptying the file already there)
+int32_t vfs_create(pcb_t * pcb, const uint8_t * path);
+
+// Removes a regular file's name, returns 0 or -1
+int32_t vfs_unlink(const uint8_t * path);
+
+// Sets a regular file's length, returns 0 or -1
+int32_t vfs_truncate(const uint8_t * path, uint32_t size);
+
+// Moves an open regular file's position, returns the new position or -1
+int32_t vfs_seek(file_t * file, int32_t offset, int32_t whence);
+
+// Returns an open regular file's length, -1 if it isn't a regular file
+int32_t vfs_file_size(file_t * file);
+
+// Gives a 4KB page of an open regular file as a frame with a reference for the caller, 0 on failure
+uint32_t vfs_map_page(file_t * file, uint32_t page);
+
+// Forgets the cached lookup of name in dir, file systems call this when they add or remove names
+void dcache_invalidate(super_block_t * sb, uint32_t dir, const uint8_t * name);
+
+// Forgets every cached lookup in sb, for when the whole file system changes under it
+void dcache_invalidate_sb(super_block_t * sb);
+
+// Returns the dentry cache counters
+dcache_stats_t dcache_get_stats(void);
+
+#endif /* _VFS_H */